@@ -0,0 +1,678 @@
+//
+// bm_serial benchmarks
+//
+// Usage: bm_serial_bench [filter]
+// Only runs benchmarks whose name contains filter (all of them by default)
+//
+#include "bm_serial.h"
+#include "bm_serial.hpp"
+#include "bm_serial_cache.h"
+#include "bm_serial_cobs.h"
+#include "bm_serial_crc.h"
+#include "bm_serial_lz.h"
+#include "bm_serial_router.h"
+#include "bm_serial_topo.h"
+#include "bm_serial_txq.h"
+
+#include <chrono>
+#include <cstdio>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Payload sizes from 16 bytes up to the largest packet
+static const size_t bench_sizes[] = {16, 32, 64, 128, 256, 512, 1024, SERIAL_BUFF_LEN};
+
+// Don't let the compiler throw away results
+static volatile size_t bench_sink;
+
+// Run fn repeatedly for roughly min_seconds, return bytes/sec
+template <typename F>
+static double bench_throughput(size_t bytes_per_call, F fn, double min_seconds = 0.1) {
+  using clock = std::chrono::steady_clock;
+  size_t iterations = 64;
+  while (true) {
+    auto start = clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+      fn();
+    }
+    double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    if (elapsed >= min_seconds) {
+      return (double)(bytes_per_call * iterations) / elapsed;
+    }
+    iterations *= 2;
+  }
+}
+
+// Random payload with roughly one zero every zero_interval bytes
+static std::vector<uint8_t> bench_payload(size_t len, uint32_t zero_interval) {
+  std::mt19937 rng(1234);
+  std::vector<uint8_t> payload(len);
+  for (auto &byte : payload) {
+    byte = (rng() % zero_interval) ? (uint8_t)(rng() | 1) : 0;
+  }
+  return payload;
+}
+
+static void bench_cobs() {
+  struct {
+    bm_serial_cobs_kernel_e kernel;
+    const char *name;
+  } kernels[] = {
+    {BM_SERIAL_COBS_KERNEL_SCALAR, "scalar"},
+    {BM_SERIAL_COBS_KERNEL_SSE2, "sse2"},
+    {BM_SERIAL_COBS_KERNEL_AVX2, "avx2"},
+  };
+
+  printf("\ncobs (MB/s, 1 zero per 64 bytes)\n");
+  printf("%-8s %-8s", "kernel", "op");
+  for (size_t size : bench_sizes) {
+    printf(" %8zu", size);
+  }
+  printf("\n");
+
+  for (auto &kernel : kernels) {
+    if (!bm_serial_cobs_set_kernel(kernel.kernel)) {
+      printf("%-8s (not supported)\n", kernel.name);
+      continue;
+    }
+
+    for (int decode = 0; decode < 2; decode++) {
+      printf("%-8s %-8s", kernel.name, decode ? "decode" : "encode");
+      for (size_t size : bench_sizes) {
+        std::vector<uint8_t> raw = bench_payload(size, 64);
+        std::vector<uint8_t> encoded(BM_SERIAL_COBS_MAX_ENCODED_LEN(size));
+        size_t encoded_len = bm_serial_cobs_encode(raw.data(), size, encoded.data(), encoded.size());
+
+        // Same work as the receiver: find the delimiter, decode in place
+        std::vector<uint8_t> stream(encoded.begin(), encoded.begin() + encoded_len);
+        stream.push_back(0);
+        std::vector<uint8_t> rx(stream.size());
+
+        double rate;
+        if (decode) {
+          rate = bench_throughput(size, [&]() {
+            memcpy(rx.data(), stream.data(), stream.size());
+            size_t frame_len = bm_serial_cobs_find_delimiter(rx.data(), rx.size());
+            bench_sink = bm_serial_cobs_decode(rx.data(), frame_len, rx.data(), frame_len);
+          });
+        } else {
+          rate = bench_throughput(size, [&]() {
+            bench_sink = bm_serial_cobs_encode(raw.data(), size, encoded.data(), encoded.size());
+          });
+        }
+        printf(" %8.0f", rate / 1e6);
+      }
+      printf("\n");
+    }
+  }
+
+  bm_serial_cobs_set_kernel(BM_SERIAL_COBS_KERNEL_AUTO);
+}
+
+// Same crc built with each compile time option (see CMakeLists.txt)
+extern "C" {
+uint16_t bench_crc16_bytewise(uint16_t seed, const uint8_t *src, size_t len);
+uint16_t bench_crc16_slice_by_4(uint16_t seed, const uint8_t *src, size_t len);
+uint16_t bench_crc16_slice_by_8(uint16_t seed, const uint8_t *src, size_t len);
+}
+
+static void bench_crc16() {
+  struct {
+    uint16_t (*fn)(uint16_t seed, const uint8_t *src, size_t len);
+    const char *name;
+  } impls[] = {
+    {bench_crc16_bytewise, "bytewise"},
+    {bench_crc16_slice_by_4, "slice4"},
+    {bench_crc16_slice_by_8, "slice8"},
+    {bm_serial_crc16_ccitt, "default"},
+  };
+
+  printf("\ncrc16 (MB/s)\n");
+  printf("%-17s", "impl");
+  for (size_t size : bench_sizes) {
+    printf(" %8zu", size);
+  }
+  printf("\n");
+
+  for (auto &impl : impls) {
+    printf("%-17s", impl.name);
+    for (size_t size : bench_sizes) {
+      std::vector<uint8_t> data = bench_payload(size, 256);
+      if (impl.fn(0, data.data(), size) != bench_crc16_bytewise(0, data.data(), size)) {
+        printf(" mismatch");
+        continue;
+      }
+      double rate = bench_throughput(size, [&]() {
+        bench_sink = impl.fn(0, data.data(), size);
+      });
+      printf(" %8.0f", rate / 1e6);
+    }
+    printf("\n");
+  }
+}
+
+static bool bench_tx_fn(const uint8_t *buff, size_t len) {
+  bench_sink = buff[len - 1];
+  return true;
+}
+
+static bool bench_tx_iov_fn(const bm_serial_iov_t *iov, size_t iov_cnt) {
+  bench_sink = iov[iov_cnt - 1].len;
+  return true;
+}
+
+// Full packet build (copy + crc) through bm_serial_pub and DFU chunks. The
+// pub_iov row sends the payload from the caller's buffer (crc only)
+static void bench_tx() {
+  bm_serial_callbacks_t callbacks = {};
+
+  const char topic[] = "bench/topic";
+
+  printf("\ntx (MB/s of payload)\n");
+  printf("%-17s", "message");
+  for (size_t size : bench_sizes) {
+    printf(" %8zu", size);
+  }
+  printf("\n");
+
+  const char *messages[] = {"pub", "dfu_chunk", "pub_iov"};
+  for (int message = 0; message < 3; message++) {
+    bool dfu = (message == 1);
+    callbacks.tx_fn = (message == 2) ? NULL : bench_tx_fn;
+    callbacks.tx_iov_fn = (message == 2) ? bench_tx_iov_fn : NULL;
+    bm_serial_set_callbacks(&callbacks);
+
+    printf("%-17s", messages[message]);
+    for (size_t size : bench_sizes) {
+      // Leave room for the message headers
+      size_t len = (size == SERIAL_BUFF_LEN) ? size - 64 : size;
+      std::vector<uint8_t> data = bench_payload(len, 256);
+      double rate;
+      if (dfu) {
+        rate = bench_throughput(len, [&]() {
+          bench_sink = bm_serial_dfu_send_chunk(0, len, data.data());
+        });
+      } else {
+        rate = bench_throughput(len, [&]() {
+          bench_sink = bm_serial_pub(0, topic, sizeof(topic) - 1, data.data(), len, 0, 0);
+        });
+      }
+      printf(" %8.0f", rate / 1e6);
+    }
+    printf("\n");
+  }
+
+}
+
+// Multiple threads publishing on one link: a mutex around the shared tx
+// buffer vs the lock-free tx queue with a single writer thread
+static void bench_contention() {
+  static bm_serial_txq_slot_t slots[64];
+  static bm_serial_txq_t txq;
+  static bm_serial_ctx_t ctx;
+  const uint32_t pubs_per_thread = 20000;
+  const char topic[] = "bench/topic";
+  std::vector<uint8_t> data = bench_payload(64, 256);
+
+  printf("\ncontention (k pubs/s, 64 byte payload, %u cores)\n",
+         std::thread::hardware_concurrency());
+  printf("%-17s", "threads");
+  const int thread_counts[] = {1, 2, 4, 8};
+  for (int threads : thread_counts) {
+    printf(" %8d", threads);
+  }
+  printf("\n");
+
+  for (int queued = 0; queued < 2; queued++) {
+    printf("%-17s", queued ? "txq" : "mutex");
+    for (int threads : thread_counts) {
+      bm_serial_callbacks_t callbacks = {};
+      callbacks.tx_fn = bench_tx_fn;
+      bm_serial_ctx_init(&ctx, &callbacks);
+      if (queued) {
+        bm_serial_txq_init(&txq, slots, sizeof(slots) / sizeof(slots[0]));
+        bm_serial_ctx_set_txq(&ctx, &txq);
+      }
+
+      std::mutex lock;
+      std::atomic<bool> done(false);
+      std::thread writer([&]() {
+        while (queued && !done.load(std::memory_order_relaxed)) {
+          bm_serial_ctx_txq_flush(&ctx);
+          std::this_thread::yield();
+        }
+      });
+
+      auto start = std::chrono::steady_clock::now();
+      std::vector<std::thread> producers;
+      for (int thread = 0; thread < threads; thread++) {
+        producers.emplace_back([&]() {
+          for (uint32_t pub = 0; pub < pubs_per_thread;) {
+            bm_serial_error_e rval;
+            if (queued) {
+              rval = bm_serial_ctx_pub(&ctx, 0, topic, sizeof(topic) - 1, data.data(), data.size(), 0, 0);
+            } else {
+              std::lock_guard<std::mutex> guard(lock);
+              rval = bm_serial_ctx_pub(&ctx, 0, topic, sizeof(topic) - 1, data.data(), data.size(), 0, 0);
+            }
+            if (rval == BM_SERIAL_OK) {
+              pub++;
+            } else {
+              // Queue full
+              std::this_thread::yield();
+            }
+          }
+        });
+      }
+      for (auto &producer : producers) {
+        producer.join();
+      }
+      done = true;
+      writer.join();
+      if (queued) {
+        bm_serial_ctx_txq_flush(&ctx);
+      }
+      double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      printf(" %8.0f", (double)(pubs_per_thread * threads) / elapsed / 1e3);
+    }
+    printf("\n");
+  }
+}
+
+// Compression ratio and speed on a few kinds of payloads, and what that buys
+// on a UART: payload kB/s sent raw vs compressed (including the time spent
+// compressing and decompressing, 10 bits per byte on the wire)
+static void bench_lz() {
+  static bm_serial_lz_t lz;
+  const size_t len = 1024;
+
+  // Sensor readings as text, like most pubs
+  std::string text;
+  std::mt19937 rng(1234);
+  for (uint32_t sample = 0; text.size() < len; sample++) {
+    char line[64];
+    snprintf(line, sizeof(line), "%u,%u.%03u,%d.%02u,%u\n", 1700000000 + sample,
+             sample * 250, (unsigned)(rng() % 1000), 18 + (int)(rng() % 3),
+             (unsigned)(rng() % 100), 1013 + (unsigned)(rng() % 4));
+    text += line;
+  }
+  std::vector<uint8_t> sensor(text.begin(), text.begin() + len);
+
+  // Machine code, like DFU chunks
+  std::ifstream exe("/proc/self/exe", std::ios::binary);
+  std::vector<uint8_t> firmware((std::istreambuf_iterator<char>(exe)),
+                                std::istreambuf_iterator<char>());
+  if (firmware.size() < 0x2000 + len) {
+    firmware = bench_payload(0x2000 + len, 4);
+  }
+  firmware = std::vector<uint8_t>(firmware.begin() + 0x2000, firmware.begin() + 0x2000 + len);
+
+  std::vector<uint8_t> random = bench_payload(len, 256);
+
+  struct {
+    const char *name;
+    const std::vector<uint8_t> *data;
+  } inputs[] = {
+    {"sensor", &sensor},
+    {"firmware", &firmware},
+    {"random", &random},
+  };
+  const uint32_t bauds[] = {115200, 460800, 921600, 3000000};
+
+  printf("\nlz (%zu byte payload: ratio, MB/s, payload kB/s raw -> compressed at baud)\n", len);
+  printf("%-10s %6s %6s %6s", "payload", "ratio", "comp", "decomp");
+  for (uint32_t baud : bauds) {
+    printf(" %15u", baud);
+  }
+  printf("\n");
+
+  for (auto &input : inputs) {
+    std::vector<uint8_t> compressed(BM_SERIAL_LZ_BOUND(len));
+    std::vector<uint8_t> out(len);
+    size_t compressed_len = bm_serial_lz_compress(&lz, input.data->data(), len,
+                                                  compressed.data(), compressed.size());
+    if (bm_serial_lz_decompress(compressed.data(), compressed_len, out.data(), len) != len ||
+        out != *input.data) {
+      printf("%-10s round trip failed\n", input.name);
+      continue;
+    }
+
+    double comp_rate = bench_throughput(len, [&]() {
+      bench_sink = bm_serial_lz_compress(&lz, input.data->data(), len, compressed.data(),
+                                         compressed.size());
+    });
+    double decomp_rate = bench_throughput(len, [&]() {
+      bench_sink = bm_serial_lz_decompress(compressed.data(), compressed_len, out.data(), len);
+    });
+
+    // Incompressible payloads are sent as is
+    size_t sent_len = (compressed_len < len) ? compressed_len : len;
+    double cpu_time = (sent_len < len) ? len / comp_rate + len / decomp_rate : len / comp_rate;
+
+    printf("%-10s %6.2f %6.0f %6.0f", input.name, (double)len / compressed_len, comp_rate / 1e6,
+           decomp_rate / 1e6);
+    for (uint32_t baud : bauds) {
+      size_t overhead = sizeof(bm_serial_packet_t) + 2;
+      double raw_time = (len + overhead) * 10.0 / baud;
+      double lz_time = (sent_len + overhead) * 10.0 / baud + cpu_time;
+      printf(" %7.0f -> %5.0f", len / raw_time / 1e3, len / lz_time / 1e3);
+    }
+    printf("\n");
+  }
+}
+
+static bool bench_route_fn(void *arg, const char *topic, uint16_t topic_len, uint64_t node_id,
+                           const uint8_t *payload, size_t len, uint8_t type, uint8_t version) {
+  (void)topic;
+  (void)topic_len;
+  (void)node_id;
+  (void)payload;
+  (void)len;
+  (void)type;
+  (void)version;
+  bench_sink = (size_t)arg;
+  return true;
+}
+
+// Topic lookup with a growing number of handlers: compare against every
+// handler (what pub_fn callbacks usually do) vs the router
+static void bench_router() {
+  static bm_serial_router_t router;
+  static bm_serial_ctx_t ctx;
+  const size_t handler_counts[] = {1, 4, 16, BM_SERIAL_ROUTER_ROUTES};
+
+  printf("\nrouter (M lookups/s, topic matches the last handler)\n");
+  printf("%-17s", "handlers");
+  for (size_t count : handler_counts) {
+    printf(" %8zu", count);
+  }
+  printf("\n");
+
+  for (int routed = 0; routed < 2; routed++) {
+    printf("%-17s", routed ? "router" : "linear");
+    for (size_t count : handler_counts) {
+      std::vector<std::string> topics;
+      for (size_t idx = 0; idx < count; idx++) {
+        topics.push_back("spotter/node/" + std::to_string(idx) + "/temperature");
+      }
+      const std::string &topic = topics.back();
+
+      bm_serial_callbacks_t callbacks = {};
+      callbacks.tx_fn = bench_tx_fn;
+      bm_serial_ctx_init(&ctx, &callbacks);
+      bm_serial_router_init(&router, &ctx, NULL, NULL);
+      for (size_t idx = 0; idx < count; idx++) {
+        bm_serial_router_add(&router, topics[idx].data(), topics[idx].size(), bench_route_fn,
+                             (void *)idx);
+      }
+
+      double rate;
+      if (routed) {
+        rate = bench_throughput(1, [&]() {
+          bm_serial_router_route(&router, topic.data(), topic.size(), 0, NULL, 0, 0, 0);
+        });
+      } else {
+        rate = bench_throughput(1, [&]() {
+          for (size_t idx = 0; idx < count; idx++) {
+            if (topics[idx].size() == topic.size() &&
+                !memcmp(topics[idx].data(), topic.data(), topic.size())) {
+              bench_route_fn((void *)idx, topic.data(), topic.size(), 0, NULL, 0, 0, 0);
+              break;
+            }
+          }
+        });
+      }
+      printf(" %8.1f", rate / 1e6);
+    }
+    printf("\n");
+  }
+}
+
+static bool bench_pub_fn(const char *topic, uint16_t topic_len, uint64_t node_id,
+                         const uint8_t *payload, size_t len, uint8_t type, uint8_t version) {
+  (void)topic;
+  (void)topic_len;
+  (void)node_id;
+  (void)payload;
+  (void)type;
+  (void)version;
+  bench_sink = len;
+  return true;
+}
+
+// Pub encode and decode without COBS: bm_serial_ctx_pub/process_packet vs the
+// typed C++ codec (bm_serial.hpp) writing to and reading from a local buffer
+static void bench_codec() {
+  static bm_serial_ctx_t ctx;
+  bm_serial_callbacks_t callbacks = {};
+  callbacks.tx_fn = bench_tx_fn;
+  callbacks.pub_fn = bench_pub_fn;
+  bm_serial_ctx_init(&ctx, &callbacks);
+  bm_serial_ctx_set_cobs_tx(&ctx, false);
+
+  const std::string_view topic = "bench/topic";
+  using pub = bm_serial::message<BM_SERIAL_PUB>;
+
+  printf("\ncodec (MB/s of payload)\n");
+  printf("%-17s", "pub");
+  for (size_t size : bench_sizes) {
+    printf(" %8zu", size);
+  }
+  printf("\n");
+
+  const char *rows[] = {"c encode", "codec encode", "c decode", "codec decode"};
+  for (int row = 0; row < 4; row++) {
+    printf("%-17s", rows[row]);
+    for (size_t size : bench_sizes) {
+      size_t len = (size == SERIAL_BUFF_LEN) ? size - 64 : size;
+      std::vector<uint8_t> data = bench_payload(len, 256);
+      std::vector<uint8_t> frame(pub::wire_size(topic.size(), len));
+      pub::encode(frame, 0, topic, data, 0, 0);
+
+      double rate;
+      switch (row) {
+      case 0:
+        rate = bench_throughput(len, [&]() {
+          bench_sink = bm_serial_ctx_pub(&ctx, 0, topic.data(), topic.size(), data.data(), len, 0, 0);
+        });
+        break;
+      case 1:
+        rate = bench_throughput(len, [&]() {
+          bench_sink = pub::encode(frame, 0, topic, data, 0, 0);
+        });
+        break;
+      case 2:
+        rate = bench_throughput(len, [&]() {
+          bench_sink = bm_serial_ctx_process_packet(&ctx, (bm_serial_packet_t *)frame.data(),
+                                                    frame.size());
+        });
+        break;
+      default:
+        rate = bench_throughput(len, [&]() {
+          bm_serial::pub_view view;
+          if (pub::decode(frame, view) == BM_SERIAL_OK) {
+            bench_sink = view.data.size();
+          }
+        });
+        break;
+      }
+      printf(" %8.0f", rate / 1e6);
+    }
+    printf("\n");
+  }
+}
+
+static uint32_t bench_cache_now;
+static uint32_t bench_cache_now_fn(void) { return bench_cache_now; }
+
+// Values sent by the bench node are received by the host right away
+static bm_serial_ctx_t *bench_cache_host;
+static bool bench_cache_node_tx_fn(const uint8_t *buff, size_t len) {
+  std::vector<uint8_t> packet(buff, buff + len);
+  return bm_serial_ctx_process_packet(bench_cache_host, (bm_serial_packet_t *)packet.data(),
+                                      len) == BM_SERIAL_OK;
+}
+
+static bool bench_cfg_value_fn(uint64_t node_id, bm_common_config_partition_e partition,
+                               uint32_t data_length, void *data) {
+  (void)node_id;
+  (void)partition;
+  (void)data;
+  bench_sink = data_length;
+  return true;
+}
+
+// bm_serial_ctx_cfg_get() with the value cached vs sending the get (tx only, no link or
+// reply, so the real difference is bigger)
+static void bench_cache() {
+  static bm_serial_ctx_t ctx;
+  static bm_serial_ctx_t node;
+  static bm_serial_cache_t cache;
+  bm_serial_callbacks_t callbacks = {};
+  callbacks.tx_fn = bench_tx_fn;
+  callbacks.cfg_value_fn = bench_cfg_value_fn;
+  bm_serial_ctx_init(&ctx, &callbacks);
+  bm_serial_ctx_set_cobs_tx(&ctx, false);
+
+  // Node answering the gets that fill the cache
+  bench_cache_host = &ctx;
+  callbacks = {};
+  callbacks.tx_fn = bench_cache_node_tx_fn;
+  bm_serial_ctx_init(&node, &callbacks);
+  bm_serial_ctx_set_cobs_tx(&node, false);
+
+  printf("\ncache (M gets/s)\n");
+  printf("%-17s %8s %8s\n", "keys", "sent", "cached");
+  for (int keys : {1, 8, BM_SERIAL_CACHE_ENTRIES}) {
+    std::vector<std::string> names;
+    for (int idx = 0; idx < keys; idx++) {
+      names.push_back("bench/key/" + std::to_string(idx));
+    }
+
+    bm_serial_cache_cfg_t cfg = {};
+    cfg.ttl = UINT32_MAX;
+    cfg.reply_timeout = UINT32_MAX;
+    cfg.now_fn = bench_cache_now_fn;
+    bm_serial_cache_init(&cache, &ctx, &cfg);
+    ctx.cache = NULL;
+
+    size_t next = 0;
+    double sent = bench_throughput(1, [&]() {
+      const std::string &key = names[next++ % keys];
+      bench_sink = bm_serial_ctx_cfg_get(&ctx, 1, BM_COMMON_CFG_PARTITION_USER, key.size(),
+                                         key.data());
+    });
+
+    // Fill the cache through the receive path
+    ctx.cache = &cache;
+    for (const std::string &key : names) {
+      bm_serial_ctx_cfg_get(&ctx, 1, BM_COMMON_CFG_PARTITION_USER, key.size(), key.data());
+      uint32_t data = 0;
+      bm_serial_ctx_cfg_value(&node, 1, BM_COMMON_CFG_PARTITION_USER, sizeof(data), &data);
+    }
+
+    double cached = bench_throughput(1, [&]() {
+      const std::string &key = names[next++ % keys];
+      bench_sink = bm_serial_ctx_cfg_get(&ctx, 1, BM_COMMON_CFG_PARTITION_USER, key.size(),
+                                         key.data());
+    });
+    printf("%-17d %8.2f %8.2f\n", keys, sent / 1e6, cached / 1e6);
+  }
+  ctx.cache = NULL;
+}
+
+// "Is node X in the network": linear scan of the raw network info node list vs
+// bm_serial_topo_has() on the snapshot
+static void bench_topo() {
+  static bm_serial_ctx_t ctx;
+  static bm_serial_topo_t topo;
+  bm_serial_callbacks_t callbacks = {};
+  bm_serial_ctx_init(&ctx, &callbacks);
+  bm_serial_topo_init(&topo, &ctx, NULL);
+
+  printf("\ntopo (M lookups/s)\n");
+  printf("%-17s %8s %8s %8s\n", "nodes", "scan", "snapshot", "acquire");
+  for (uint16_t num_nodes : {8, 32, BM_SERIAL_TOPO_MAX_NODES}) {
+    std::mt19937_64 rng(1234);
+    std::vector<uint64_t> nodes(num_nodes);
+    for (auto &node_id : nodes) {
+      node_id = rng();
+    }
+
+    std::vector<uint8_t> payload(sizeof(bm_common_network_info_t) + num_nodes * sizeof(uint64_t));
+    bm_common_network_info_t *info = (bm_common_network_info_t *)payload.data();
+    info->num_nodes = num_nodes;
+    memcpy(info->node_list_and_cbor_config_map, nodes.data(), num_nodes * sizeof(uint64_t));
+    bm_serial_topo_rx(&topo, payload.data(), payload.size());
+
+    // Half hits, half misses
+    std::vector<uint64_t> lookups;
+    for (uint16_t idx = 0; idx < num_nodes; idx++) {
+      lookups.push_back(nodes[idx]);
+      lookups.push_back(rng());
+    }
+
+    size_t next = 0;
+    double scan = bench_throughput(1, [&]() {
+      uint64_t node_id = lookups[next++ % lookups.size()];
+      bool found = false;
+      for (uint16_t idx = 0; idx < info->num_nodes && !found; idx++) {
+        uint64_t entry;
+        memcpy(&entry, &info->node_list_and_cbor_config_map[idx * sizeof(entry)], sizeof(entry));
+        found = (entry == node_id);
+      }
+      bench_sink = found;
+    });
+
+    // Acquired once for many lookups, or once per lookup
+    const bm_serial_topo_snapshot_t *held = bm_serial_topo_acquire(&topo);
+    double snapshot = bench_throughput(1, [&]() {
+      bench_sink = bm_serial_topo_has(held, lookups[next++ % lookups.size()]);
+    });
+    bm_serial_topo_release(&topo, held);
+
+    double acquire = bench_throughput(1, [&]() {
+      uint64_t node_id = lookups[next++ % lookups.size()];
+      const bm_serial_topo_snapshot_t *current = bm_serial_topo_acquire(&topo);
+      bench_sink = bm_serial_topo_has(current, node_id);
+      bm_serial_topo_release(&topo, current);
+    });
+    printf("%-17u %8.1f %8.1f %8.1f\n", num_nodes, scan / 1e6, snapshot / 1e6, acquire / 1e6);
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *filter = (argc > 1) ? argv[1] : "";
+
+  struct {
+    const char *name;
+    void (*fn)();
+  } benchmarks[] = {
+    {"cobs", bench_cobs},
+    {"crc16", bench_crc16},
+    {"tx", bench_tx},
+    {"contention", bench_contention},
+    {"lz", bench_lz},
+    {"router", bench_router},
+    {"codec", bench_codec},
+    {"cache", bench_cache},
+    {"topo", bench_topo},
+  };
+
+  for (auto &benchmark : benchmarks) {
+    if (strstr(benchmark.name, filter)) {
+      benchmark.fn();
+    }
+  }
+
+  return 0;
+}
@@ -1,33 +1,84 @@
 #include "bm_serial.h"
+#include "bm_serial_alias.h"
+#include "bm_serial_cache.h"
+#include "bm_serial_cobs.h"
+#include "bm_serial_corr.h"
 #include "bm_serial_crc.h"
+#include "bm_serial_lz.h"
+#include "bm_serial_pool.h"
+#include "bm_serial_rel.h"
+#include "bm_serial_router.h"
+#include "bm_serial_topo.h"
+#include "bm_serial_txq.h"
 #include <string.h>
 
 #define MAX_TOPIC_LEN 64
 
-#define SERIAL_BUFF_LEN 2048
-static uint8_t bm_serial_tx_buff[SERIAL_BUFF_LEN];
+_Static_assert(SERIAL_TX_HEADROOM == BM_SERIAL_COBS_OVERHEAD(SERIAL_BUFF_LEN),
+               "tx buffer must have room to COBS encode in place");
+_Static_assert(sizeof(bm_serial_batch_entry_t) == sizeof(bm_serial_packet_t),
+               "batch entries are handled in place as packets");
+_Static_assert(BM_SERIAL_ALIAS_MAX_TOPIC_LEN == MAX_TOPIC_LEN,
+               "every topic can get an alias");
 
-static bm_serial_callbacks_t _callbacks;
+// Instance used by the bm_serial_* functions that don't take a context
+static bm_serial_ctx_t _default_ctx;
+
+/*!
+  Initialize a bm_serial instance. Each instance has its own callbacks, tx
+  buffer and stats, so one process can drive multiple serial links.
+
+  \param[out] *ctx instance to initialize
+  \param[in] *callbacks callbacks for this instance (copied), can be NULL and
+  set later with bm_serial_ctx_set_callbacks()
+  \return none
+*/
+void bm_serial_ctx_init(bm_serial_ctx_t *ctx,
+                        const bm_serial_callbacks_t *callbacks) {
+  memset(ctx, 0, sizeof(bm_serial_ctx_t));
+  if (callbacks) {
+    memcpy(&ctx->callbacks, callbacks, sizeof(bm_serial_callbacks_t));
+  }
+}
 
 /*!
   Set all the callback functions for bm_serial
 
+  \param[in] *ctx bm_serial instance
   \param[in] *callbacks pointer to callback structure. This file keeps it's own
   copy \return none
 */
-void bm_serial_set_callbacks(bm_serial_callbacks_t *callbacks) {
-  memcpy(&_callbacks, callbacks, sizeof(bm_serial_callbacks_t));
+void bm_serial_ctx_set_callbacks(bm_serial_ctx_t *ctx,
+                                 bm_serial_callbacks_t *callbacks) {
+  memcpy(&ctx->callbacks, callbacks, sizeof(bm_serial_callbacks_t));
+}
+
+/*!
+  Enable/disable COBS framing of transmitted packets
+
+  When enabled, every packet is COBS encoded in place and terminated with a
+  0x00 delimiter before being passed to tx_fn. Use bm_serial_cobs_rx_feed() on
+  the receiving end.
+
+  \param[in] *ctx bm_serial instance
+  \param[in] enable true to COBS encode packets
+  \return none
+*/
+void bm_serial_ctx_set_cobs_tx(bm_serial_ctx_t *ctx, bool enable) {
+  ctx->cobs_tx = enable;
 }
 
 /*!
   Validate the topic and check that the transmit callback function is set,
   otherwise there's no point
 
+  \param[in] *ctx bm_serial instance
   \param[in] *topic topic string
   \param[in] topic_len length of the topic
   \return BM_SERIAL_OK if topic is valid, nonzero otherwise
 */
-static bm_serial_error_e _bm_serial_validate_topic_and_cb(const char *topic,
+static bm_serial_error_e _bm_serial_validate_topic_and_cb(bm_serial_ctx_t *ctx,
+                                                          const char *topic,
                                                           uint16_t topic_len) {
   bm_serial_error_e rval = BM_SERIAL_OK;
   do {
@@ -43,7 +94,7 @@ static bm_serial_error_e _bm_serial_validate_topic_and_cb(const char *topic,
     }
 
     // No transmit function :'(
-    if (!_callbacks.tx_fn) {
+    if (!ctx->callbacks.tx_fn && !ctx->callbacks.tx_iov_fn) {
       rval = BM_SERIAL_MISSING_CALLBACK;
       break;
     }
@@ -53,22 +104,72 @@ static bm_serial_error_e _bm_serial_validate_topic_and_cb(const char *topic,
   return rval;
 }
 
+/*!
+  Check a topic the same way bm_serial_pub() does, for modules that build pubs
+  themselves
+
+  \param[in] *ctx bm_serial instance
+  \param[in] *topic topic string
+  \param[in] topic_len length of the topic
+  \return BM_SERIAL_OK if topic is valid, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_validate_topic(bm_serial_ctx_t *ctx,
+                                               const char *topic,
+                                               uint16_t topic_len) {
+  return _bm_serial_validate_topic_and_cb(ctx, topic, topic_len);
+}
+
 /*!
   Get packet buffer with initialized header
-  Using static buffer for now (NOT THREAD SAFE)
-  If we ever want to allocate or use a message pool, this is where we'd do it
+  Uses a tx queue slot if the instance has a queue (thread safe), a pool block
+  if it has a pool (thread safe), otherwise the instance's buffer (NOT THREAD
+  SAFE, use one instance per thread)
 
+  \param *ctx bm_serial instance
   \param type bm_serial message type
   \param flags optional flags
   \param buff_len size of required buffer
+  \param[out] *builder where the buffer, slot and pool packet are stored
   \return pointer to buffer if allocated successfully, NULL otherwise
 */
-static bm_serial_packet_t *_bm_serial_get_packet(bm_serial_message_t type,
-                                                 uint8_t flags,
-                                                 uint16_t buff_len) {
+static bm_serial_packet_t *
+_bm_serial_get_packet(bm_serial_ctx_t *ctx, bm_serial_message_t type,
+                      uint8_t flags, uint16_t buff_len,
+                      bm_serial_builder_t *builder) {
 
   if (buff_len <= SERIAL_BUFF_LEN) {
-    bm_serial_packet_t *packet = (bm_serial_packet_t *)bm_serial_tx_buff;
+    uint16_t headroom = SERIAL_TX_HEADROOM;
+    builder->slot = NULL;
+    builder->pkt = NULL;
+    if (ctx->txq) {
+      builder->slot = bm_serial_txq_claim(ctx->txq);
+      if (!builder->slot) {
+        return NULL;
+      }
+      builder->buff = builder->slot->buff;
+      builder->buff_len = BM_SERIAL_TX_BUFF_LEN;
+    } else if (ctx->pool) {
+      // Only take the headroom (and delimiter) this packet needs, so it fits
+      // the smallest class possible
+      size_t size = buff_len;
+      headroom = 0;
+      if (ctx->cobs_tx) {
+        headroom = BM_SERIAL_COBS_OVERHEAD(buff_len);
+        size += headroom + 1;
+      }
+      builder->pkt = bm_serial_pool_alloc(ctx->pool, size);
+      if (!builder->pkt) {
+        return NULL;
+      }
+      builder->pkt->type = type;
+      builder->buff = builder->pkt->buff;
+      builder->buff_len = builder->pkt->size;
+    } else {
+      builder->buff = ctx->tx_buff;
+      builder->buff_len = BM_SERIAL_TX_BUFF_LEN;
+    }
+
+    bm_serial_packet_t *packet = (bm_serial_packet_t *)&builder->buff[headroom];
 
     packet->type = type;
     packet->flags = flags;
@@ -81,109 +182,209 @@ static bm_serial_packet_t *_bm_serial_get_packet(bm_serial_message_t type,
 }
 
 /*!
-  Send raw bm_serial data
+  Pass segments to whichever transmit function is available. Multiple segments
+  require tx_iov_fn.
 
-  \param[in] type bm_serial message type
-  \param[in] *payload message payload
-  \param[in] len payload length
-  \return BM_SERIAL_OK if topic is valid, nonzero otherwise
+  \param[in] *ctx bm_serial instance
+  \param[in] *iov packet segments
+  \param[in] iov_cnt number of segments
+  \return BM_SERIAL_OK if sent, nonzero otherwise
 */
-bm_serial_error_e bm_serial_tx(bm_serial_message_t type, const uint8_t *payload,
-                               size_t len) {
+static bm_serial_error_e _bm_serial_tx_iov(bm_serial_ctx_t *ctx,
+                                           const bm_serial_iov_t *iov,
+                                           size_t iov_cnt) {
   bm_serial_error_e rval = BM_SERIAL_OK;
 
   do {
-    if (!payload) {
-      rval = BM_SERIAL_NULL_BUFF;
+    bool sent;
+    if (ctx->callbacks.tx_iov_fn) {
+      sent = ctx->callbacks.tx_iov_fn(iov, iov_cnt);
+    } else if (ctx->callbacks.tx_fn && iov_cnt == 1) {
+      sent = ctx->callbacks.tx_fn(iov[0].buff, iov[0].len);
+    } else {
+      rval = BM_SERIAL_MISSING_CALLBACK;
       break;
     }
 
-    // Lets make sure that what we are trying to send will fit in the payload
-    if ((uint32_t)len + sizeof(bm_serial_packet_t) >= (SERIAL_BUFF_LEN - 1)) {
-      rval = BM_SERIAL_OVERFLOW;
+    if (!sent) {
+      ctx->stats.tx_errors++;
+      rval = BM_SERIAL_TX_ERR;
       break;
     }
 
-    if (!_callbacks.tx_fn) {
-      rval = BM_SERIAL_MISSING_CALLBACK;
-      break;
+    ctx->stats.tx_packets++;
+    for (size_t idx = 0; idx < iov_cnt; idx++) {
+      ctx->stats.tx_bytes += iov[idx].len;
     }
 
-    uint16_t message_len = sizeof(bm_serial_packet_t) + len;
-    bm_serial_packet_t *packet = _bm_serial_get_packet(type, 0, message_len);
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
-      break;
-    }
-    memcpy(packet->payload, payload, len);
+  } while (0);
+
+  return rval;
+}
 
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
+/*!
+  Hand a finished packet (crc already set) to the transmit function, the tx
+  queue if it was built in a queue slot, or the packet sink if it was built in
+  a pool block, COBS encoding it first if enabled
 
-    uint16_t bm_serial_message_len = sizeof(bm_serial_packet_t) + len;
-    if (!_callbacks.tx_fn((uint8_t *)packet, bm_serial_message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+  \param[in] *builder packet builder
+  \return BM_SERIAL_OK if sent (or queued), nonzero otherwise
+*/
+static bm_serial_error_e _bm_serial_tx_packet(bm_serial_builder_t *builder) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  bm_serial_ctx_t *ctx = builder->ctx;
+
+  do {
+    uint8_t *buff = builder->buff;
+
+    if (builder->pkt) {
+      builder->pkt->flags = builder->packet->flags;
+    }
+
+    bm_serial_iov_t iov = {(const uint8_t *)builder->packet, builder->len};
+    if (ctx->cobs_tx) {
+      // Encode in place
+      iov.len = bm_serial_cobs_encode((const uint8_t *)builder->packet,
+                                      builder->len, buff,
+                                      builder->buff_len - 1);
+      if (!iov.len) {
+        rval = BM_SERIAL_OVERFLOW;
+        break;
+      }
+      buff[iov.len++] = 0;
+      iov.buff = buff;
+    }
 
+    if (builder->slot) {
+      bm_serial_txq_publish(ctx->txq, builder->slot, iov.buff - buff, iov.len);
+      builder->slot = NULL;
       break;
     }
 
+    if (builder->pkt) {
+      builder->pkt->offset = iov.buff - buff;
+      builder->pkt->len = iov.len;
+      if (ctx->pkt_sink) {
+        // Sink owns the packet from here on
+        bm_serial_pkt_t *pkt = builder->pkt;
+        builder->pkt = NULL;
+        rval = ctx->pkt_sink(ctx->pkt_sink_arg, pkt);
+        break;
+      }
+    }
+
+    rval = _bm_serial_tx_iov(ctx, &iov, 1);
+
   } while (0);
 
+  if (builder->slot) {
+    bm_serial_txq_publish(ctx->txq, builder->slot, 0, 0);
+    builder->slot = NULL;
+  }
+
+  if (builder->pkt) {
+    bm_serial_pkt_release(builder->pkt);
+    builder->pkt = NULL;
+  }
+
   return rval;
 }
 
 /*!
-  bm_serial publish data to topic
+  Send packets through a tx queue so multiple threads can use the instance at
+  the same time. Each call builds its packet in its own queue slot, a single
+  writer thread sends them with bm_serial_ctx_txq_flush().
 
-  \param node_id node id of publisher
-  \param *topic topic to publish on
-  \param topic_len length of topic
-  \param *data data to publish
-  \param data_len length of data
-  \return BM_SERIAL_OK if ok, nonzero otherwise
+  Must be set before any packets are sent. The reserve/commit API still only
+  supports one thread at a time.
+
+  \param[in] *ctx bm_serial instance
+  \param[in] *txq initialized queue, NULL to send directly from tx_buff
+  \return none
 */
-bm_serial_error_e bm_serial_pub(uint64_t node_id, const char *topic,
-                                uint16_t topic_len, const uint8_t *data,
-                                uint16_t data_len, uint8_t type,
-                                uint8_t version) {
+void bm_serial_ctx_set_txq(bm_serial_ctx_t *ctx, bm_serial_txq_t *txq) {
+  ctx->txq = txq;
+}
+
+/*!
+  Send every queued packet that is ready. Only call from one (writer) thread.
+
+  Packets that fail to send are dropped and counted in stats.tx_errors.
+
+  \param[in] *ctx bm_serial instance
+  \return BM_SERIAL_OK if all packets were sent, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_txq_flush(bm_serial_ctx_t *ctx) {
   bm_serial_error_e rval = BM_SERIAL_OK;
 
   do {
-    rval = _bm_serial_validate_topic_and_cb(topic, topic_len);
-    if (rval) {
+    if (!ctx->txq) {
+      rval = BM_SERIAL_MISC_ERR;
       break;
     }
 
-    uint16_t message_len = sizeof(bm_serial_packet_t) +
-                           sizeof(bm_serial_pub_header_t) + topic_len +
-                           data_len;
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_PUB, 0, message_len);
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
-      break;
+    bm_serial_txq_slot_t *slot;
+    while ((slot = bm_serial_txq_peek(ctx->txq))) {
+      // Abandoned slots have nothing to send
+      if (slot->len) {
+        bm_serial_iov_t iov = {&slot->buff[slot->offset], slot->len};
+        bm_serial_error_e tx_rval = _bm_serial_tx_iov(ctx, &iov, 1);
+        if (tx_rval) {
+          rval = tx_rval;
+        }
+      }
+      bm_serial_txq_release(ctx->txq, slot);
     }
 
-    bm_serial_pub_header_t *pub_header =
-        (bm_serial_pub_header_t *)packet->payload;
-    pub_header->node_id = node_id;
-    pub_header->topic_len = topic_len;
-    pub_header->type = type;
-    pub_header->version = version;
-    memcpy(pub_header->topic, topic, topic_len);
+  } while (0);
 
-    // Copy data after payload (if any)
-    if (data && data_len) {
-      memcpy(&pub_header->topic[topic_len], data, data_len);
-    }
+  return rval;
+}
+
+/*!
+  Build packets in blocks from a packet pool instead of tx_buff. Each packet
+  gets its own block, so sending is thread safe (as long as the transmit
+  function or sink is) and a reservation isn't overwritten by other sends.
+
+  Finished packets are passed to sink, which can queue them, keep them for a
+  retransmit with bm_serial_pkt_retain() and send them later with
+  bm_serial_ctx_pkt_send(). Without a sink they are sent and released right
+  away. A tx queue (bm_serial_ctx_set_txq()) takes precedence over the pool.
+
+  Must be set before any packets are sent.
+
+  \param[in] *ctx bm_serial instance
+  \param[in] *pool initialized pool, NULL to use tx_buff
+  \param[in] sink optional packet sink
+  \param[in] *sink_arg passed to sink
+  \return none
+*/
+void bm_serial_ctx_set_pool(bm_serial_ctx_t *ctx, bm_serial_pool_t *pool,
+                            bm_serial_pkt_sink_fn sink, void *sink_arg) {
+  ctx->pool = pool;
+  ctx->pkt_sink = sink;
+  ctx->pkt_sink_arg = sink_arg;
+}
 
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
+/*!
+  Transmit a pool packet. The packet is not released, so it can be sent again.
 
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+  \param[in] *ctx bm_serial instance
+  \param[in] *pkt packet passed to the packet sink
+  \return BM_SERIAL_OK if sent, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_pkt_send(bm_serial_ctx_t *ctx,
+                                         const bm_serial_pkt_t *pkt) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!pkt || !pkt->len) {
+      rval = BM_SERIAL_NULL_BUFF;
       break;
     }
 
-    // TODO - do we wait for an ack?
+    bm_serial_iov_t iov = {&pkt->buff[pkt->offset], pkt->len};
+    rval = _bm_serial_tx_iov(ctx, &iov, 1);
 
   } while (0);
 
@@ -191,48 +392,62 @@ bm_serial_error_e bm_serial_pub(uint64_t node_id, const char *topic,
 }
 
 /*!
-  bm_serial subscribe/unsubscribe from topic
+  Start building a packet
 
-  \param *topic topic to subscribe to
-  \param topic_len lenth of topic
-  \param sub subscribe/unsubscribe
-  \return BM_SERIAL_OK on success, nonzero otherwise
+  The fixed size message header (header_len bytes at packet->payload) is filled
+  in directly by the caller before the first _bm_serial_builder_put(). Variable
+  length segments are then appended with _bm_serial_builder_put(), which
+  updates the crc while copying so each byte is only touched once.
+
+  \param[in] *ctx bm_serial instance
+  \param[out] *builder packet builder
+  \param[in] type bm_serial message type
+  \param[in] flags optional flags
+  \param[in] header_len size of the fixed message header
+  \param[in] message_len total packet length (including bm_serial_packet_t)
+  \return BM_SERIAL_OK if a packet buffer is available, nonzero otherwise
 */
-static bm_serial_error_e _bm_serial_sub_unsub(const char *topic,
-                                              uint16_t topic_len, bool sub) {
+static bm_serial_error_e _bm_serial_builder_start(bm_serial_ctx_t *ctx,
+                                                  bm_serial_builder_t *builder,
+                                                  bm_serial_message_t type,
+                                                  uint8_t flags,
+                                                  uint16_t header_len,
+                                                  uint16_t message_len) {
   bm_serial_error_e rval = BM_SERIAL_OK;
 
   do {
-    rval = _bm_serial_validate_topic_and_cb(topic, topic_len);
-    if (rval) {
+    if (sizeof(bm_serial_packet_t) + header_len > message_len) {
+      rval = BM_SERIAL_OVERFLOW;
       break;
     }
 
-    uint16_t message_len =
-        sizeof(bm_serial_packet_t) + sizeof(bm_serial_pub_header_t) + topic_len;
-
-    bm_serial_packet_t *packet = NULL;
-    if (sub) {
-      packet = _bm_serial_get_packet(BM_SERIAL_SUB, 0, message_len);
-    } else {
-      packet = _bm_serial_get_packet(BM_SERIAL_UNSUB, 0, message_len);
+    // Without a txq or pool the reserved packet is in tx_buff, don't overwrite
+    // it before it's committed
+    if (ctx->reserved_active && !ctx->txq && !ctx->pool) {
+      rval = BM_SERIAL_BUSY;
+      break;
     }
 
-    if (!packet) {
+    builder->ctx = ctx;
+    builder->packet =
+        _bm_serial_get_packet(ctx, type, flags, message_len, builder);
+    if (!builder->packet) {
       rval = BM_SERIAL_OUT_OF_MEMORY;
       break;
     }
 
-    bm_serial_sub_unsub_header_t *sub_header =
-        (bm_serial_sub_unsub_header_t *)packet->payload;
-    sub_header->topic_len = topic_len;
-    memcpy(sub_header->topic, topic, topic_len);
-
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
+    builder->len = sizeof(bm_serial_packet_t) + header_len;
+    builder->max_len = message_len;
+    builder->crc_len = 0;
+    builder->crc16 = 0;
+    builder->overflow = false;
+    builder->ext = NULL;
+    builder->ext_len = 0;
+    builder->alias_register = false;
 
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
-      break;
+    // Tentative sequence number, confirmed when sending
+    if (ctx->rel && type != BM_SERIAL_ACK) {
+      builder->packet->flags |= bm_serial_rel_peek_flags(ctx->rel);
     }
 
   } while (0);
@@ -241,157 +456,213 @@ static bm_serial_error_e _bm_serial_sub_unsub(const char *topic,
 }
 
 /*!
-  bm_serial subscribe to topic
+  Add the bytes written in place (packet and message headers) to the crc
 
-  \param *topic topic to subscribe to
-  \param topic_len lenth of topic
-  \return BM_SERIAL_OK on success, nonzero otherwise
+  \param[in] *builder packet builder
+  \return none
 */
-bm_serial_error_e bm_serial_sub(const char *topic, uint16_t topic_len) {
-  // TODO - do we wait for an ack?
-  return _bm_serial_sub_unsub(topic, topic_len, true);
+static void _bm_serial_builder_flush(bm_serial_builder_t *builder) {
+  uint8_t *buff = (uint8_t *)builder->packet;
+  builder->crc16 = bm_serial_crc16_ccitt(
+      builder->crc16, &buff[builder->crc_len], builder->len - builder->crc_len);
+  builder->crc_len = builder->len;
 }
 
 /*!
-  bm_serial unsubscribe from topic
+  Copy a segment to the end of the packet, updating the crc in the same pass
 
-  \param *topic topic to subscribe to
-  \param topic_len lenth of topic
-  \return BM_SERIAL_OK on success, nonzero otherwise
+  \param[in] *builder packet builder
+  \param[in] *data segment data
+  \param[in] len segment length
+  \return none (overflow is reported by _bm_serial_builder_send)
 */
-bm_serial_error_e bm_serial_unsub(const char *topic, uint16_t topic_len) {
-  // TODO - do we want for an ack?
-  return _bm_serial_sub_unsub(topic, topic_len, false);
-}
+static void _bm_serial_builder_put(bm_serial_builder_t *builder,
+                                   const void *data, size_t len) {
+  // Nothing can follow a segment sent from the caller's buffer
+  if (builder->overflow || builder->ext ||
+      len > (size_t)(builder->max_len - builder->len)) {
+    builder->overflow = true;
+    return;
+  }
 
-/*!
-  Update RTC on target device
+  if (!len) {
+    return;
+  }
 
-  \param[in] *time time to set the clock to
-  \return BM_SERIAL_OK if sent, nonzero otherwise
-*/
-bm_serial_error_e bm_serial_set_rtc(bm_serial_time_t *time) {
-  bm_serial_error_e rval = BM_SERIAL_OK;
+  _bm_serial_builder_flush(builder);
 
-  do {
-    uint16_t message_len = sizeof(bm_serial_packet_t) + sizeof(bm_serial_rtc_t);
+  uint8_t *buff = (uint8_t *)builder->packet;
+  builder->crc16 = bm_serial_crc16_ccitt_copy(
+      builder->crc16, &buff[builder->len], (const uint8_t *)data, len);
+  builder->len += len;
+  builder->crc_len = builder->len;
+}
 
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_RTC_SET, 0, message_len);
+/*!
+  Append the last segment of the packet. If the transport supports
+  scatter-gather transmit it is sent straight from data (only the crc is
+  computed here), otherwise it is copied like any other segment.
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
-      break;
-    }
+  data must stay valid until _bm_serial_builder_send() returns.
 
-    bm_serial_rtc_t *rtc_header = (bm_serial_rtc_t *)packet->payload;
-    memcpy(&rtc_header->time, time, sizeof(bm_serial_time_t));
+  \param[in] *builder packet builder
+  \param[in] *data segment data
+  \param[in] len segment length
+  \return none (overflow is reported by _bm_serial_builder_send)
+*/
+static void _bm_serial_builder_put_ext(bm_serial_builder_t *builder,
+                                       const void *data, size_t len) {
+  bm_serial_ctx_t *ctx = builder->ctx;
+
+  // Queued/pooled packets may be sent later, data might not be valid by then.
+  // Compression needs the whole payload in the packet.
+  if (!ctx->callbacks.tx_iov_fn || ctx->cobs_tx || ctx->lz || builder->slot ||
+      builder->pkt || !len) {
+    _bm_serial_builder_put(builder, data, len);
+    return;
+  }
 
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
+  if (builder->overflow || builder->ext ||
+      len > (size_t)(builder->max_len - builder->len)) {
+    builder->overflow = true;
+    return;
+  }
 
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
-      break;
-    }
+  _bm_serial_builder_flush(builder);
+  builder->crc16 =
+      bm_serial_crc16_ccitt(builder->crc16, (const uint8_t *)data, len);
+  builder->ext = (const uint8_t *)data;
+  builder->ext_len = len;
+}
 
-  } while (0);
+/*!
+  Give up on a packet. Queue slots must always be published, so the consumer
+  is told to skip it. Pool packets go back to the pool.
 
-  return rval;
+  \param[in] *builder packet builder
+  \return none
+*/
+static void _bm_serial_builder_abort(bm_serial_builder_t *builder) {
+  if (builder->slot) {
+    bm_serial_txq_publish(builder->ctx->txq, builder->slot, 0, 0);
+    builder->slot = NULL;
+  }
+
+  if (builder->pkt) {
+    bm_serial_pkt_release(builder->pkt);
+    builder->pkt = NULL;
+  }
 }
 
 /*!
-  Send out a bm_common_network_info_t
+  Finalize the crc and transmit the packet
 
-  \param[in] *config_crc
-  \param[in] *fw_info
-  \param[in] num_nodes
-  \param[in] *node_id_list
-  \param[in] config_map_size
-  \param[in] *cbor_config_map
+  \param[in] *builder packet builder
   \return BM_SERIAL_OK if sent, nonzero otherwise
 */
-bm_serial_error_e bm_serial_send_network_info(
-    uint32_t network_crc32, bm_common_config_crc_t *config_crc,
-    bm_common_fw_version_t *fw_info, uint16_t num_nodes, uint64_t *node_id_list,
-    uint16_t config_map_size, uint8_t *cbor_config_map) {
+static bm_serial_error_e _bm_serial_builder_send(bm_serial_builder_t *builder) {
   bm_serial_error_e rval = BM_SERIAL_OK;
-  do {
+  bm_serial_corr_entry_t *corr_entry = NULL;
 
-    if (!config_crc || !fw_info || !node_id_list || num_nodes == 0 ||
-        !cbor_config_map) {
-      rval = BM_SERIAL_MISC_ERR;
+  do {
+    if (builder->overflow) {
+      _bm_serial_builder_abort(builder);
+      rval = BM_SERIAL_OVERFLOW;
       break;
     }
 
-    uint16_t message_len = sizeof(bm_serial_packet_t) +
-                           sizeof(bm_common_network_info_t) +
-                           (sizeof(uint64_t) * num_nodes) + config_map_size;
-
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_NETWORK_INFO, 0, message_len);
+    bm_serial_packet_t *packet = builder->packet;
+    if (builder->ctx->corr) {
+      // Before compression, the request is parsed from the payload
+      rval = bm_serial_corr_tx(builder->ctx->corr, packet->type,
+                               packet->payload,
+                               builder->len - sizeof(bm_serial_packet_t),
+                               &corr_entry);
+      if (rval) {
+        _bm_serial_builder_abort(builder);
+        break;
+      }
+    }
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
-      break;
+    if (builder->ctx->lz &&
+        bm_serial_lz_tx(builder->ctx->lz, packet, &builder->len)) {
+      // Payload was replaced, start the crc over
+      builder->crc_len = 0;
+      builder->crc16 = 0;
     }
 
-    bm_common_network_info_t *network_info =
-        (bm_common_network_info_t *)packet->payload;
-    network_info->network_crc32 = network_crc32;
-    memcpy(&network_info->config_crc, config_crc,
-           sizeof(bm_common_config_crc_t));
-    memcpy(&network_info->fw_info, fw_info, sizeof(bm_common_fw_version_t));
-    network_info->num_nodes = num_nodes;
-    size_t node_list_size = sizeof(uint64_t) * num_nodes;
-    memcpy(&network_info->node_list_and_cbor_config_map, node_id_list,
-           node_list_size);
-    network_info->map_size_bytes = config_map_size;
-    memcpy(&network_info->node_list_and_cbor_config_map[node_list_size],
-           cbor_config_map, config_map_size);
+    if (builder->ctx->rel && packet->type != BM_SERIAL_ACK) {
+      uint8_t flags = packet->flags;
+      rval = bm_serial_rel_tx_flags(builder->ctx->rel, builder->pkt, &flags);
+      if (rval) {
+        _bm_serial_builder_abort(builder);
+        break;
+      }
 
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
+      if (flags != packet->flags) {
+        // Another packet was sent with our sequence number while this one was
+        // reserved, start the crc over
+        packet->flags = flags;
+        builder->crc_len = 0;
+        builder->crc16 = 0;
+      }
+    }
 
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
-      break;
+    _bm_serial_builder_flush(builder);
+    builder->packet->crc16 = builder->crc16;
+
+    if (builder->ext) {
+      const bm_serial_iov_t iov[] = {
+          {(const uint8_t *)builder->packet, builder->len},
+          {builder->ext, builder->ext_len},
+      };
+      rval =
+          _bm_serial_tx_iov(builder->ctx, iov, sizeof(iov) / sizeof(iov[0]));
+    } else {
+      rval = _bm_serial_tx_packet(builder);
     }
 
   } while (0);
+
+  if (rval && corr_entry) {
+    bm_serial_corr_drop(builder->ctx->corr, corr_entry);
+  }
+
+  if (!rval && builder->alias_register && builder->ctx->alias) {
+    bm_serial_alias_tx_registered(builder->ctx->alias, builder->alias_id,
+                                  builder->alias_generation);
+  }
+
   return rval;
 }
 
 /*!
-  Send out a self test request or response
+  Reserve space at the end of the packet for the caller to fill in. The crc
+  for it is computed when sending. Marks the builder as the pending
+  reservation for bm_serial_commit()
 
-  \param[in] node_id node id of device who ran self test (or 0 to request one)
-  \param[in] result self test result
-  \return BM_SERIAL_OK on successful send, nonzero otherwise
+  \param[in] *builder packet builder (ctx->reserved)
+  \param[in] len bytes to reserve
+  \param[out] **data where the caller writes len bytes
+  \return BM_SERIAL_OK if ok, nonzero otherwise
 */
-bm_serial_error_e bm_serial_send_self_test(uint64_t node_id, uint32_t result) {
+static bm_serial_error_e
+_bm_serial_builder_reserve(bm_serial_builder_t *builder, size_t len,
+                           uint8_t **data) {
   bm_serial_error_e rval = BM_SERIAL_OK;
 
   do {
-    uint16_t message_len =
-        sizeof(bm_serial_packet_t) + sizeof(bm_serial_self_test_t);
-
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_SELF_TEST, 0, message_len);
-
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
+    if (builder->overflow || len > (size_t)(builder->max_len - builder->len)) {
+      _bm_serial_builder_abort(builder);
+      rval = BM_SERIAL_OVERFLOW;
       break;
     }
 
-    bm_serial_self_test_t *self_test = (bm_serial_self_test_t *)packet->payload;
-    self_test->node_id = node_id;
-    self_test->result = result;
-
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
+    _bm_serial_builder_flush(builder);
 
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
-      break;
-    }
+    *data = &((uint8_t *)builder->packet)[builder->len];
+    builder->len += len;
+    builder->ctx->reserved_active = true;
 
   } while (0);
 
@@ -399,821 +670,2275 @@ bm_serial_error_e bm_serial_send_self_test(uint64_t node_id, uint32_t result) {
 }
 
 /*!
-  Send out a reboot info message
+  Send the alias reset held back by a pending reservation (if any)
 
-  \param[in] node_id node id of device who ran self test (or 0 to request one)
-  \param[in] reboot_reason reboot reason enum
-  \param[in] gitSHA 32-bit gitSHA
-  \param[in] reboot_count reboot count
-  \return BM_SERIAL_OK on successful send, nonzero otherwise
+  \param[in] *ctx bm_serial instance
+  \return none
 */
-bm_serial_error_e bm_serial_send_reboot_info(uint64_t node_id,
-                                             uint32_t reboot_reason,
-                                             uint32_t gitSHA,
-                                             uint32_t reboot_count,
-                                             uint32_t pc,
-                                             uint32_t lr) {
-  bm_serial_error_e rval = BM_SERIAL_OK;
-  do {
-    uint16_t message_len =
-        sizeof(bm_serial_packet_t) + sizeof(bm_serial_reboot_info_t);
+static void _bm_serial_alias_reset_flush(bm_serial_ctx_t *ctx) {
+  bm_serial_alias_t *alias = ctx->alias;
+  if (!alias || !alias->reset_pending || ctx->reserved_active) {
+    return;
+  }
 
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_REBOOT_INFO, 0, message_len);
+  alias->reset_pending = false;
+  bm_serial_alias_reset_t reset = {alias->reset_id};
+  bm_serial_builder_t builder;
+  if (!_bm_serial_builder_start(ctx, &builder, BM_SERIAL_ALIAS_RESET, 0, 0,
+                                sizeof(bm_serial_packet_t) + sizeof(reset))) {
+    _bm_serial_builder_put(&builder, &reset, sizeof(reset));
+    _bm_serial_builder_send(&builder);
+  }
+}
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
-      break;
-    }
-    bm_serial_reboot_info_t *reboot_info =
-        (bm_serial_reboot_info_t *)packet->payload;
-    reboot_info->node_id = node_id;
-    reboot_info->reboot_reason = reboot_reason;
-    reboot_info->gitSHA = gitSHA;
-    reboot_info->reboot_count = reboot_count;
-    reboot_info->pc = pc;
-    reboot_info->lr = lr;
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+/*!
+  Ask the sender to register an alias again. Held back while a reserved
+  packet is pending, since sending would overwrite it (without a txq or pool)
+
+  \param[in] *ctx bm_serial instance
+  \param[in] id unknown alias
+  \return none
+*/
+static void _bm_serial_alias_reset(bm_serial_ctx_t *ctx, uint16_t id) {
+  bm_serial_alias_t *alias = ctx->alias;
+  if (alias->reset_pending && alias->reset_id != id) {
+    id = BM_SERIAL_ALIAS_ALL;
+  }
+  alias->reset_pending = true;
+  alias->reset_id = id;
+  _bm_serial_alias_reset_flush(ctx);
+}
+
+/*!
+  Drop the pending reservation (if any)
+
+  \param[in] *ctx bm_serial instance
+  \return none
+*/
+static void _bm_serial_reserved_drop(bm_serial_ctx_t *ctx) {
+  if (ctx->reserved_active) {
+    _bm_serial_builder_abort(&ctx->reserved);
+    ctx->reserved_active = false;
+    _bm_serial_alias_reset_flush(ctx);
+  }
+}
+
+/*!
+  Send the packet from the last bm_serial_*_reserve() call once its data has
+  been filled in
+
+  \param[in] *ctx bm_serial instance
+  \return BM_SERIAL_OK if sent, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_commit(bm_serial_ctx_t *ctx) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!ctx->reserved_active) {
+      rval = BM_SERIAL_MISC_ERR;
       break;
     }
+
+    ctx->reserved_active = false;
+    rval = _bm_serial_builder_send(&ctx->reserved);
+    _bm_serial_alias_reset_flush(ctx);
+
   } while (0);
+
   return rval;
 }
 
-bm_serial_error_e bm_serial_dfu_send_start(bm_serial_dfu_start_t *dfu_start) {
+/*!
+  Give up on the packet from the last bm_serial_*_reserve() call, releasing
+  its queue slot or pool block. Safe to call when nothing is reserved.
+
+  \param[in] *ctx bm_serial instance
+  \return none
+*/
+void bm_serial_ctx_reserve_abort(bm_serial_ctx_t *ctx) {
+  _bm_serial_reserved_drop(ctx);
+}
+
+/*!
+  Send raw bm_serial data
+
+  \param[in] *ctx bm_serial instance
+  \param[in] type bm_serial message type
+  \param[in] *payload message payload
+  \param[in] len payload length
+  \return BM_SERIAL_OK if topic is valid, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_tx(bm_serial_ctx_t *ctx,
+                                   bm_serial_message_t type,
+                                   const uint8_t *payload, size_t len) {
   bm_serial_error_e rval = BM_SERIAL_OK;
+
   do {
-    uint16_t message_len =
-        sizeof(bm_serial_packet_t) + sizeof(bm_serial_dfu_start_t);
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_DFU_START, 0, message_len);
+    if (!payload) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
+    // Lets make sure that what we are trying to send will fit in the payload
+    if ((uint32_t)len + sizeof(bm_serial_packet_t) >= (SERIAL_BUFF_LEN - 1)) {
+      rval = BM_SERIAL_OVERFLOW;
       break;
     }
 
-    bm_serial_dfu_start_t *msg_start = (bm_serial_dfu_start_t *)packet->payload;
-    memcpy(msg_start, dfu_start, sizeof(bm_serial_dfu_start_t));
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
+    if (!ctx->callbacks.tx_fn && !ctx->callbacks.tx_iov_fn) {
+      rval = BM_SERIAL_MISSING_CALLBACK;
+      break;
+    }
 
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+    uint16_t message_len = sizeof(bm_serial_packet_t) + len;
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, type, 0, 0, message_len);
+    if (rval) {
       break;
     }
+    _bm_serial_builder_put_ext(&builder, payload, len);
+
+    rval = _bm_serial_builder_send(&builder);
 
   } while (0);
+
   return rval;
 }
 
-bm_serial_error_e bm_serial_dfu_send_chunk(uint32_t offset, size_t length,
-                                           uint8_t *data) {
+/*!
+  Start an aliased pub packet. The topic is only included until the receiver
+  was sent it with the alias.
+
+  \param[in] *ctx bm_serial instance (with aliasing enabled)
+  \param[out] *builder packet builder
+  \param node_id node id of publisher
+  \param *topic topic to publish on
+  \param topic_len length of topic
+  \param data_len length of data
+  \param type data type
+  \param version data version
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+static bm_serial_error_e
+_bm_serial_pub_alias_start(bm_serial_ctx_t *ctx, bm_serial_builder_t *builder,
+                           uint64_t node_id, const char *topic,
+                           uint16_t topic_len, uint16_t data_len, uint8_t type,
+                           uint8_t version) {
   bm_serial_error_e rval = BM_SERIAL_OK;
-  do {
 
-    uint16_t message_len =
-        sizeof(bm_serial_packet_t) + sizeof(bm_serial_dfu_chunk_t) + length;
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_DFU_CHUNK, 0, message_len);
+  do {
+    bm_serial_alias_entry_t *entry =
+        bm_serial_alias_tx(ctx->alias, topic, topic_len);
+    if (entry->registered) {
+      topic_len = 0;
+    }
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
+    uint16_t message_len = sizeof(bm_serial_packet_t) +
+                           sizeof(bm_serial_pub_alias_header_t) + topic_len +
+                           data_len;
+    rval = _bm_serial_builder_start(ctx, builder, BM_SERIAL_PUB_ALIAS, 0,
+                                    sizeof(bm_serial_pub_alias_header_t),
+                                    message_len);
+    if (rval) {
       break;
     }
 
-    bm_serial_dfu_chunk_t *dfu_chunk = (bm_serial_dfu_chunk_t *)packet->payload;
-    dfu_chunk->offset = offset;
-    dfu_chunk->length = length;
-    memcpy(dfu_chunk->data, data, length);
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
+    bm_serial_pub_alias_header_t *pub_header =
+        (bm_serial_pub_alias_header_t *)builder->packet->payload;
+    pub_header->node_id = node_id;
+    pub_header->type = type;
+    pub_header->version = version;
+    pub_header->alias = entry->alias;
+    pub_header->generation = entry->generation;
+    pub_header->topic_len = topic_len;
+    _bm_serial_builder_put(builder, topic, topic_len);
 
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
-      break;
-    }
+    // Registered once it's sent. If it gets lost after that the receiver
+    // doesn't know the alias, or knows it for the previous generation, and
+    // asks for the topic again.
+    builder->alias_register = topic_len != 0;
+    builder->alias_id = entry->alias;
+    builder->alias_generation = entry->generation;
 
   } while (0);
+
   return rval;
 }
 
-bm_serial_error_e bm_serial_dfu_send_finish(uint64_t node_id, bool success,
-                                            uint32_t status) {
+/*!
+  Start a pub packet, everything except the data
+
+  \param[in] *ctx bm_serial instance
+  \param[out] *builder packet builder
+  \param node_id node id of publisher
+  \param *topic topic to publish on
+  \param topic_len length of topic
+  \param data_len length of data
+  \param type data type
+  \param version data version
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+static bm_serial_error_e _bm_serial_pub_start(bm_serial_ctx_t *ctx,
+                                              bm_serial_builder_t *builder,
+                                              uint64_t node_id,
+                                              const char *topic,
+                                              uint16_t topic_len,
+                                              uint16_t data_len, uint8_t type,
+                                              uint8_t version) {
   bm_serial_error_e rval = BM_SERIAL_OK;
+
   do {
-    uint16_t message_len =
-        sizeof(bm_serial_packet_t) + sizeof(bm_serial_dfu_finish_t);
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_DFU_RESULT, 0, message_len);
+    rval = _bm_serial_validate_topic_and_cb(ctx, topic, topic_len);
+    if (rval) {
+      break;
+    }
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
+    if (data_len > SERIAL_BUFF_LEN) {
+      rval = BM_SERIAL_OVERFLOW;
       break;
     }
 
-    bm_serial_dfu_finish_t *dfu_finish =
-        (bm_serial_dfu_finish_t *)packet->payload;
-    dfu_finish->dfu_status = status;
-    dfu_finish->node_id = node_id;
-    dfu_finish->success = success;
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
+    if (ctx->alias && topic_len) {
+      rval = _bm_serial_pub_alias_start(ctx, builder, node_id, topic,
+                                        topic_len, data_len, type, version);
+      break;
+    }
 
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+    uint16_t message_len = sizeof(bm_serial_packet_t) +
+                           sizeof(bm_serial_pub_header_t) + topic_len +
+                           data_len;
+    rval = _bm_serial_builder_start(ctx, builder, BM_SERIAL_PUB, 0,
+                                    sizeof(bm_serial_pub_header_t),
+                                    message_len);
+    if (rval) {
       break;
     }
+
+    bm_serial_pub_header_t *pub_header =
+        (bm_serial_pub_header_t *)builder->packet->payload;
+    pub_header->node_id = node_id;
+    pub_header->topic_len = topic_len;
+    pub_header->type = type;
+    pub_header->version = version;
+    _bm_serial_builder_put(builder, topic, topic_len);
+
   } while (0);
+
   return rval;
 }
 
-bm_serial_error_e bm_serial_cfg_get(uint64_t node_id,
-                                    bm_common_config_partition_e partition,
-                                    size_t key_len, const char *key) {
+/*!
+  bm_serial publish data to topic
+
+  \param *ctx bm_serial instance
+  \param node_id node id of publisher
+  \param *topic topic to publish on
+  \param topic_len length of topic
+  \param *data data to publish
+  \param data_len length of data
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_pub(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                    const char *topic, uint16_t topic_len,
+                                    const uint8_t *data, uint16_t data_len,
+                                    uint8_t type, uint8_t version) {
   bm_serial_error_e rval = BM_SERIAL_OK;
-  do {
-    uint16_t message_len =
-        sizeof(bm_serial_packet_t) + sizeof(bm_common_config_get_t) + key_len;
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_CFG_GET, 0, message_len);
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
-      break;
+  do {
+    // Data is optional
+    if (!data) {
+      data_len = 0;
     }
 
-    bm_common_config_get_t *cfg_get_msg =
-        (bm_common_config_get_t *)packet->payload;
-    cfg_get_msg->header.target_node_id = node_id;
-    cfg_get_msg->header.source_node_id = 0; // UNUSED
-    cfg_get_msg->partition = partition;
-    cfg_get_msg->key_length = key_len;
-    memcpy(cfg_get_msg->key, key, key_len);
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+    bm_serial_builder_t builder;
+    rval = _bm_serial_pub_start(ctx, &builder, node_id, topic, topic_len,
+                                data_len, type, version);
+    if (rval) {
       break;
     }
+
+    // Data goes after the topic (if any)
+    _bm_serial_builder_put_ext(&builder, data, data_len);
+
+    // Delivery is confirmed with ACKs if the instance has reliability
+    // enabled (see bm_serial_rel.h)
+    rval = _bm_serial_builder_send(&builder);
+
   } while (0);
+
   return rval;
 }
 
-bm_serial_error_e bm_serial_cfg_set(uint64_t node_id,
-                                    bm_common_config_partition_e partition,
-                                    size_t key_len, const char *key,
-                                    size_t value_size, void *val) {
+/*!
+  Reserve a pub packet so data can be written directly into the tx buffer.
+  Fill in data_len bytes at *data and send with bm_serial_commit().
+
+  Without a txq or pool the packet lives in the shared tx buffer, so other
+  sends return BM_SERIAL_BUSY until it's committed or aborted with
+  bm_serial_reserve_abort().
+
+  \param *ctx bm_serial instance
+  \param node_id node id of publisher
+  \param *topic topic to publish on
+  \param topic_len length of topic
+  \param data_len length of data
+  \param type data type
+  \param version data version
+  \param[out] **data where to write the data
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_pub_reserve(bm_serial_ctx_t *ctx,
+                                            uint64_t node_id, const char *topic,
+                                            uint16_t topic_len,
+                                            uint16_t data_len, uint8_t type,
+                                            uint8_t version, uint8_t **data) {
   bm_serial_error_e rval = BM_SERIAL_OK;
+
   do {
-    uint16_t message_len = sizeof(bm_serial_packet_t) +
-                           sizeof(bm_common_config_set_t) + key_len +
-                           value_size;
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_CFG_SET, 0, message_len);
+    _bm_serial_reserved_drop(ctx);
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
+    if (!data) {
+      rval = BM_SERIAL_NULL_BUFF;
       break;
     }
 
-    bm_common_config_set_t *cfg_set_msg =
-        (bm_common_config_set_t *)packet->payload;
-    cfg_set_msg->header.target_node_id = node_id;
-    cfg_set_msg->header.source_node_id = 0; // UNUSED
-    cfg_set_msg->partition = partition;
-    cfg_set_msg->key_length = key_len;
-    cfg_set_msg->data_length = value_size;
-    memcpy(cfg_set_msg->keyAndData, key, key_len);
-    memcpy(&cfg_set_msg->keyAndData[key_len], val, value_size);
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+    rval = _bm_serial_pub_start(ctx, &ctx->reserved, node_id, topic, topic_len,
+                                data_len, type, version);
+    if (rval) {
       break;
     }
+
+    rval = _bm_serial_builder_reserve(&ctx->reserved, data_len, data);
+
   } while (0);
+
   return rval;
 }
 
-bm_serial_error_e bm_serial_cfg_value(uint64_t node_id,
-                                      bm_common_config_partition_e partition,
-                                      uint32_t data_length, void *data) {
+/*!
+  bm_serial subscribe/unsubscribe from topic
+
+  \param *ctx bm_serial instance
+  \param *topic topic to subscribe to
+  \param topic_len lenth of topic
+  \param sub subscribe/unsubscribe
+  \return BM_SERIAL_OK on success, nonzero otherwise
+*/
+static bm_serial_error_e _bm_serial_sub_unsub(bm_serial_ctx_t *ctx,
+                                              const char *topic,
+                                              uint16_t topic_len, bool sub) {
   bm_serial_error_e rval = BM_SERIAL_OK;
-  do {
-    uint16_t message_len = sizeof(bm_serial_packet_t) +
-                           sizeof(bm_common_config_value_t) + data_length;
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_CFG_VALUE, 0, message_len);
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
+  do {
+    rval = _bm_serial_validate_topic_and_cb(ctx, topic, topic_len);
+    if (rval) {
       break;
     }
 
-    bm_common_config_value_t *cfg_value_msg =
-        (bm_common_config_value_t *)packet->payload;
-    cfg_value_msg->header.target_node_id = 0; // UNUSED
-    cfg_value_msg->header.source_node_id = node_id;
-    cfg_value_msg->partition = partition;
-    cfg_value_msg->data_length = data_length;
-    memcpy(cfg_value_msg->data, data, data_length);
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+    // Header and topic only. Versions before the builder sized these as a pub
+    // header, sending 10 stale bytes after the topic that receivers ignore.
+    uint16_t message_len = sizeof(bm_serial_packet_t) +
+                           sizeof(bm_serial_sub_unsub_header_t) + topic_len;
+
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(
+        ctx, &builder, sub ? BM_SERIAL_SUB : BM_SERIAL_UNSUB, 0,
+        sizeof(bm_serial_sub_unsub_header_t), message_len);
+    if (rval) {
       break;
     }
+
+    bm_serial_sub_unsub_header_t *sub_header =
+        (bm_serial_sub_unsub_header_t *)builder.packet->payload;
+    sub_header->topic_len = topic_len;
+    _bm_serial_builder_put(&builder, topic, topic_len);
+
+    rval = _bm_serial_builder_send(&builder);
+
   } while (0);
+
   return rval;
 }
 
-bm_serial_error_e bm_serial_cfg_commit(uint64_t node_id,
-                                       bm_common_config_partition_e partition) {
-  bm_serial_error_e rval = BM_SERIAL_OK;
-  do {
-    uint16_t message_len =
-        sizeof(bm_serial_packet_t) + sizeof(bm_common_config_commit_t);
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_CFG_COMMIT, 0, message_len);
+/*!
+  bm_serial subscribe to topic
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
-      break;
-    }
-    bm_common_config_commit_t *cfg_commit_msg =
-        (bm_common_config_commit_t *)packet->payload;
-    cfg_commit_msg->header.target_node_id = node_id;
-    cfg_commit_msg->header.source_node_id = 0; // UNUSED.
-    cfg_commit_msg->partition = partition;
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+  \param *ctx bm_serial instance
+  \param *topic topic to subscribe to
+  \param topic_len lenth of topic
+  \return BM_SERIAL_OK on success, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_sub(bm_serial_ctx_t *ctx, const char *topic,
+                                    uint16_t topic_len) {
+  return _bm_serial_sub_unsub(ctx, topic, topic_len, true);
+}
+
+/*!
+  bm_serial unsubscribe from topic
+
+  \param *ctx bm_serial instance
+  \param *topic topic to subscribe to
+  \param topic_len lenth of topic
+  \return BM_SERIAL_OK on success, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_unsub(bm_serial_ctx_t *ctx, const char *topic,
+                                      uint16_t topic_len) {
+  return _bm_serial_sub_unsub(ctx, topic, topic_len, false);
+}
+
+/*!
+  Update RTC on target device
+
+  \param[in] *ctx bm_serial instance
+  \param[in] *time time to set the clock to
+  \return BM_SERIAL_OK if sent, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_set_rtc(bm_serial_ctx_t *ctx,
+                                        bm_serial_time_t *time) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    uint16_t message_len = sizeof(bm_serial_packet_t) + sizeof(bm_serial_rtc_t);
+
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_RTC_SET, 0,
+                                    sizeof(bm_serial_rtc_t), message_len);
+    if (rval) {
       break;
     }
+
+    bm_serial_rtc_t *rtc_header = (bm_serial_rtc_t *)builder.packet->payload;
+    rtc_header->flags = 0;
+    memcpy(&rtc_header->time, time, sizeof(bm_serial_time_t));
+
+    rval = _bm_serial_builder_send(&builder);
+
   } while (0);
+
   return rval;
 }
 
+/*!
+  Send out a bm_common_network_info_t
+
+  \param[in] *ctx bm_serial instance
+  \param[in] *config_crc
+  \param[in] *fw_info
+  \param[in] num_nodes
+  \param[in] *node_id_list
+  \param[in] config_map_size
+  \param[in] *cbor_config_map
+  \return BM_SERIAL_OK if sent, nonzero otherwise
+*/
 bm_serial_error_e
-bm_serial_cfg_status_request(uint64_t node_id,
-                             bm_common_config_partition_e partition) {
+bm_serial_ctx_send_network_info(bm_serial_ctx_t *ctx, uint32_t network_crc32,
+                                bm_common_config_crc_t *config_crc,
+                                bm_common_fw_version_t *fw_info,
+                                uint16_t num_nodes, uint64_t *node_id_list,
+                                uint16_t config_map_size,
+                                uint8_t *cbor_config_map) {
   bm_serial_error_e rval = BM_SERIAL_OK;
   do {
-    uint16_t message_len =
-        sizeof(bm_serial_packet_t) + sizeof(bm_common_config_status_request_t);
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_CFG_STATUS_REQ, 0, message_len);
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
+    if (!config_crc || !fw_info || !node_id_list || num_nodes == 0 ||
+        !cbor_config_map) {
+      rval = BM_SERIAL_MISC_ERR;
       break;
     }
-    bm_common_config_status_request_t *status_req_msg =
-        (bm_common_config_status_request_t *)packet->payload;
-    status_req_msg->header.target_node_id = node_id;
-    status_req_msg->header.source_node_id = 0; // UNUSED.
-    status_req_msg->partition = partition;
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+
+    size_t node_list_size = sizeof(uint64_t) * num_nodes;
+    uint16_t message_len = sizeof(bm_serial_packet_t) +
+                           sizeof(bm_common_network_info_t) + node_list_size +
+                           config_map_size;
+
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_NETWORK_INFO, 0,
+                                    sizeof(bm_common_network_info_t),
+                                    message_len);
+    if (rval) {
       break;
     }
+
+    bm_common_network_info_t *network_info =
+        (bm_common_network_info_t *)builder.packet->payload;
+    network_info->network_crc32 = network_crc32;
+    memcpy(&network_info->config_crc, config_crc,
+           sizeof(bm_common_config_crc_t));
+    memcpy(&network_info->fw_info, fw_info, sizeof(bm_common_fw_version_t));
+    network_info->num_nodes = num_nodes;
+    network_info->map_size_bytes = config_map_size;
+    _bm_serial_builder_put(&builder, node_id_list, node_list_size);
+    _bm_serial_builder_put(&builder, cbor_config_map, config_map_size);
+
+    rval = _bm_serial_builder_send(&builder);
+
   } while (0);
   return rval;
 }
 
-bm_serial_error_e
-bm_serial_cfg_status_response(uint64_t node_id,
-                              bm_common_config_partition_e partition,
-                              bool commited, uint8_t num_keys, void *keys) {
+/*!
+  Send out a self test request or response
+
+  \param[in] *ctx bm_serial instance
+  \param[in] node_id node id of device who ran self test (or 0 to request one)
+  \param[in] result self test result
+  \return BM_SERIAL_OK on successful send, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_send_self_test(bm_serial_ctx_t *ctx,
+                                               uint64_t node_id,
+                                               uint32_t result) {
   bm_serial_error_e rval = BM_SERIAL_OK;
+
   do {
     uint16_t message_len =
-        sizeof(bm_serial_packet_t) + sizeof(bm_common_config_status_response_t);
-    size_t key_data_len = 0;
-    bm_common_config_status_key_data_t *cur_key =
-        (bm_common_config_status_key_data_t *)keys;
-    for (int i = 0; i < num_keys; i++) {
-      key_data_len += sizeof(bm_common_config_status_key_data_t);
-      key_data_len += cur_key->key_length;
-      cur_key +=
-          sizeof(bm_common_config_status_key_data_t) + cur_key->key_length;
-    }
-    message_len += key_data_len;
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_CFG_STATUS_RESP, 0, message_len);
+        sizeof(bm_serial_packet_t) + sizeof(bm_serial_self_test_t);
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
-      break;
-    }
-    bm_common_config_status_response_t *status_resp_msg =
-        (bm_common_config_status_response_t *)packet->payload;
-    status_resp_msg->header.target_node_id = 0;       // UNUSED
-    status_resp_msg->header.source_node_id = node_id; // UNUSED.
-    status_resp_msg->partition = partition;
-    status_resp_msg->committed = commited;
-    status_resp_msg->num_keys = num_keys;
-    memcpy(status_resp_msg->keyData, keys, key_data_len);
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_SELF_TEST, 0,
+                                    sizeof(bm_serial_self_test_t), message_len);
+    if (rval) {
       break;
     }
+
+    bm_serial_self_test_t *self_test =
+        (bm_serial_self_test_t *)builder.packet->payload;
+    self_test->node_id = node_id;
+    self_test->result = result;
+
+    rval = _bm_serial_builder_send(&builder);
+
   } while (0);
+
   return rval;
 }
 
-bm_serial_error_e
-bm_serial_cfg_delete_request(uint64_t node_id,
-                             bm_common_config_partition_e partition,
-                             size_t key_len, const char *key) {
+/*!
+  Send out a reboot info message
+
+  \param[in] *ctx bm_serial instance
+  \param[in] node_id node id of device who ran self test (or 0 to request one)
+  \param[in] reboot_reason reboot reason enum
+  \param[in] gitSHA 32-bit gitSHA
+  \param[in] reboot_count reboot count
+  \return BM_SERIAL_OK on successful send, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_send_reboot_info(bm_serial_ctx_t *ctx,
+                                                 uint64_t node_id,
+                                                 uint32_t reboot_reason,
+                                                 uint32_t gitSHA,
+                                                 uint32_t reboot_count,
+                                                 uint32_t pc, uint32_t lr) {
   bm_serial_error_e rval = BM_SERIAL_OK;
   do {
-    uint16_t message_len = sizeof(bm_serial_packet_t) +
-                           sizeof(bm_common_config_delete_key_request_t) +
-                           key_len;
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_CFG_DEL_REQ, 0, message_len);
+    uint16_t message_len =
+        sizeof(bm_serial_packet_t) + sizeof(bm_serial_reboot_info_t);
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
-      break;
-    }
-    bm_common_config_delete_key_request_t *del_key_req =
-        (bm_common_config_delete_key_request_t *)packet->payload;
-    del_key_req->header.target_node_id = node_id;
-    del_key_req->header.source_node_id = 0; // UNUSED.
-    del_key_req->partition = partition;
-    del_key_req->key_length = key_len;
-    memcpy(del_key_req->key, key, key_len);
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_REBOOT_INFO, 0,
+                                    sizeof(bm_serial_reboot_info_t),
+                                    message_len);
+    if (rval) {
       break;
     }
+    bm_serial_reboot_info_t *reboot_info =
+        (bm_serial_reboot_info_t *)builder.packet->payload;
+    reboot_info->node_id = node_id;
+    reboot_info->reboot_reason = reboot_reason;
+    reboot_info->gitSHA = gitSHA;
+    reboot_info->reboot_count = reboot_count;
+    reboot_info->pc = pc;
+    reboot_info->lr = lr;
+    rval = _bm_serial_builder_send(&builder);
   } while (0);
   return rval;
 }
 
 bm_serial_error_e
-bm_serial_cfg_delete_response(uint64_t node_id,
-                              bm_common_config_partition_e partition,
-                              size_t key_len, const char *key, bool success) {
+bm_serial_ctx_dfu_send_start(bm_serial_ctx_t *ctx,
+                             bm_serial_dfu_start_t *dfu_start) {
   bm_serial_error_e rval = BM_SERIAL_OK;
   do {
-    uint16_t message_len = sizeof(bm_serial_packet_t) +
-                           sizeof(bm_common_config_delete_key_response_t) +
-                           key_len;
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_CFG_DEL_RESP, 0, message_len);
+    uint16_t message_len =
+        sizeof(bm_serial_packet_t) + sizeof(bm_serial_dfu_start_t);
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
-      break;
-    }
-    bm_common_config_delete_key_response_t *del_key_resp =
-        (bm_common_config_delete_key_response_t *)packet->payload;
-    del_key_resp->header.target_node_id = 0; // UNUSED
-    del_key_resp->header.source_node_id = node_id;
-    del_key_resp->partition = partition;
-    del_key_resp->success = success;
-    del_key_resp->key_length = key_len;
-    memcpy(del_key_resp->key, key, key_len);
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_DFU_START, 0, 0,
+                                    message_len);
+    if (rval) {
       break;
     }
+
+    _bm_serial_builder_put(&builder, dfu_start, sizeof(bm_serial_dfu_start_t));
+    rval = _bm_serial_builder_send(&builder);
+
   } while (0);
   return rval;
 }
 
-bm_serial_error_e bm_serial_send_info_request(uint64_t node_id) {
+/*!
+  Start a DFU chunk packet, everything except the chunk data
+
+  \param[in] *ctx bm_serial instance
+  \param[out] *builder packet builder
+  \param[in] offset chunk offset
+  \param[in] length chunk length
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+static bm_serial_error_e
+_bm_serial_dfu_chunk_start(bm_serial_ctx_t *ctx, bm_serial_builder_t *builder,
+                           uint32_t offset, size_t length) {
   bm_serial_error_e rval = BM_SERIAL_OK;
   do {
-    uint16_t message_len =
-        sizeof(bm_serial_packet_t) + sizeof(bm_serial_device_info_request_t);
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_DEVICE_INFO_REQ, 0, message_len);
-
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
+    if (length > SERIAL_BUFF_LEN) {
+      rval = BM_SERIAL_OVERFLOW;
       break;
     }
-    bm_serial_device_info_request_t *device_info_req_msg =
-        (bm_serial_device_info_request_t *)packet->payload;
-    device_info_req_msg->target_node_id = node_id;
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+
+    uint16_t message_len =
+        sizeof(bm_serial_packet_t) + sizeof(bm_serial_dfu_chunk_t) + length;
+
+    rval = _bm_serial_builder_start(ctx, builder, BM_SERIAL_DFU_CHUNK, 0,
+                                    sizeof(bm_serial_dfu_chunk_t), message_len);
+    if (rval) {
       break;
     }
+
+    bm_serial_dfu_chunk_t *dfu_chunk =
+        (bm_serial_dfu_chunk_t *)builder->packet->payload;
+    dfu_chunk->offset = offset;
+    dfu_chunk->length = length;
+
   } while (0);
   return rval;
 }
 
-bm_serial_error_e
-bm_serial_send_info_reply(uint64_t node_id,
-                          bm_serial_device_info_reply_t *bcmp_info) {
-  (void)node_id;
+bm_serial_error_e bm_serial_ctx_dfu_send_chunk(bm_serial_ctx_t *ctx,
+                                               uint32_t offset, size_t length,
+                                               uint8_t *data) {
   bm_serial_error_e rval = BM_SERIAL_OK;
   do {
-    uint16_t message_len = sizeof(bm_serial_packet_t) +
-                           sizeof(bm_serial_device_info_reply_t) +
-                           bcmp_info->dev_name_len + bcmp_info->ver_str_len;
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_DEVICE_INFO_REPLY, 0, message_len);
-
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
-      break;
-    }
-    bm_serial_device_info_reply_t *device_info_reply_msg =
-        (bm_serial_device_info_reply_t *)packet->payload;
-    memcpy(device_info_reply_msg, bcmp_info,
-           sizeof(bm_serial_device_info_reply_t) + bcmp_info->dev_name_len +
-               bcmp_info->ver_str_len);
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+    bm_serial_builder_t builder;
+    rval = _bm_serial_dfu_chunk_start(ctx, &builder, offset, length);
+    if (rval) {
       break;
     }
+
+    _bm_serial_builder_put_ext(&builder, data, length);
+    rval = _bm_serial_builder_send(&builder);
+
   } while (0);
   return rval;
 }
 
-bm_serial_error_e bm_serial_send_resource_request(uint64_t node_id) {
+/*!
+  Reserve a DFU chunk packet so the chunk can be read directly into the tx
+  buffer. Send with bm_serial_commit() (see bm_serial_pub_reserve())
+
+  \param[in] *ctx bm_serial instance
+  \param[in] offset chunk offset
+  \param[in] length chunk length
+  \param[out] **data where to write the chunk data
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_dfu_chunk_reserve(bm_serial_ctx_t *ctx,
+                                                  uint32_t offset,
+                                                  size_t length,
+                                                  uint8_t **data) {
   bm_serial_error_e rval = BM_SERIAL_OK;
   do {
-    uint16_t message_len =
-        sizeof(bm_serial_packet_t) + sizeof(bm_serial_resource_table_request_t);
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_RESOURCE_REQ, 0, message_len);
+    _bm_serial_reserved_drop(ctx);
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
+    if (!data) {
+      rval = BM_SERIAL_NULL_BUFF;
       break;
     }
-    bm_serial_resource_table_request_t *resource_req_msg =
-        (bm_serial_resource_table_request_t *)packet->payload;
-    resource_req_msg->target_node_id = node_id;
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
+
+    rval = _bm_serial_dfu_chunk_start(ctx, &ctx->reserved, offset, length);
+    if (rval) {
       break;
     }
+
+    rval = _bm_serial_builder_reserve(&ctx->reserved, length, data);
+
   } while (0);
   return rval;
 }
 
-// TODO - This struct is defined in bcmp_messages.h, but that is not included in
-// this repo yet. We should eventually include it, or have this struct moved
-// into the common messages repo. Perhaps this can happen when we do this
-// ticket: SC-195824
-typedef struct {
-  // Length of resource name
-  uint16_t resource_len;
-  // Name of resource
-  char resource[0];
-} __attribute__((packed)) bcmp_resource_t;
+/*!
+  Ask the DFU sender to resend part of the image (see DFU_CHUNK_NAK_BITFLAG)
 
-bm_serial_error_e
-bm_serial_send_resource_reply(uint64_t node_id,
-                              bm_serial_resource_table_reply_t *bcmp_resource) {
-  (void)node_id;
+  \param[in] *ctx bm_serial instance
+  \param[in] offset start of the missing range
+  \param[in] length bytes missing, 0 to acknowledge everything before offset
+  \return BM_SERIAL_OK if sent, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ctx_dfu_send_nak(bm_serial_ctx_t *ctx,
+                                             uint32_t offset, size_t length) {
   bm_serial_error_e rval = BM_SERIAL_OK;
   do {
+    if (offset & DFU_CHUNK_NAK_BITFLAG) {
+      rval = BM_SERIAL_OVERFLOW;
+      break;
+    }
+
     uint16_t message_len =
-        sizeof(bm_serial_packet_t) + sizeof(bm_serial_resource_table_reply_t);
+        sizeof(bm_serial_packet_t) + sizeof(bm_serial_dfu_chunk_t);
 
-    size_t length_of_resources = 0;
-    uint16_t num_pubs = bcmp_resource->num_pubs;
-    while (num_pubs) {
-      bcmp_resource_t *cur_resource =
-          (bcmp_resource_t *)(&bcmp_resource
-                                   ->resource_list[length_of_resources]);
-      length_of_resources +=
-          (sizeof(bcmp_resource_t) + cur_resource->resource_len);
-      num_pubs--;
-    }
-    uint16_t num_subs = bcmp_resource->num_subs;
-    while (num_subs) {
-      bcmp_resource_t *cur_resource =
-          (bcmp_resource_t *)(&bcmp_resource
-                                   ->resource_list[length_of_resources]);
-      length_of_resources +=
-          (sizeof(bcmp_resource_t) + cur_resource->resource_len);
-      num_subs--;
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_DFU_CHUNK, 0,
+                                    sizeof(bm_serial_dfu_chunk_t), message_len);
+    if (rval) {
+      break;
     }
 
-    message_len += length_of_resources;
-
-    bm_serial_packet_t *packet =
-        _bm_serial_get_packet(BM_SERIAL_RESOURCE_REPLY, 0, message_len);
+    bm_serial_dfu_chunk_t *dfu_chunk =
+        (bm_serial_dfu_chunk_t *)builder.packet->payload;
+    dfu_chunk->offset = offset | DFU_CHUNK_NAK_BITFLAG;
+    dfu_chunk->length = length;
+    rval = _bm_serial_builder_send(&builder);
 
-    if (!packet) {
-      rval = BM_SERIAL_OUT_OF_MEMORY;
-      break;
-    }
-    bm_serial_resource_table_reply_t *resource_req_msg =
-        (bm_serial_resource_table_reply_t *)packet->payload;
-    memcpy(resource_req_msg, bcmp_resource,
-           sizeof(bm_serial_resource_table_reply_t) + length_of_resources);
-    packet->crc16 = bm_serial_crc16_ccitt(0, (uint8_t *)packet, message_len);
-    if (!_callbacks.tx_fn((uint8_t *)packet, message_len)) {
-      rval = BM_SERIAL_TX_ERR;
-      break;
-    }
   } while (0);
   return rval;
 }
 
-// Process bm_serial packet (not COBS anymore!)
-bm_serial_error_e bm_serial_process_packet(bm_serial_packet_t *packet,
-                                           size_t len) {
+bm_serial_error_e bm_serial_ctx_dfu_send_finish(bm_serial_ctx_t *ctx,
+                                                uint64_t node_id, bool success,
+                                                uint32_t status) {
   bm_serial_error_e rval = BM_SERIAL_OK;
-
-  // calc the crc16 and compare
-  uint16_t crc16_pre = packet->crc16;
-  packet->crc16 = 0;
   do {
-    uint16_t crc16_post = bm_serial_crc16_ccitt(0, (uint8_t *)packet, len);
+    uint16_t message_len =
+        sizeof(bm_serial_packet_t) + sizeof(bm_serial_dfu_finish_t);
 
-    if (crc16_post != crc16_pre) {
-      rval = BM_SERIAL_CRC_ERR;
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_DFU_RESULT, 0,
+                                    sizeof(bm_serial_dfu_finish_t),
+                                    message_len);
+    if (rval) {
       break;
     }
 
-    switch (packet->type) {
-    case BM_SERIAL_DEBUG: {
-      if (_callbacks.debug_fn) {
-        _callbacks.debug_fn(packet->payload, len - sizeof(bm_serial_packet_t));
-      }
-      break;
-    }
+    bm_serial_dfu_finish_t *dfu_finish =
+        (bm_serial_dfu_finish_t *)builder.packet->payload;
+    dfu_finish->dfu_status = status;
+    dfu_finish->node_id = node_id;
+    dfu_finish->success = success;
+    rval = _bm_serial_builder_send(&builder);
+  } while (0);
+  return rval;
+}
 
-    case BM_SERIAL_PUB: {
-      if (!_callbacks.pub_fn) {
-        break;
-      }
+/*!
+  Answer a get with a cached value, as if it had just been received
 
-      bm_serial_pub_header_t *pub_header =
-          (bm_serial_pub_header_t *)packet->payload;
-
-      // Protect against topic length being incorrect
-      // (would result in overflow when subtracting from len to determine data
-      // len)
-      uint32_t non_data_len = sizeof(bm_serial_packet_t) +
-                              sizeof(bm_serial_pub_header_t) +
-                              pub_header->topic_len;
-      if (non_data_len > len) {
-        rval = BM_SERIAL_INVALID_TOPIC_LEN;
-        break;
-      }
+  \param[in] *ctx bm_serial instance
+  \param[in] *payload cached bm_common_config_value_t
+  \param[in] len payload length
+  \return none
+*/
+static void _bm_serial_cfg_value_cached(bm_serial_ctx_t *ctx,
+                                        const uint8_t *payload, size_t len) {
+  if (ctx->rx_hook &&
+      ctx->rx_hook(ctx->rx_hook_arg, BM_SERIAL_CFG_VALUE, payload, len)) {
+    return;
+  }
 
-      uint32_t data_len = len - non_data_len;
-      _callbacks.pub_fn((const char *)pub_header->topic, pub_header->topic_len,
-                        pub_header->node_id,
-                        &pub_header->topic[pub_header->topic_len], data_len,
-                        pub_header->type, pub_header->version);
+  if (ctx->callbacks.cfg_value_fn) {
+    bm_common_config_value_t *cfg_value = (bm_common_config_value_t *)payload;
+    ctx->callbacks.cfg_value_fn(cfg_value->header.source_node_id,
+                                cfg_value->partition, cfg_value->data_length,
+                                cfg_value->data);
+  }
+}
 
+bm_serial_error_e bm_serial_ctx_cfg_get(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                        bm_common_config_partition_e partition,
+                                        size_t key_len, const char *key) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    const uint8_t *cached;
+    size_t cached_len;
+    if (ctx->cache && bm_serial_cache_get(ctx->cache, node_id, partition,
+                                          key_len, key, &cached, &cached_len)) {
+      _bm_serial_cfg_value_cached(ctx, cached, cached_len);
       break;
     }
 
-    case BM_SERIAL_SUB: {
-      if (!_callbacks.sub_fn) {
-        break;
-      }
-
-      bm_serial_sub_unsub_header_t *sub_header =
-          (bm_serial_sub_unsub_header_t *)packet->payload;
-      _callbacks.sub_fn((const char *)sub_header->topic, sub_header->topic_len);
+    uint16_t message_len =
+        sizeof(bm_serial_packet_t) + sizeof(bm_common_config_get_t) + key_len;
 
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_CFG_GET, 0,
+                                    sizeof(bm_common_config_get_t),
+                                    message_len);
+    if (rval) {
       break;
     }
 
-    case BM_SERIAL_UNSUB: {
-      if (!_callbacks.unsub_fn) {
-        break;
-      }
+    bm_common_config_get_t *cfg_get_msg =
+        (bm_common_config_get_t *)builder.packet->payload;
+    cfg_get_msg->header.target_node_id = node_id;
+    cfg_get_msg->header.source_node_id = 0; // UNUSED
+    cfg_get_msg->partition = partition;
+    cfg_get_msg->key_length = key_len;
+    _bm_serial_builder_put(&builder, key, key_len);
+    rval = _bm_serial_builder_send(&builder);
+    if (!rval && ctx->cache) {
+      bm_serial_cache_sent(ctx->cache, node_id, partition, key_len, key);
+    }
+  } while (0);
+  return rval;
+}
 
-      bm_serial_sub_unsub_header_t *unsub_header =
-          (bm_serial_sub_unsub_header_t *)packet->payload;
-      _callbacks.unsub_fn((const char *)unsub_header->topic,
-                          unsub_header->topic_len);
+bm_serial_error_e bm_serial_ctx_cfg_set(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                        bm_common_config_partition_e partition,
+                                        size_t key_len, const char *key,
+                                        size_t value_size, void *val) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    uint16_t message_len = sizeof(bm_serial_packet_t) +
+                           sizeof(bm_common_config_set_t) + key_len +
+                           value_size;
 
-      break;
+    if (ctx->cache) {
+      bm_serial_cache_invalidate(ctx->cache, node_id, partition, key_len, key);
     }
 
-    case BM_SERIAL_LOG: {
-      if (_callbacks.log_fn) {
-        // TODO - decode and use actual topic
-        _callbacks.log_fn(0, packet->payload, len - sizeof(bm_serial_packet_t));
-      }
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_CFG_SET, 0,
+                                    sizeof(bm_common_config_set_t),
+                                    message_len);
+    if (rval) {
       break;
     }
 
-    case BM_SERIAL_NET_MSG: {
-      if (_callbacks.net_msg_fn) {
-        uint32_t non_data_len =
-            sizeof(bm_serial_packet_t) + sizeof(bm_serial_net_msg_header_t);
-        if (non_data_len > len) {
-          rval = BM_SERIAL_INVALID_MSG_LEN;
-          break;
-        }
-        bm_serial_net_msg_header_t *net_msg =
-            (bm_serial_net_msg_header_t *)packet->payload;
+    bm_common_config_set_t *cfg_set_msg =
+        (bm_common_config_set_t *)builder.packet->payload;
+    cfg_set_msg->header.target_node_id = node_id;
+    cfg_set_msg->header.source_node_id = 0; // UNUSED
+    cfg_set_msg->partition = partition;
+    cfg_set_msg->key_length = key_len;
+    cfg_set_msg->data_length = value_size;
+    _bm_serial_builder_put(&builder, key, key_len);
+    _bm_serial_builder_put(&builder, val, value_size);
+    rval = _bm_serial_builder_send(&builder);
+  } while (0);
+  return rval;
+}
 
-        uint32_t data_len = len - non_data_len;
-        _callbacks.net_msg_fn(net_msg->node_id, net_msg->data, data_len);
-      }
+/*!
+  Start a cfg value packet, everything except the (cbor encoded) value
+
+  \param[in] *ctx bm_serial instance
+  \param[out] *builder packet builder
+  \param[in] node_id node id of the value's owner
+  \param[in] partition config partition
+  \param[in] data_length value length
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+static bm_serial_error_e
+_bm_serial_cfg_value_start(bm_serial_ctx_t *ctx, bm_serial_builder_t *builder,
+                           uint64_t node_id,
+                           bm_common_config_partition_e partition,
+                           uint32_t data_length) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    if (data_length > SERIAL_BUFF_LEN) {
+      rval = BM_SERIAL_OVERFLOW;
       break;
     }
 
-    case BM_SERIAL_RTC_SET: {
-      if (_callbacks.rtc_set_fn) {
-        bm_serial_rtc_t *rtc_msg = (bm_serial_rtc_t *)packet->payload;
-        _callbacks.rtc_set_fn(&rtc_msg->time);
-      }
+    uint16_t message_len = sizeof(bm_serial_packet_t) +
+                           sizeof(bm_common_config_value_t) + data_length;
+
+    rval = _bm_serial_builder_start(ctx, builder, BM_SERIAL_CFG_VALUE, 0,
+                                    sizeof(bm_common_config_value_t),
+                                    message_len);
+    if (rval) {
       break;
     }
 
-    case BM_SERIAL_SELF_TEST: {
-      if (_callbacks.self_test_fn) {
-        bm_serial_self_test_t *self_test =
-            (bm_serial_self_test_t *)packet->payload;
-        _callbacks.self_test_fn(self_test->node_id, self_test->result);
-      }
+    bm_common_config_value_t *cfg_value_msg =
+        (bm_common_config_value_t *)builder->packet->payload;
+    cfg_value_msg->header.target_node_id = 0; // UNUSED
+    cfg_value_msg->header.source_node_id = node_id;
+    cfg_value_msg->partition = partition;
+    cfg_value_msg->data_length = data_length;
+  } while (0);
+  return rval;
+}
+
+bm_serial_error_e
+bm_serial_ctx_cfg_value(bm_serial_ctx_t *ctx, uint64_t node_id,
+                        bm_common_config_partition_e partition,
+                        uint32_t data_length, void *data) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    bm_serial_builder_t builder;
+    rval = _bm_serial_cfg_value_start(ctx, &builder, node_id, partition,
+                                      data_length);
+    if (rval) {
       break;
     }
 
-    case BM_SERIAL_REBOOT_INFO: {
-      if (_callbacks.reboot_info_fn) {
-        bm_serial_reboot_info_t *reboot_info =
-            (bm_serial_reboot_info_t *)packet->payload;
-        _callbacks.reboot_info_fn(
-            reboot_info->node_id, reboot_info->reboot_reason,
-            reboot_info->gitSHA, reboot_info->reboot_count,
-            reboot_info->pc, reboot_info->lr);
-      }
+    _bm_serial_builder_put(&builder, data, data_length);
+    rval = _bm_serial_builder_send(&builder);
+  } while (0);
+  return rval;
+}
+
+/*!
+  Reserve a cfg value packet so the value can be encoded directly into the tx
+  buffer. Send with bm_serial_commit() (see bm_serial_pub_reserve())
+
+  \param[in] *ctx bm_serial instance
+  \param[in] node_id node id of the value's owner
+  \param[in] partition config partition
+  \param[in] data_length value length
+  \param[out] **data where to write the value
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e
+bm_serial_ctx_cfg_value_reserve(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                bm_common_config_partition_e partition,
+                                uint32_t data_length, uint8_t **data) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    _bm_serial_reserved_drop(ctx);
+
+    if (!data) {
+      rval = BM_SERIAL_NULL_BUFF;
       break;
     }
 
-    case BM_SERIAL_DFU_START: {
-      if (_callbacks.dfu_start_fn) {
-        bm_serial_dfu_start_t *dfu_start =
-            (bm_serial_dfu_start_t *)packet->payload;
-        _callbacks.dfu_start_fn(dfu_start);
-      }
+    rval = _bm_serial_cfg_value_start(ctx, &ctx->reserved, node_id, partition,
+                                      data_length);
+    if (rval) {
       break;
     }
 
-    case BM_SERIAL_DFU_CHUNK: {
-      if (_callbacks.dfu_chunk_fn) {
-        bm_serial_dfu_chunk_t *dfu_chunk =
-            (bm_serial_dfu_chunk_t *)packet->payload;
-        _callbacks.dfu_chunk_fn(dfu_chunk->offset, dfu_chunk->length,
-                                dfu_chunk->data);
-      }
-      break;
+    rval = _bm_serial_builder_reserve(&ctx->reserved, data_length, data);
+  } while (0);
+  return rval;
+}
+
+bm_serial_error_e
+bm_serial_ctx_cfg_commit(bm_serial_ctx_t *ctx, uint64_t node_id,
+                         bm_common_config_partition_e partition) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    uint16_t message_len =
+        sizeof(bm_serial_packet_t) + sizeof(bm_common_config_commit_t);
+
+    if (ctx->cache) {
+      bm_serial_cache_invalidate_partition(ctx->cache, node_id, partition);
     }
 
-    case BM_SERIAL_DFU_RESULT: {
-      if (_callbacks.dfu_end_fn) {
-        bm_serial_dfu_finish_t *dfu_end =
-            (bm_serial_dfu_finish_t *)packet->payload;
-        _callbacks.dfu_end_fn(dfu_end->node_id, dfu_end->success,
-                              dfu_end->dfu_status);
-      }
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_CFG_COMMIT, 0,
+                                    sizeof(bm_common_config_commit_t),
+                                    message_len);
+    if (rval) {
       break;
     }
+    bm_common_config_commit_t *cfg_commit_msg =
+        (bm_common_config_commit_t *)builder.packet->payload;
+    cfg_commit_msg->header.target_node_id = node_id;
+    cfg_commit_msg->header.source_node_id = 0; // UNUSED.
+    cfg_commit_msg->partition = partition;
+    rval = _bm_serial_builder_send(&builder);
+  } while (0);
+  return rval;
+}
 
-    case BM_SERIAL_CFG_GET: {
-      if (_callbacks.cfg_get_fn) {
-        bm_common_config_get_t *cfg_get =
-            (bm_common_config_get_t *)packet->payload;
-        _callbacks.cfg_get_fn(cfg_get->header.target_node_id,
-                              cfg_get->partition, cfg_get->key_length,
-                              cfg_get->key);
-      }
+bm_serial_error_e
+bm_serial_ctx_cfg_status_request(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                 bm_common_config_partition_e partition) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    uint16_t message_len =
+        sizeof(bm_serial_packet_t) + sizeof(bm_common_config_status_request_t);
+
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_CFG_STATUS_REQ, 0,
+                                    sizeof(bm_common_config_status_request_t),
+                                    message_len);
+    if (rval) {
       break;
     }
-    case BM_SERIAL_CFG_SET: {
-      if (_callbacks.cfg_set_fn) {
-        bm_common_config_set_t *cfg_set =
-            (bm_common_config_set_t *)packet->payload;
-        _callbacks.cfg_set_fn(cfg_set->header.target_node_id,
-                              cfg_set->partition, cfg_set->key_length,
-                              (char *)cfg_set->keyAndData, cfg_set->data_length,
-                              &cfg_set->keyAndData[cfg_set->key_length]);
-      }
-      break;
+    bm_common_config_status_request_t *status_req_msg =
+        (bm_common_config_status_request_t *)builder.packet->payload;
+    status_req_msg->header.target_node_id = node_id;
+    status_req_msg->header.source_node_id = 0; // UNUSED.
+    status_req_msg->partition = partition;
+    rval = _bm_serial_builder_send(&builder);
+  } while (0);
+  return rval;
+}
+
+bm_serial_error_e
+bm_serial_ctx_cfg_status_response(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                  bm_common_config_partition_e partition,
+                                  bool commited, uint8_t num_keys, void *keys) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    uint16_t message_len =
+        sizeof(bm_serial_packet_t) + sizeof(bm_common_config_status_response_t);
+    size_t key_data_len = 0;
+    bm_common_config_status_key_data_t *cur_key =
+        (bm_common_config_status_key_data_t *)keys;
+    for (int i = 0; i < num_keys; i++) {
+      key_data_len += sizeof(bm_common_config_status_key_data_t);
+      key_data_len += cur_key->key_length;
+      cur_key +=
+          sizeof(bm_common_config_status_key_data_t) + cur_key->key_length;
     }
-    case BM_SERIAL_CFG_VALUE: {
-      if (_callbacks.cfg_value_fn) {
-        bm_common_config_value_t *cfg_value =
-            (bm_common_config_value_t *)packet->payload;
-        _callbacks.cfg_value_fn(cfg_value->header.source_node_id,
-                                cfg_value->partition, cfg_value->data_length,
-                                cfg_value->data);
-      }
+    message_len += key_data_len;
+
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_CFG_STATUS_RESP, 0,
+                                    sizeof(bm_common_config_status_response_t),
+                                    message_len);
+    if (rval) {
       break;
     }
-    case BM_SERIAL_CFG_COMMIT: {
-      if (_callbacks.cfg_commit_fn) {
-        bm_common_config_commit_t *cfg_commit =
-            (bm_common_config_commit_t *)packet->payload;
-        _callbacks.cfg_commit_fn(cfg_commit->header.target_node_id,
-                                 cfg_commit->partition);
-      }
-      break;
+    bm_common_config_status_response_t *status_resp_msg =
+        (bm_common_config_status_response_t *)builder.packet->payload;
+    status_resp_msg->header.target_node_id = 0;       // UNUSED
+    status_resp_msg->header.source_node_id = node_id; // UNUSED.
+    status_resp_msg->partition = partition;
+    status_resp_msg->committed = commited;
+    status_resp_msg->num_keys = num_keys;
+    _bm_serial_builder_put(&builder, keys, key_data_len);
+    rval = _bm_serial_builder_send(&builder);
+  } while (0);
+  return rval;
+}
+
+bm_serial_error_e
+bm_serial_ctx_cfg_delete_request(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                 bm_common_config_partition_e partition,
+                                 size_t key_len, const char *key) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    uint16_t message_len = sizeof(bm_serial_packet_t) +
+                           sizeof(bm_common_config_delete_key_request_t) +
+                           key_len;
+
+    if (ctx->cache) {
+      bm_serial_cache_invalidate(ctx->cache, node_id, partition, key_len, key);
     }
-    case BM_SERIAL_CFG_STATUS_REQ: {
-      if (_callbacks.cfg_status_request_fn) {
-        bm_common_config_status_request_t *cfg_status_req =
-            (bm_common_config_status_request_t *)packet->payload;
-        _callbacks.cfg_status_request_fn(cfg_status_req->header.target_node_id,
-                                         cfg_status_req->partition);
-      }
+
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(
+        ctx, &builder, BM_SERIAL_CFG_DEL_REQ, 0,
+        sizeof(bm_common_config_delete_key_request_t), message_len);
+    if (rval) {
       break;
     }
-    case BM_SERIAL_CFG_STATUS_RESP: {
-      if (_callbacks.cfg_status_response_fn) {
-        bm_common_config_status_response_t *cfg_status_resp =
-            (bm_common_config_status_response_t *)packet->payload;
-        _callbacks.cfg_status_response_fn(
-            cfg_status_resp->header.source_node_id, cfg_status_resp->partition,
-            cfg_status_resp->committed, cfg_status_resp->num_keys,
-            cfg_status_resp->keyData);
-      }
+    bm_common_config_delete_key_request_t *del_key_req =
+        (bm_common_config_delete_key_request_t *)builder.packet->payload;
+    del_key_req->header.target_node_id = node_id;
+    del_key_req->header.source_node_id = 0; // UNUSED.
+    del_key_req->partition = partition;
+    del_key_req->key_length = key_len;
+    _bm_serial_builder_put(&builder, key, key_len);
+    rval = _bm_serial_builder_send(&builder);
+  } while (0);
+  return rval;
+}
+
+bm_serial_error_e
+bm_serial_ctx_cfg_delete_response(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                  bm_common_config_partition_e partition,
+                                  size_t key_len, const char *key,
+                                  bool success) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    uint16_t message_len = sizeof(bm_serial_packet_t) +
+                           sizeof(bm_common_config_delete_key_response_t) +
+                           key_len;
+
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(
+        ctx, &builder, BM_SERIAL_CFG_DEL_RESP, 0,
+        sizeof(bm_common_config_delete_key_response_t), message_len);
+    if (rval) {
       break;
     }
-    case BM_SERIAL_CFG_DEL_REQ: {
-      if (_callbacks.cfg_key_del_request_fn) {
-        bm_common_config_delete_key_request_t *cfg_del_req =
-            (bm_common_config_delete_key_request_t *)packet->payload;
-        _callbacks.cfg_key_del_request_fn(
-            cfg_del_req->header.target_node_id, cfg_del_req->partition,
-            cfg_del_req->key_length, cfg_del_req->key);
-      }
+    bm_common_config_delete_key_response_t *del_key_resp =
+        (bm_common_config_delete_key_response_t *)builder.packet->payload;
+    del_key_resp->header.target_node_id = 0; // UNUSED
+    del_key_resp->header.source_node_id = node_id;
+    del_key_resp->partition = partition;
+    del_key_resp->success = success;
+    del_key_resp->key_length = key_len;
+    _bm_serial_builder_put(&builder, key, key_len);
+    rval = _bm_serial_builder_send(&builder);
+  } while (0);
+  return rval;
+}
+
+bm_serial_error_e bm_serial_ctx_send_info_request(bm_serial_ctx_t *ctx,
+                                                  uint64_t node_id) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    uint16_t message_len =
+        sizeof(bm_serial_packet_t) + sizeof(bm_serial_device_info_request_t);
+
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_DEVICE_INFO_REQ, 0,
+                                    sizeof(bm_serial_device_info_request_t),
+                                    message_len);
+    if (rval) {
       break;
     }
-    case BM_SERIAL_CFG_DEL_RESP: {
-      if (_callbacks.cfg_key_del_response_fn) {
-        bm_common_config_delete_key_response_t *cfg_del_resp =
-            (bm_common_config_delete_key_response_t *)packet->payload;
-        _callbacks.cfg_key_del_response_fn(
-            cfg_del_resp->header.source_node_id, cfg_del_resp->partition,
-            cfg_del_resp->key_length, cfg_del_resp->key, cfg_del_resp->success);
-      }
+    bm_serial_device_info_request_t *device_info_req_msg =
+        (bm_serial_device_info_request_t *)builder.packet->payload;
+    device_info_req_msg->target_node_id = node_id;
+    rval = _bm_serial_builder_send(&builder);
+  } while (0);
+  return rval;
+}
+
+bm_serial_error_e
+bm_serial_ctx_send_info_reply(bm_serial_ctx_t *ctx, uint64_t node_id,
+                              bm_serial_device_info_reply_t *bcmp_info) {
+  (void)node_id;
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    size_t info_len = sizeof(bm_serial_device_info_reply_t) +
+                      bcmp_info->dev_name_len + bcmp_info->ver_str_len;
+    uint16_t message_len = sizeof(bm_serial_packet_t) + info_len;
+
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_DEVICE_INFO_REPLY,
+                                    0, 0, message_len);
+    if (rval) {
+      break;
+    }
+    _bm_serial_builder_put(&builder, bcmp_info, info_len);
+    rval = _bm_serial_builder_send(&builder);
+  } while (0);
+  return rval;
+}
+
+bm_serial_error_e bm_serial_ctx_send_resource_request(bm_serial_ctx_t *ctx,
+                                                      uint64_t node_id) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    uint16_t message_len =
+        sizeof(bm_serial_packet_t) + sizeof(bm_serial_resource_table_request_t);
+
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_RESOURCE_REQ, 0,
+                                    sizeof(bm_serial_resource_table_request_t),
+                                    message_len);
+    if (rval) {
       break;
     }
-    case BM_SERIAL_NETWORK_INFO: {
-      if (_callbacks.network_info_fn) {
-        bm_common_network_info_t *network_info =
-            (bm_common_network_info_t *)packet->payload;
-        _callbacks.network_info_fn(network_info);
+    bm_serial_resource_table_request_t *resource_req_msg =
+        (bm_serial_resource_table_request_t *)builder.packet->payload;
+    resource_req_msg->target_node_id = node_id;
+    rval = _bm_serial_builder_send(&builder);
+  } while (0);
+  return rval;
+}
+
+// TODO - This struct is defined in bcmp_messages.h, but that is not included in
+// this repo yet. We should eventually include it, or have this struct moved
+// into the common messages repo. Perhaps this can happen when we do this
+// ticket: SC-195824
+typedef struct {
+  // Length of resource name
+  uint16_t resource_len;
+  // Name of resource
+  char resource[0];
+} __attribute__((packed)) bcmp_resource_t;
+
+bm_serial_error_e bm_serial_ctx_send_resource_reply(
+    bm_serial_ctx_t *ctx, uint64_t node_id,
+    bm_serial_resource_table_reply_t *bcmp_resource) {
+  (void)node_id;
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  do {
+    uint16_t message_len =
+        sizeof(bm_serial_packet_t) + sizeof(bm_serial_resource_table_reply_t);
+
+    size_t length_of_resources = 0;
+    uint16_t num_pubs = bcmp_resource->num_pubs;
+    while (num_pubs) {
+      bcmp_resource_t *cur_resource =
+          (bcmp_resource_t *)(&bcmp_resource
+                                   ->resource_list[length_of_resources]);
+      length_of_resources +=
+          (sizeof(bcmp_resource_t) + cur_resource->resource_len);
+      num_pubs--;
+    }
+    uint16_t num_subs = bcmp_resource->num_subs;
+    while (num_subs) {
+      bcmp_resource_t *cur_resource =
+          (bcmp_resource_t *)(&bcmp_resource
+                                   ->resource_list[length_of_resources]);
+      length_of_resources +=
+          (sizeof(bcmp_resource_t) + cur_resource->resource_len);
+      num_subs--;
+    }
+
+    message_len += length_of_resources;
+
+    bm_serial_builder_t builder;
+    rval = _bm_serial_builder_start(ctx, &builder, BM_SERIAL_RESOURCE_REPLY, 0,
+                                    0, message_len);
+    if (rval) {
+      break;
+    }
+    _bm_serial_builder_put(&builder, bcmp_resource,
+                           sizeof(bm_serial_resource_table_reply_t) +
+                               length_of_resources);
+    rval = _bm_serial_builder_send(&builder);
+  } while (0);
+  return rval;
+}
+
+/*!
+  Pass a received pub to the router, or to pub_fn if it has no handler for it
+
+  \param[in] *ctx bm_serial instance
+  \param[in] *topic topic
+  \param[in] topic_len topic length
+  \param[in] node_id publisher
+  \param[in] *payload pub data
+  \param[in] len pub data length
+  \param[in] type pub type
+  \param[in] version pub version
+  \return none
+*/
+static void _bm_serial_deliver_pub(bm_serial_ctx_t *ctx, const char *topic,
+                                   uint16_t topic_len, uint64_t node_id,
+                                   const uint8_t *payload, size_t len,
+                                   uint8_t type, uint8_t version) {
+  if (ctx->router &&
+      bm_serial_router_route(ctx->router, topic, topic_len, node_id, payload,
+                             len, type, version)) {
+    return;
+  }
+
+  if (ctx->callbacks.pub_fn) {
+    ctx->callbacks.pub_fn(topic, topic_len, node_id, payload, len, type,
+                          version);
+  }
+}
+
+//
+// Built-in message handlers, called from _bm_serial_dispatch() with the crc
+// checked and at least the message's min_len payload bytes
+//
+
+static bm_serial_error_e _bm_serial_rx_debug(bm_serial_ctx_t *ctx,
+                                             bm_serial_packet_t *packet,
+                                             size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+
+  if (callbacks->debug_fn) {
+    callbacks->debug_fn(packet->payload, len - sizeof(bm_serial_packet_t));
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_pub(bm_serial_ctx_t *ctx,
+                                           bm_serial_packet_t *packet,
+                                           size_t len) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+
+  do {
+    if (!callbacks->pub_fn && !ctx->router) {
+      break;
+    }
+
+    bm_serial_pub_header_t *pub_header =
+        (bm_serial_pub_header_t *)packet->payload;
+
+    // Protect against topic length being incorrect
+    // (would result in overflow when subtracting from len to determine data
+    // len)
+    uint32_t non_data_len = sizeof(bm_serial_packet_t) +
+                            sizeof(bm_serial_pub_header_t) +
+                            pub_header->topic_len;
+    if (non_data_len > len) {
+      rval = BM_SERIAL_INVALID_TOPIC_LEN;
+      break;
+    }
+
+    uint32_t data_len = len - non_data_len;
+    _bm_serial_deliver_pub(ctx, (const char *)pub_header->topic,
+                           pub_header->topic_len, pub_header->node_id,
+                           &pub_header->topic[pub_header->topic_len],
+                           data_len, pub_header->type, pub_header->version);
+
+  } while (0);
+
+  return rval;
+}
+
+static bm_serial_error_e _bm_serial_rx_pub_alias(bm_serial_ctx_t *ctx,
+                                                 bm_serial_packet_t *packet,
+                                                 size_t len) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    bm_serial_pub_alias_header_t *pub_header =
+        (bm_serial_pub_alias_header_t *)packet->payload;
+
+    uint32_t non_data_len = sizeof(bm_serial_packet_t) +
+                            sizeof(bm_serial_pub_alias_header_t) +
+                            pub_header->topic_len;
+    if (non_data_len > len || pub_header->topic_len > MAX_TOPIC_LEN) {
+      rval = BM_SERIAL_INVALID_TOPIC_LEN;
+      break;
+    }
+
+    const char *topic = (const char *)pub_header->topic;
+    uint16_t topic_len = pub_header->topic_len;
+    if (topic_len) {
+      if (ctx->alias) {
+        bm_serial_alias_rx_set(ctx->alias, pub_header->alias,
+                               pub_header->generation, topic, topic_len);
+      }
+    } else {
+      topic = ctx->alias ? bm_serial_alias_rx_get(
+                               ctx->alias, pub_header->alias,
+                               pub_header->generation, &topic_len)
+                         : NULL;
+      if (!topic) {
+        // Ask for the topic again, this pub is lost
+        if (ctx->alias) {
+          _bm_serial_alias_reset(ctx, pub_header->alias);
+        }
+        rval = BM_SERIAL_UNKNOWN_ALIAS;
+        break;
+      }
+    }
+
+    _bm_serial_deliver_pub(ctx, topic, topic_len, pub_header->node_id,
+                           &pub_header->topic[pub_header->topic_len],
+                           len - non_data_len, pub_header->type,
+                           pub_header->version);
+
+  } while (0);
+
+  return rval;
+}
+
+static bm_serial_error_e _bm_serial_rx_alias_reset(bm_serial_ctx_t *ctx,
+                                                   bm_serial_packet_t *packet,
+                                                   size_t len) {
+  (void)len;
+
+  if (ctx->alias) {
+    bm_serial_alias_reset_t *reset =
+        (bm_serial_alias_reset_t *)packet->payload;
+    bm_serial_alias_tx_reset(ctx->alias, reset->alias);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_sub(bm_serial_ctx_t *ctx,
+                                           bm_serial_packet_t *packet,
+                                           size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->sub_fn) {
+    bm_serial_sub_unsub_header_t *sub_header =
+        (bm_serial_sub_unsub_header_t *)packet->payload;
+    callbacks->sub_fn((const char *)sub_header->topic, sub_header->topic_len);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_unsub(bm_serial_ctx_t *ctx,
+                                             bm_serial_packet_t *packet,
+                                             size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->unsub_fn) {
+    bm_serial_sub_unsub_header_t *unsub_header =
+        (bm_serial_sub_unsub_header_t *)packet->payload;
+    callbacks->unsub_fn((const char *)unsub_header->topic,
+                        unsub_header->topic_len);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_log(bm_serial_ctx_t *ctx,
+                                           bm_serial_packet_t *packet,
+                                           size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+
+  if (callbacks->log_fn) {
+    // TODO - decode and use actual topic
+    callbacks->log_fn(0, packet->payload, len - sizeof(bm_serial_packet_t));
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_net_msg(bm_serial_ctx_t *ctx,
+                                               bm_serial_packet_t *packet,
+                                               size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+
+  if (callbacks->net_msg_fn) {
+    bm_serial_net_msg_header_t *net_msg =
+        (bm_serial_net_msg_header_t *)packet->payload;
+
+    uint32_t data_len = len - sizeof(bm_serial_packet_t) -
+                        sizeof(bm_serial_net_msg_header_t);
+    callbacks->net_msg_fn(net_msg->node_id, net_msg->data, data_len);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_rtc_set(bm_serial_ctx_t *ctx,
+                                               bm_serial_packet_t *packet,
+                                               size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->rtc_set_fn) {
+    bm_serial_rtc_t *rtc_msg = (bm_serial_rtc_t *)packet->payload;
+    callbacks->rtc_set_fn(&rtc_msg->time);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_self_test(bm_serial_ctx_t *ctx,
+                                                 bm_serial_packet_t *packet,
+                                                 size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->self_test_fn) {
+    bm_serial_self_test_t *self_test =
+        (bm_serial_self_test_t *)packet->payload;
+    callbacks->self_test_fn(self_test->node_id, self_test->result);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_reboot_info(bm_serial_ctx_t *ctx,
+                                                   bm_serial_packet_t *packet,
+                                                   size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->reboot_info_fn) {
+    bm_serial_reboot_info_t *reboot_info =
+        (bm_serial_reboot_info_t *)packet->payload;
+    callbacks->reboot_info_fn(
+        reboot_info->node_id, reboot_info->reboot_reason,
+        reboot_info->gitSHA, reboot_info->reboot_count,
+        reboot_info->pc, reboot_info->lr);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_dfu_start(bm_serial_ctx_t *ctx,
+                                                 bm_serial_packet_t *packet,
+                                                 size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->dfu_start_fn) {
+    bm_serial_dfu_start_t *dfu_start =
+        (bm_serial_dfu_start_t *)packet->payload;
+    callbacks->dfu_start_fn(dfu_start);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_dfu_chunk(bm_serial_ctx_t *ctx,
+                                                 bm_serial_packet_t *packet,
+                                                 size_t len) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+
+  do {
+    bm_serial_dfu_chunk_t *dfu_chunk =
+        (bm_serial_dfu_chunk_t *)packet->payload;
+
+    // NAKs carry the length being asked for, not data
+    if (!(dfu_chunk->offset & DFU_CHUNK_NAK_BITFLAG) &&
+        dfu_chunk->length > len - sizeof(bm_serial_packet_t) -
+                                sizeof(bm_serial_dfu_chunk_t)) {
+      rval = BM_SERIAL_INVALID_MSG_LEN;
+      break;
+    }
+
+    if (callbacks->dfu_chunk_fn) {
+      callbacks->dfu_chunk_fn(dfu_chunk->offset, dfu_chunk->length,
+                              dfu_chunk->data);
+    }
+
+  } while (0);
+
+  return rval;
+}
+
+static bm_serial_error_e _bm_serial_rx_dfu_result(bm_serial_ctx_t *ctx,
+                                                  bm_serial_packet_t *packet,
+                                                  size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->dfu_end_fn) {
+    bm_serial_dfu_finish_t *dfu_end =
+        (bm_serial_dfu_finish_t *)packet->payload;
+    callbacks->dfu_end_fn(dfu_end->node_id, dfu_end->success,
+                          dfu_end->dfu_status);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_cfg_get(bm_serial_ctx_t *ctx,
+                                               bm_serial_packet_t *packet,
+                                               size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->cfg_get_fn) {
+    bm_common_config_get_t *cfg_get =
+        (bm_common_config_get_t *)packet->payload;
+    callbacks->cfg_get_fn(cfg_get->header.target_node_id,
+                          cfg_get->partition, cfg_get->key_length,
+                          cfg_get->key);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_cfg_set(bm_serial_ctx_t *ctx,
+                                               bm_serial_packet_t *packet,
+                                               size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->cfg_set_fn) {
+    bm_common_config_set_t *cfg_set =
+        (bm_common_config_set_t *)packet->payload;
+    callbacks->cfg_set_fn(cfg_set->header.target_node_id,
+                          cfg_set->partition, cfg_set->key_length,
+                          (char *)cfg_set->keyAndData, cfg_set->data_length,
+                          &cfg_set->keyAndData[cfg_set->key_length]);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_cfg_value(bm_serial_ctx_t *ctx,
+                                                 bm_serial_packet_t *packet,
+                                                 size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->cfg_value_fn) {
+    bm_common_config_value_t *cfg_value =
+        (bm_common_config_value_t *)packet->payload;
+    callbacks->cfg_value_fn(cfg_value->header.source_node_id,
+                            cfg_value->partition, cfg_value->data_length,
+                            cfg_value->data);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_cfg_commit(bm_serial_ctx_t *ctx,
+                                                  bm_serial_packet_t *packet,
+                                                  size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->cfg_commit_fn) {
+    bm_common_config_commit_t *cfg_commit =
+        (bm_common_config_commit_t *)packet->payload;
+    callbacks->cfg_commit_fn(cfg_commit->header.target_node_id,
+                             cfg_commit->partition);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e
+_bm_serial_rx_cfg_status_req(bm_serial_ctx_t *ctx, bm_serial_packet_t *packet,
+                             size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->cfg_status_request_fn) {
+    bm_common_config_status_request_t *cfg_status_req =
+        (bm_common_config_status_request_t *)packet->payload;
+    callbacks->cfg_status_request_fn(cfg_status_req->header.target_node_id,
+                                     cfg_status_req->partition);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e
+_bm_serial_rx_cfg_status_resp(bm_serial_ctx_t *ctx, bm_serial_packet_t *packet,
+                              size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->cfg_status_response_fn) {
+    bm_common_config_status_response_t *cfg_status_resp =
+        (bm_common_config_status_response_t *)packet->payload;
+    callbacks->cfg_status_response_fn(
+        cfg_status_resp->header.source_node_id, cfg_status_resp->partition,
+        cfg_status_resp->committed, cfg_status_resp->num_keys,
+        cfg_status_resp->keyData);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_cfg_del_req(bm_serial_ctx_t *ctx,
+                                                   bm_serial_packet_t *packet,
+                                                   size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->cfg_key_del_request_fn) {
+    bm_common_config_delete_key_request_t *cfg_del_req =
+        (bm_common_config_delete_key_request_t *)packet->payload;
+    callbacks->cfg_key_del_request_fn(
+        cfg_del_req->header.target_node_id, cfg_del_req->partition,
+        cfg_del_req->key_length, cfg_del_req->key);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_cfg_del_resp(bm_serial_ctx_t *ctx,
+                                                    bm_serial_packet_t *packet,
+                                                    size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->cfg_key_del_response_fn) {
+    bm_common_config_delete_key_response_t *cfg_del_resp =
+        (bm_common_config_delete_key_response_t *)packet->payload;
+    callbacks->cfg_key_del_response_fn(
+        cfg_del_resp->header.source_node_id, cfg_del_resp->partition,
+        cfg_del_resp->key_length, cfg_del_resp->key, cfg_del_resp->success);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_network_info(bm_serial_ctx_t *ctx,
+                                                    bm_serial_packet_t *packet,
+                                                    size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+
+  if (ctx->topo) {
+    // Dropped network infos are counted in the topology stats, the callback
+    // still gets them
+    bm_serial_topo_rx(ctx->topo, packet->payload,
+                      len - sizeof(bm_serial_packet_t));
+  }
+
+  if (callbacks->network_info_fn) {
+    bm_common_network_info_t *network_info =
+        (bm_common_network_info_t *)packet->payload;
+    callbacks->network_info_fn(network_info);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e
+_bm_serial_rx_device_info_req(bm_serial_ctx_t *ctx, bm_serial_packet_t *packet,
+                              size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->bcmp_info_request_fn) {
+    bm_serial_device_info_request_t *info_req =
+        (bm_serial_device_info_request_t *)packet->payload;
+    callbacks->bcmp_info_request_fn(info_req->target_node_id);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e
+_bm_serial_rx_device_info_reply(bm_serial_ctx_t *ctx,
+                                bm_serial_packet_t *packet, size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->bcmp_info_response_fn) {
+    bm_serial_device_info_reply_t *info_reply =
+        (bm_serial_device_info_reply_t *)packet->payload;
+    callbacks->bcmp_info_response_fn(info_reply->info.node_id, info_reply);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e _bm_serial_rx_resource_req(bm_serial_ctx_t *ctx,
+                                                    bm_serial_packet_t *packet,
+                                                    size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->bcmp_resource_request_fn) {
+    bm_serial_resource_table_request_t *resource_req =
+        (bm_serial_resource_table_request_t *)packet->payload;
+    callbacks->bcmp_resource_request_fn(resource_req->target_node_id);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_error_e
+_bm_serial_rx_resource_reply(bm_serial_ctx_t *ctx, bm_serial_packet_t *packet,
+                             size_t len) {
+  bm_serial_callbacks_t *callbacks = &ctx->callbacks;
+  (void)len;
+
+  if (callbacks->bcmp_resource_response_fn) {
+    bm_serial_resource_table_reply_t *resource_reply =
+        (bm_serial_resource_table_reply_t *)packet->payload;
+    callbacks->bcmp_resource_response_fn(resource_reply->node_id,
+                                         resource_reply);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+typedef struct {
+  bm_serial_error_e (*fn)(bm_serial_ctx_t *ctx, bm_serial_packet_t *packet,
+                          size_t len);
+  // Shortest valid payload
+  uint16_t min_len;
+} bm_serial_builtin_msg_t;
+
+// Built-in message types (BM_SERIAL_ACK and BM_SERIAL_BATCH are handled in
+// bm_serial_ctx_process_packet())
+#define BM_SERIAL_BUILTIN_MSGS (BM_SERIAL_RESOURCE_REPLY + 1)
+
+static const bm_serial_builtin_msg_t
+    _bm_serial_builtin_msgs[BM_SERIAL_BUILTIN_MSGS] = {
+  [BM_SERIAL_DEBUG] = {_bm_serial_rx_debug, 0},
+  [BM_SERIAL_PUB] = {_bm_serial_rx_pub, sizeof(bm_serial_pub_header_t)},
+  [BM_SERIAL_SUB] = {_bm_serial_rx_sub, sizeof(bm_serial_sub_unsub_header_t)},
+  [BM_SERIAL_UNSUB] = {_bm_serial_rx_unsub,
+                       sizeof(bm_serial_sub_unsub_header_t)},
+  [BM_SERIAL_LOG] = {_bm_serial_rx_log, 0},
+  [BM_SERIAL_NET_MSG] = {_bm_serial_rx_net_msg,
+                         sizeof(bm_serial_net_msg_header_t)},
+  [BM_SERIAL_RTC_SET] = {_bm_serial_rx_rtc_set, sizeof(bm_serial_rtc_t)},
+  [BM_SERIAL_SELF_TEST] = {_bm_serial_rx_self_test,
+                           sizeof(bm_serial_self_test_t)},
+  [BM_SERIAL_NETWORK_INFO] = {_bm_serial_rx_network_info,
+                              sizeof(bm_common_network_info_t)},
+  [BM_SERIAL_REBOOT_INFO] = {_bm_serial_rx_reboot_info,
+                             sizeof(bm_serial_reboot_info_t)},
+  [BM_SERIAL_PUB_ALIAS] = {_bm_serial_rx_pub_alias,
+                           sizeof(bm_serial_pub_alias_header_t)},
+  [BM_SERIAL_ALIAS_RESET] = {_bm_serial_rx_alias_reset,
+                             sizeof(bm_serial_alias_reset_t)},
+  [BM_SERIAL_DFU_START] = {_bm_serial_rx_dfu_start,
+                           sizeof(bm_serial_dfu_start_t)},
+  [BM_SERIAL_DFU_CHUNK] = {_bm_serial_rx_dfu_chunk,
+                           sizeof(bm_serial_dfu_chunk_t)},
+  [BM_SERIAL_DFU_RESULT] = {_bm_serial_rx_dfu_result,
+                            sizeof(bm_serial_dfu_finish_t)},
+  [BM_SERIAL_CFG_GET] = {_bm_serial_rx_cfg_get, sizeof(bm_common_config_get_t)},
+  [BM_SERIAL_CFG_SET] = {_bm_serial_rx_cfg_set, sizeof(bm_common_config_set_t)},
+  [BM_SERIAL_CFG_VALUE] = {_bm_serial_rx_cfg_value,
+                           sizeof(bm_common_config_value_t)},
+  [BM_SERIAL_CFG_COMMIT] = {_bm_serial_rx_cfg_commit,
+                            sizeof(bm_common_config_commit_t)},
+  [BM_SERIAL_CFG_STATUS_REQ] = {_bm_serial_rx_cfg_status_req,
+                                sizeof(bm_common_config_status_request_t)},
+  [BM_SERIAL_CFG_STATUS_RESP] = {_bm_serial_rx_cfg_status_resp,
+                                 sizeof(bm_common_config_status_response_t)},
+  [BM_SERIAL_CFG_DEL_REQ] = {_bm_serial_rx_cfg_del_req,
+                             sizeof(bm_common_config_delete_key_request_t)},
+  [BM_SERIAL_CFG_DEL_RESP] = {_bm_serial_rx_cfg_del_resp,
+                              sizeof(bm_common_config_delete_key_response_t)},
+  [BM_SERIAL_DEVICE_INFO_REQ] = {_bm_serial_rx_device_info_req,
+                                 sizeof(bm_serial_device_info_request_t)},
+  [BM_SERIAL_DEVICE_INFO_REPLY] = {_bm_serial_rx_device_info_reply,
+                                   sizeof(bm_serial_device_info_reply_t)},
+  [BM_SERIAL_RESOURCE_REQ] = {_bm_serial_rx_resource_req,
+                              sizeof(bm_serial_resource_table_request_t)},
+  [BM_SERIAL_RESOURCE_REPLY] = {_bm_serial_rx_resource_reply,
+                                sizeof(bm_serial_resource_table_reply_t)},
+};
+
+/*!
+  Pass a received message to its handler. Built-in types go to their
+  callbacks, other types to the handlers registered with
+  bm_serial_ctx_register_msg().
+
+  \param[in] *ctx bm_serial instance
+  \param[in] *packet message, crc already checked
+  \param[in] len message length, including the bm_serial_packet_t header
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+static bm_serial_error_e _bm_serial_dispatch(bm_serial_ctx_t *ctx,
+                                             bm_serial_packet_t *packet,
+                                             size_t len) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  size_t payload_len = len - sizeof(bm_serial_packet_t);
+
+  do {
+    if (packet->type < BM_SERIAL_BUILTIN_MSGS &&
+        _bm_serial_builtin_msgs[packet->type].fn) {
+      const bm_serial_builtin_msg_t *msg =
+          &_bm_serial_builtin_msgs[packet->type];
+      if (payload_len < msg->min_len) {
+        rval = BM_SERIAL_INVALID_MSG_LEN;
+        break;
+      }
+      if (ctx->corr) {
+        bm_serial_corr_rx(ctx->corr, packet->type, packet->payload,
+                          payload_len);
       }
+      if (ctx->cache) {
+        bm_serial_cache_rx(ctx->cache, packet->type, packet->payload,
+                           payload_len);
+      }
+      if (ctx->rx_hook && ctx->rx_hook(ctx->rx_hook_arg, packet->type,
+                                       packet->payload, payload_len)) {
+        break;
+      }
+      rval = msg->fn(ctx, packet, len);
       break;
     }
-    case BM_SERIAL_DEVICE_INFO_REQ: {
-      if (_callbacks.bcmp_info_request_fn) {
-        bm_serial_device_info_request_t *info_req =
-            (bm_serial_device_info_request_t *)packet->payload;
-        _callbacks.bcmp_info_request_fn(info_req->target_node_id);
-      }
+
+    const bm_serial_msg_handler_t *handler =
+        ctx->msgs ? &ctx->msgs->handlers[packet->type] : NULL;
+    if (!handler || !handler->fn) {
+      rval = BM_SERIAL_UNSUPPORTED_MSG;
       break;
     }
-    case BM_SERIAL_DEVICE_INFO_REPLY: {
-      if (_callbacks.bcmp_info_response_fn) {
-        bm_serial_device_info_reply_t *info_reply =
-            (bm_serial_device_info_reply_t *)packet->payload;
-        _callbacks.bcmp_info_response_fn(info_reply->info.node_id, info_reply);
-      }
+
+    if (payload_len < handler->min_len) {
+      rval = BM_SERIAL_INVALID_MSG_LEN;
       break;
     }
-    case BM_SERIAL_RESOURCE_REQ: {
-      if (_callbacks.bcmp_resource_request_fn) {
-        bm_serial_resource_table_request_t *resource_req =
-            (bm_serial_resource_table_request_t *)packet->payload;
-        _callbacks.bcmp_resource_request_fn(resource_req->target_node_id);
-      }
+
+    if (handler->validate_fn &&
+        !handler->validate_fn(packet->payload, payload_len)) {
+      rval = BM_SERIAL_INVALID_MSG;
       break;
     }
-    case BM_SERIAL_RESOURCE_REPLY: {
-      if (_callbacks.bcmp_resource_response_fn) {
-        bm_serial_resource_table_reply_t *resource_reply =
-            (bm_serial_resource_table_reply_t *)packet->payload;
-        _callbacks.bcmp_resource_response_fn(resource_reply->node_id,
-                                             resource_reply);
-      }
+
+    handler->fn(handler->arg, packet->type, packet->payload, payload_len);
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Set the table for application defined message types, clearing it
+
+  \param[in] *ctx bm_serial instance
+  \param[in] *msgs table, NULL to drop application defined messages
+  \return none
+*/
+void bm_serial_ctx_set_msg_table(bm_serial_ctx_t *ctx,
+                                 bm_serial_msg_table_t *msgs) {
+  if (msgs) {
+    memset(msgs, 0, sizeof(bm_serial_msg_table_t));
+  }
+  ctx->msgs = msgs;
+}
+
+/*!
+  Register the handler for an application defined message type, replacing the
+  previous one. Send these messages with bm_serial_ctx_tx().
+
+  \param[in] *ctx bm_serial instance, with a table set
+             (bm_serial_ctx_set_msg_table())
+  \param[in] type message type, one bm_serial doesn't use (preferably
+             BM_SERIAL_APP_MSG_FIRST or up)
+  \param[in] *handler handler (copied), NULL to remove it
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e
+bm_serial_ctx_register_msg(bm_serial_ctx_t *ctx, uint8_t type,
+                           const bm_serial_msg_handler_t *handler) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!ctx || !ctx->msgs || (handler && !handler->fn)) {
+      rval = BM_SERIAL_NULL_BUFF;
       break;
     }
-    default: {
+
+    if (type == BM_SERIAL_ACK || type == BM_SERIAL_BATCH ||
+        (type < BM_SERIAL_BUILTIN_MSGS && _bm_serial_builtin_msgs[type].fn)) {
       rval = BM_SERIAL_UNSUPPORTED_MSG;
       break;
     }
+
+    if (handler) {
+      ctx->msgs->handlers[type] = *handler;
+    } else {
+      memset(&ctx->msgs->handlers[type], 0, sizeof(bm_serial_msg_handler_t));
+    }
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Set a hook that sees every built-in message received (after its length is
+  checked) before the message's callback. Lets wrappers pick out the replies
+  they're waiting for without taking over the callbacks.
+
+  \param[in] *ctx bm_serial instance
+  \param[in] fn hook, returns true to consume the message (its callback isn't
+             called), NULL to remove it
+  \param[in] *arg argument passed to fn
+  \return none
+*/
+void bm_serial_ctx_set_rx_hook(bm_serial_ctx_t *ctx, bm_serial_rx_hook_fn fn,
+                               void *arg) {
+  ctx->rx_hook = fn;
+  ctx->rx_hook_arg = arg;
+}
+
+/*!
+  Pass every message in a batch to its callback, straight from the received
+  buffer. Entries are laid out like packets (see bm_serial_batch_entry_t).
+
+  \param[in] *ctx bm_serial instance
+  \param[in] *packet BM_SERIAL_BATCH packet, crc already checked
+  \param[in] len packet length, including the bm_serial_packet_t header
+  \return BM_SERIAL_OK if every message was ok, the first error otherwise
+*/
+static bm_serial_error_e _bm_serial_dispatch_batch(bm_serial_ctx_t *ctx,
+                                                   bm_serial_packet_t *packet,
+                                                   size_t len) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  size_t offset = 0;
+  size_t payload_len = len - sizeof(bm_serial_packet_t);
+  // Header repeated pubs use
+  bm_serial_pub_header_t *last_pub = NULL;
+
+  while (offset < payload_len) {
+    if (payload_len - offset < sizeof(bm_serial_batch_entry_t)) {
+      rval = BM_SERIAL_INVALID_MSG_LEN;
+      break;
+    }
+
+    bm_serial_batch_entry_t *entry =
+        (bm_serial_batch_entry_t *)&packet->payload[offset];
+    size_t entry_len = sizeof(bm_serial_batch_entry_t) + entry->len;
+    if (entry_len > payload_len - offset) {
+      rval = BM_SERIAL_INVALID_MSG_LEN;
+      break;
+    }
+    offset += entry_len;
+
+    // Batches don't nest and acks are never batched
+    bm_serial_error_e entry_rval = BM_SERIAL_UNSUPPORTED_MSG;
+    if (entry->flags & BM_SERIAL_BATCH_FLAG_REPEAT) {
+      if (entry->type == BM_SERIAL_PUB && last_pub) {
+        entry_rval = BM_SERIAL_OK;
+        _bm_serial_deliver_pub(ctx, (const char *)last_pub->topic,
+                               last_pub->topic_len, last_pub->node_id,
+                               entry->payload, entry->len, last_pub->type,
+                               last_pub->version);
+      }
+    } else if (entry->type != BM_SERIAL_BATCH &&
+               entry->type != BM_SERIAL_ACK) {
+      entry_rval =
+          _bm_serial_dispatch(ctx, (bm_serial_packet_t *)entry, entry_len);
+      if (entry->type == BM_SERIAL_PUB && !entry_rval) {
+        last_pub = (bm_serial_pub_header_t *)entry->payload;
+      }
+    }
+    if (entry_rval && !rval) {
+      rval = entry_rval;
+    }
+  }
+
+  return rval;
+}
+
+// Process bm_serial packet (not COBS anymore!)
+// Use bm_serial_cobs_rx_feed() to process a raw COBS encoded byte stream
+bm_serial_error_e bm_serial_ctx_process_packet(bm_serial_ctx_t *ctx,
+                                               bm_serial_packet_t *packet,
+                                               size_t len) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  // calc the crc16 and compare
+  uint16_t crc16_pre = packet->crc16;
+  packet->crc16 = 0;
+  do {
+    uint16_t crc16_post = bm_serial_crc16_ccitt(0, (uint8_t *)packet, len);
+
+    if (crc16_post != crc16_pre) {
+      rval = BM_SERIAL_CRC_ERR;
+      break;
+    }
+
+    if (ctx->rel) {
+      if (packet->type == BM_SERIAL_ACK) {
+        rval = bm_serial_rel_rx_ack(ctx->rel, packet->payload,
+                                    len - sizeof(bm_serial_packet_t));
+        break;
+      }
+
+      // Duplicates are acknowledged again, but not passed on
+      if ((packet->flags & BM_SERIAL_FLAG_SEQ) &&
+          !bm_serial_rel_rx_seq(ctx->rel, packet->flags)) {
+        break;
+      }
+    }
+
+    if (packet->flags & BM_SERIAL_FLAG_COMPRESSED) {
+      if (!ctx->lz) {
+        rval = BM_SERIAL_UNSUPPORTED_MSG;
+        break;
+      }
+
+      packet = bm_serial_lz_rx(ctx->lz, packet, &len);
+      if (!packet) {
+        rval = BM_SERIAL_COMPRESSION_ERR;
+        break;
+      }
+    }
+
+    if (packet->type == BM_SERIAL_BATCH) {
+      rval = _bm_serial_dispatch_batch(ctx, packet, len);
+    } else {
+      rval = _bm_serial_dispatch(ctx, packet, len);
     }
 
   } while (0);
 
+  if (rval) {
+    ctx->stats.rx_errors++;
+  } else {
+    ctx->stats.rx_packets++;
+  }
+
   return rval;
 }
+
+//
+// Default instance, for applications with a single serial link
+//
+
+void bm_serial_set_callbacks(bm_serial_callbacks_t *callbacks) {
+  bm_serial_ctx_set_callbacks(&_default_ctx, callbacks);
+}
+
+void bm_serial_set_cobs_tx(bool enable) {
+  bm_serial_ctx_set_cobs_tx(&_default_ctx, enable);
+}
+
+bm_serial_ctx_t *bm_serial_get_default_ctx(void) { return &_default_ctx; }
+
+bm_serial_error_e bm_serial_process_packet(bm_serial_packet_t *packet,
+                                           size_t len) {
+  return bm_serial_ctx_process_packet(&_default_ctx, packet, len);
+}
+
+bm_serial_error_e bm_serial_tx(bm_serial_message_t type, const uint8_t *payload,
+                               size_t len) {
+  return bm_serial_ctx_tx(&_default_ctx, type, payload, len);
+}
+
+bm_serial_error_e bm_serial_pub(uint64_t node_id, const char *topic,
+                                uint16_t topic_len, const uint8_t *data,
+                                uint16_t data_len, uint8_t type,
+                                uint8_t version) {
+  return bm_serial_ctx_pub(&_default_ctx, node_id, topic, topic_len, data,
+                           data_len, type, version);
+}
+
+bm_serial_error_e bm_serial_pub_reserve(uint64_t node_id, const char *topic,
+                                        uint16_t topic_len, uint16_t data_len,
+                                        uint8_t type, uint8_t version,
+                                        uint8_t **data) {
+  return bm_serial_ctx_pub_reserve(&_default_ctx, node_id, topic, topic_len,
+                                   data_len, type, version, data);
+}
+
+bm_serial_error_e bm_serial_commit(void) {
+  return bm_serial_ctx_commit(&_default_ctx);
+}
+
+void bm_serial_reserve_abort(void) {
+  bm_serial_ctx_reserve_abort(&_default_ctx);
+}
+
+bm_serial_error_e bm_serial_sub(const char *topic, uint16_t topic_len) {
+  return bm_serial_ctx_sub(&_default_ctx, topic, topic_len);
+}
+
+bm_serial_error_e bm_serial_unsub(const char *topic, uint16_t topic_len) {
+  return bm_serial_ctx_unsub(&_default_ctx, topic, topic_len);
+}
+
+bm_serial_error_e bm_serial_set_rtc(bm_serial_time_t *time) {
+  return bm_serial_ctx_set_rtc(&_default_ctx, time);
+}
+
+bm_serial_error_e bm_serial_send_network_info(
+    uint32_t network_crc32, bm_common_config_crc_t *config_crc,
+    bm_common_fw_version_t *fw_info, uint16_t num_nodes, uint64_t *node_id_list,
+    uint16_t config_map_size, uint8_t *cbor_config_map) {
+  return bm_serial_ctx_send_network_info(&_default_ctx, network_crc32,
+                                         config_crc, fw_info, num_nodes,
+                                         node_id_list, config_map_size,
+                                         cbor_config_map);
+}
+
+bm_serial_error_e bm_serial_send_self_test(uint64_t node_id, uint32_t result) {
+  return bm_serial_ctx_send_self_test(&_default_ctx, node_id, result);
+}
+
+bm_serial_error_e bm_serial_send_reboot_info(uint64_t node_id,
+                                             uint32_t reboot_reason,
+                                             uint32_t gitSHA,
+                                             uint32_t reboot_count,
+                                             uint32_t pc,
+                                             uint32_t lr) {
+  return bm_serial_ctx_send_reboot_info(&_default_ctx, node_id, reboot_reason,
+                                        gitSHA, reboot_count, pc, lr);
+}
+
+bm_serial_error_e bm_serial_dfu_send_start(bm_serial_dfu_start_t *dfu_start) {
+  return bm_serial_ctx_dfu_send_start(&_default_ctx, dfu_start);
+}
+
+bm_serial_error_e bm_serial_dfu_send_chunk(uint32_t offset, size_t length,
+                                           uint8_t *data) {
+  return bm_serial_ctx_dfu_send_chunk(&_default_ctx, offset, length, data);
+}
+
+bm_serial_error_e bm_serial_dfu_chunk_reserve(uint32_t offset, size_t length,
+                                              uint8_t **data) {
+  return bm_serial_ctx_dfu_chunk_reserve(&_default_ctx, offset, length, data);
+}
+
+bm_serial_error_e bm_serial_dfu_send_nak(uint32_t offset, size_t length) {
+  return bm_serial_ctx_dfu_send_nak(&_default_ctx, offset, length);
+}
+
+bm_serial_error_e bm_serial_dfu_send_finish(uint64_t node_id, bool success,
+                                            uint32_t status) {
+  return bm_serial_ctx_dfu_send_finish(&_default_ctx, node_id, success, status);
+}
+
+bm_serial_error_e bm_serial_cfg_get(uint64_t node_id,
+                                    bm_common_config_partition_e partition,
+                                    size_t key_len, const char *key) {
+  return bm_serial_ctx_cfg_get(&_default_ctx, node_id, partition, key_len,
+                               key);
+}
+
+bm_serial_error_e bm_serial_cfg_set(uint64_t node_id,
+                                    bm_common_config_partition_e partition,
+                                    size_t key_len, const char *key,
+                                    size_t value_size, void *val) {
+  return bm_serial_ctx_cfg_set(&_default_ctx, node_id, partition, key_len, key,
+                               value_size, val);
+}
+
+bm_serial_error_e bm_serial_cfg_value(uint64_t node_id,
+                                      bm_common_config_partition_e partition,
+                                      uint32_t data_length, void *data) {
+  return bm_serial_ctx_cfg_value(&_default_ctx, node_id, partition,
+                                 data_length, data);
+}
+
+bm_serial_error_e
+bm_serial_cfg_value_reserve(uint64_t node_id,
+                            bm_common_config_partition_e partition,
+                            uint32_t data_length, uint8_t **data) {
+  return bm_serial_ctx_cfg_value_reserve(&_default_ctx, node_id, partition,
+                                         data_length, data);
+}
+
+bm_serial_error_e bm_serial_cfg_commit(uint64_t node_id,
+                                       bm_common_config_partition_e partition) {
+  return bm_serial_ctx_cfg_commit(&_default_ctx, node_id, partition);
+}
+
+bm_serial_error_e
+bm_serial_cfg_status_request(uint64_t node_id,
+                             bm_common_config_partition_e partition) {
+  return bm_serial_ctx_cfg_status_request(&_default_ctx, node_id, partition);
+}
+
+bm_serial_error_e
+bm_serial_cfg_status_response(uint64_t node_id,
+                              bm_common_config_partition_e partition,
+                              bool commited, uint8_t num_keys, void *keys) {
+  return bm_serial_ctx_cfg_status_response(&_default_ctx, node_id, partition,
+                                           commited, num_keys, keys);
+}
+
+bm_serial_error_e
+bm_serial_cfg_delete_request(uint64_t node_id,
+                             bm_common_config_partition_e partition,
+                             size_t key_len, const char *key) {
+  return bm_serial_ctx_cfg_delete_request(&_default_ctx, node_id, partition,
+                                          key_len, key);
+}
+
+bm_serial_error_e
+bm_serial_cfg_delete_response(uint64_t node_id,
+                              bm_common_config_partition_e partition,
+                              size_t key_len, const char *key, bool success) {
+  return bm_serial_ctx_cfg_delete_response(&_default_ctx, node_id, partition,
+                                           key_len, key, success);
+}
+
+bm_serial_error_e bm_serial_send_info_request(uint64_t node_id) {
+  return bm_serial_ctx_send_info_request(&_default_ctx, node_id);
+}
+
+bm_serial_error_e
+bm_serial_send_info_reply(uint64_t node_id,
+                          bm_serial_device_info_reply_t *bcmp_info) {
+  return bm_serial_ctx_send_info_reply(&_default_ctx, node_id, bcmp_info);
+}
+
+bm_serial_error_e bm_serial_send_resource_request(uint64_t node_id) {
+  return bm_serial_ctx_send_resource_request(&_default_ctx, node_id);
+}
+
+bm_serial_error_e
+bm_serial_send_resource_reply(uint64_t node_id,
+                              bm_serial_resource_table_reply_t *bcmp_resource) {
+  return bm_serial_ctx_send_resource_reply(&_default_ctx, node_id,
+                                           bcmp_resource);
+}
@@ -9,6 +9,22 @@
 extern "C" {
 #endif
 
+// Largest packet (including bm_serial_packet_t header) that can be sent
+#define SERIAL_BUFF_LEN 2048
+
+// Packets are built after enough headroom to COBS encode them in place
+// (BM_SERIAL_COBS_OVERHEAD(SERIAL_BUFF_LEN))
+#define SERIAL_TX_HEADROOM (SERIAL_BUFF_LEN / 254 + 1)
+
+// Packet buffer size, including headroom and the COBS delimiter
+#define BM_SERIAL_TX_BUFF_LEN (SERIAL_TX_HEADROOM + SERIAL_BUFF_LEN + 1)
+
+// One segment of a packet passed to tx_iov_fn
+typedef struct {
+  const uint8_t *buff;
+  size_t len;
+} bm_serial_iov_t;
+
 typedef struct {
   // Function used to transmit data over the wire
   bool (*tx_fn)(const uint8_t *buff, size_t len);
@@ -106,6 +122,12 @@ typedef struct {
   // Function called when a BCMP resource response is received.
   bool (*bcmp_resource_response_fn)(
       uint64_t node_id, bm_serial_resource_table_reply_t *bcmp_resource);
+
+  // Optional scatter-gather transmit function. Segments must be sent back to
+  // back as a single packet. When set (and COBS tx is disabled), large
+  // payloads are sent straight from the caller's buffer instead of being
+  // copied into the tx buffer first. Either tx_fn or tx_iov_fn is required.
+  bool (*tx_iov_fn)(const bm_serial_iov_t *iov, size_t iov_cnt);
 } bm_serial_callbacks_t;
 
 typedef enum {
@@ -120,9 +142,161 @@ typedef enum {
   BM_SERIAL_INVALID_TOPIC_LEN = -8,
   BM_SERIAL_INVALID_MSG_LEN = -9,
   BM_SERIAL_MISC_ERR = -10,
+  BM_SERIAL_COBS_ERR = -11,
+  BM_SERIAL_UNKNOWN_ALIAS = -12,
+  BM_SERIAL_COMPRESSION_ERR = -13,
+  BM_SERIAL_INVALID_MSG = -14,
+  BM_SERIAL_TIMEOUT = -15,
+  BM_SERIAL_BUSY = -16,
 } bm_serial_error_e;
 
+typedef struct bm_serial_ctx_s bm_serial_ctx_t;
+typedef struct bm_serial_txq_s bm_serial_txq_t;
+typedef struct bm_serial_txq_slot_s bm_serial_txq_slot_t;
+typedef struct bm_serial_pool_s bm_serial_pool_t;
+typedef struct bm_serial_pkt_s bm_serial_pkt_t;
+typedef struct bm_serial_rel_s bm_serial_rel_t;
+typedef struct bm_serial_alias_s bm_serial_alias_t;
+typedef struct bm_serial_lz_s bm_serial_lz_t;
+typedef struct bm_serial_router_s bm_serial_router_t;
+typedef struct bm_serial_corr_s bm_serial_corr_t;
+typedef struct bm_serial_cache_s bm_serial_cache_t;
+typedef struct bm_serial_topo_s bm_serial_topo_t;
+
+// Packet being built. The crc is updated as segments are copied in so every
+// byte is only touched once. Declared here because bm_serial_ctx_t holds one
+// for *_reserve(), only bm_serial.c should touch its fields.
+typedef struct {
+  bm_serial_ctx_t *ctx;
+  // Queue slot or pool packet the packet is built in (both NULL when using
+  // ctx->tx_buff)
+  bm_serial_txq_slot_t *slot;
+  bm_serial_pkt_t *pkt;
+  // Buffer the packet is built in, with COBS headroom before packet
+  uint8_t *buff;
+  uint16_t buff_len;
+  bm_serial_packet_t *packet;
+  // Bytes written so far, including the bm_serial_packet_t header
+  uint16_t len;
+  // Total packet length requested from _bm_serial_get_packet
+  uint16_t max_len;
+  // Bytes already included in crc16
+  uint16_t crc_len;
+  uint16_t crc16;
+  // Set if a segment didn't fit, reported when sending
+  bool overflow;
+  // Trailing segment sent from the caller's buffer (see tx_iov_fn)
+  const uint8_t *ext;
+  uint16_t ext_len;
+  // Alias this pub registers, marked as registered once it's sent
+  bool alias_register;
+  uint16_t alias_id;
+  uint16_t alias_generation;
+} bm_serial_builder_t;
+
+typedef struct {
+  uint32_t tx_packets;
+  uint32_t tx_bytes;
+  uint32_t tx_errors;
+  // Packets passed to bm_serial_process_packet and accepted/rejected
+  uint32_t rx_packets;
+  uint32_t rx_errors;
+} bm_serial_stats_t;
+
+// Takes ownership of a finished (framed) pool packet, see
+// bm_serial_ctx_set_pool(). Must call bm_serial_pkt_release() when done with
+// it, even on error.
+typedef bm_serial_error_e (*bm_serial_pkt_sink_fn)(void *arg,
+                                                  bm_serial_pkt_t *pkt);
+
+// Handler for an application defined message type, see
+// bm_serial_ctx_register_msg()
+typedef bool (*bm_serial_msg_fn)(void *arg, uint8_t type,
+                                 const uint8_t *payload, size_t len);
+// Optional check before the handler is called, false drops the message
+typedef bool (*bm_serial_msg_validate_fn)(const uint8_t *payload, size_t len);
+
+typedef struct {
+  bm_serial_msg_fn fn;
+  void *arg;
+  bm_serial_msg_validate_fn validate_fn;
+  // Shorter payloads are dropped
+  uint16_t min_len;
+} bm_serial_msg_handler_t;
+
+// Sees every built-in message received before its callback, see
+// bm_serial_ctx_set_rx_hook(). Returning true consumes the message.
+typedef bool (*bm_serial_rx_hook_fn)(void *arg, uint8_t type,
+                                     const uint8_t *payload, size_t len);
+
+// Handlers for application defined message types, indexed by type. Types
+// from BM_SERIAL_APP_MSG_FIRST up are never used by bm_serial itself.
+typedef struct {
+  bm_serial_msg_handler_t handlers[256];
+} bm_serial_msg_table_t;
+
+// One bm_serial instance (serial link). Initialize with bm_serial_ctx_init()
+// and don't touch the fields directly, except for reading stats.
+// The bm_serial_* functions without a context use a default instance.
+struct bm_serial_ctx_s {
+  bm_serial_callbacks_t callbacks;
+  bm_serial_stats_t stats;
+
+  // COBS encode transmitted packets
+  bool cobs_tx;
+
+  // Packet waiting for bm_serial_ctx_commit()
+  bm_serial_builder_t reserved;
+  bool reserved_active;
+
+  // Optional tx queue (see bm_serial_txq.h). When set, packets are built in
+  // queue slots and sent by bm_serial_ctx_txq_flush() instead of tx_buff
+  bm_serial_txq_t *txq;
+
+  // Optional packet pool (see bm_serial_pool.h). When set (and there's no
+  // txq), packets are built in pool blocks and passed to pkt_sink, or sent
+  // and released right away if there's no sink
+  bm_serial_pool_t *pool;
+  bm_serial_pkt_sink_fn pkt_sink;
+  void *pkt_sink_arg;
+
+  // Optional reliable delivery (see bm_serial_rel.h)
+  bm_serial_rel_t *rel;
+
+  // Optional topic aliasing (see bm_serial_alias.h)
+  bm_serial_alias_t *alias;
+
+  // Optional payload compression (see bm_serial_lz.h)
+  bm_serial_lz_t *lz;
+
+  // Optional pub router (see bm_serial_router.h), received pubs go through it
+  // before pub_fn
+  bm_serial_router_t *router;
+
+  // Optional application defined message types (see
+  // bm_serial_ctx_register_msg())
+  bm_serial_msg_table_t *msgs;
+
+  // Optional request/response correlation (see bm_serial_corr.h)
+  bm_serial_corr_t *corr;
+
+  // Optional config value cache (see bm_serial_cache.h)
+  bm_serial_cache_t *cache;
+
+  // Optional network topology snapshots (see bm_serial_topo.h)
+  bm_serial_topo_t *topo;
+
+  // Optional hook for built-in messages (see bm_serial_ctx_set_rx_hook())
+  bm_serial_rx_hook_fn rx_hook;
+  void *rx_hook_arg;
+
+  // Extra byte at the end for the COBS delimiter
+  uint8_t tx_buff[BM_SERIAL_TX_BUFF_LEN];
+};
+
 void bm_serial_set_callbacks(bm_serial_callbacks_t *callbacks);
+void bm_serial_set_cobs_tx(bool enable);
+bm_serial_ctx_t *bm_serial_get_default_ctx(void);
 bm_serial_error_e bm_serial_process_packet(bm_serial_packet_t *packet,
                                            size_t len);
 bm_serial_error_e bm_serial_tx(bm_serial_message_t type, const uint8_t *buff,
@@ -132,6 +306,12 @@ bm_serial_error_e bm_serial_pub(uint64_t node_id, const char *topic,
                                 uint16_t topic_len, const uint8_t *data,
                                 uint16_t data_len, uint8_t type,
                                 uint8_t version);
+bm_serial_error_e bm_serial_pub_reserve(uint64_t node_id, const char *topic,
+                                        uint16_t topic_len, uint16_t data_len,
+                                        uint8_t type, uint8_t version,
+                                        uint8_t **data);
+bm_serial_error_e bm_serial_commit(void);
+void bm_serial_reserve_abort(void);
 bm_serial_error_e bm_serial_sub(const char *topic, uint16_t topic_len);
 bm_serial_error_e bm_serial_unsub(const char *topic, uint16_t topic_len);
 bm_serial_error_e bm_serial_set_rtc(bm_serial_time_t *time);
@@ -146,6 +326,9 @@ bm_serial_error_e bm_serial_send_reboot_info(uint64_t node_id,
 bm_serial_error_e bm_serial_dfu_send_start(bm_serial_dfu_start_t *dfu_start);
 bm_serial_error_e bm_serial_dfu_send_chunk(uint32_t offset, size_t length,
                                            uint8_t *data);
+bm_serial_error_e bm_serial_dfu_chunk_reserve(uint32_t offset, size_t length,
+                                              uint8_t **data);
+bm_serial_error_e bm_serial_dfu_send_nak(uint32_t offset, size_t length);
 bm_serial_error_e bm_serial_dfu_send_finish(uint64_t node_id, bool success,
                                             uint32_t status);
 
@@ -159,6 +342,10 @@ bm_serial_error_e bm_serial_cfg_set(uint64_t node_id,
 bm_serial_error_e bm_serial_cfg_value(uint64_t node_id,
                                       bm_common_config_partition_e partition,
                                       uint32_t data_length, void *data);
+bm_serial_error_e
+bm_serial_cfg_value_reserve(uint64_t node_id,
+                            bm_common_config_partition_e partition,
+                            uint32_t data_length, uint8_t **data);
 bm_serial_error_e bm_serial_cfg_commit(uint64_t node_id,
                                        bm_common_config_partition_e partition);
 bm_serial_error_e
@@ -191,6 +378,128 @@ bm_serial_error_e bm_serial_send_network_info(
     uint32_t network_crc32, bm_common_config_crc_t *config_crc,
     bm_common_fw_version_t *fw_info, uint16_t num_nodes, uint64_t *node_id_list,
     uint16_t config_map_size, uint8_t *cbor_config_map);
+
+// Same as above, for a specific bm_serial instance
+void bm_serial_ctx_init(bm_serial_ctx_t *ctx,
+                        const bm_serial_callbacks_t *callbacks);
+void bm_serial_ctx_set_callbacks(bm_serial_ctx_t *ctx,
+                                 bm_serial_callbacks_t *callbacks);
+void bm_serial_ctx_set_cobs_tx(bm_serial_ctx_t *ctx, bool enable);
+void bm_serial_ctx_set_txq(bm_serial_ctx_t *ctx, bm_serial_txq_t *txq);
+bm_serial_error_e bm_serial_ctx_txq_flush(bm_serial_ctx_t *ctx);
+void bm_serial_ctx_set_pool(bm_serial_ctx_t *ctx, bm_serial_pool_t *pool,
+                            bm_serial_pkt_sink_fn sink, void *sink_arg);
+void bm_serial_ctx_set_msg_table(bm_serial_ctx_t *ctx,
+                                 bm_serial_msg_table_t *msgs);
+bm_serial_error_e
+bm_serial_ctx_register_msg(bm_serial_ctx_t *ctx, uint8_t type,
+                           const bm_serial_msg_handler_t *handler);
+void bm_serial_ctx_set_rx_hook(bm_serial_ctx_t *ctx, bm_serial_rx_hook_fn fn,
+                               void *arg);
+bm_serial_error_e bm_serial_ctx_pkt_send(bm_serial_ctx_t *ctx,
+                                         const bm_serial_pkt_t *pkt);
+bm_serial_error_e bm_serial_ctx_commit(bm_serial_ctx_t *ctx);
+void bm_serial_ctx_reserve_abort(bm_serial_ctx_t *ctx);
+bm_serial_error_e bm_serial_ctx_tx(bm_serial_ctx_t *ctx,
+                                   bm_serial_message_t type,
+                                   const uint8_t *payload, size_t len);
+bm_serial_error_e bm_serial_ctx_pub(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                    const char *topic, uint16_t topic_len,
+                                    const uint8_t *data, uint16_t data_len,
+                                    uint8_t type, uint8_t version);
+bm_serial_error_e bm_serial_ctx_validate_topic(bm_serial_ctx_t *ctx,
+                                               const char *topic,
+                                               uint16_t topic_len);
+bm_serial_error_e bm_serial_ctx_pub_reserve(bm_serial_ctx_t *ctx,
+                                            uint64_t node_id, const char *topic,
+                                            uint16_t topic_len,
+                                            uint16_t data_len, uint8_t type,
+                                            uint8_t version, uint8_t **data);
+bm_serial_error_e bm_serial_ctx_sub(bm_serial_ctx_t *ctx, const char *topic,
+                                    uint16_t topic_len);
+bm_serial_error_e bm_serial_ctx_unsub(bm_serial_ctx_t *ctx, const char *topic,
+                                      uint16_t topic_len);
+bm_serial_error_e bm_serial_ctx_set_rtc(bm_serial_ctx_t *ctx,
+                                        bm_serial_time_t *time);
+bm_serial_error_e
+bm_serial_ctx_send_network_info(bm_serial_ctx_t *ctx, uint32_t network_crc32,
+                                bm_common_config_crc_t *config_crc,
+                                bm_common_fw_version_t *fw_info,
+                                uint16_t num_nodes, uint64_t *node_id_list,
+                                uint16_t config_map_size,
+                                uint8_t *cbor_config_map);
+bm_serial_error_e bm_serial_ctx_send_self_test(bm_serial_ctx_t *ctx,
+                                               uint64_t node_id,
+                                               uint32_t result);
+bm_serial_error_e bm_serial_ctx_send_reboot_info(bm_serial_ctx_t *ctx,
+                                                 uint64_t node_id,
+                                                 uint32_t reboot_reason,
+                                                 uint32_t gitSHA,
+                                                 uint32_t reboot_count,
+                                                 uint32_t pc, uint32_t lr);
+bm_serial_error_e
+bm_serial_ctx_dfu_send_start(bm_serial_ctx_t *ctx,
+                             bm_serial_dfu_start_t *dfu_start);
+bm_serial_error_e bm_serial_ctx_dfu_send_chunk(bm_serial_ctx_t *ctx,
+                                               uint32_t offset, size_t length,
+                                               uint8_t *data);
+bm_serial_error_e bm_serial_ctx_dfu_chunk_reserve(bm_serial_ctx_t *ctx,
+                                                  uint32_t offset,
+                                                  size_t length,
+                                                  uint8_t **data);
+bm_serial_error_e bm_serial_ctx_dfu_send_nak(bm_serial_ctx_t *ctx,
+                                             uint32_t offset, size_t length);
+bm_serial_error_e bm_serial_ctx_dfu_send_finish(bm_serial_ctx_t *ctx,
+                                                uint64_t node_id, bool success,
+                                                uint32_t status);
+bm_serial_error_e bm_serial_ctx_cfg_get(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                        bm_common_config_partition_e partition,
+                                        size_t key_len, const char *key);
+bm_serial_error_e bm_serial_ctx_cfg_set(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                        bm_common_config_partition_e partition,
+                                        size_t key_len, const char *key,
+                                        size_t value_size, void *val);
+bm_serial_error_e
+bm_serial_ctx_cfg_value(bm_serial_ctx_t *ctx, uint64_t node_id,
+                        bm_common_config_partition_e partition,
+                        uint32_t data_length, void *data);
+bm_serial_error_e
+bm_serial_ctx_cfg_value_reserve(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                bm_common_config_partition_e partition,
+                                uint32_t data_length, uint8_t **data);
+bm_serial_error_e
+bm_serial_ctx_cfg_commit(bm_serial_ctx_t *ctx, uint64_t node_id,
+                         bm_common_config_partition_e partition);
+bm_serial_error_e
+bm_serial_ctx_cfg_status_request(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                 bm_common_config_partition_e partition);
+bm_serial_error_e
+bm_serial_ctx_cfg_status_response(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                  bm_common_config_partition_e partition,
+                                  bool commited, uint8_t num_keys, void *keys);
+bm_serial_error_e
+bm_serial_ctx_cfg_delete_request(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                 bm_common_config_partition_e partition,
+                                 size_t key_len, const char *key);
+bm_serial_error_e
+bm_serial_ctx_cfg_delete_response(bm_serial_ctx_t *ctx, uint64_t node_id,
+                                  bm_common_config_partition_e partition,
+                                  size_t key_len, const char *key,
+                                  bool success);
+bm_serial_error_e bm_serial_ctx_send_info_request(bm_serial_ctx_t *ctx,
+                                                  uint64_t node_id);
+bm_serial_error_e
+bm_serial_ctx_send_info_reply(bm_serial_ctx_t *ctx, uint64_t node_id,
+                              bm_serial_device_info_reply_t *bcmp_info);
+bm_serial_error_e bm_serial_ctx_send_resource_request(bm_serial_ctx_t *ctx,
+                                                      uint64_t node_id);
+bm_serial_error_e bm_serial_ctx_send_resource_reply(
+    bm_serial_ctx_t *ctx, uint64_t node_id,
+    bm_serial_resource_table_reply_t *bcmp_resource);
+bm_serial_error_e bm_serial_ctx_process_packet(bm_serial_ctx_t *ctx,
+                                               bm_serial_packet_t *packet,
+                                               size_t len);
+
 #ifdef __cplusplus
 }
 #endif
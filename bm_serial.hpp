@@ -0,0 +1,1048 @@
+//
+// Typed C++17 codec for bm_serial packets, header only.
+//
+// bm_serial::message<BM_SERIAL_X> encodes and decodes one message type
+// straight to and from a caller's buffer: no heap, no builder, sizes and
+// offsets known at compile time so the whole path inlines per type. Frames
+// are the same bytes bm_serial.c sends and receives (before COBS), without
+// sequence numbers or compression.
+//
+//   uint8_t buff[bm_serial::message<BM_SERIAL_RTC_SET>::wire_size];
+//   size_t len = bm_serial::message<BM_SERIAL_RTC_SET>::encode(buff, rtc);
+//
+//   bm_serial::pub_view pub;
+//   if (bm_serial::message<BM_SERIAL_PUB>::decode({frame, len}, pub) ==
+//       BM_SERIAL_OK) { ... pub.topic, pub.data ... }
+//
+// encode() returns the frame length, 0 if it doesn't fit or is invalid.
+// decode() checks the length, type and crc, and returns views into the frame.
+// Variable length messages also have decode_payload(), which takes just the
+// payload (what an rx hook gets, after bm_serial.c checked the crc).
+//
+#pragma once
+
+#include "bm_serial.h"
+#include "bm_serial_crc.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+
+namespace bm_serial {
+
+// Non-owning view of a buffer (std::span is C++20)
+template <typename T> class span {
+public:
+  constexpr span() = default;
+  constexpr span(T *data, size_t size) : data_(data), size_(size) {}
+  template <size_t N> constexpr span(T (&arr)[N]) : data_(arr), size_(N) {}
+  // Anything with data() and size(), like std::vector, std::array or a span
+  // of non-const bytes
+  template <typename C,
+            typename = std::enable_if_t<std::is_convertible_v<
+                decltype(std::declval<C &>().data()), T *>>>
+  constexpr span(C &&container)
+      : data_(container.data()), size_(container.size()) {}
+
+  constexpr T *data() const { return data_; }
+  constexpr size_t size() const { return size_; }
+  constexpr bool empty() const { return !size_; }
+  constexpr T &operator[](size_t idx) const { return data_[idx]; }
+  constexpr T *begin() const { return data_; }
+  constexpr T *end() const { return data_ + size_; }
+  constexpr span subspan(size_t offset) const {
+    return span(data_ + offset, size_ - offset);
+  }
+
+private:
+  T *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+using bytes = span<uint8_t>;
+using const_bytes = span<const uint8_t>;
+
+// Longest topic (MAX_TOPIC_LEN in bm_serial.c)
+constexpr size_t max_topic_len = 64;
+
+// Wire layouts, these are the protocol
+constexpr size_t header_size = sizeof(bm_serial_packet_t);
+static_assert(header_size == 4 && offsetof(bm_serial_packet_t, crc16) == 2);
+static_assert(sizeof(bm_serial_pub_header_t) == 12 &&
+              offsetof(bm_serial_pub_header_t, type) == 8 &&
+              offsetof(bm_serial_pub_header_t, version) == 9 &&
+              offsetof(bm_serial_pub_header_t, topic_len) == 10);
+static_assert(sizeof(bm_serial_sub_unsub_header_t) == 2);
+static_assert(sizeof(bm_serial_net_msg_header_t) == 9);
+static_assert(sizeof(bm_serial_rtc_t) == 15);
+static_assert(sizeof(bm_serial_self_test_t) == 12);
+static_assert(sizeof(bm_serial_reboot_info_t) == 28);
+static_assert(sizeof(bm_serial_dfu_start_t) == 26);
+static_assert(sizeof(bm_serial_dfu_chunk_t) == 8);
+static_assert(sizeof(bm_serial_dfu_finish_t) == 13);
+static_assert(sizeof(bm_serial_alias_reset_t) == 2);
+static_assert(sizeof(bm_serial_device_info_request_t) == 8);
+static_assert(sizeof(bm_serial_resource_table_request_t) == 8);
+static_assert(sizeof(bm_serial_pub_alias_header_t) == 16);
+static_assert(sizeof(bm_serial_device_info_t) == 36 &&
+              sizeof(bm_serial_device_info_reply_t) == 38);
+static_assert(sizeof(bm_serial_resource_t) == 2 &&
+              sizeof(bm_serial_resource_table_reply_t) == 12);
+
+namespace detail {
+
+template <typename T> inline void store(uint8_t *dst, const T &val) {
+  std::memcpy(dst, &val, sizeof(T));
+}
+
+template <typename T> inline T load(const uint8_t *src) {
+  T val;
+  std::memcpy(&val, src, sizeof(T));
+  return val;
+}
+
+// Fill in the packet header once the payload is in place
+inline size_t finish(bytes out, bm_serial_message_t type, size_t len) {
+  out[0] = type;
+  out[1] = 0;
+  store<uint16_t>(&out[2], 0);
+  store<uint16_t>(&out[2], bm_serial_crc16_ccitt(0, out.data(), len));
+  return len;
+}
+
+// Check a received packet, its crc is computed as if the crc field was 0
+inline bm_serial_error_e check(const_bytes in, bm_serial_message_t type,
+                               size_t min_payload) {
+  if (in.size() < header_size) {
+    return BM_SERIAL_INVALID_MSG_LEN;
+  }
+
+  const uint8_t header[header_size] = {in[0], in[1], 0, 0};
+  uint16_t crc16 = bm_serial_crc16_ccitt(0, header, header_size);
+  crc16 = bm_serial_crc16_ccitt(crc16, &in[header_size],
+                                in.size() - header_size);
+  if (crc16 != load<uint16_t>(&in[2])) {
+    return BM_SERIAL_CRC_ERR;
+  }
+
+  if (in[0] != type || (in[1] & BM_SERIAL_FLAG_COMPRESSED)) {
+    return BM_SERIAL_UNSUPPORTED_MSG;
+  }
+
+  if (in.size() - header_size < min_payload) {
+    return BM_SERIAL_INVALID_MSG_LEN;
+  }
+
+  return BM_SERIAL_OK;
+}
+
+// Check a received packet and decode its payload with Codec
+template <typename Codec, typename View>
+inline bm_serial_error_e decode(const_bytes in, View &view) {
+  bm_serial_error_e rval = check(in, Codec::type, Codec::header_len);
+  if (!rval) {
+    rval = Codec::decode_payload(in.subspan(header_size), view);
+  }
+  return rval;
+}
+
+// Lists of one byte length prefixed strings (cfg status keys) or
+// bm_serial_resource_t (resource tables). Finds where count entries at the
+// start of in end, false if they don't fit.
+template <typename Len>
+inline bool list_size(const_bytes in, size_t count, size_t &size) {
+  size_t offset = 0;
+  for (size_t idx = 0; idx < count; idx++) {
+    if (in.size() - offset < sizeof(Len)) {
+      return false;
+    }
+    Len len = load<Len>(&in[offset]);
+    offset += sizeof(Len);
+    if (len > in.size() - offset) {
+      return false;
+    }
+    offset += len;
+  }
+  size = offset;
+  return true;
+}
+
+// Call fn with every string in a list checked by list_size()
+template <typename Len, typename Fn>
+inline void list_for_each(const_bytes list, Fn &&fn) {
+  size_t offset = 0;
+  while (offset < list.size()) {
+    Len len = load<Len>(&list[offset]);
+    offset += sizeof(Len);
+    fn(std::string_view((const char *)&list[offset], len));
+    offset += len;
+  }
+}
+
+template <typename Len>
+inline size_t list_wire_size(span<const std::string_view> strings) {
+  size_t len = 0;
+  for (std::string_view str : strings) {
+    len += sizeof(Len) + str.size();
+  }
+  return len;
+}
+
+// Returns the bytes written, out has to fit list_wire_size()
+template <typename Len>
+inline size_t list_encode(uint8_t *out, span<const std::string_view> strings) {
+  size_t offset = 0;
+  for (std::string_view str : strings) {
+    store<Len>(&out[offset], str.size());
+    offset += sizeof(Len);
+    std::memcpy(&out[offset], str.data(), str.size());
+    offset += str.size();
+  }
+  return offset;
+}
+
+template <typename Len>
+inline bool list_fits(span<const std::string_view> strings) {
+  for (std::string_view str : strings) {
+    if (str.size() > std::numeric_limits<Len>::max()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace detail
+
+// Only message types with a specialization below have a codec
+template <bm_serial_message_t Type> struct message;
+
+// Messages that are one packed struct
+template <bm_serial_message_t Type, typename Payload> struct fixed_message {
+  static_assert(std::is_trivially_copyable_v<Payload>);
+
+  static constexpr bm_serial_message_t type = Type;
+  using payload_type = Payload;
+  static constexpr size_t payload_offset = header_size;
+  static constexpr size_t wire_size = header_size + sizeof(Payload);
+
+  static size_t encode(bytes out, const Payload &payload) {
+    if (out.size() < wire_size) {
+      return 0;
+    }
+    detail::store(&out[payload_offset], payload);
+    return detail::finish(out, Type, wire_size);
+  }
+
+  // Longer packets are accepted, newer versions may add fields at the end
+  static bm_serial_error_e decode(const_bytes in, Payload &payload) {
+    bm_serial_error_e rval = detail::check(in, Type, sizeof(Payload));
+    if (!rval) {
+      payload = detail::load<Payload>(&in[payload_offset]);
+    }
+    return rval;
+  }
+};
+
+template <>
+struct message<BM_SERIAL_RTC_SET>
+    : fixed_message<BM_SERIAL_RTC_SET, bm_serial_rtc_t> {};
+template <>
+struct message<BM_SERIAL_SELF_TEST>
+    : fixed_message<BM_SERIAL_SELF_TEST, bm_serial_self_test_t> {};
+template <>
+struct message<BM_SERIAL_REBOOT_INFO>
+    : fixed_message<BM_SERIAL_REBOOT_INFO, bm_serial_reboot_info_t> {};
+template <>
+struct message<BM_SERIAL_ALIAS_RESET>
+    : fixed_message<BM_SERIAL_ALIAS_RESET, bm_serial_alias_reset_t> {};
+template <>
+struct message<BM_SERIAL_DFU_START>
+    : fixed_message<BM_SERIAL_DFU_START, bm_serial_dfu_start_t> {};
+template <>
+struct message<BM_SERIAL_DFU_RESULT>
+    : fixed_message<BM_SERIAL_DFU_RESULT, bm_serial_dfu_finish_t> {};
+template <>
+struct message<BM_SERIAL_DEVICE_INFO_REQ>
+    : fixed_message<BM_SERIAL_DEVICE_INFO_REQ,
+                    bm_serial_device_info_request_t> {};
+template <>
+struct message<BM_SERIAL_RESOURCE_REQ>
+    : fixed_message<BM_SERIAL_RESOURCE_REQ,
+                    bm_serial_resource_table_request_t> {};
+
+// Messages that are just bytes
+template <bm_serial_message_t Type> struct raw_message {
+  static constexpr bm_serial_message_t type = Type;
+  static constexpr size_t payload_offset = header_size;
+  static constexpr size_t wire_size(size_t len) { return header_size + len; }
+
+  static size_t encode(bytes out, const_bytes data) {
+    if (out.size() < wire_size(data.size())) {
+      return 0;
+    }
+    std::memcpy(&out[payload_offset], data.data(), data.size());
+    return detail::finish(out, Type, wire_size(data.size()));
+  }
+
+  static bm_serial_error_e decode(const_bytes in, const_bytes &data) {
+    bm_serial_error_e rval = detail::check(in, Type, 0);
+    if (!rval) {
+      data = in.subspan(payload_offset);
+    }
+    return rval;
+  }
+};
+
+template <> struct message<BM_SERIAL_DEBUG> : raw_message<BM_SERIAL_DEBUG> {};
+template <> struct message<BM_SERIAL_LOG> : raw_message<BM_SERIAL_LOG> {};
+
+// Sub and unsub, just a topic
+template <bm_serial_message_t Type> struct topic_message {
+  static constexpr bm_serial_message_t type = Type;
+  static constexpr size_t topic_offset =
+      header_size + sizeof(bm_serial_sub_unsub_header_t);
+  static constexpr size_t wire_size(size_t topic_len) {
+    return topic_offset + topic_len;
+  }
+
+  static size_t encode(bytes out, std::string_view topic) {
+    if (topic.empty() || topic.size() > max_topic_len ||
+        out.size() < wire_size(topic.size())) {
+      return 0;
+    }
+    detail::store<uint16_t>(&out[header_size], topic.size());
+    std::memcpy(&out[topic_offset], topic.data(), topic.size());
+    return detail::finish(out, Type, wire_size(topic.size()));
+  }
+
+  static bm_serial_error_e decode(const_bytes in, std::string_view &topic) {
+    bm_serial_error_e rval =
+        detail::check(in, Type, sizeof(bm_serial_sub_unsub_header_t));
+    if (rval) {
+      return rval;
+    }
+    uint16_t topic_len = detail::load<uint16_t>(&in[header_size]);
+    if (topic_len > in.size() - topic_offset) {
+      return BM_SERIAL_INVALID_TOPIC_LEN;
+    }
+    topic = std::string_view((const char *)&in[topic_offset], topic_len);
+    return BM_SERIAL_OK;
+  }
+};
+
+template <> struct message<BM_SERIAL_SUB> : topic_message<BM_SERIAL_SUB> {};
+template <>
+struct message<BM_SERIAL_UNSUB> : topic_message<BM_SERIAL_UNSUB> {};
+
+struct pub_view {
+  uint64_t node_id;
+  std::string_view topic;
+  const_bytes data;
+  uint8_t type;
+  uint8_t version;
+};
+
+template <> struct message<BM_SERIAL_PUB> {
+  static constexpr bm_serial_message_t type = BM_SERIAL_PUB;
+  static constexpr size_t topic_offset =
+      header_size + sizeof(bm_serial_pub_header_t);
+  static constexpr size_t wire_size(size_t topic_len, size_t data_len) {
+    return topic_offset + topic_len + data_len;
+  }
+
+  static size_t encode(bytes out, uint64_t node_id, std::string_view topic,
+                       const_bytes data, uint8_t type, uint8_t version) {
+    if (topic.empty() || topic.size() > max_topic_len ||
+        out.size() < wire_size(topic.size(), data.size())) {
+      return 0;
+    }
+    uint8_t *header = &out[header_size];
+    detail::store(&header[offsetof(bm_serial_pub_header_t, node_id)], node_id);
+    header[offsetof(bm_serial_pub_header_t, type)] = type;
+    header[offsetof(bm_serial_pub_header_t, version)] = version;
+    detail::store<uint16_t>(
+        &header[offsetof(bm_serial_pub_header_t, topic_len)], topic.size());
+    std::memcpy(&out[topic_offset], topic.data(), topic.size());
+    std::memcpy(&out[topic_offset + topic.size()], data.data(), data.size());
+    return detail::finish(out, BM_SERIAL_PUB,
+                          wire_size(topic.size(), data.size()));
+  }
+
+  static bm_serial_error_e decode(const_bytes in, pub_view &pub) {
+    bm_serial_error_e rval =
+        detail::check(in, BM_SERIAL_PUB, sizeof(bm_serial_pub_header_t));
+    if (rval) {
+      return rval;
+    }
+    const uint8_t *header = &in[header_size];
+    uint16_t topic_len = detail::load<uint16_t>(
+        &header[offsetof(bm_serial_pub_header_t, topic_len)]);
+    if (topic_len > in.size() - topic_offset) {
+      return BM_SERIAL_INVALID_TOPIC_LEN;
+    }
+    pub.node_id = detail::load<uint64_t>(
+        &header[offsetof(bm_serial_pub_header_t, node_id)]);
+    pub.type = header[offsetof(bm_serial_pub_header_t, type)];
+    pub.version = header[offsetof(bm_serial_pub_header_t, version)];
+    pub.topic = std::string_view((const char *)&in[topic_offset], topic_len);
+    pub.data = in.subspan(topic_offset + topic_len);
+    return BM_SERIAL_OK;
+  }
+};
+
+struct net_msg_view {
+  uint64_t node_id;
+  uint8_t flags;
+  const_bytes data;
+};
+
+template <> struct message<BM_SERIAL_NET_MSG> {
+  static constexpr bm_serial_message_t type = BM_SERIAL_NET_MSG;
+  static constexpr size_t data_offset =
+      header_size + sizeof(bm_serial_net_msg_header_t);
+  static constexpr size_t wire_size(size_t data_len) {
+    return data_offset + data_len;
+  }
+
+  static size_t encode(bytes out, uint64_t node_id, const_bytes data) {
+    if (out.size() < wire_size(data.size())) {
+      return 0;
+    }
+    uint8_t *header = &out[header_size];
+    detail::store(&header[offsetof(bm_serial_net_msg_header_t, node_id)],
+                  node_id);
+    header[offsetof(bm_serial_net_msg_header_t, flags)] = 0;
+    std::memcpy(&out[data_offset], data.data(), data.size());
+    return detail::finish(out, BM_SERIAL_NET_MSG, wire_size(data.size()));
+  }
+
+  static bm_serial_error_e decode(const_bytes in, net_msg_view &msg) {
+    bm_serial_error_e rval = detail::check(in, BM_SERIAL_NET_MSG,
+                                           sizeof(bm_serial_net_msg_header_t));
+    if (rval) {
+      return rval;
+    }
+    const uint8_t *header = &in[header_size];
+    msg.node_id = detail::load<uint64_t>(
+        &header[offsetof(bm_serial_net_msg_header_t, node_id)]);
+    msg.flags = header[offsetof(bm_serial_net_msg_header_t, flags)];
+    msg.data = in.subspan(data_offset);
+    return BM_SERIAL_OK;
+  }
+};
+
+struct dfu_chunk_view {
+  uint32_t offset;
+  uint32_t length;
+  // Empty for a NAK (DFU_CHUNK_NAK_BITFLAG in offset)
+  const_bytes data;
+};
+
+template <> struct message<BM_SERIAL_DFU_CHUNK> {
+  static constexpr bm_serial_message_t type = BM_SERIAL_DFU_CHUNK;
+  static constexpr size_t data_offset =
+      header_size + sizeof(bm_serial_dfu_chunk_t);
+  static constexpr size_t wire_size(size_t data_len) {
+    return data_offset + data_len;
+  }
+
+  static size_t encode(bytes out, uint32_t offset, const_bytes data) {
+    if (out.size() < wire_size(data.size())) {
+      return 0;
+    }
+    uint8_t *header = &out[header_size];
+    detail::store(&header[offsetof(bm_serial_dfu_chunk_t, offset)], offset);
+    detail::store<uint32_t>(&header[offsetof(bm_serial_dfu_chunk_t, length)],
+                            data.size());
+    std::memcpy(&out[data_offset], data.data(), data.size());
+    return detail::finish(out, BM_SERIAL_DFU_CHUNK, wire_size(data.size()));
+  }
+
+  static bm_serial_error_e decode(const_bytes in, dfu_chunk_view &chunk) {
+    bm_serial_error_e rval = detail::check(in, BM_SERIAL_DFU_CHUNK,
+                                           sizeof(bm_serial_dfu_chunk_t));
+    if (rval) {
+      return rval;
+    }
+    const uint8_t *header = &in[header_size];
+    chunk.offset = detail::load<uint32_t>(
+        &header[offsetof(bm_serial_dfu_chunk_t, offset)]);
+    chunk.length = detail::load<uint32_t>(
+        &header[offsetof(bm_serial_dfu_chunk_t, length)]);
+    chunk.data = in.subspan(data_offset);
+    if (!(chunk.offset & DFU_CHUNK_NAK_BITFLAG) &&
+        chunk.length != chunk.data.size()) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    return BM_SERIAL_OK;
+  }
+};
+
+struct pub_alias_view {
+  uint64_t node_id;
+  uint16_t alias;
+  uint16_t generation;
+  // Empty if the pub only carries the alias
+  std::string_view topic;
+  const_bytes data;
+  uint8_t type;
+  uint8_t version;
+};
+
+template <> struct message<BM_SERIAL_PUB_ALIAS> {
+  static constexpr bm_serial_message_t type = BM_SERIAL_PUB_ALIAS;
+  static constexpr size_t header_len = sizeof(bm_serial_pub_alias_header_t);
+  static constexpr size_t topic_offset = header_size + header_len;
+  static constexpr size_t wire_size(size_t topic_len, size_t data_len) {
+    return topic_offset + topic_len + data_len;
+  }
+
+  static size_t encode(bytes out, uint64_t node_id, uint16_t alias,
+                       uint16_t generation, std::string_view topic,
+                       const_bytes data, uint8_t type, uint8_t version) {
+    if (topic.size() > max_topic_len ||
+        out.size() < wire_size(topic.size(), data.size())) {
+      return 0;
+    }
+    bm_serial_pub_alias_header_t header = {};
+    header.node_id = node_id;
+    header.type = type;
+    header.version = version;
+    header.alias = alias;
+    header.generation = generation;
+    header.topic_len = topic.size();
+    detail::store(&out[header_size], header);
+    std::memcpy(&out[topic_offset], topic.data(), topic.size());
+    std::memcpy(&out[topic_offset + topic.size()], data.data(), data.size());
+    return detail::finish(out, BM_SERIAL_PUB_ALIAS,
+                          wire_size(topic.size(), data.size()));
+  }
+
+  static bm_serial_error_e decode_payload(const_bytes in, pub_alias_view &pub) {
+    if (in.size() < header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    auto header = detail::load<bm_serial_pub_alias_header_t>(in.data());
+    if (header.topic_len > in.size() - header_len ||
+        header.topic_len > max_topic_len) {
+      return BM_SERIAL_INVALID_TOPIC_LEN;
+    }
+    pub.node_id = header.node_id;
+    pub.alias = header.alias;
+    pub.generation = header.generation;
+    pub.type = header.type;
+    pub.version = header.version;
+    pub.topic =
+        std::string_view((const char *)&in[header_len], header.topic_len);
+    pub.data = in.subspan(header_len + header.topic_len);
+    return BM_SERIAL_OK;
+  }
+
+  static bm_serial_error_e decode(const_bytes in, pub_alias_view &pub) {
+    return detail::decode<message>(in, pub);
+  }
+};
+
+//
+// Config messages. Keys are at most 255 bytes (one byte length). Requests are
+// encoded with just the target node id and replies (value, status and delete
+// responses) with just the source node id, same as bm_serial.c.
+//
+
+// Get and delete request, just a key
+struct cfg_key_view {
+  uint64_t target_node_id;
+  uint64_t source_node_id;
+  bm_common_config_partition_e partition;
+  std::string_view key;
+};
+
+template <bm_serial_message_t Type, typename Header> struct cfg_key_message {
+  static constexpr bm_serial_message_t type = Type;
+  static constexpr size_t header_len = sizeof(Header);
+  static constexpr size_t key_offset = header_size + header_len;
+  static constexpr size_t wire_size(size_t key_len) {
+    return key_offset + key_len;
+  }
+
+  static size_t encode(bytes out, uint64_t target_node_id,
+                       bm_common_config_partition_e partition,
+                       std::string_view key) {
+    if (key.size() > UINT8_MAX || out.size() < wire_size(key.size())) {
+      return 0;
+    }
+    Header header = {};
+    header.header.target_node_id = target_node_id;
+    header.partition = partition;
+    header.key_length = key.size();
+    detail::store(&out[header_size], header);
+    std::memcpy(&out[key_offset], key.data(), key.size());
+    return detail::finish(out, Type, wire_size(key.size()));
+  }
+
+  static bm_serial_error_e decode_payload(const_bytes in, cfg_key_view &cfg) {
+    if (in.size() < header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    auto header = detail::load<Header>(in.data());
+    if (header.key_length > in.size() - header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    cfg.target_node_id = header.header.target_node_id;
+    cfg.source_node_id = header.header.source_node_id;
+    cfg.partition = header.partition;
+    cfg.key =
+        std::string_view((const char *)&in[header_len], header.key_length);
+    return BM_SERIAL_OK;
+  }
+
+  static bm_serial_error_e decode(const_bytes in, cfg_key_view &cfg) {
+    return detail::decode<cfg_key_message>(in, cfg);
+  }
+};
+
+template <>
+struct message<BM_SERIAL_CFG_GET>
+    : cfg_key_message<BM_SERIAL_CFG_GET, bm_common_config_get_t> {};
+template <>
+struct message<BM_SERIAL_CFG_DEL_REQ>
+    : cfg_key_message<BM_SERIAL_CFG_DEL_REQ,
+                      bm_common_config_delete_key_request_t> {};
+
+struct cfg_set_view {
+  uint64_t target_node_id;
+  uint64_t source_node_id;
+  bm_common_config_partition_e partition;
+  std::string_view key;
+  const_bytes data;
+};
+
+template <> struct message<BM_SERIAL_CFG_SET> {
+  static constexpr bm_serial_message_t type = BM_SERIAL_CFG_SET;
+  static constexpr size_t header_len = sizeof(bm_common_config_set_t);
+  static constexpr size_t key_offset = header_size + header_len;
+  static constexpr size_t wire_size(size_t key_len, size_t data_len) {
+    return key_offset + key_len + data_len;
+  }
+
+  static size_t encode(bytes out, uint64_t target_node_id,
+                       bm_common_config_partition_e partition,
+                       std::string_view key, const_bytes data) {
+    if (key.size() > UINT8_MAX ||
+        out.size() < wire_size(key.size(), data.size())) {
+      return 0;
+    }
+    bm_common_config_set_t header = {};
+    header.header.target_node_id = target_node_id;
+    header.partition = partition;
+    header.key_length = key.size();
+    header.data_length = data.size();
+    detail::store(&out[header_size], header);
+    std::memcpy(&out[key_offset], key.data(), key.size());
+    std::memcpy(&out[key_offset + key.size()], data.data(), data.size());
+    return detail::finish(out, BM_SERIAL_CFG_SET,
+                          wire_size(key.size(), data.size()));
+  }
+
+  static bm_serial_error_e decode_payload(const_bytes in, cfg_set_view &cfg) {
+    if (in.size() < header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    auto header = detail::load<bm_common_config_set_t>(in.data());
+    if ((size_t)header.key_length + header.data_length >
+        in.size() - header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    cfg.target_node_id = header.header.target_node_id;
+    cfg.source_node_id = header.header.source_node_id;
+    cfg.partition = header.partition;
+    cfg.key =
+        std::string_view((const char *)&in[header_len], header.key_length);
+    cfg.data =
+        const_bytes(&in[header_len + header.key_length], header.data_length);
+    return BM_SERIAL_OK;
+  }
+
+  static bm_serial_error_e decode(const_bytes in, cfg_set_view &cfg) {
+    return detail::decode<message>(in, cfg);
+  }
+};
+
+struct cfg_value_view {
+  uint64_t target_node_id;
+  uint64_t source_node_id;
+  bm_common_config_partition_e partition;
+  const_bytes data;
+};
+
+template <> struct message<BM_SERIAL_CFG_VALUE> {
+  static constexpr bm_serial_message_t type = BM_SERIAL_CFG_VALUE;
+  static constexpr size_t header_len = sizeof(bm_common_config_value_t);
+  static constexpr size_t data_offset = header_size + header_len;
+  static constexpr size_t wire_size(size_t data_len) {
+    return data_offset + data_len;
+  }
+
+  static size_t encode(bytes out, uint64_t source_node_id,
+                       bm_common_config_partition_e partition,
+                       const_bytes data) {
+    if (out.size() < wire_size(data.size())) {
+      return 0;
+    }
+    bm_common_config_value_t header = {};
+    header.header.source_node_id = source_node_id;
+    header.partition = partition;
+    header.data_length = data.size();
+    detail::store(&out[header_size], header);
+    std::memcpy(&out[data_offset], data.data(), data.size());
+    return detail::finish(out, BM_SERIAL_CFG_VALUE, wire_size(data.size()));
+  }
+
+  static bm_serial_error_e decode_payload(const_bytes in,
+                                          cfg_value_view &cfg) {
+    if (in.size() < header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    auto header = detail::load<bm_common_config_value_t>(in.data());
+    if (header.data_length > in.size() - header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    cfg.target_node_id = header.header.target_node_id;
+    cfg.source_node_id = header.header.source_node_id;
+    cfg.partition = header.partition;
+    cfg.data = const_bytes(&in[header_len], header.data_length);
+    return BM_SERIAL_OK;
+  }
+
+  static bm_serial_error_e decode(const_bytes in, cfg_value_view &cfg) {
+    return detail::decode<message>(in, cfg);
+  }
+};
+
+template <>
+struct message<BM_SERIAL_CFG_COMMIT>
+    : fixed_message<BM_SERIAL_CFG_COMMIT, bm_common_config_commit_t> {};
+template <>
+struct message<BM_SERIAL_CFG_STATUS_REQ>
+    : fixed_message<BM_SERIAL_CFG_STATUS_REQ,
+                    bm_common_config_status_request_t> {};
+
+struct cfg_status_view {
+  uint64_t target_node_id;
+  uint64_t source_node_id;
+  bm_common_config_partition_e partition;
+  bool committed;
+  uint8_t num_keys;
+  // Length prefixed keys, see for_each_key()
+  const_bytes keys;
+};
+
+template <> struct message<BM_SERIAL_CFG_STATUS_RESP> {
+  static constexpr bm_serial_message_t type = BM_SERIAL_CFG_STATUS_RESP;
+  static constexpr size_t header_len =
+      sizeof(bm_common_config_status_response_t);
+  static constexpr size_t keys_offset = header_size + header_len;
+  static size_t wire_size(span<const std::string_view> keys) {
+    return keys_offset + detail::list_wire_size<uint8_t>(keys);
+  }
+
+  static size_t encode(bytes out, uint64_t source_node_id,
+                       bm_common_config_partition_e partition, bool committed,
+                       span<const std::string_view> keys) {
+    if (keys.size() > UINT8_MAX || !detail::list_fits<uint8_t>(keys) ||
+        out.size() < wire_size(keys)) {
+      return 0;
+    }
+    bm_common_config_status_response_t header = {};
+    header.header.source_node_id = source_node_id;
+    header.partition = partition;
+    header.committed = committed;
+    header.num_keys = keys.size();
+    detail::store(&out[header_size], header);
+    detail::list_encode<uint8_t>(&out[keys_offset], keys);
+    return detail::finish(out, BM_SERIAL_CFG_STATUS_RESP, wire_size(keys));
+  }
+
+  static bm_serial_error_e decode_payload(const_bytes in,
+                                          cfg_status_view &status) {
+    if (in.size() < header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    auto header = detail::load<bm_common_config_status_response_t>(in.data());
+    size_t keys_len;
+    if (!detail::list_size<uint8_t>(in.subspan(header_len), header.num_keys,
+                                    keys_len)) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    status.target_node_id = header.header.target_node_id;
+    status.source_node_id = header.header.source_node_id;
+    status.partition = header.partition;
+    status.committed = header.committed;
+    status.num_keys = header.num_keys;
+    status.keys = const_bytes(&in[header_len], keys_len);
+    return BM_SERIAL_OK;
+  }
+
+  static bm_serial_error_e decode(const_bytes in, cfg_status_view &status) {
+    return detail::decode<message>(in, status);
+  }
+
+  // Call fn(std::string_view) with every key
+  template <typename Fn>
+  static void for_each_key(const cfg_status_view &status, Fn &&fn) {
+    detail::list_for_each<uint8_t>(status.keys, std::forward<Fn>(fn));
+  }
+};
+
+struct cfg_del_view {
+  uint64_t target_node_id;
+  uint64_t source_node_id;
+  bm_common_config_partition_e partition;
+  bool success;
+  std::string_view key;
+};
+
+template <> struct message<BM_SERIAL_CFG_DEL_RESP> {
+  static constexpr bm_serial_message_t type = BM_SERIAL_CFG_DEL_RESP;
+  static constexpr size_t header_len =
+      sizeof(bm_common_config_delete_key_response_t);
+  static constexpr size_t key_offset = header_size + header_len;
+  static constexpr size_t wire_size(size_t key_len) {
+    return key_offset + key_len;
+  }
+
+  static size_t encode(bytes out, uint64_t source_node_id,
+                       bm_common_config_partition_e partition,
+                       std::string_view key, bool success) {
+    if (key.size() > UINT8_MAX || out.size() < wire_size(key.size())) {
+      return 0;
+    }
+    bm_common_config_delete_key_response_t header = {};
+    header.header.source_node_id = source_node_id;
+    header.partition = partition;
+    header.success = success;
+    header.key_length = key.size();
+    detail::store(&out[header_size], header);
+    std::memcpy(&out[key_offset], key.data(), key.size());
+    return detail::finish(out, BM_SERIAL_CFG_DEL_RESP, wire_size(key.size()));
+  }
+
+  static bm_serial_error_e decode_payload(const_bytes in, cfg_del_view &del) {
+    if (in.size() < header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    auto header =
+        detail::load<bm_common_config_delete_key_response_t>(in.data());
+    if (header.key_length > in.size() - header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    del.target_node_id = header.header.target_node_id;
+    del.source_node_id = header.header.source_node_id;
+    del.partition = header.partition;
+    del.success = header.success;
+    del.key =
+        std::string_view((const char *)&in[header_len], header.key_length);
+    return BM_SERIAL_OK;
+  }
+
+  static bm_serial_error_e decode(const_bytes in, cfg_del_view &del) {
+    return detail::decode<message>(in, del);
+  }
+};
+
+struct network_info_view {
+  uint32_t network_crc32;
+  bm_common_config_crc_t config_crc;
+  bm_common_fw_version_t fw_info;
+  uint16_t num_nodes;
+  // num_nodes node ids, unaligned (see node())
+  const_bytes nodes;
+  // CBOR config map
+  const_bytes map;
+
+  uint64_t node(size_t idx) const {
+    return detail::load<uint64_t>(&nodes[idx * sizeof(uint64_t)]);
+  }
+};
+
+template <> struct message<BM_SERIAL_NETWORK_INFO> {
+  static constexpr bm_serial_message_t type = BM_SERIAL_NETWORK_INFO;
+  static constexpr size_t header_len = sizeof(bm_common_network_info_t);
+  static constexpr size_t nodes_offset = header_size + header_len;
+  static constexpr size_t wire_size(size_t num_nodes, size_t map_len) {
+    return nodes_offset + num_nodes * sizeof(uint64_t) + map_len;
+  }
+
+  // num_nodes and map_size_bytes in info are filled in from nodes and map
+  static size_t encode(bytes out, const bm_common_network_info_t &info,
+                       span<const uint64_t> nodes, const_bytes map) {
+    if (nodes.size() > UINT16_MAX || map.size() > UINT16_MAX ||
+        out.size() < wire_size(nodes.size(), map.size())) {
+      return 0;
+    }
+    bm_common_network_info_t header = info;
+    header.num_nodes = nodes.size();
+    header.map_size_bytes = map.size();
+    detail::store(&out[header_size], header);
+    size_t nodes_len = nodes.size() * sizeof(uint64_t);
+    std::memcpy(&out[nodes_offset], nodes.data(), nodes_len);
+    std::memcpy(&out[nodes_offset + nodes_len], map.data(), map.size());
+    return detail::finish(out, BM_SERIAL_NETWORK_INFO,
+                          wire_size(nodes.size(), map.size()));
+  }
+
+  static bm_serial_error_e decode_payload(const_bytes in,
+                                          network_info_view &info) {
+    if (in.size() < header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    auto header = detail::load<bm_common_network_info_t>(in.data());
+    size_t nodes_len = header.num_nodes * sizeof(uint64_t);
+    if (nodes_len + header.map_size_bytes > in.size() - header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    info.network_crc32 = header.network_crc32;
+    info.config_crc = header.config_crc;
+    info.fw_info = header.fw_info;
+    info.num_nodes = header.num_nodes;
+    info.nodes = const_bytes(&in[header_len], nodes_len);
+    info.map = const_bytes(&in[header_len + nodes_len], header.map_size_bytes);
+    return BM_SERIAL_OK;
+  }
+
+  static bm_serial_error_e decode(const_bytes in, network_info_view &info) {
+    return detail::decode<message>(in, info);
+  }
+};
+
+struct device_info_view {
+  bm_serial_device_info_t info;
+  std::string_view version;
+  std::string_view name;
+};
+
+template <> struct message<BM_SERIAL_DEVICE_INFO_REPLY> {
+  static constexpr bm_serial_message_t type = BM_SERIAL_DEVICE_INFO_REPLY;
+  static constexpr size_t header_len = sizeof(bm_serial_device_info_reply_t);
+  static constexpr size_t strings_offset = header_size + header_len;
+  static constexpr size_t wire_size(size_t version_len, size_t name_len) {
+    return strings_offset + version_len + name_len;
+  }
+
+  static size_t encode(bytes out, const bm_serial_device_info_t &info,
+                       std::string_view version, std::string_view name) {
+    if (version.size() > UINT8_MAX || name.size() > UINT8_MAX ||
+        out.size() < wire_size(version.size(), name.size())) {
+      return 0;
+    }
+    bm_serial_device_info_reply_t header = {};
+    header.info = info;
+    header.ver_str_len = version.size();
+    header.dev_name_len = name.size();
+    detail::store(&out[header_size], header);
+    std::memcpy(&out[strings_offset], version.data(), version.size());
+    std::memcpy(&out[strings_offset + version.size()], name.data(),
+                name.size());
+    return detail::finish(out, BM_SERIAL_DEVICE_INFO_REPLY,
+                          wire_size(version.size(), name.size()));
+  }
+
+  static bm_serial_error_e decode_payload(const_bytes in,
+                                          device_info_view &info) {
+    if (in.size() < header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    auto header = detail::load<bm_serial_device_info_reply_t>(in.data());
+    if ((size_t)header.ver_str_len + header.dev_name_len >
+        in.size() - header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    const char *strings = (const char *)&in[header_len];
+    info.info = header.info;
+    info.version = std::string_view(strings, header.ver_str_len);
+    info.name =
+        std::string_view(&strings[header.ver_str_len], header.dev_name_len);
+    return BM_SERIAL_OK;
+  }
+
+  static bm_serial_error_e decode(const_bytes in, device_info_view &info) {
+    return detail::decode<message>(in, info);
+  }
+};
+
+struct resource_table_view {
+  uint64_t node_id;
+  uint16_t num_pubs;
+  uint16_t num_subs;
+  // bm_serial_resource_t list, pubs first, see for_each_resource()
+  const_bytes resources;
+};
+
+template <> struct message<BM_SERIAL_RESOURCE_REPLY> {
+  static constexpr bm_serial_message_t type = BM_SERIAL_RESOURCE_REPLY;
+  static constexpr size_t header_len =
+      sizeof(bm_serial_resource_table_reply_t);
+  static constexpr size_t list_offset = header_size + header_len;
+  static size_t wire_size(span<const std::string_view> pubs,
+                          span<const std::string_view> subs) {
+    return list_offset + detail::list_wire_size<uint16_t>(pubs) +
+           detail::list_wire_size<uint16_t>(subs);
+  }
+
+  static size_t encode(bytes out, uint64_t node_id,
+                       span<const std::string_view> pubs,
+                       span<const std::string_view> subs) {
+    if (pubs.size() > UINT16_MAX || subs.size() > UINT16_MAX ||
+        !detail::list_fits<uint16_t>(pubs) ||
+        !detail::list_fits<uint16_t>(subs) ||
+        out.size() < wire_size(pubs, subs)) {
+      return 0;
+    }
+    bm_serial_resource_table_reply_t header = {};
+    header.node_id = node_id;
+    header.num_pubs = pubs.size();
+    header.num_subs = subs.size();
+    detail::store(&out[header_size], header);
+    size_t len = detail::list_encode<uint16_t>(&out[list_offset], pubs);
+    detail::list_encode<uint16_t>(&out[list_offset + len], subs);
+    return detail::finish(out, BM_SERIAL_RESOURCE_REPLY,
+                          wire_size(pubs, subs));
+  }
+
+  static bm_serial_error_e decode_payload(const_bytes in,
+                                          resource_table_view &table) {
+    if (in.size() < header_len) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    auto header = detail::load<bm_serial_resource_table_reply_t>(in.data());
+    size_t count = (size_t)header.num_pubs + header.num_subs;
+    size_t list_len;
+    if (!detail::list_size<uint16_t>(in.subspan(header_len), count,
+                                     list_len)) {
+      return BM_SERIAL_INVALID_MSG_LEN;
+    }
+    table.node_id = header.node_id;
+    table.num_pubs = header.num_pubs;
+    table.num_subs = header.num_subs;
+    table.resources = const_bytes(&in[header_len], list_len);
+    return BM_SERIAL_OK;
+  }
+
+  static bm_serial_error_e decode(const_bytes in, resource_table_view &table) {
+    return detail::decode<message>(in, table);
+  }
+
+  // Call fn(std::string_view name, bool pub) with every resource
+  template <typename Fn>
+  static void for_each_resource(const resource_table_view &table, Fn &&fn) {
+    size_t idx = 0;
+    detail::list_for_each<uint16_t>(
+        table.resources,
+        [&](std::string_view name) { fn(name, idx++ < table.num_pubs); });
+  }
+};
+
+} // namespace bm_serial
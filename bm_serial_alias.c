@@ -0,0 +1,205 @@
+#include "bm_serial_alias.h"
+#include <stdint.h>
+#include <string.h>
+
+/*!
+  Find the entry to (re)use for a new topic, a free one or the least recently
+  used one
+
+  \param[in] *entries table
+  \param[out] *evicted true if a topic has to be evicted
+  \return entry
+*/
+static bm_serial_alias_entry_t *
+_bm_serial_alias_victim(bm_serial_alias_entry_t *entries, bool *evicted) {
+  bm_serial_alias_entry_t *victim = &entries[0];
+  for (size_t idx = 0; idx < BM_SERIAL_ALIAS_ENTRIES; idx++) {
+    if (!entries[idx].topic_len) {
+      *evicted = false;
+      return &entries[idx];
+    }
+    if (entries[idx].used < victim->used) {
+      victim = &entries[idx];
+    }
+  }
+
+  *evicted = true;
+  return victim;
+}
+
+/*!
+  Enable topic aliasing on a bm_serial instance
+
+  \param[out] *alias alias tables
+  \param[in] *ctx bm_serial instance
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_alias_init(bm_serial_alias_t *alias,
+                                       bm_serial_ctx_t *ctx) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!alias || !ctx) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    memset(alias, 0, sizeof(bm_serial_alias_t));
+    for (uint16_t idx = 0; idx < BM_SERIAL_ALIAS_ENTRIES; idx++) {
+      alias->tx[idx].alias = idx;
+    }
+
+    ctx->alias = alias;
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Get the alias for a topic being published, assigning one (evicting the least
+  recently used topic if needed) the first time
+
+  \param[in] *alias alias tables
+  \param[in] *topic topic
+  \param[in] topic_len topic length (1 to BM_SERIAL_ALIAS_MAX_TOPIC_LEN)
+  \return entry for the topic, the caller reports it with
+          bm_serial_alias_tx_registered() once the topic was sent with the
+          alias
+*/
+bm_serial_alias_entry_t *bm_serial_alias_tx(bm_serial_alias_t *alias,
+                                            const char *topic,
+                                            uint16_t topic_len) {
+  bm_serial_alias_entry_t *entry = NULL;
+
+  for (size_t idx = 0; idx < BM_SERIAL_ALIAS_ENTRIES; idx++) {
+    if (alias->tx[idx].topic_len == topic_len &&
+        !memcmp(alias->tx[idx].topic, topic, topic_len)) {
+      entry = &alias->tx[idx];
+      break;
+    }
+  }
+
+  if (!entry) {
+    bool evicted;
+    entry = _bm_serial_alias_victim(alias->tx, &evicted);
+    if (evicted) {
+      alias->stats.tx_evictions++;
+    }
+    memcpy(entry->topic, topic, topic_len);
+    entry->topic_len = topic_len;
+    entry->generation++;
+    entry->registered = false;
+  }
+
+  if (entry->registered) {
+    alias->stats.tx_hits++;
+  } else {
+    alias->stats.tx_registrations++;
+  }
+  entry->used = ++alias->clock;
+
+  return entry;
+}
+
+/*!
+  A pub registering an alias was sent. Ignored if the alias went to another
+  topic in the meantime.
+
+  \param[in] *alias alias tables
+  \param[in] id alias
+  \param[in] generation generation the pub was sent with
+  \return none
+*/
+void bm_serial_alias_tx_registered(bm_serial_alias_t *alias, uint16_t id,
+                                   uint16_t generation) {
+  if (id < BM_SERIAL_ALIAS_ENTRIES &&
+      alias->tx[id].generation == generation) {
+    alias->tx[id].registered = true;
+  }
+}
+
+/*!
+  Receiver doesn't know an alias, send its topic again next time
+
+  \param[in] *alias alias tables
+  \param[in] id alias, BM_SERIAL_ALIAS_ALL for all of them
+  \return none
+*/
+void bm_serial_alias_tx_reset(bm_serial_alias_t *alias, uint16_t id) {
+  alias->stats.resets_received++;
+  for (size_t idx = 0; idx < BM_SERIAL_ALIAS_ENTRIES; idx++) {
+    if (id == BM_SERIAL_ALIAS_ALL || alias->tx[idx].alias == id) {
+      alias->tx[idx].registered = false;
+    }
+  }
+}
+
+/*!
+  Remember the topic for a received alias
+
+  \param[in] *alias alias tables
+  \param[in] id alias
+  \param[in] generation generation the sender registered it with
+  \param[in] *topic topic
+  \param[in] topic_len topic length (1 to BM_SERIAL_ALIAS_MAX_TOPIC_LEN)
+  \return none
+*/
+void bm_serial_alias_rx_set(bm_serial_alias_t *alias, uint16_t id,
+                            uint16_t generation, const char *topic,
+                            uint16_t topic_len) {
+  bm_serial_alias_entry_t *entry = NULL;
+
+  for (size_t idx = 0; idx < BM_SERIAL_ALIAS_ENTRIES; idx++) {
+    if (alias->rx[idx].topic_len && alias->rx[idx].alias == id) {
+      entry = &alias->rx[idx];
+      break;
+    }
+  }
+
+  if (!entry) {
+    bool evicted;
+    entry = _bm_serial_alias_victim(alias->rx, &evicted);
+    if (evicted) {
+      alias->stats.rx_evictions++;
+    }
+    entry->alias = id;
+  }
+
+  memcpy(entry->topic, topic, topic_len);
+  entry->topic_len = topic_len;
+  entry->generation = generation;
+  entry->used = ++alias->clock;
+  alias->stats.rx_registrations++;
+}
+
+/*!
+  Look up the topic for a received alias
+
+  \param[in] *alias alias tables
+  \param[in] id alias
+  \param[in] generation generation the pub was sent with
+  \param[out] *topic_len topic length
+  \return topic (valid until the next registration), NULL if unknown or
+          registered for an older generation
+*/
+const char *bm_serial_alias_rx_get(bm_serial_alias_t *alias, uint16_t id,
+                                   uint16_t generation, uint16_t *topic_len) {
+  for (size_t idx = 0; idx < BM_SERIAL_ALIAS_ENTRIES; idx++) {
+    bm_serial_alias_entry_t *entry = &alias->rx[idx];
+    if (entry->topic_len && entry->alias == id) {
+      if (entry->generation != generation) {
+        // Sender gave the alias to another topic and we missed it
+        alias->stats.rx_stale++;
+        return NULL;
+      }
+      entry->used = ++alias->clock;
+      alias->stats.rx_hits++;
+      *topic_len = entry->topic_len;
+      return (const char *)entry->topic;
+    }
+  }
+
+  alias->stats.rx_unknown++;
+  return NULL;
+}
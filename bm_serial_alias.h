@@ -0,0 +1,94 @@
+#pragma once
+
+#include "bm_serial.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Topics remembered in each direction
+#ifndef BM_SERIAL_ALIAS_ENTRIES
+#define BM_SERIAL_ALIAS_ENTRIES 32
+#endif
+
+// Longest topic that gets an alias (MAX_TOPIC_LEN in bm_serial.c)
+#define BM_SERIAL_ALIAS_MAX_TOPIC_LEN 64
+
+typedef struct {
+  uint8_t topic[BM_SERIAL_ALIAS_MAX_TOPIC_LEN];
+  // 0 if the entry is free
+  uint16_t topic_len;
+  uint16_t alias;
+  // Sender, bumped every time the alias gets a new topic. Receiver, the
+  // generation the topic was registered with.
+  uint16_t generation;
+  // Last use, for LRU eviction
+  uint32_t used;
+  // Sender, the topic was sent with the alias
+  bool registered;
+} bm_serial_alias_entry_t;
+
+typedef struct {
+  // Sender, pubs sent with only the alias and with the topic
+  uint32_t tx_hits;
+  uint32_t tx_registrations;
+  uint32_t tx_evictions;
+  uint32_t resets_received;
+  // Receiver
+  uint32_t rx_hits;
+  uint32_t rx_registrations;
+  uint32_t rx_evictions;
+  uint32_t rx_unknown;
+  // Alias was registered for a topic the sender evicted since
+  uint32_t rx_stale;
+} bm_serial_alias_stats_t;
+
+//
+// Optional topic aliasing for pubs. The first pub on a topic is sent as a
+// BM_SERIAL_PUB_ALIAS with the topic and a 16 bit alias, later ones carry only
+// the alias. Each end keeps the BM_SERIAL_ALIAS_ENTRIES most recently used
+// topics. When the sender evicts a topic its alias is registered again with
+// the new one, under the next generation. A topic only counts as registered
+// once the pub carrying it was sent. When the receiver gets an alias it
+// doesn't have (evicted, registration lost, restarted), or has for another
+// generation (the new registration was lost), it drops the pub and answers
+// with a BM_SERIAL_ALIAS_RESET, so the next pub on that topic carries the full
+// topic again. While a bm_serial_*_reserve() packet is pending the reset waits
+// until it's committed or dropped, so it doesn't overwrite it.
+//
+// Both ends need aliasing enabled. Not thread safe, publish from one thread.
+//
+struct bm_serial_alias_s {
+  bm_serial_alias_entry_t tx[BM_SERIAL_ALIAS_ENTRIES];
+  bm_serial_alias_entry_t rx[BM_SERIAL_ALIAS_ENTRIES];
+  uint32_t clock;
+  // Receiver, BM_SERIAL_ALIAS_RESET held back while a reserved packet is
+  // being filled in (BM_SERIAL_ALIAS_ALL if more than one alias needs it)
+  bool reset_pending;
+  uint16_t reset_id;
+
+  bm_serial_alias_stats_t stats;
+};
+
+bm_serial_error_e bm_serial_alias_init(bm_serial_alias_t *alias,
+                                       bm_serial_ctx_t *ctx);
+
+// Used by bm_serial.c
+bm_serial_alias_entry_t *bm_serial_alias_tx(bm_serial_alias_t *alias,
+                                            const char *topic,
+                                            uint16_t topic_len);
+void bm_serial_alias_tx_registered(bm_serial_alias_t *alias, uint16_t id,
+                                   uint16_t generation);
+void bm_serial_alias_tx_reset(bm_serial_alias_t *alias, uint16_t id);
+void bm_serial_alias_rx_set(bm_serial_alias_t *alias, uint16_t id,
+                            uint16_t generation, const char *topic,
+                            uint16_t topic_len);
+const char *bm_serial_alias_rx_get(bm_serial_alias_t *alias, uint16_t id,
+                                   uint16_t generation, uint16_t *topic_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,240 @@
+#include "bm_serial_async.h"
+#include <stdint.h>
+#include <string.h>
+
+// Handshake between _bm_serial_async_run() and bm_serial_async_tx_done() for
+// drivers that finish (or call tx_done from an interrupt) before tx_start_fn
+// returns
+typedef enum {
+  ASYNC_IDLE = 0,
+  ASYNC_STARTING,
+  ASYNC_IN_FLIGHT,
+  ASYNC_DONE_OK,
+  ASYNC_DONE_FAIL,
+} _bm_serial_async_state_e;
+
+/*!
+  Report a finished packet and give it back to the pool
+
+  \param[in] *async async transmitter
+  \param[in] *pkt packet
+  \param[in] success true if it was sent
+  \return none
+*/
+static void _bm_serial_async_complete(bm_serial_async_t *async,
+                                      bm_serial_pkt_t *pkt, bool success) {
+  bm_serial_ctx_t *ctx = async->ctx;
+  if (success) {
+    async->stats.completed++;
+    ctx->stats.tx_packets++;
+    ctx->stats.tx_bytes += pkt->len;
+  } else {
+    async->stats.failed++;
+    ctx->stats.tx_errors++;
+  }
+
+  if (async->cfg.complete_fn) {
+    async->cfg.complete_fn(async->cfg.arg, pkt, success);
+  }
+
+  bm_serial_pkt_release(pkt);
+}
+
+/*!
+  Release backpressure once the ring drains to the low watermark
+
+  \param[in] *async async transmitter
+  \return none
+*/
+static void _bm_serial_async_check_low(bm_serial_async_t *async) {
+  if (__atomic_load_n(&async->above, __ATOMIC_SEQ_CST) &&
+      bm_serial_async_pending(async) <= async->cfg.low_watermark &&
+      __atomic_exchange_n(&async->above, false, __ATOMIC_SEQ_CST)) {
+    async->cfg.watermark_fn(async->cfg.arg, false);
+  }
+}
+
+/*!
+  Start sending queued packets until one is in flight or the ring is empty.
+  Caller must own async->busy.
+
+  \param[in] *async async transmitter
+  \return none
+*/
+static void _bm_serial_async_run(bm_serial_async_t *async) {
+  while (true) {
+    bm_serial_pkt_t *pkt = (bm_serial_pkt_t *)bm_serial_ring_pop(&async->ring);
+    _bm_serial_async_check_low(async);
+    if (!pkt) {
+      __atomic_store_n(&async->busy, false, __ATOMIC_SEQ_CST);
+
+      // A producer might have queued a packet after the pop but before busy
+      // was cleared, in which case it saw us busy and didn't start it
+      if (!bm_serial_ring_peek(&async->ring) ||
+          __atomic_exchange_n(&async->busy, true, __ATOMIC_SEQ_CST)) {
+        return;
+      }
+      continue;
+    }
+
+    async->current = pkt;
+    __atomic_store_n(&async->state, ASYNC_STARTING, __ATOMIC_RELEASE);
+    if (!async->cfg.tx_start_fn(async->cfg.arg, &pkt->buff[pkt->offset],
+                                pkt->len)) {
+      async->current = NULL;
+      __atomic_store_n(&async->state, ASYNC_IDLE, __ATOMIC_RELAXED);
+      _bm_serial_async_complete(async, pkt, false);
+      continue;
+    }
+
+    uint8_t state = ASYNC_STARTING;
+    if (__atomic_compare_exchange_n(&async->state, &state, ASYNC_IN_FLIGHT,
+                                    false, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE)) {
+      // bm_serial_async_tx_done() carries on from here
+      return;
+    }
+
+    // Driver finished before tx_start_fn returned
+    async->current = NULL;
+    __atomic_store_n(&async->state, ASYNC_IDLE, __ATOMIC_RELAXED);
+    _bm_serial_async_complete(async, pkt, state == ASYNC_DONE_OK);
+  }
+}
+
+/*!
+  Initialize an async transmitter and attach it to an instance. Packets sent
+  with the instance are built in pool blocks and queued instead of going to
+  tx_fn, and the send functions return as soon as they are queued.
+
+  \param[out] *async async transmitter
+  \param[in] *ctx bm_serial instance
+  \param[in] *pool initialized packet pool
+  \param[in] *cells ring storage
+  \param[in] num_cells max number of queued packets (must be a power of 2)
+  \param[in] *cfg transmit and notification callbacks (copied)
+  \return BM_SERIAL_OK if initialized, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_async_init(bm_serial_async_t *async,
+                                       bm_serial_ctx_t *ctx,
+                                       bm_serial_pool_t *pool,
+                                       bm_serial_ring_cell_t *cells,
+                                       size_t num_cells,
+                                       const bm_serial_async_cfg_t *cfg) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!async || !ctx || !pool || !cells || !cfg) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    if (!cfg->tx_start_fn) {
+      rval = BM_SERIAL_MISSING_CALLBACK;
+      break;
+    }
+
+    if (cfg->watermark_fn && (cfg->low_watermark >= cfg->high_watermark ||
+                              cfg->high_watermark > num_cells)) {
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+
+    memset(async, 0, sizeof(bm_serial_async_t));
+    rval = bm_serial_ring_init(&async->ring, cells, num_cells);
+    if (rval) {
+      break;
+    }
+    async->ctx = ctx;
+    memcpy(&async->cfg, cfg, sizeof(bm_serial_async_cfg_t));
+
+    bm_serial_ctx_set_pool(ctx, pool, bm_serial_async_sink, async);
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Packet sink (see bm_serial_ctx_set_pool()) that queues packets for async
+  transmit, and starts transmitting if the wire is idle
+
+  \param[in] *arg async transmitter
+  \param[in] *pkt finished packet
+  \return BM_SERIAL_OK if queued, BM_SERIAL_OUT_OF_MEMORY if the ring is full
+*/
+bm_serial_error_e bm_serial_async_sink(void *arg, bm_serial_pkt_t *pkt) {
+  bm_serial_async_t *async = (bm_serial_async_t *)arg;
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!bm_serial_ring_push(&async->ring, pkt)) {
+      __atomic_fetch_add(&async->stats.dropped, 1, __ATOMIC_RELAXED);
+      bm_serial_pkt_release(pkt);
+      rval = BM_SERIAL_OUT_OF_MEMORY;
+      break;
+    }
+    __atomic_fetch_add(&async->stats.enqueued, 1, __ATOMIC_RELAXED);
+
+    uint16_t depth = bm_serial_async_pending(async);
+    uint16_t max_depth =
+        __atomic_load_n(&async->stats.max_depth, __ATOMIC_RELAXED);
+    while (depth > max_depth &&
+           !__atomic_compare_exchange_n(&async->stats.max_depth, &max_depth,
+                                        depth, true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+    }
+
+    if (async->cfg.watermark_fn && depth >= async->cfg.high_watermark &&
+        !__atomic_exchange_n(&async->above, true, __ATOMIC_SEQ_CST)) {
+      async->cfg.watermark_fn(async->cfg.arg, true);
+    }
+
+    if (!__atomic_exchange_n(&async->busy, true, __ATOMIC_SEQ_CST)) {
+      _bm_serial_async_run(async);
+    }
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Called by the driver when the transfer started by tx_start_fn finishes.
+  Reports the packet and starts the next one. Can be called from an interrupt
+  as long as the callbacks can, including from inside tx_start_fn.
+
+  \param[in] *async async transmitter
+  \param[in] success true if the packet was sent
+  \return none
+*/
+void bm_serial_async_tx_done(bm_serial_async_t *async, bool success) {
+  uint8_t state = ASYNC_STARTING;
+  if (__atomic_compare_exchange_n(&async->state, &state,
+                                  success ? ASYNC_DONE_OK : ASYNC_DONE_FAIL,
+                                  false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    // Still inside tx_start_fn, _bm_serial_async_run() picks it up
+    return;
+  }
+
+  if (state != ASYNC_IN_FLIGHT) {
+    // Nothing in flight
+    return;
+  }
+
+  bm_serial_pkt_t *pkt = async->current;
+  async->current = NULL;
+  __atomic_store_n(&async->state, ASYNC_IDLE, __ATOMIC_RELAXED);
+  _bm_serial_async_complete(async, pkt, success);
+  _bm_serial_async_run(async);
+}
+
+/*!
+  Number of queued packets, not including the one being transmitted
+
+  \param[in] *async async transmitter
+  \return packets waiting to be sent
+*/
+size_t bm_serial_async_pending(bm_serial_async_t *async) {
+  return bm_serial_ring_count(&async->ring);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "bm_serial.h"
+#include "bm_serial_pool.h"
+#include "bm_serial_ring.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  // Start transmitting buff and return right away (e.g. kick off a DMA or
+  // interrupt driven UART transfer). buff stays valid until the driver calls
+  // bm_serial_async_tx_done(). Return false if the transfer couldn't start.
+  bool (*tx_start_fn)(void *arg, const uint8_t *buff, size_t len);
+
+  // Optional, called once per packet after it was sent (or failed)
+  void (*complete_fn)(void *arg, const bm_serial_pkt_t *pkt, bool success);
+
+  // Optional, called with true when the number of queued packets reaches
+  // high_watermark and with false once it drains back down to low_watermark.
+  // Producers should hold off sending in between.
+  void (*watermark_fn)(void *arg, bool above);
+
+  void *arg;
+  uint16_t high_watermark;
+  uint16_t low_watermark;
+} bm_serial_async_cfg_t;
+
+typedef struct {
+  uint32_t enqueued;
+  uint32_t completed;
+  uint32_t failed;
+  // Packets dropped because the ring was full
+  uint32_t dropped;
+  uint16_t max_depth;
+} bm_serial_async_stats_t;
+
+//
+// Asynchronous transmit. Packets built by the instance (in pool blocks) are
+// put in a bounded lock-free ring and the send returns right away. The ring
+// is drained by whoever finds the wire idle: the sending thread when it
+// enqueues, then the driver's completion (bm_serial_async_tx_done()) for
+// every packet after that, so the wire stays busy without a writer thread.
+//
+typedef struct {
+  bm_serial_ctx_t *ctx;
+  bm_serial_async_cfg_t cfg;
+
+  // Queued packets
+  bm_serial_ring_t ring;
+
+  // Set while a packet is being transmitted (owner drains the ring)
+  bool busy;
+  uint8_t state;
+  bm_serial_pkt_t *current;
+
+  // Above the high watermark, waiting to drain to the low one
+  bool above;
+
+  bm_serial_async_stats_t stats;
+} bm_serial_async_t;
+
+bm_serial_error_e bm_serial_async_init(bm_serial_async_t *async,
+                                       bm_serial_ctx_t *ctx,
+                                       bm_serial_pool_t *pool,
+                                       bm_serial_ring_cell_t *cells,
+                                       size_t num_cells,
+                                       const bm_serial_async_cfg_t *cfg);
+bm_serial_error_e bm_serial_async_sink(void *arg, bm_serial_pkt_t *pkt);
+void bm_serial_async_tx_done(bm_serial_async_t *async, bool success);
+size_t bm_serial_async_pending(bm_serial_async_t *async);
+
+#ifdef __cplusplus
+}
+#endif
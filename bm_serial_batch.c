@@ -0,0 +1,323 @@
+#include "bm_serial_batch.h"
+#include <stdint.h>
+#include <string.h>
+
+/*!
+  Send the pending entries. A single entry goes out as a normal packet, there's
+  nothing to save by wrapping it.
+
+  \param[in] *batch aggregator
+  \return BM_SERIAL_OK if sent (or nothing was pending), nonzero otherwise
+*/
+static bm_serial_error_e _bm_serial_batch_send(bm_serial_batch_t *batch) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!batch->count) {
+      break;
+    }
+
+    if (batch->count == 1) {
+      bm_serial_batch_entry_t *entry = (bm_serial_batch_entry_t *)batch->buff;
+      rval = bm_serial_ctx_tx(batch->ctx, (bm_serial_message_t)entry->type,
+                              entry->payload, entry->len);
+      batch->stats.singles++;
+    } else {
+      rval = bm_serial_ctx_tx(batch->ctx, BM_SERIAL_BATCH, batch->buff,
+                              batch->len);
+      batch->stats.batches++;
+    }
+
+    if (rval) {
+      batch->stats.dropped += batch->count;
+    }
+
+    batch->len = 0;
+    batch->count = 0;
+    batch->pub_pending = false;
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Send the batch if nothing else fits or the oldest message is due
+
+  \param[in] *batch aggregator
+  \param[in] now current time
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+static bm_serial_error_e _bm_serial_batch_check(bm_serial_batch_t *batch,
+                                                uint32_t now) {
+  if (!batch->count) {
+    return BM_SERIAL_OK;
+  }
+
+  if ((size_t)(batch->cfg.max_len - batch->len) <=
+      sizeof(bm_serial_batch_entry_t)) {
+    batch->stats.size_flushes++;
+    return _bm_serial_batch_send(batch);
+  }
+
+  if (now - batch->first_at >= batch->cfg.max_delay) {
+    batch->stats.deadline_flushes++;
+    return _bm_serial_batch_send(batch);
+  }
+
+  return BM_SERIAL_OK;
+}
+
+/*!
+  Make room for an entry at the end of the batch, sending the batch first if
+  the entry doesn't fit
+
+  \param[in] *batch aggregator
+  \param[in] type message type
+  \param[in] flags entry flags
+  \param[in] len message length
+  \param[in] now current time
+  \param[out] **payload where the message goes
+  \return BM_SERIAL_OK if there's room, BM_SERIAL_OVERFLOW if the message is
+          too big to batch, nonzero otherwise
+*/
+static bm_serial_error_e _bm_serial_batch_entry(bm_serial_batch_t *batch,
+                                                bm_serial_message_t type,
+                                                uint8_t flags, size_t len,
+                                                uint32_t now,
+                                                uint8_t **payload) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    size_t entry_len = sizeof(bm_serial_batch_entry_t) + len;
+    if (entry_len > batch->cfg.max_len) {
+      rval = BM_SERIAL_OVERFLOW;
+      break;
+    }
+
+    if (entry_len > (size_t)(batch->cfg.max_len - batch->len)) {
+      batch->stats.size_flushes++;
+      // The new message is still added if this fails
+      _bm_serial_batch_send(batch);
+    }
+
+    if (!batch->count) {
+      batch->first_at = now;
+    }
+
+    bm_serial_batch_entry_t *entry =
+        (bm_serial_batch_entry_t *)&batch->buff[batch->len];
+    entry->type = type;
+    entry->flags = flags;
+    entry->len = len;
+    *payload = entry->payload;
+
+    batch->len += entry_len;
+    batch->count++;
+    batch->stats.messages++;
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Initialize a batch aggregator
+
+  \param[out] *batch aggregator
+  \param[in] *ctx bm_serial instance the batches are sent on
+  \param[in] *cfg config
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_batch_init(bm_serial_batch_t *batch,
+                                       bm_serial_ctx_t *ctx,
+                                       const bm_serial_batch_cfg_t *cfg) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!batch || !ctx || !cfg || !cfg->now_fn) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    if (cfg->max_len <= sizeof(bm_serial_batch_entry_t) ||
+        cfg->max_len > BM_SERIAL_BATCH_MAX_LEN) {
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+
+    memset(batch, 0, sizeof(bm_serial_batch_t));
+    batch->ctx = ctx;
+    batch->cfg = *cfg;
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Add a raw message to the batch. Messages that are too big to batch are sent
+  right away, after whatever was pending.
+
+  \param[in] *batch aggregator
+  \param[in] type bm_serial message type (not BM_SERIAL_ACK or BM_SERIAL_BATCH)
+  \param[in] *payload message payload, copied
+  \param[in] len payload length
+  \return BM_SERIAL_OK if batched (or sent), nonzero otherwise
+*/
+bm_serial_error_e bm_serial_batch_tx(bm_serial_batch_t *batch,
+                                     bm_serial_message_t type,
+                                     const uint8_t *payload, size_t len) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!payload) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    // Acks have to go out right away and batches don't nest
+    if (type == BM_SERIAL_ACK || type == BM_SERIAL_BATCH) {
+      rval = BM_SERIAL_UNSUPPORTED_MSG;
+      break;
+    }
+
+    uint32_t now = batch->cfg.now_fn();
+    uint8_t *data;
+    rval = _bm_serial_batch_entry(batch, type, 0, len, now, &data);
+    if (rval == BM_SERIAL_OVERFLOW) {
+      _bm_serial_batch_send(batch);
+      batch->stats.direct++;
+      rval = bm_serial_ctx_tx(batch->ctx, type, payload, len);
+      break;
+    }
+
+    memcpy(data, payload, len);
+    if (type == BM_SERIAL_PUB) {
+      // Later pubs can't repeat a header the receiver sees differently
+      batch->pub_pending = false;
+    }
+    rval = _bm_serial_batch_check(batch, now);
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Add a publish to the batch, see bm_serial_pub(). Publishes that are too big
+  to batch are sent right away, after whatever was pending.
+
+  \param[in] *batch aggregator
+  \param node_id node id of publisher
+  \param *topic topic to publish on
+  \param topic_len length of topic
+  \param *data data to publish, copied
+  \param data_len length of data
+  \param type data type
+  \param version data version
+  \return BM_SERIAL_OK if batched (or sent), BM_SERIAL_INVALID_TOPIC_LEN if
+          the topic is too long, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_batch_pub(bm_serial_batch_t *batch,
+                                      uint64_t node_id, const char *topic,
+                                      uint16_t topic_len, const uint8_t *data,
+                                      uint16_t data_len, uint8_t type,
+                                      uint8_t version) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!data && data_len) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    rval = bm_serial_ctx_validate_topic(batch->ctx, topic, topic_len);
+    if (rval == BM_SERIAL_OVERFLOW) {
+      // Not to be confused with a pub too big to batch
+      rval = BM_SERIAL_INVALID_TOPIC_LEN;
+    }
+    if (rval) {
+      break;
+    }
+
+    uint32_t now = batch->cfg.now_fn();
+
+    // Same header as the last pub, if it's still there after making room
+    bool repeat = false;
+    if (batch->pub_pending && sizeof(bm_serial_batch_entry_t) + data_len <=
+                                  (size_t)(batch->cfg.max_len - batch->len)) {
+      bm_serial_batch_entry_t *last =
+          (bm_serial_batch_entry_t *)&batch->buff[batch->pub_at];
+      bm_serial_pub_header_t *last_header =
+          (bm_serial_pub_header_t *)last->payload;
+      repeat = last_header->node_id == node_id && last_header->type == type &&
+               last_header->version == version &&
+               last_header->topic_len == topic_len &&
+               !memcmp(last_header->topic, topic, topic_len);
+    }
+
+    uint8_t *payload;
+    if (repeat) {
+      rval = _bm_serial_batch_entry(batch, BM_SERIAL_PUB,
+                                    BM_SERIAL_BATCH_FLAG_REPEAT, data_len, now,
+                                    &payload);
+      if (rval) {
+        break;
+      }
+      if (data_len) {
+        memcpy(payload, data, data_len);
+      }
+      batch->stats.repeats++;
+      rval = _bm_serial_batch_check(batch, now);
+      break;
+    }
+
+    size_t len = sizeof(bm_serial_pub_header_t) + topic_len + data_len;
+    rval = _bm_serial_batch_entry(batch, BM_SERIAL_PUB, 0, len, now, &payload);
+    if (rval == BM_SERIAL_OVERFLOW) {
+      _bm_serial_batch_send(batch);
+      batch->stats.direct++;
+      rval = bm_serial_ctx_pub(batch->ctx, node_id, topic, topic_len, data,
+                               data_len, type, version);
+      break;
+    }
+    batch->pub_at = batch->len - sizeof(bm_serial_batch_entry_t) - len;
+    batch->pub_pending = true;
+
+    bm_serial_pub_header_t *pub_header = (bm_serial_pub_header_t *)payload;
+    pub_header->node_id = node_id;
+    pub_header->type = type;
+    pub_header->version = version;
+    pub_header->topic_len = topic_len;
+    memcpy(pub_header->topic, topic, topic_len);
+    if (data_len) {
+      memcpy(&pub_header->topic[topic_len], data, data_len);
+    }
+
+    rval = _bm_serial_batch_check(batch, now);
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Send whatever is pending now
+
+  \param[in] *batch aggregator
+  \return BM_SERIAL_OK if sent (or nothing was pending), nonzero otherwise
+*/
+bm_serial_error_e bm_serial_batch_flush(bm_serial_batch_t *batch) {
+  return _bm_serial_batch_send(batch);
+}
+
+/*!
+  Send the pending batch if its oldest message is due. Call periodically.
+
+  \param[in] *batch aggregator
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_batch_poll(bm_serial_batch_t *batch) {
+  return _bm_serial_batch_check(batch, batch->cfg.now_fn());
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "bm_serial.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest batch payload (everything bm_serial_ctx_tx() takes)
+#define BM_SERIAL_BATCH_MAX_LEN                                                \
+  (SERIAL_BUFF_LEN - sizeof(bm_serial_packet_t) - 2)
+
+typedef struct {
+  // Send the batch once this many bytes of entries are pending (up to
+  // BM_SERIAL_BATCH_MAX_LEN). Bigger messages aren't batched.
+  uint16_t max_len;
+  // Send the batch once its oldest message has waited this long, in now_fn
+  // ticks. Only checked when adding messages and in bm_serial_batch_poll().
+  uint32_t max_delay;
+  uint32_t (*now_fn)(void);
+} bm_serial_batch_cfg_t;
+
+typedef struct {
+  // Messages added
+  uint32_t messages;
+  // Pubs added without their header
+  uint32_t repeats;
+  // BM_SERIAL_BATCH packets sent
+  uint32_t batches;
+  // Flushes with only one message pending, sent as a normal packet
+  uint32_t singles;
+  // Messages bigger than max_len, sent on their own right away
+  uint32_t direct;
+  // Why batches were sent
+  uint32_t size_flushes;
+  uint32_t deadline_flushes;
+  // Messages lost because their batch couldn't be sent
+  uint32_t dropped;
+} bm_serial_batch_stats_t;
+
+//
+// Nagle style aggregator. Small messages are appended to a pending batch
+// instead of each being sent in its own packet (packet header, crc, COBS
+// overhead and delimiter). Consecutive pubs with the same node id and topic
+// only carry the data. The batch goes out as one BM_SERIAL_BATCH packet
+// when the next message wouldn't fit in max_len, or when the oldest message
+// has waited max_delay. The receiver needs nothing extra,
+// bm_serial_process_packet() hands each message to its callback in place.
+//
+// Messages keep their order, including ones too big to batch (the pending
+// batch is sent first). Call bm_serial_batch_poll() periodically so a quiet
+// link still meets the deadline. Not thread safe.
+//
+typedef struct {
+  bm_serial_ctx_t *ctx;
+  bm_serial_batch_cfg_t cfg;
+
+  // Pending entries (bm_serial_batch_entry_t), sent from here
+  uint8_t buff[BM_SERIAL_BATCH_MAX_LEN];
+  uint16_t len;
+  uint16_t count;
+  uint32_t first_at;
+
+  // Last pub entry in the batch, later pubs with the same header only carry
+  // their data (BM_SERIAL_BATCH_FLAG_REPEAT)
+  uint16_t pub_at;
+  bool pub_pending;
+
+  bm_serial_batch_stats_t stats;
+} bm_serial_batch_t;
+
+bm_serial_error_e bm_serial_batch_init(bm_serial_batch_t *batch,
+                                       bm_serial_ctx_t *ctx,
+                                       const bm_serial_batch_cfg_t *cfg);
+bm_serial_error_e bm_serial_batch_tx(bm_serial_batch_t *batch,
+                                     bm_serial_message_t type,
+                                     const uint8_t *payload, size_t len);
+bm_serial_error_e bm_serial_batch_pub(bm_serial_batch_t *batch,
+                                      uint64_t node_id, const char *topic,
+                                      uint16_t topic_len, const uint8_t *data,
+                                      uint16_t data_len, uint8_t type,
+                                      uint8_t version);
+bm_serial_error_e bm_serial_batch_flush(bm_serial_batch_t *batch);
+bm_serial_error_e bm_serial_batch_poll(bm_serial_batch_t *batch);
+
+#ifdef __cplusplus
+}
+#endif
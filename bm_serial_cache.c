@@ -0,0 +1,510 @@
+#include "bm_serial_cache.h"
+#include "bm_serial_hash.h"
+#include <stdint.h>
+#include <string.h>
+
+_Static_assert(BM_SERIAL_CACHE_ENTRIES < 256, "entry index is 8 bits");
+_Static_assert((BM_SERIAL_CACHE_BUCKETS & (BM_SERIAL_CACHE_BUCKETS - 1)) == 0,
+               "BM_SERIAL_CACHE_BUCKETS must be a power of 2");
+_Static_assert(BM_SERIAL_CACHE_KEY_LEN < 256, "key length is 8 bits");
+
+static uint32_t _bm_serial_cache_bucket(uint64_t node_id, uint8_t partition,
+                                        size_t key_len, const char *key) {
+  uint32_t hash =
+      bm_serial_fnv1a(BM_SERIAL_FNV_OFFSET, &node_id, sizeof(node_id));
+  hash = bm_serial_fnv1a(hash, &partition, sizeof(partition));
+  hash = bm_serial_fnv1a(hash, key, key_len);
+  return hash % BM_SERIAL_CACHE_BUCKETS;
+}
+
+/*!
+  Find a cached value
+
+  \param[in] *cache config cache
+  \param[in] node_id node
+  \param[in] partition config partition
+  \param[in] key_len key length, up to BM_SERIAL_CACHE_KEY_LEN
+  \param[in] *key key
+  \return entry, NULL if the value isn't cached
+*/
+static bm_serial_cache_entry_t *
+_bm_serial_cache_find(bm_serial_cache_t *cache, uint64_t node_id,
+                      uint8_t partition, size_t key_len, const char *key) {
+  uint8_t idx =
+      cache->buckets[_bm_serial_cache_bucket(node_id, partition, key_len, key)];
+  while (idx) {
+    bm_serial_cache_entry_t *entry = &cache->entries[idx - 1];
+    if (entry->node_id == node_id && entry->partition == partition &&
+        entry->key_len == key_len && !memcmp(entry->key, key, key_len)) {
+      return entry;
+    }
+    idx = entry->next;
+  }
+  return NULL;
+}
+
+/*!
+  Drop a cached value
+
+  \param[in] *cache config cache
+  \param[in] *entry value
+  \return none
+*/
+static void _bm_serial_cache_remove(bm_serial_cache_t *cache,
+                                    bm_serial_cache_entry_t *entry) {
+  uint8_t idx = (uint8_t)(entry - cache->entries) + 1;
+  uint8_t *link = &cache->buckets[_bm_serial_cache_bucket(
+      entry->node_id, entry->partition, entry->key_len, entry->key)];
+  while (*link != idx) {
+    link = &cache->entries[*link - 1].next;
+  }
+  *link = entry->next;
+
+  entry->used = false;
+  entry->next = cache->free_entry;
+  cache->free_entry = idx;
+  cache->count--;
+}
+
+/*!
+  Stop gets in flight from caching the value they get back
+
+  \param[in] *cache config cache
+  \param[in] node_id node, 0 for every node
+  \param[in] partition config partition
+  \param[in] key_len key length
+  \param[in] *key key, NULL for every key
+  \return none
+*/
+static void _bm_serial_cache_stale(bm_serial_cache_t *cache, uint64_t node_id,
+                                   uint8_t partition, size_t key_len,
+                                   const char *key) {
+  for (uint16_t idx = 0; idx < BM_SERIAL_CACHE_PENDING; idx++) {
+    bm_serial_cache_pending_t *pending = &cache->pending[idx];
+    if (!pending->used || pending->partition != partition ||
+        (node_id && pending->node_id != node_id)) {
+      continue;
+    }
+    if (key && (pending->key_len != key_len ||
+                memcmp(pending->key, key, key_len))) {
+      continue;
+    }
+    pending->stale = true;
+  }
+}
+
+/*!
+  Forget a get that won't be answered (in time). Its value could still come
+  in and be taken for the next get's, so those aren't cached either.
+
+  \param[in] *cache config cache
+  \param[in] *pending get
+  \return none
+*/
+static void _bm_serial_cache_lost(bm_serial_cache_t *cache,
+                                  bm_serial_cache_pending_t *pending) {
+  pending->used = false;
+  _bm_serial_cache_stale(cache, pending->node_id, pending->partition, 0, NULL);
+}
+
+/*!
+  Forget gets that waited longer than reply_timeout
+
+  \param[in] *cache config cache
+  \param[in] now current time
+  \return none
+*/
+static void _bm_serial_cache_expire(bm_serial_cache_t *cache, uint32_t now) {
+  for (uint16_t idx = 0; idx < BM_SERIAL_CACHE_PENDING; idx++) {
+    bm_serial_cache_pending_t *pending = &cache->pending[idx];
+    if (pending->used && now - pending->sent_at >= cache->cfg.reply_timeout) {
+      _bm_serial_cache_lost(cache, pending);
+    }
+  }
+}
+
+/*!
+  Get an entry for a new value, dropping one if the cache is full (an expired
+  one if there is any, the oldest otherwise)
+
+  \param[in] *cache config cache
+  \param[in] now current time
+  \return free entry
+*/
+static bm_serial_cache_entry_t *_bm_serial_cache_alloc(bm_serial_cache_t *cache,
+                                                       uint32_t now) {
+  if (!cache->free_entry) {
+    bm_serial_cache_entry_t *victim = NULL;
+    for (uint16_t idx = 0; idx < BM_SERIAL_CACHE_ENTRIES; idx++) {
+      bm_serial_cache_entry_t *entry = &cache->entries[idx];
+      if (now - entry->stored_at >= entry->ttl) {
+        victim = entry;
+        break;
+      }
+      if (!victim || now - entry->stored_at > now - victim->stored_at) {
+        victim = entry;
+      }
+    }
+
+    if (now - victim->stored_at >= victim->ttl) {
+      cache->stats.expired++;
+    } else {
+      cache->stats.evicted++;
+    }
+    _bm_serial_cache_remove(cache, victim);
+  }
+
+  uint8_t idx = cache->free_entry;
+  bm_serial_cache_entry_t *entry = &cache->entries[idx - 1];
+  cache->free_entry = entry->next;
+  return entry;
+}
+
+/*!
+  Cache a received value if it answers a get
+
+  \param[in] *cache config cache
+  \param[in] *payload bm_common_config_value_t
+  \param[in] len payload length
+  \return none
+*/
+static void _bm_serial_cache_value(bm_serial_cache_t *cache,
+                                   const uint8_t *payload, size_t len) {
+  const bm_common_config_value_t *value =
+      (const bm_common_config_value_t *)payload;
+  if (value->data_length > len - sizeof(*value)) {
+    return;
+  }
+
+  uint32_t now = cache->cfg.now_fn();
+  _bm_serial_cache_expire(cache, now);
+
+  uint64_t node_id = value->header.source_node_id;
+  uint8_t partition = (uint8_t)value->partition;
+  bm_serial_cache_pending_t *pending = NULL;
+  for (uint16_t idx = 0; idx < BM_SERIAL_CACHE_PENDING; idx++) {
+    bm_serial_cache_pending_t *candidate = &cache->pending[idx];
+    if (candidate->used && candidate->node_id == node_id &&
+        candidate->partition == partition &&
+        (!pending || candidate->seq - pending->seq > UINT32_MAX / 2)) {
+      pending = candidate;
+    }
+  }
+  if (!pending) {
+    return;
+  }
+  pending->used = false;
+
+  if (pending->stale || value->data_length > BM_SERIAL_CACHE_VALUE_LEN) {
+    return;
+  }
+
+  uint32_t ttl = cache->cfg.ttl;
+  if (cache->cfg.ttl_fn) {
+    ttl = cache->cfg.ttl_fn(cache->cfg.arg, node_id,
+                            (bm_common_config_partition_e)partition,
+                            pending->key_len, pending->key);
+  }
+  if (!ttl) {
+    return;
+  }
+
+  bm_serial_cache_entry_t *entry = _bm_serial_cache_find(
+      cache, node_id, partition, pending->key_len, pending->key);
+  if (entry) {
+    _bm_serial_cache_remove(cache, entry);
+  }
+  entry = _bm_serial_cache_alloc(cache, now);
+
+  entry->node_id = node_id;
+  entry->stored_at = now;
+  entry->ttl = ttl;
+  entry->partition = partition;
+  entry->key_len = pending->key_len;
+  entry->used = true;
+  memcpy(entry->key, pending->key, pending->key_len);
+  entry->payload_len = sizeof(*value) + value->data_length;
+  memcpy(entry->payload, payload, entry->payload_len);
+
+  uint8_t *bucket = &cache->buckets[_bm_serial_cache_bucket(
+      node_id, partition, entry->key_len, entry->key)];
+  entry->next = *bucket;
+  *bucket = (uint8_t)(entry - cache->entries) + 1;
+
+  cache->count++;
+  cache->stats.stores++;
+}
+
+/*!
+  Enable the config value cache on a bm_serial instance. Drops every cached
+  value if called again.
+
+  \param[out] *cache config cache
+  \param[in] *ctx bm_serial instance
+  \param[in] *cfg configuration (copied)
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_cache_init(bm_serial_cache_t *cache,
+                                       bm_serial_ctx_t *ctx,
+                                       const bm_serial_cache_cfg_t *cfg) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!cache || !ctx || !cfg || !cfg->now_fn) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    memset(cache, 0, sizeof(bm_serial_cache_t));
+    cache->ctx = ctx;
+    cache->cfg = *cfg;
+
+    for (uint16_t idx = 0; idx < BM_SERIAL_CACHE_ENTRIES; idx++) {
+      cache->entries[idx].next =
+          (idx + 1 < BM_SERIAL_CACHE_ENTRIES) ? idx + 2 : 0;
+    }
+    cache->free_entry = 1;
+
+    ctx->cache = cache;
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Drop every cached value
+
+  \param[in] *cache config cache
+  \return none
+*/
+void bm_serial_cache_flush(bm_serial_cache_t *cache) {
+  for (uint16_t idx = 0; idx < BM_SERIAL_CACHE_ENTRIES && cache->count;
+       idx++) {
+    if (cache->entries[idx].used) {
+      _bm_serial_cache_remove(cache, &cache->entries[idx]);
+      cache->stats.invalidated++;
+    }
+  }
+}
+
+/*!
+  Drop a cached value, and don't cache the value of gets for it in flight
+
+  \param[in] *cache config cache
+  \param[in] node_id node
+  \param[in] partition config partition
+  \param[in] key_len key length
+  \param[in] *key key
+  \return none
+*/
+void bm_serial_cache_invalidate(bm_serial_cache_t *cache, uint64_t node_id,
+                                bm_common_config_partition_e partition,
+                                size_t key_len, const char *key) {
+  if (key_len > BM_SERIAL_CACHE_KEY_LEN) {
+    // Never cached
+    return;
+  }
+
+  bm_serial_cache_entry_t *entry =
+      _bm_serial_cache_find(cache, node_id, (uint8_t)partition, key_len, key);
+  if (entry) {
+    _bm_serial_cache_remove(cache, entry);
+    cache->stats.invalidated++;
+  }
+  _bm_serial_cache_stale(cache, node_id, (uint8_t)partition, key_len, key);
+}
+
+/*!
+  Drop every cached value in a partition, and don't cache the value of gets
+  for it in flight
+
+  \param[in] *cache config cache
+  \param[in] node_id node, 0 for every node
+  \param[in] partition config partition
+  \return none
+*/
+void bm_serial_cache_invalidate_partition(
+    bm_serial_cache_t *cache, uint64_t node_id,
+    bm_common_config_partition_e partition) {
+  for (uint16_t idx = 0; idx < BM_SERIAL_CACHE_ENTRIES && cache->count;
+       idx++) {
+    bm_serial_cache_entry_t *entry = &cache->entries[idx];
+    if (entry->used && entry->partition == (uint8_t)partition &&
+        (!node_id || entry->node_id == node_id)) {
+      _bm_serial_cache_remove(cache, entry);
+      cache->stats.invalidated++;
+    }
+  }
+  _bm_serial_cache_stale(cache, node_id, (uint8_t)partition, 0, NULL);
+}
+
+/*!
+  Values cached (including ones whose ttl ran out and weren't dropped yet)
+
+  \param[in] *cache config cache
+  \return number of values
+*/
+uint16_t bm_serial_cache_count(bm_serial_cache_t *cache) {
+  return cache->count;
+}
+
+/*!
+  Look up the value for a get about to be sent
+
+  \param[in] *cache config cache
+  \param[in] node_id node
+  \param[in] partition config partition
+  \param[in] key_len key length
+  \param[in] *key key
+  \param[out] **payload cached bm_common_config_value_t
+  \param[out] *len payload length
+  \return true if the value is cached, false if the get has to be sent
+*/
+bool bm_serial_cache_get(bm_serial_cache_t *cache, uint64_t node_id,
+                         bm_common_config_partition_e partition,
+                         size_t key_len, const char *key,
+                         const uint8_t **payload, size_t *len) {
+  uint32_t now = cache->cfg.now_fn();
+  bm_serial_cache_entry_t *entry = NULL;
+  if (key_len <= BM_SERIAL_CACHE_KEY_LEN) {
+    entry = _bm_serial_cache_find(cache, node_id, (uint8_t)partition, key_len,
+                                  key);
+  }
+
+  if (entry && now - entry->stored_at >= entry->ttl) {
+    _bm_serial_cache_remove(cache, entry);
+    cache->stats.expired++;
+    entry = NULL;
+  }
+
+  // A hit would be answered before the gets still in flight for this node
+  // and partition, and whoever waits on replies in order would get it for
+  // the wrong key. Send it after them instead.
+  if (entry) {
+    _bm_serial_cache_expire(cache, now);
+    for (uint16_t idx = 0; idx < BM_SERIAL_CACHE_PENDING; idx++) {
+      bm_serial_cache_pending_t *pending = &cache->pending[idx];
+      if (pending->used && pending->node_id == node_id &&
+          pending->partition == (uint8_t)partition) {
+        entry = NULL;
+        break;
+      }
+    }
+  }
+
+  if (!entry) {
+    cache->stats.misses++;
+    return false;
+  }
+
+  cache->stats.hits++;
+  *payload = entry->payload;
+  *len = entry->payload_len;
+  return true;
+}
+
+/*!
+  Remember a get that was sent, to cache its value
+
+  \param[in] *cache config cache
+  \param[in] node_id node
+  \param[in] partition config partition
+  \param[in] key_len key length
+  \param[in] *key key
+  \return none
+*/
+void bm_serial_cache_sent(bm_serial_cache_t *cache, uint64_t node_id,
+                          bm_common_config_partition_e partition,
+                          size_t key_len, const char *key) {
+  uint32_t now = cache->cfg.now_fn();
+  _bm_serial_cache_expire(cache, now);
+
+  bm_serial_cache_pending_t *pending = NULL;
+  for (uint16_t idx = 0; idx < BM_SERIAL_CACHE_PENDING; idx++) {
+    bm_serial_cache_pending_t *candidate = &cache->pending[idx];
+    if (!candidate->used) {
+      pending = candidate;
+      break;
+    }
+    if (!pending || candidate->seq - pending->seq > UINT32_MAX / 2) {
+      pending = candidate;
+    }
+  }
+  if (pending->used) {
+    // Full, give up on the oldest
+    _bm_serial_cache_lost(cache, pending);
+  }
+
+  pending->node_id = node_id;
+  pending->sent_at = now;
+  pending->seq = cache->next_seq++;
+  pending->partition = (uint8_t)partition;
+  pending->used = true;
+  // Still has to take its value, so later gets get theirs
+  pending->stale = key_len > BM_SERIAL_CACHE_KEY_LEN;
+  pending->key_len = pending->stale ? 0 : (uint8_t)key_len;
+  memcpy(pending->key, key, pending->key_len);
+}
+
+/*!
+  Cache received values, and drop the ones a received message changes
+
+  \param[in] *cache config cache
+  \param[in] type message type
+  \param[in] *payload message payload, at least the type's minimum length
+  \param[in] len payload length
+  \return none
+*/
+void bm_serial_cache_rx(bm_serial_cache_t *cache, uint8_t type,
+                        const uint8_t *payload, size_t len) {
+  switch (type) {
+  case BM_SERIAL_CFG_VALUE: {
+    _bm_serial_cache_value(cache, payload, len);
+    break;
+  }
+  case BM_SERIAL_CFG_SET: {
+    const bm_common_config_set_t *set = (const bm_common_config_set_t *)payload;
+    if (set->key_length <= len - sizeof(*set)) {
+      bm_serial_cache_invalidate(cache, set->header.target_node_id,
+                                 set->partition, set->key_length,
+                                 (const char *)set->keyAndData);
+    }
+    break;
+  }
+  case BM_SERIAL_CFG_COMMIT: {
+    const bm_common_config_commit_t *commit =
+        (const bm_common_config_commit_t *)payload;
+    bm_serial_cache_invalidate_partition(cache, commit->header.target_node_id,
+                                         commit->partition);
+    break;
+  }
+  case BM_SERIAL_CFG_DEL_RESP: {
+    const bm_common_config_delete_key_response_t *del =
+        (const bm_common_config_delete_key_response_t *)payload;
+    if (del->key_length <= len - sizeof(*del)) {
+      bm_serial_cache_invalidate(cache, del->header.source_node_id,
+                                 del->partition, del->key_length, del->key);
+    }
+    break;
+  }
+  case BM_SERIAL_NETWORK_INFO: {
+    const bm_common_network_info_t *info =
+        (const bm_common_network_info_t *)payload;
+    bm_common_config_partition_e partition = info->config_crc.partition;
+    uint32_t crc32 = info->config_crc.crc32;
+    if ((uint32_t)partition >= BM_SERIAL_CACHE_PARTITIONS) {
+      break;
+    }
+    if (cache->config_crc_valid[partition] &&
+        cache->config_crc[partition] != crc32) {
+      bm_serial_cache_invalidate_partition(cache, 0, partition);
+    }
+    cache->config_crc[partition] = crc32;
+    cache->config_crc_valid[partition] = true;
+    break;
+  }
+  default:
+    break;
+  }
+}
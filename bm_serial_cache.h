@@ -0,0 +1,161 @@
+#pragma once
+
+#include "bm_serial.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Max cached values (less than 256)
+#ifndef BM_SERIAL_CACHE_ENTRIES
+#define BM_SERIAL_CACHE_ENTRIES 32
+#endif
+
+// Hash table size (power of 2), twice the entries so chains stay short
+#define BM_SERIAL_CACHE_BUCKETS 64
+
+// Longer keys and values are never cached
+#ifndef BM_SERIAL_CACHE_KEY_LEN
+#define BM_SERIAL_CACHE_KEY_LEN 32
+#endif
+#ifndef BM_SERIAL_CACHE_VALUE_LEN
+#define BM_SERIAL_CACHE_VALUE_LEN 64
+#endif
+
+// Max gets waiting for their value
+#ifndef BM_SERIAL_CACHE_PENDING
+#define BM_SERIAL_CACHE_PENDING 16
+#endif
+
+// Partitions whose config crc is followed in network info
+#define BM_SERIAL_CACHE_PARTITIONS (BM_COMMON_CFG_PARTITION_HARDWARE + 1)
+
+typedef struct {
+  // How long a value is used for, in now_fn ticks
+  uint32_t ttl;
+  // How long to wait for the value of a get, in now_fn ticks. Replies later
+  // than this aren't cached.
+  uint32_t reply_timeout;
+  uint32_t (*now_fn)(void);
+
+  // Optional, ttl for a value about to be cached (0 to not cache it), instead
+  // of ttl
+  uint32_t (*ttl_fn)(void *arg, uint64_t node_id,
+                     bm_common_config_partition_e partition, size_t key_len,
+                     const char *key);
+  void *arg;
+} bm_serial_cache_cfg_t;
+
+typedef struct {
+  // Gets answered from the cache / sent to the node
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t stores;
+  // Values dropped because their ttl ran out, something changed them, or to
+  // make room
+  uint32_t expired;
+  uint32_t invalidated;
+  uint32_t evicted;
+} bm_serial_cache_stats_t;
+
+typedef struct {
+  uint64_t node_id;
+  uint32_t stored_at;
+  uint32_t ttl;
+  uint8_t partition;
+  uint8_t key_len;
+  bool used;
+  // Index + 1 of the next entry in the bucket (or free list), 0 at the end
+  uint8_t next;
+  char key[BM_SERIAL_CACHE_KEY_LEN];
+  // Received bm_common_config_value_t, handed out again on hits
+  uint16_t payload_len;
+  uint8_t payload[sizeof(bm_common_config_value_t) +
+                  BM_SERIAL_CACHE_VALUE_LEN];
+} bm_serial_cache_entry_t;
+
+typedef struct {
+  uint64_t node_id;
+  uint32_t sent_at;
+  // Order sent, the oldest get for a node and partition gets the next value
+  uint32_t seq;
+  uint8_t partition;
+  uint8_t key_len;
+  bool used;
+  // Value is passed on but not cached (the key changed or got out of sync)
+  bool stale;
+  char key[BM_SERIAL_CACHE_KEY_LEN];
+} bm_serial_cache_pending_t;
+
+//
+// Optional client side config value cache. Values received for
+// bm_serial_cfg_get() are kept per (node id, partition, key) for their ttl,
+// and a repeat get is answered right away from memory instead of going over
+// the link. Hits go to the rx hook and cfg_value_fn just like a received
+// value, from inside bm_serial_ctx_cfg_get().
+//
+// Values are dropped when:
+//  - the key is set or deleted (bm_serial_cfg_set(), delete requests, and
+//    received sets and delete responses)
+//  - the node's partition is committed (sent or received)
+//  - a partition's config crc changes in network info (the partition is
+//    dropped for every node, network info doesn't say whose crc it is)
+//
+// CFG_VALUE doesn't carry the key, so gets are remembered and values taken
+// to answer them in the order sent, per node and partition. Once a get goes
+// unanswered for reply_timeout, the node and partition's other gets in flight
+// aren't cached either. Keep BM_SERIAL_CACHE_PENDING above the gets in flight.
+// Values are only answered from the cache while no get to the same node and
+// partition is in flight, so replies never overtake earlier gets.
+//
+// Gets sent inside a BM_SERIAL_BATCH aren't seen. Not thread safe.
+//
+struct bm_serial_cache_s {
+  bm_serial_ctx_t *ctx;
+  bm_serial_cache_cfg_t cfg;
+
+  bm_serial_cache_entry_t entries[BM_SERIAL_CACHE_ENTRIES];
+  // Index + 1 of the first entry per bucket
+  uint8_t buckets[BM_SERIAL_CACHE_BUCKETS];
+  uint8_t free_entry;
+  uint16_t count;
+
+  bm_serial_cache_pending_t pending[BM_SERIAL_CACHE_PENDING];
+  uint32_t next_seq;
+
+  // Last config crc per partition from network info
+  uint32_t config_crc[BM_SERIAL_CACHE_PARTITIONS];
+  bool config_crc_valid[BM_SERIAL_CACHE_PARTITIONS];
+
+  bm_serial_cache_stats_t stats;
+};
+
+bm_serial_error_e bm_serial_cache_init(bm_serial_cache_t *cache,
+                                       bm_serial_ctx_t *ctx,
+                                       const bm_serial_cache_cfg_t *cfg);
+void bm_serial_cache_flush(bm_serial_cache_t *cache);
+void bm_serial_cache_invalidate(bm_serial_cache_t *cache, uint64_t node_id,
+                                bm_common_config_partition_e partition,
+                                size_t key_len, const char *key);
+void bm_serial_cache_invalidate_partition(
+    bm_serial_cache_t *cache, uint64_t node_id,
+    bm_common_config_partition_e partition);
+uint16_t bm_serial_cache_count(bm_serial_cache_t *cache);
+
+// Used by bm_serial.c
+bool bm_serial_cache_get(bm_serial_cache_t *cache, uint64_t node_id,
+                         bm_common_config_partition_e partition,
+                         size_t key_len, const char *key,
+                         const uint8_t **payload, size_t *len);
+void bm_serial_cache_sent(bm_serial_cache_t *cache, uint64_t node_id,
+                          bm_common_config_partition_e partition,
+                          size_t key_len, const char *key);
+void bm_serial_cache_rx(bm_serial_cache_t *cache, uint8_t type,
+                        const uint8_t *payload, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
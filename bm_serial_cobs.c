@@ -0,0 +1,479 @@
+#include "bm_serial_cobs.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BM_SERIAL_COBS_X86
+#include <immintrin.h>
+#endif
+
+// Returns the offset of the first zero byte in buff, or len if there is none
+typedef size_t (*_bm_serial_cobs_scan_fn_t)(const uint8_t *buff, size_t len);
+
+static bm_serial_cobs_kernel_e _kernel = BM_SERIAL_COBS_KERNEL_AUTO;
+static _bm_serial_cobs_scan_fn_t _scan_fn = NULL;
+
+/*!
+  Find the first zero byte, checking a machine word at a time
+
+  \param[in] *buff buffer to scan
+  \param[in] len length of buffer
+  \return offset of first zero byte, len if none found
+*/
+static size_t _bm_serial_cobs_scan_scalar(const uint8_t *buff, size_t len) {
+  const size_t ones = (size_t)-1 / 0xFF;
+  const size_t highs = ones * 0x80;
+  size_t idx = 0;
+
+  for (; idx + sizeof(size_t) <= len; idx += sizeof(size_t)) {
+    size_t word;
+    memcpy(&word, &buff[idx], sizeof(word));
+    if ((word - ones) & ~word & highs) {
+      break;
+    }
+  }
+
+  for (; idx < len; idx++) {
+    if (!buff[idx]) {
+      break;
+    }
+  }
+
+  return idx;
+}
+
+#ifdef BM_SERIAL_COBS_X86
+__attribute__((target("sse2"))) static size_t
+_bm_serial_cobs_scan_sse2(const uint8_t *buff, size_t len) {
+  const __m128i zero = _mm_setzero_si128();
+  size_t idx = 0;
+
+  for (; idx + sizeof(__m128i) <= len; idx += sizeof(__m128i)) {
+    __m128i block = _mm_loadu_si128((const __m128i *)&buff[idx]);
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero));
+    if (mask) {
+      return idx + __builtin_ctz(mask);
+    }
+  }
+
+  return idx + _bm_serial_cobs_scan_scalar(&buff[idx], len - idx);
+}
+
+__attribute__((target("avx2"))) static size_t
+_bm_serial_cobs_scan_avx2(const uint8_t *buff, size_t len) {
+  const __m256i zero = _mm256_setzero_si256();
+  size_t idx = 0;
+
+  for (; idx + sizeof(__m256i) <= len; idx += sizeof(__m256i)) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)&buff[idx]);
+    uint32_t mask =
+        (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, zero));
+    if (mask) {
+      return idx + __builtin_ctz(mask);
+    }
+  }
+
+  // Finish with a 128-bit compare here rather than calling the SSE2 kernel to
+  // avoid AVX/SSE transition penalties
+  if (idx + sizeof(__m128i) <= len) {
+    __m128i block = _mm_loadu_si128((const __m128i *)&buff[idx]);
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(block, _mm256_castsi256_si128(zero)));
+    if (mask) {
+      return idx + __builtin_ctz(mask);
+    }
+    idx += sizeof(__m128i);
+  }
+
+  _mm256_zeroupper();
+  return idx + _bm_serial_cobs_scan_scalar(&buff[idx], len - idx);
+}
+#endif
+
+/*!
+  Check if a scan kernel can run on this CPU
+
+  \param[in] kernel kernel to check
+  \return true if supported, false otherwise
+*/
+static bool _bm_serial_cobs_kernel_supported(bm_serial_cobs_kernel_e kernel) {
+  switch (kernel) {
+  case BM_SERIAL_COBS_KERNEL_AUTO:
+  case BM_SERIAL_COBS_KERNEL_SCALAR:
+    return true;
+#ifdef BM_SERIAL_COBS_X86
+  case BM_SERIAL_COBS_KERNEL_SSE2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+  case BM_SERIAL_COBS_KERNEL_AVX2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+/*!
+  Get the zero scan kernel, picking the fastest one the CPU supports on first
+  use
+
+  \return scan function
+*/
+static _bm_serial_cobs_scan_fn_t _bm_serial_cobs_scan(void) {
+  // Atomic so concurrent first uses (e.g. multiple tx threads) are safe, they
+  // all store the same result
+  _bm_serial_cobs_scan_fn_t scan = __atomic_load_n(&_scan_fn, __ATOMIC_ACQUIRE);
+  if (scan) {
+    return scan;
+  }
+
+  bm_serial_cobs_kernel_e kernel = __atomic_load_n(&_kernel, __ATOMIC_RELAXED);
+  if (kernel == BM_SERIAL_COBS_KERNEL_AUTO) {
+    kernel = BM_SERIAL_COBS_KERNEL_SCALAR;
+    if (_bm_serial_cobs_kernel_supported(BM_SERIAL_COBS_KERNEL_AVX2)) {
+      kernel = BM_SERIAL_COBS_KERNEL_AVX2;
+    } else if (_bm_serial_cobs_kernel_supported(BM_SERIAL_COBS_KERNEL_SSE2)) {
+      kernel = BM_SERIAL_COBS_KERNEL_SSE2;
+    }
+  }
+
+  scan = _bm_serial_cobs_scan_scalar;
+#ifdef BM_SERIAL_COBS_X86
+  if (kernel == BM_SERIAL_COBS_KERNEL_AVX2) {
+    scan = _bm_serial_cobs_scan_avx2;
+  } else if (kernel == BM_SERIAL_COBS_KERNEL_SSE2) {
+    scan = _bm_serial_cobs_scan_sse2;
+  }
+#endif
+
+  __atomic_store_n(&_kernel, kernel, __ATOMIC_RELAXED);
+  __atomic_store_n(&_scan_fn, scan, __ATOMIC_RELEASE);
+  return scan;
+}
+
+/*!
+  Select the zero scan kernel used to encode/decode COBS frames. By default the
+  fastest kernel the CPU supports is picked at runtime
+
+  \param[in] kernel kernel to use, BM_SERIAL_COBS_KERNEL_AUTO to pick one
+  \return true if the kernel is supported on this CPU, false otherwise
+*/
+bool bm_serial_cobs_set_kernel(bm_serial_cobs_kernel_e kernel) {
+  if (!_bm_serial_cobs_kernel_supported(kernel)) {
+    return false;
+  }
+
+  _kernel = kernel;
+  _scan_fn = NULL;
+  _bm_serial_cobs_scan();
+
+  return true;
+}
+
+/*!
+  Get the zero scan kernel in use
+
+  \return kernel in use
+*/
+bm_serial_cobs_kernel_e bm_serial_cobs_get_kernel(void) {
+  _bm_serial_cobs_scan();
+  return _kernel;
+}
+
+/*!
+  Find the next frame delimiter in a byte stream using the selected kernel
+
+  \param[in] *buff received bytes
+  \param[in] len number of bytes
+  \return offset of the first 0x00 delimiter, len if there is none
+*/
+size_t bm_serial_cobs_find_delimiter(const uint8_t *buff, size_t len) {
+  return _bm_serial_cobs_scan()(buff, len);
+}
+
+/*!
+  COBS encode a buffer (without the trailing 0x00 delimiter)
+
+  Encoding can be done in place, as long as src starts at least
+  BM_SERIAL_COBS_OVERHEAD(len) bytes after dst. The packet builders use this to
+  encode frames inside the tx buffer without a second buffer.
+
+  \param[in] *src data to encode
+  \param[in] len length of data to encode
+  \param[out] *dst encoded output
+  \param[in] dst_len size of output buffer
+  \return encoded length, 0 if the output buffer is too small
+*/
+size_t bm_serial_cobs_encode(const uint8_t *src, size_t len, uint8_t *dst,
+                             size_t dst_len) {
+  size_t rval = 0;
+
+  do {
+    if (!src || !dst) {
+      break;
+    }
+
+    if (dst_len < BM_SERIAL_COBS_MAX_ENCODED_LEN(len)) {
+      break;
+    }
+
+    _bm_serial_cobs_scan_fn_t scan = _bm_serial_cobs_scan();
+    size_t out = 0;
+    size_t idx = 0;
+    while (true) {
+      size_t block_len = len - idx;
+      if (block_len > 254) {
+        block_len = 254;
+      }
+
+      // Copy everything up to the next zero (or a full block) in one go.
+      // Code byte is written last so in place encoding never overwrites
+      // unread input
+      size_t run = scan(&src[idx], block_len);
+      memmove(&dst[out + 1], &src[idx], run);
+      dst[out] = run + 1;
+      out += run + 1;
+      idx += run;
+
+      if (run < block_len) {
+        // Block ended on a zero
+        idx++;
+      } else if (run < 254) {
+        // End of input
+        break;
+      }
+    }
+
+    rval = out;
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  COBS decode a single frame (without the trailing 0x00 delimiter)
+
+  Decoding can be done in place (dst == src) since the output is always shorter
+  than the input.
+
+  \param[in] *src encoded frame
+  \param[in] len length of encoded frame
+  \param[out] *dst decoded output
+  \param[in] dst_len size of output buffer
+  \return decoded length, 0 if the frame is malformed or doesn't fit
+*/
+size_t bm_serial_cobs_decode(const uint8_t *src, size_t len, uint8_t *dst,
+                             size_t dst_len) {
+  size_t out = 0;
+  size_t idx = 0;
+
+  if (!src || !dst) {
+    return 0;
+  }
+
+  while (idx < len) {
+    uint8_t code = src[idx++];
+    if (!code) {
+      return 0;
+    }
+
+    size_t block_len = code - 1;
+    if (block_len > len - idx || block_len > dst_len - out) {
+      return 0;
+    }
+
+    memmove(&dst[out], &src[idx], block_len);
+    out += block_len;
+    idx += block_len;
+
+    // Every block except full ones and the last one ends with a zero
+    if (code != 0xFF && idx < len) {
+      if (out == dst_len) {
+        return 0;
+      }
+      dst[out++] = 0;
+    }
+  }
+
+  return out;
+}
+
+/*!
+  Initialize a COBS stream receiver
+
+  \param[in] *rx receiver to initialize
+  \param[in] *buff buffer used to assemble frames split across chunks
+  \param[in] buff_len size of buff (largest decoded frame accepted)
+  \return none
+*/
+void bm_serial_cobs_rx_init(bm_serial_cobs_rx_t *rx, uint8_t *buff,
+                            size_t buff_len) {
+  memset(rx, 0, sizeof(bm_serial_cobs_rx_t));
+  rx->buff = buff;
+  rx->buff_len = buff_len;
+  rx->ctx = bm_serial_get_default_ctx();
+}
+
+/*!
+  Initialize a COBS stream receiver for a specific bm_serial instance
+
+  \param[in] *ctx instance decoded frames are processed by
+  \param[in] *rx receiver to initialize
+  \param[in] *buff buffer used to assemble frames split across chunks
+  \param[in] buff_len size of buff (largest decoded frame accepted)
+  \return none
+*/
+void bm_serial_cobs_ctx_rx_init(bm_serial_ctx_t *ctx, bm_serial_cobs_rx_t *rx,
+                                uint8_t *buff, size_t buff_len) {
+  bm_serial_cobs_rx_init(rx, buff, buff_len);
+  rx->ctx = ctx;
+}
+
+/*!
+  Drop any partially received frame (e.g. after the serial port is reopened)
+
+  \param[in] *rx receiver
+  \return none
+*/
+void bm_serial_cobs_rx_reset(bm_serial_cobs_rx_t *rx) {
+  rx->len = 0;
+  rx->code = 0;
+  rx->remaining = 0;
+  rx->discard = false;
+}
+
+/*!
+  Hand a decoded frame to the receiver's bm_serial instance
+
+  \param[in] *rx receiver
+  \param[in] *frame decoded frame
+  \param[in] len decoded frame length
+  \return BM_SERIAL_OK if processed, nonzero otherwise
+*/
+static bm_serial_error_e _bm_serial_cobs_rx_dispatch(bm_serial_cobs_rx_t *rx,
+                                                     uint8_t *frame,
+                                                     size_t len) {
+  if (len < sizeof(bm_serial_packet_t)) {
+    rx->dropped++;
+    return BM_SERIAL_INVALID_MSG_LEN;
+  }
+
+  rx->frames++;
+  return bm_serial_ctx_process_packet(rx->ctx, (bm_serial_packet_t *)frame,
+                                      len);
+}
+
+/*!
+  Feed raw bytes from the wire into the receiver
+
+  Complete frames found in data are decoded in place and processed directly
+  from the caller's buffer. Only frames split across calls are decoded into the
+  receiver buffer, byte by byte as they arrive, so no frame is ever copied
+  twice.
+
+  \param[in] *rx receiver
+  \param[in,out] *data bytes received (modified by in-place decoding)
+  \param[in] len number of bytes received
+  \return BM_SERIAL_OK if all frames were processed, last error otherwise
+*/
+bm_serial_error_e bm_serial_cobs_rx_feed(bm_serial_cobs_rx_t *rx,
+                                         uint8_t *data, size_t len) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!rx || !rx->buff || !data) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    _bm_serial_cobs_scan_fn_t scan = _bm_serial_cobs_scan();
+    size_t idx = 0;
+    while (idx < len) {
+      // Not in the middle of a frame, so decode in place if the whole frame
+      // is in this chunk
+      if (!rx->code && !rx->discard) {
+        size_t frame_len = scan(&data[idx], len - idx);
+        if (idx + frame_len < len) {
+          uint8_t *frame = &data[idx];
+          idx += frame_len + 1;
+
+          // Back to back delimiters
+          if (!frame_len) {
+            continue;
+          }
+
+          size_t decoded_len =
+              bm_serial_cobs_decode(frame, frame_len, frame, frame_len);
+          if (!decoded_len) {
+            rx->dropped++;
+            rval = BM_SERIAL_COBS_ERR;
+            continue;
+          }
+
+          bm_serial_error_e err =
+              _bm_serial_cobs_rx_dispatch(rx, frame, decoded_len);
+          if (err) {
+            rval = err;
+          }
+          continue;
+        }
+      }
+
+      // Partial frame, decode into the receive buffer as bytes arrive
+      size_t end = idx + scan(&data[idx], len - idx);
+      while (idx < end) {
+        if (rx->discard) {
+          idx = end;
+          break;
+        }
+
+        if (rx->remaining) {
+          size_t run = end - idx;
+          if (run > rx->remaining) {
+            run = rx->remaining;
+          }
+          if (run > rx->buff_len - rx->len) {
+            rx->discard = true;
+            continue;
+          }
+          memcpy(&rx->buff[rx->len], &data[idx], run);
+          rx->len += run;
+          rx->remaining -= run;
+          idx += run;
+        } else {
+          // Code byte. Previous block ends with an implied zero unless it
+          // was a full block
+          if (rx->code && rx->code != 0xFF) {
+            if (rx->len == rx->buff_len) {
+              rx->discard = true;
+              continue;
+            }
+            rx->buff[rx->len++] = 0;
+          }
+          rx->code = data[idx];
+          rx->remaining = rx->code - 1;
+          idx++;
+        }
+      }
+
+      // Delimiter
+      if (idx < len) {
+        idx++;
+        if (rx->discard || rx->remaining) {
+          rx->dropped++;
+          rval = rx->discard ? BM_SERIAL_OVERFLOW : BM_SERIAL_COBS_ERR;
+        } else if (rx->len) {
+          bm_serial_error_e err =
+              _bm_serial_cobs_rx_dispatch(rx, rx->buff, rx->len);
+          if (err) {
+            rval = err;
+          }
+        }
+        bm_serial_cobs_rx_reset(rx);
+      }
+    }
+
+  } while (0);
+
+  return rval;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "bm_serial.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Worst case number of bytes COBS adds to a frame of len bytes
+// (not including the 0x00 delimiter)
+#define BM_SERIAL_COBS_OVERHEAD(len) ((len) / 254 + 1)
+
+// Worst case encoded size of a frame of len bytes (not including delimiter)
+#define BM_SERIAL_COBS_MAX_ENCODED_LEN(len)                                    \
+  ((len) + BM_SERIAL_COBS_OVERHEAD(len))
+
+// Kernels used to find zero bytes when encoding/decoding
+typedef enum {
+  BM_SERIAL_COBS_KERNEL_AUTO = 0,
+  BM_SERIAL_COBS_KERNEL_SCALAR,
+  BM_SERIAL_COBS_KERNEL_SSE2,
+  BM_SERIAL_COBS_KERNEL_AVX2,
+} bm_serial_cobs_kernel_e;
+
+typedef struct {
+  // Instance decoded frames are processed by
+  bm_serial_ctx_t *ctx;
+
+  // Buffer decoded frames are assembled in when they span multiple chunks
+  uint8_t *buff;
+  size_t buff_len;
+
+  // Number of decoded bytes currently in buff
+  size_t len;
+
+  // Code byte of the block being decoded and bytes left in it
+  uint8_t code;
+  uint8_t remaining;
+
+  // Set when the current frame is too long or malformed. All bytes are
+  // discarded until the next delimiter
+  bool discard;
+
+  // Frames handed to bm_serial_ctx_process_packet
+  uint32_t frames;
+
+  // Frames dropped due to bad encoding or overflow
+  uint32_t dropped;
+} bm_serial_cobs_rx_t;
+
+bool bm_serial_cobs_set_kernel(bm_serial_cobs_kernel_e kernel);
+bm_serial_cobs_kernel_e bm_serial_cobs_get_kernel(void);
+
+size_t bm_serial_cobs_find_delimiter(const uint8_t *buff, size_t len);
+size_t bm_serial_cobs_encode(const uint8_t *src, size_t len, uint8_t *dst,
+                             size_t dst_len);
+size_t bm_serial_cobs_decode(const uint8_t *src, size_t len, uint8_t *dst,
+                             size_t dst_len);
+
+void bm_serial_cobs_rx_init(bm_serial_cobs_rx_t *rx, uint8_t *buff,
+                            size_t buff_len);
+void bm_serial_cobs_ctx_rx_init(bm_serial_ctx_t *ctx, bm_serial_cobs_rx_t *rx,
+                                uint8_t *buff, size_t buff_len);
+void bm_serial_cobs_rx_reset(bm_serial_cobs_rx_t *rx);
+bm_serial_error_e bm_serial_cobs_rx_feed(bm_serial_cobs_rx_t *rx,
+                                         uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,665 @@
+//
+// C++20 coroutine wrappers for config and BCMP queries, header only.
+//
+// Queries like bm_serial_ctx_cfg_get() get their reply through a separate
+// callback (cfg_value_fn here). The executor links each reply to the query
+// waiting for it, so a round trip is a single co_await:
+//
+//   bm_serial::task<void> read_key(bm_serial::executor &ex, uint64_t node) {
+//     auto value = co_await ex.cfg_get(node, BM_COMMON_CFG_PARTITION_USER,
+//                                      "sensor_period");
+//     if (value) { ... value->data ... }
+//   }
+//
+//   bm_serial::executor ex(ctx, now_fn, 1000);
+//   ex.spawn(read_key(ex, node));
+//   while (true) {
+//     // bm_serial_ctx_process_packet() with whatever came in, then
+//     ex.poll();
+//   }
+//
+// Everything runs on one thread, the one calling bm_serial_ctx_process_packet()
+// and poll(). A waiting query is one pending entry, not a thread, so hundreds
+// can be outstanding at once. Replies to queries go to the coroutine instead
+// of the callback, the callback still gets everything else.
+//
+#pragma once
+
+#if __cplusplus >= 202002L
+
+#include "bm_serial.hpp"
+
+#include <algorithm>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <list>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace bm_serial {
+
+// Result of a query. err is BM_SERIAL_OK if the reply came back, the send
+// error, BM_SERIAL_TIMEOUT, BM_SERIAL_BUSY (see executor) or an error parsing
+// the reply otherwise.
+template <typename T> struct reply {
+  bm_serial_error_e err = BM_SERIAL_OK;
+  T value{};
+
+  explicit operator bool() const { return err == BM_SERIAL_OK; }
+  T *operator->() { return &value; }
+  const T *operator->() const { return &value; }
+};
+
+struct cfg_value {
+  uint64_t node_id;
+  bm_common_config_partition_e partition;
+  std::vector<uint8_t> data;
+};
+
+struct cfg_status_reply {
+  uint64_t node_id;
+  bm_common_config_partition_e partition;
+  bool committed;
+  std::vector<std::string> keys;
+};
+
+struct cfg_del_reply {
+  uint64_t node_id;
+  bm_common_config_partition_e partition;
+  std::string key;
+  bool success;
+};
+
+struct device_info_reply {
+  bm_serial_device_info_t info;
+  std::string version;
+  std::string name;
+};
+
+struct resource_table {
+  uint64_t node_id;
+  std::vector<std::string> pubs;
+  std::vector<std::string> subs;
+};
+
+template <typename T = void> class task;
+class executor;
+
+namespace detail {
+
+struct promise_base {
+  // Coroutine awaiting this task, resumed when it finishes
+  std::coroutine_handle<> continuation;
+
+  // Tasks start when awaited or spawned
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  struct final_awaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<P> handle) noexcept {
+      std::coroutine_handle<> next = handle.promise().continuation;
+      return next ? next : std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+  final_awaiter final_suspend() noexcept { return {}; }
+
+  // Nothing in here throws
+  void unhandled_exception() { std::terminate(); }
+};
+
+template <typename T> struct promise : promise_base {
+  std::optional<T> value;
+
+  task<T> get_return_object();
+  void return_value(T val) { value = std::move(val); }
+};
+
+template <> struct promise<void> : promise_base {
+  task<void> get_return_object();
+  void return_void() {}
+};
+
+// Query waiting for its reply
+struct pending {
+  // Message that answers it and what the reply has to match
+  uint8_t reply_type;
+  uint64_t node_id;
+  bm_common_config_partition_e partition;
+  std::string key;
+
+  uint32_t deadline;
+  // Entry in the executor's send order list
+  std::list<pending *>::iterator order_it;
+  std::coroutine_handle<> handle;
+  // Set once the coroutine is suspended, before that a reply (looped back
+  // while sending) just finishes the query
+  bool suspended = false;
+  bool registered = false;
+  bool done = false;
+  bm_serial_error_e err = BM_SERIAL_OK;
+
+  // Fills in the result from the reply payload
+  bm_serial_error_e (*parse)(void *result, const uint8_t *payload,
+                             size_t len);
+  void *result;
+};
+
+// Replies are matched on (type, node id, partition, key). cfg values don't
+// carry the key, so gets to the same node and partition are answered in order
+// (see executor::lost() for when one of them times out).
+using match_key = std::tuple<uint8_t, uint64_t, uint32_t, std::string>;
+
+// Fill in a query's result from its reply
+inline void convert(cfg_value &value, const cfg_value_view &view) {
+  value.node_id = view.source_node_id;
+  value.partition = view.partition;
+  value.data.assign(view.data.data(), view.data.data() + view.data.size());
+}
+
+inline void convert(cfg_status_reply &status, const cfg_status_view &view) {
+  status.node_id = view.source_node_id;
+  status.partition = view.partition;
+  status.committed = view.committed;
+  status.keys.clear();
+  message<BM_SERIAL_CFG_STATUS_RESP>::for_each_key(
+      view, [&](std::string_view key) { status.keys.emplace_back(key); });
+}
+
+inline void convert(cfg_del_reply &del, const cfg_del_view &view) {
+  del.node_id = view.source_node_id;
+  del.partition = view.partition;
+  del.key.assign(view.key);
+  del.success = view.success;
+}
+
+inline void convert(device_info_reply &info, const device_info_view &view) {
+  info.info = view.info;
+  info.version.assign(view.version);
+  info.name.assign(view.name);
+}
+
+inline void convert(resource_table &table, const resource_table_view &view) {
+  table.node_id = view.node_id;
+  table.pubs.clear();
+  table.subs.clear();
+  message<BM_SERIAL_RESOURCE_REPLY>::for_each_resource(
+      view, [&](std::string_view name, bool pub) {
+        (pub ? table.pubs : table.subs).emplace_back(name);
+      });
+}
+
+// Reply message and decoded view for each result type
+template <typename T> struct reply_traits;
+template <> struct reply_traits<cfg_value> {
+  using codec = message<BM_SERIAL_CFG_VALUE>;
+  using view = cfg_value_view;
+};
+template <> struct reply_traits<cfg_status_reply> {
+  using codec = message<BM_SERIAL_CFG_STATUS_RESP>;
+  using view = cfg_status_view;
+};
+template <> struct reply_traits<cfg_del_reply> {
+  using codec = message<BM_SERIAL_CFG_DEL_RESP>;
+  using view = cfg_del_view;
+};
+template <> struct reply_traits<device_info_reply> {
+  using codec = message<BM_SERIAL_DEVICE_INFO_REPLY>;
+  using view = device_info_view;
+};
+template <> struct reply_traits<resource_table> {
+  using codec = message<BM_SERIAL_RESOURCE_REPLY>;
+  using view = resource_table_view;
+};
+
+template <typename T>
+inline bm_serial_error_e parse(T &result, const uint8_t *payload,
+                               size_t len) {
+  typename reply_traits<T>::view view;
+  bm_serial_error_e rval =
+      reply_traits<T>::codec::decode_payload({payload, len}, view);
+  if (!rval) {
+    convert(result, view);
+  }
+  return rval;
+}
+
+} // namespace detail
+
+// Coroutine returning T. Starts when awaited (or spawned on an executor).
+template <typename T> class task {
+public:
+  using promise_type = detail::promise<T>;
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  task() = default;
+  explicit task(handle_type handle) : handle_(handle) {}
+  task(task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  task &operator=(task &&other) noexcept {
+    if (this != &other) {
+      reset();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+  task(const task &) = delete;
+  task &operator=(const task &) = delete;
+  ~task() { reset(); }
+
+  bool done() const { return !handle_ || handle_.done(); }
+
+  // Runs the task, the awaiting coroutine resumes with its result
+  auto operator co_await() noexcept {
+    struct awaiter {
+      handle_type handle;
+
+      bool await_ready() noexcept { return !handle || handle.done(); }
+      std::coroutine_handle<>
+      await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle.promise().continuation = caller;
+        return handle;
+      }
+      T await_resume() {
+        if constexpr (!std::is_void_v<T>) {
+          return std::move(*handle.promise().value);
+        }
+      }
+    };
+    return awaiter{handle_};
+  }
+
+  // Hand the coroutine over (to an executor)
+  handle_type release() { return std::exchange(handle_, {}); }
+
+private:
+  void reset() {
+    if (handle_) {
+      handle_.destroy();
+      handle_ = {};
+    }
+  }
+
+  handle_type handle_;
+};
+
+namespace detail {
+
+template <typename T> task<T> promise<T>::get_return_object() {
+  return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object() {
+  return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+} // namespace detail
+
+// co_await one of these (from executor) to send a query and wait for the reply
+template <typename T> class query {
+public:
+  query(executor &ex, uint8_t reply_type, uint64_t node_id,
+        bm_common_config_partition_e partition, std::string_view key)
+      : ex_(ex) {
+    pending_.reply_type = reply_type;
+    pending_.node_id = node_id;
+    pending_.partition = partition;
+    pending_.key = key;
+    pending_.parse = [](void *result, const uint8_t *payload, size_t len) {
+      return detail::parse(*(T *)result, payload, len);
+    };
+    pending_.result = &reply_.value;
+  }
+  query(const query &) = delete;
+  query &operator=(const query &) = delete;
+  inline ~query();
+
+  bool await_ready() const noexcept { return false; }
+  inline bool await_suspend(std::coroutine_handle<> caller);
+  reply<T> await_resume() {
+    reply_.err = pending_.err;
+    return std::move(reply_);
+  }
+
+private:
+  executor &ex_;
+  detail::pending pending_;
+  reply<T> reply_;
+};
+
+//
+// Single threaded executor for coroutines on one bm_serial instance. Takes
+// over the instance's rx hook (bm_serial_ctx_set_rx_hook()) to pick out the
+// replies queries are waiting for. Must outlive the queries.
+//
+// When a cfg get times out, the gets waiting on the same node and partition
+// fail with it and new ones fail with BM_SERIAL_BUSY for one more timeout.
+// Its value could still come in and would be taken for theirs.
+//
+class executor {
+public:
+  // timeout is how long a query waits for its reply, in now_fn ticks
+  executor(bm_serial_ctx_t &ctx, uint32_t (*now_fn)(void), uint32_t timeout)
+      : ctx_(ctx), now_fn_(now_fn), timeout_(timeout) {
+    bm_serial_ctx_set_rx_hook(&ctx_, rx_hook, this);
+  }
+
+  ~executor() {
+    bm_serial_ctx_set_rx_hook(&ctx_, nullptr, nullptr);
+    // Unfinished tasks cancel their queries as they're destroyed
+    for (auto handle : tasks_) {
+      handle.destroy();
+    }
+  }
+
+  executor(const executor &) = delete;
+  executor &operator=(const executor &) = delete;
+
+  // Start a task, the executor owns it until it finishes
+  void spawn(task<void> task) {
+    auto handle = task.release();
+    if (handle) {
+      tasks_.push_back(handle);
+      handle.resume();
+    }
+  }
+
+  // Time out queries and resume the coroutines whose reply came in
+  // \return number of coroutines resumed
+  size_t poll() {
+    uint32_t now = now_fn_();
+    while (!order_.empty() &&
+           (int32_t)(now - order_.front()->deadline) >= 0) {
+      detail::pending *pending = order_.front();
+      pending->err = BM_SERIAL_TIMEOUT;
+      finish(pending);
+      if (pending->reply_type == BM_SERIAL_CFG_VALUE) {
+        lost(pending, now);
+      }
+    }
+
+    size_t resumed = 0;
+    while (!ready_.empty()) {
+      std::coroutine_handle<> handle = ready_.front();
+      ready_.pop_front();
+      handle.resume();
+      resumed++;
+    }
+
+    for (auto it = tasks_.begin(); it != tasks_.end();) {
+      if (it->done()) {
+        it->destroy();
+        it = tasks_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    return resumed;
+  }
+
+  // Queries waiting for a reply
+  size_t pending() const { return order_.size(); }
+
+  // Spawned tasks that haven't finished
+  size_t tasks() const { return tasks_.size(); }
+
+  query<cfg_value> cfg_get(uint64_t node_id,
+                           bm_common_config_partition_e partition,
+                           std::string_view key) {
+    return {*this, BM_SERIAL_CFG_VALUE, node_id, partition, key};
+  }
+
+  query<cfg_status_reply> cfg_status(uint64_t node_id,
+                               bm_common_config_partition_e partition) {
+    return {*this, BM_SERIAL_CFG_STATUS_RESP, node_id, partition, {}};
+  }
+
+  query<cfg_del_reply> cfg_delete(uint64_t node_id,
+                            bm_common_config_partition_e partition,
+                            std::string_view key) {
+    return {*this, BM_SERIAL_CFG_DEL_RESP, node_id, partition, key};
+  }
+
+  // node_id 0 asks every node, the first reply answers it
+  query<device_info_reply> device_info(uint64_t node_id) {
+    return {*this, BM_SERIAL_DEVICE_INFO_REPLY, node_id,
+            BM_COMMON_CFG_PARTITION_USER, {}};
+  }
+
+  query<resource_table> resources(uint64_t node_id) {
+    return {*this, BM_SERIAL_RESOURCE_REPLY, node_id,
+            BM_COMMON_CFG_PARTITION_USER, {}};
+  }
+
+private:
+  template <typename T> friend class query;
+
+  static detail::match_key key_of(const detail::pending *pending) {
+    return {pending->reply_type, pending->node_id, pending->partition,
+            (pending->reply_type == BM_SERIAL_CFG_DEL_RESP) ? pending->key
+                                                            : std::string()};
+  }
+
+  // Send a query and wait for its reply
+  // \return true if the caller stays suspended
+  bool start(detail::pending *pending, std::coroutine_handle<> caller) {
+    if (pending->reply_type == BM_SERIAL_CFG_VALUE &&
+        quarantined(pending->node_id, pending->partition)) {
+      pending->err = BM_SERIAL_BUSY;
+      pending->done = true;
+      return false;
+    }
+
+    pending->handle = caller;
+    pending->deadline = now_fn_() + timeout_;
+    pending->registered = true;
+    waiting_[key_of(pending)].push_back(pending);
+    pending->order_it = order_.insert(order_.end(), pending);
+
+    pending->err = send(pending);
+    if (pending->err) {
+      finish(pending);
+    }
+    if (pending->done) {
+      return false;
+    }
+    pending->suspended = true;
+    return true;
+  }
+
+  bm_serial_error_e send(const detail::pending *pending) {
+    switch (pending->reply_type) {
+    case BM_SERIAL_CFG_VALUE:
+      return bm_serial_ctx_cfg_get(&ctx_, pending->node_id, pending->partition,
+                                   pending->key.size(), pending->key.data());
+    case BM_SERIAL_CFG_STATUS_RESP:
+      return bm_serial_ctx_cfg_status_request(&ctx_, pending->node_id,
+                                              pending->partition);
+    case BM_SERIAL_CFG_DEL_RESP:
+      return bm_serial_ctx_cfg_delete_request(
+          &ctx_, pending->node_id, pending->partition, pending->key.size(),
+          pending->key.data());
+    case BM_SERIAL_DEVICE_INFO_REPLY:
+      return bm_serial_ctx_send_info_request(&ctx_, pending->node_id);
+    case BM_SERIAL_RESOURCE_REPLY:
+      return bm_serial_ctx_send_resource_request(&ctx_, pending->node_id);
+    default:
+      return BM_SERIAL_UNSUPPORTED_MSG;
+    }
+  }
+
+  // Stop waiting, resume the coroutine on the next poll()
+  void finish(detail::pending *pending) {
+    unlink(pending);
+    pending->done = true;
+    if (pending->suspended) {
+      ready_.push_back(pending->handle);
+    }
+  }
+
+  void unlink(detail::pending *pending) {
+    if (!pending->registered) {
+      return;
+    }
+    pending->registered = false;
+
+    auto it = waiting_.find(key_of(pending));
+    auto &queue = it->second;
+    queue.erase(std::find(queue.begin(), queue.end(), pending));
+    if (queue.empty()) {
+      waiting_.erase(it);
+    }
+    order_.erase(pending->order_it);
+  }
+
+  // A get timed out. Values don't carry the key, so its value could still come
+  // in and be taken for the next get to the same node and partition. Fail the
+  // ones waiting and hold off new ones until it can't come anymore.
+  void lost(const detail::pending *pending, uint32_t now) {
+    detail::match_key key = key_of(pending);
+    for (auto it = waiting_.find(key); it != waiting_.end();
+         it = waiting_.find(key)) {
+      detail::pending *other = it->second.front();
+      other->err = BM_SERIAL_TIMEOUT;
+      finish(other);
+    }
+    quarantine_[{pending->node_id, pending->partition}] = now + timeout_;
+  }
+
+  bool quarantined(uint64_t node_id, uint32_t partition) {
+    auto it = quarantine_.find({node_id, partition});
+    if (it == quarantine_.end()) {
+      return false;
+    }
+    if ((int32_t)(now_fn_() - it->second) >= 0) {
+      quarantine_.erase(it);
+      return false;
+    }
+    return true;
+  }
+
+  // Query destroyed (its coroutine was) before it finished
+  void cancel(detail::pending *pending) {
+    unlink(pending);
+    if (pending->done && pending->suspended) {
+      auto it = std::find(ready_.begin(), ready_.end(), pending->handle);
+      if (it != ready_.end()) {
+        ready_.erase(it);
+      }
+    }
+  }
+
+  static bool rx_hook(void *arg, uint8_t type, const uint8_t *payload,
+                      size_t len) {
+    return static_cast<executor *>(arg)->received(type, payload, len);
+  }
+
+  bool received(uint8_t type, const uint8_t *payload, size_t len) {
+    uint64_t node_id;
+    uint32_t partition = BM_COMMON_CFG_PARTITION_USER;
+    std::string key;
+    const_bytes in(payload, len);
+    // Malformed replies can't be matched, they go to the callbacks
+    switch (type) {
+    case BM_SERIAL_CFG_VALUE: {
+      cfg_value_view value;
+      if (message<BM_SERIAL_CFG_VALUE>::decode_payload(in, value)) {
+        return false;
+      }
+      node_id = value.source_node_id;
+      partition = value.partition;
+      if (quarantined(node_id, partition)) {
+        // Most likely the value of a get that timed out
+        return false;
+      }
+      break;
+    }
+    case BM_SERIAL_CFG_STATUS_RESP: {
+      cfg_status_view status;
+      if (message<BM_SERIAL_CFG_STATUS_RESP>::decode_payload(in, status)) {
+        return false;
+      }
+      node_id = status.source_node_id;
+      partition = status.partition;
+      break;
+    }
+    case BM_SERIAL_CFG_DEL_RESP: {
+      cfg_del_view del;
+      if (message<BM_SERIAL_CFG_DEL_RESP>::decode_payload(in, del)) {
+        return false;
+      }
+      node_id = del.source_node_id;
+      partition = del.partition;
+      key.assign(del.key);
+      break;
+    }
+    case BM_SERIAL_DEVICE_INFO_REPLY: {
+      device_info_view info;
+      if (message<BM_SERIAL_DEVICE_INFO_REPLY>::decode_payload(in, info)) {
+        return false;
+      }
+      node_id = info.info.node_id;
+      break;
+    }
+    case BM_SERIAL_RESOURCE_REPLY: {
+      resource_table_view table;
+      if (message<BM_SERIAL_RESOURCE_REPLY>::decode_payload(in, table)) {
+        return false;
+      }
+      node_id = table.node_id;
+      break;
+    }
+    default:
+      return false;
+    }
+
+    detail::match_key match(type, node_id, partition, std::move(key));
+    auto it = waiting_.find(match);
+    if (it == waiting_.end()) {
+      // Query sent to every node
+      std::get<1>(match) = 0;
+      it = waiting_.find(match);
+    }
+    if (it == waiting_.end()) {
+      return false;
+    }
+
+    detail::pending *pending = it->second.front();
+    pending->err = pending->parse(pending->result, payload, len);
+    finish(pending);
+    return true;
+  }
+
+  bm_serial_ctx_t &ctx_;
+  uint32_t (*now_fn_)(void);
+  uint32_t timeout_;
+
+  // Waiting queries by what answers them, oldest first
+  std::map<detail::match_key, std::deque<detail::pending *>> waiting_;
+  // Every waiting query in the order sent, which is also deadline order
+  std::list<detail::pending *> order_;
+  // Node and partition a cfg get timed out on, until when new gets fail
+  std::map<std::pair<uint64_t, uint32_t>, uint32_t> quarantine_;
+  // Coroutines to resume on the next poll()
+  std::deque<std::coroutine_handle<>> ready_;
+  std::list<std::coroutine_handle<>> tasks_;
+};
+
+template <typename T> query<T>::~query() { ex_.cancel(&pending_); }
+
+template <typename T>
+bool query<T>::await_suspend(std::coroutine_handle<> caller) {
+  return ex_.start(&pending_, caller);
+}
+
+} // namespace bm_serial
+
+#endif // __cplusplus >= 202002L
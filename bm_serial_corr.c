@@ -0,0 +1,513 @@
+#include "bm_serial_corr.h"
+#include "bm_serial_hash.h"
+#include <stdint.h>
+#include <string.h>
+
+_Static_assert(BM_SERIAL_CORR_ENTRIES < 256, "entry index is 8 bits");
+_Static_assert((BM_SERIAL_CORR_BUCKETS & (BM_SERIAL_CORR_BUCKETS - 1)) == 0,
+               "BM_SERIAL_CORR_BUCKETS must be a power of 2");
+
+// What a request is waiting for, or what a reply answers
+typedef struct {
+  uint8_t type;
+  uint64_t node_id;
+  uint8_t partition;
+  uint32_t key_hash;
+} bm_serial_corr_key_t;
+
+// Request sent for each bm_serial_corr_type_e
+static const bm_serial_message_t _bm_serial_corr_requests[] = {
+    [BM_SERIAL_CORR_CFG_GET] = BM_SERIAL_CFG_GET,
+    [BM_SERIAL_CORR_CFG_STATUS] = BM_SERIAL_CFG_STATUS_REQ,
+    [BM_SERIAL_CORR_CFG_DEL] = BM_SERIAL_CFG_DEL_REQ,
+    [BM_SERIAL_CORR_INFO] = BM_SERIAL_DEVICE_INFO_REQ,
+    [BM_SERIAL_CORR_RESOURCE] = BM_SERIAL_RESOURCE_REQ,
+};
+
+static uint32_t _bm_serial_corr_bucket(const bm_serial_corr_key_t *key) {
+  uint32_t hash = bm_serial_fnv1a(BM_SERIAL_FNV_OFFSET, &key->node_id,
+                                  sizeof(key->node_id));
+  hash = bm_serial_fnv1a(hash, &key->type, sizeof(key->type));
+  hash = bm_serial_fnv1a(hash, &key->partition, sizeof(key->partition));
+  hash = bm_serial_fnv1a(hash, &key->key_hash, sizeof(key->key_hash));
+  return hash % BM_SERIAL_CORR_BUCKETS;
+}
+
+static uint32_t _bm_serial_corr_node_bucket(uint64_t node_id) {
+  return bm_serial_fnv1a(BM_SERIAL_FNV_OFFSET, &node_id, sizeof(node_id)) %
+         BM_SERIAL_CORR_BUCKETS;
+}
+
+/*!
+  Get what a request waits for
+
+  \param[in] type message type
+  \param[in] *payload message payload
+  \param[in] len payload length
+  \param[out] *key request type, node, partition and key hash
+  \return true if the message is a request that gets a reply
+*/
+static bool _bm_serial_corr_request(uint8_t type, const uint8_t *payload,
+                                    size_t len, bm_serial_corr_key_t *key) {
+  memset(key, 0, sizeof(bm_serial_corr_key_t));
+
+  switch (type) {
+  case BM_SERIAL_CFG_GET: {
+    if (len < sizeof(bm_common_config_get_t)) {
+      return false;
+    }
+    const bm_common_config_get_t *get = (const bm_common_config_get_t *)payload;
+    key->type = BM_SERIAL_CORR_CFG_GET;
+    key->node_id = get->header.target_node_id;
+    key->partition = get->partition;
+    return true;
+  }
+  case BM_SERIAL_CFG_STATUS_REQ: {
+    if (len < sizeof(bm_common_config_status_request_t)) {
+      return false;
+    }
+    const bm_common_config_status_request_t *status =
+        (const bm_common_config_status_request_t *)payload;
+    key->type = BM_SERIAL_CORR_CFG_STATUS;
+    key->node_id = status->header.target_node_id;
+    key->partition = status->partition;
+    return true;
+  }
+  case BM_SERIAL_CFG_DEL_REQ: {
+    const bm_common_config_delete_key_request_t *del =
+        (const bm_common_config_delete_key_request_t *)payload;
+    if (len < sizeof(*del) || del->key_length > len - sizeof(*del)) {
+      return false;
+    }
+    key->type = BM_SERIAL_CORR_CFG_DEL;
+    key->node_id = del->header.target_node_id;
+    key->partition = del->partition;
+    key->key_hash =
+        bm_serial_fnv1a(BM_SERIAL_FNV_OFFSET, del->key, del->key_length);
+    return true;
+  }
+  case BM_SERIAL_DEVICE_INFO_REQ:
+  case BM_SERIAL_RESOURCE_REQ: {
+    // Same layout
+    if (len < sizeof(bm_serial_device_info_request_t)) {
+      return false;
+    }
+    const bm_serial_device_info_request_t *request =
+        (const bm_serial_device_info_request_t *)payload;
+    key->type = (type == BM_SERIAL_DEVICE_INFO_REQ) ? BM_SERIAL_CORR_INFO
+                                                    : BM_SERIAL_CORR_RESOURCE;
+    key->node_id = request->target_node_id;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+/*!
+  Get the request a reply answers
+
+  \param[in] type message type
+  \param[in] *payload message payload, at least the type's minimum length
+  \param[in] len payload length
+  \param[out] *key request type, node, partition and key hash
+  \return true if the message is a reply
+*/
+static bool _bm_serial_corr_reply(uint8_t type, const uint8_t *payload,
+                                  size_t len, bm_serial_corr_key_t *key) {
+  memset(key, 0, sizeof(bm_serial_corr_key_t));
+
+  switch (type) {
+  case BM_SERIAL_CFG_VALUE: {
+    const bm_common_config_value_t *value =
+        (const bm_common_config_value_t *)payload;
+    key->type = BM_SERIAL_CORR_CFG_GET;
+    key->node_id = value->header.source_node_id;
+    key->partition = value->partition;
+    return true;
+  }
+  case BM_SERIAL_CFG_STATUS_RESP: {
+    const bm_common_config_status_response_t *status =
+        (const bm_common_config_status_response_t *)payload;
+    key->type = BM_SERIAL_CORR_CFG_STATUS;
+    key->node_id = status->header.source_node_id;
+    key->partition = status->partition;
+    return true;
+  }
+  case BM_SERIAL_CFG_DEL_RESP: {
+    const bm_common_config_delete_key_response_t *del =
+        (const bm_common_config_delete_key_response_t *)payload;
+    if (del->key_length > len - sizeof(*del)) {
+      return false;
+    }
+    key->type = BM_SERIAL_CORR_CFG_DEL;
+    key->node_id = del->header.source_node_id;
+    key->partition = del->partition;
+    key->key_hash =
+        bm_serial_fnv1a(BM_SERIAL_FNV_OFFSET, del->key, del->key_length);
+    return true;
+  }
+  case BM_SERIAL_DEVICE_INFO_REPLY: {
+    const bm_serial_device_info_reply_t *info =
+        (const bm_serial_device_info_reply_t *)payload;
+    key->type = BM_SERIAL_CORR_INFO;
+    key->node_id = info->info.node_id;
+    return true;
+  }
+  case BM_SERIAL_RESOURCE_REPLY: {
+    const bm_serial_resource_table_reply_t *resources =
+        (const bm_serial_resource_table_reply_t *)payload;
+    key->type = BM_SERIAL_CORR_RESOURCE;
+    key->node_id = resources->node_id;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+/*!
+  Find the oldest request waiting for key
+
+  \param[in] *corr correlation table
+  \param[in] *key what the reply answers
+  \return request, NULL if none
+*/
+static bm_serial_corr_entry_t *
+_bm_serial_corr_find(bm_serial_corr_t *corr, const bm_serial_corr_key_t *key) {
+  uint8_t idx = corr->buckets[_bm_serial_corr_bucket(key)];
+  while (idx) {
+    bm_serial_corr_entry_t *entry = &corr->entries[idx - 1];
+    if (entry->type == key->type && entry->node_id == key->node_id &&
+        entry->partition == key->partition &&
+        entry->key_hash == key->key_hash) {
+      return entry;
+    }
+    idx = entry->next;
+  }
+  return NULL;
+}
+
+/*!
+  Find a node's in-flight counter
+
+  \param[in] *corr correlation table
+  \param[in] node_id node
+  \param[in] add add one (at 0) if the node has none
+  \return counter, NULL if the node has none and add is false
+*/
+static bm_serial_corr_node_t *_bm_serial_corr_node(bm_serial_corr_t *corr,
+                                                   uint64_t node_id,
+                                                   bool add) {
+  uint8_t *bucket = &corr->node_buckets[_bm_serial_corr_node_bucket(node_id)];
+  for (uint8_t idx = *bucket; idx; idx = corr->nodes[idx - 1].next) {
+    if (corr->nodes[idx - 1].node_id == node_id) {
+      return &corr->nodes[idx - 1];
+    }
+  }
+
+  if (!add) {
+    return NULL;
+  }
+
+  // There are never more nodes than entries, so one is always free
+  uint8_t idx = corr->free_node;
+  bm_serial_corr_node_t *node = &corr->nodes[idx - 1];
+  corr->free_node = node->next;
+  node->node_id = node_id;
+  node->in_flight = 0;
+  node->next = *bucket;
+  *bucket = idx;
+  return node;
+}
+
+/*!
+  Stop counting a request against its node
+
+  \param[in] *corr correlation table
+  \param[in] node_id node the request went to
+  \return none
+*/
+static void _bm_serial_corr_node_done(bm_serial_corr_t *corr,
+                                      uint64_t node_id) {
+  uint8_t *node_link =
+      &corr->node_buckets[_bm_serial_corr_node_bucket(node_id)];
+  while (corr->nodes[*node_link - 1].node_id != node_id) {
+    node_link = &corr->nodes[*node_link - 1].next;
+  }
+  bm_serial_corr_node_t *node = &corr->nodes[*node_link - 1];
+  if (!--node->in_flight) {
+    uint8_t node_idx = *node_link;
+    *node_link = node->next;
+    node->next = corr->free_node;
+    corr->free_node = node_idx;
+  }
+}
+
+/*!
+  Take a request out of the table
+
+  \param[in] *corr correlation table
+  \param[in] *entry request
+  \return none
+*/
+static void _bm_serial_corr_remove(bm_serial_corr_t *corr,
+                                   bm_serial_corr_entry_t *entry) {
+  uint8_t idx = (uint8_t)(entry - corr->entries) + 1;
+  bm_serial_corr_key_t key = {entry->type, entry->node_id, entry->partition,
+                              entry->key_hash};
+
+  uint8_t *link = &corr->buckets[_bm_serial_corr_bucket(&key)];
+  while (*link != idx) {
+    link = &corr->entries[*link - 1].next;
+  }
+  *link = entry->next;
+
+  if (entry->expired) {
+    // Already stopped counting
+    entry->expired = false;
+    corr->expired_count--;
+  } else {
+    _bm_serial_corr_node_done(corr, entry->node_id);
+    corr->count--;
+  }
+
+  entry->type = BM_SERIAL_CORR_TYPES;
+  entry->next = corr->free_entry;
+  corr->free_entry = idx;
+}
+
+/*!
+  Enable request/response correlation on a bm_serial instance. Drops every
+  pending request if called again.
+
+  \param[out] *corr correlation table
+  \param[in] *ctx bm_serial instance
+  \param[in] *cfg configuration (copied)
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_corr_init(bm_serial_corr_t *corr,
+                                      bm_serial_ctx_t *ctx,
+                                      const bm_serial_corr_cfg_t *cfg) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!corr || !ctx || !cfg || !cfg->now_fn) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    memset(corr, 0, sizeof(bm_serial_corr_t));
+    corr->ctx = ctx;
+    corr->cfg = *cfg;
+
+    for (uint16_t idx = 0; idx < BM_SERIAL_CORR_ENTRIES; idx++) {
+      corr->entries[idx].type = BM_SERIAL_CORR_TYPES;
+      corr->entries[idx].next =
+          (idx + 1 < BM_SERIAL_CORR_ENTRIES) ? idx + 2 : 0;
+      corr->nodes[idx].next = (idx + 1 < BM_SERIAL_CORR_ENTRIES) ? idx + 2 : 0;
+    }
+    corr->free_entry = 1;
+    corr->free_node = 1;
+
+    ctx->corr = corr;
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Track a message about to be sent if it's a request
+
+  \param[in] *corr correlation table
+  \param[in] type message type
+  \param[in] *payload message payload
+  \param[in] len payload length
+  \param[out] **entry request added, NULL if the message isn't a request. Pass
+              to bm_serial_corr_drop() if the message isn't sent after all.
+  \return BM_SERIAL_OK if ok (or not a request), nonzero if the request can't
+          be sent now
+*/
+bm_serial_error_e bm_serial_corr_tx(bm_serial_corr_t *corr, uint8_t type,
+                                    const uint8_t *payload, size_t len,
+                                    bm_serial_corr_entry_t **entry) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  bm_serial_corr_key_t key;
+  *entry = NULL;
+
+  do {
+    if (!_bm_serial_corr_request(type, payload, len, &key)) {
+      break;
+    }
+
+    if (!corr->free_entry) {
+      corr->stats.rejected++;
+      rval = BM_SERIAL_OUT_OF_MEMORY;
+      break;
+    }
+
+    bm_serial_corr_node_t *node =
+        _bm_serial_corr_node(corr, key.node_id, true);
+    if (corr->cfg.max_per_node && node->in_flight >= corr->cfg.max_per_node) {
+      corr->stats.rejected++;
+      rval = BM_SERIAL_BUSY;
+      break;
+    }
+    node->in_flight++;
+
+    uint8_t idx = corr->free_entry;
+    bm_serial_corr_entry_t *new_entry = &corr->entries[idx - 1];
+    corr->free_entry = new_entry->next;
+    new_entry->node_id = key.node_id;
+    new_entry->sent_at = corr->cfg.now_fn();
+    new_entry->key_hash = key.key_hash;
+    new_entry->partition = key.partition;
+    new_entry->type = key.type;
+    new_entry->next = 0;
+
+    // Append, so the oldest request for a key is found first
+    uint8_t *link = &corr->buckets[_bm_serial_corr_bucket(&key)];
+    while (*link) {
+      link = &corr->entries[*link - 1].next;
+    }
+    *link = idx;
+
+    corr->count++;
+    corr->stats.tracked++;
+    *entry = new_entry;
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Forget a request from bm_serial_corr_tx() that wasn't sent
+
+  \param[in] *corr correlation table
+  \param[in] *entry request
+  \return none
+*/
+void bm_serial_corr_drop(bm_serial_corr_t *corr,
+                         bm_serial_corr_entry_t *entry) {
+  corr->stats.tracked--;
+  _bm_serial_corr_remove(corr, entry);
+}
+
+/*!
+  Match a received message with the request it answers
+
+  \param[in] *corr correlation table
+  \param[in] type message type
+  \param[in] *payload message payload, at least the type's minimum length
+  \param[in] len payload length
+  \return true if it answered a pending request
+*/
+bool bm_serial_corr_rx(bm_serial_corr_t *corr, uint8_t type,
+                       const uint8_t *payload, size_t len) {
+  bm_serial_corr_key_t key;
+  if (!_bm_serial_corr_reply(type, payload, len, &key)) {
+    return false;
+  }
+
+  bm_serial_corr_entry_t *entry = _bm_serial_corr_find(corr, &key);
+  if (!entry && key.node_id) {
+    // Request sent to every node
+    key.node_id = 0;
+    entry = _bm_serial_corr_find(corr, &key);
+  }
+  if (!entry) {
+    corr->stats.unsolicited++;
+    return false;
+  }
+  if (entry->expired) {
+    // Answers a request that expired, not the next one with the same key
+    corr->stats.late++;
+    _bm_serial_corr_remove(corr, entry);
+    return false;
+  }
+
+  uint32_t rtt = corr->cfg.now_fn() - entry->sent_at;
+  bm_serial_corr_latency_t *latency = &corr->latency[entry->type];
+  uint8_t bin = rtt ? (uint8_t)(32 - __builtin_clz(rtt)) : 0;
+  if (bin >= BM_SERIAL_CORR_HIST_BINS) {
+    bin = BM_SERIAL_CORR_HIST_BINS - 1;
+  }
+  latency->hist[bin]++;
+  latency->count++;
+  latency->total += rtt;
+  if (rtt > latency->max) {
+    latency->max = rtt;
+  }
+
+  corr->stats.matched++;
+  _bm_serial_corr_remove(corr, entry);
+  return true;
+}
+
+/*!
+  Expire requests that waited for their reply longer than the timeout, and
+  drop expired ones a late reply can't come for anymore. Call periodically.
+
+  \param[in] *corr correlation table
+  \return none
+*/
+void bm_serial_corr_poll(bm_serial_corr_t *corr) {
+  uint32_t now = corr->cfg.now_fn();
+
+  for (uint16_t idx = 0;
+       idx < BM_SERIAL_CORR_ENTRIES && (corr->count || corr->expired_count);
+       idx++) {
+    bm_serial_corr_entry_t *entry = &corr->entries[idx];
+    if (entry->type == BM_SERIAL_CORR_TYPES ||
+        now - entry->sent_at < corr->cfg.timeout) {
+      continue;
+    }
+
+    if (entry->expired) {
+      _bm_serial_corr_remove(corr, entry);
+      continue;
+    }
+
+    bm_serial_message_t type = _bm_serial_corr_requests[entry->type];
+    uint64_t node_id = entry->node_id;
+    bm_common_config_partition_e partition =
+        (bm_common_config_partition_e)entry->partition;
+
+    // Keep its place in the bucket, so a late reply doesn't go to the next
+    // request with the same key
+    _bm_serial_corr_node_done(corr, entry->node_id);
+    corr->count--;
+    entry->expired = true;
+    entry->sent_at = now;
+    corr->expired_count++;
+    corr->stats.expired++;
+
+    if (corr->cfg.expired_fn) {
+      corr->cfg.expired_fn(corr->cfg.arg, type, node_id, partition);
+    }
+  }
+}
+
+/*!
+  Requests waiting for a reply
+
+  \param[in] *corr correlation table
+  \return number of requests
+*/
+uint16_t bm_serial_corr_pending(bm_serial_corr_t *corr) {
+  return corr->count;
+}
+
+/*!
+  Requests waiting for a reply from one node
+
+  \param[in] *corr correlation table
+  \param[in] node_id node
+  \return number of requests
+*/
+uint8_t bm_serial_corr_in_flight(bm_serial_corr_t *corr, uint64_t node_id) {
+  bm_serial_corr_node_t *node = _bm_serial_corr_node(corr, node_id, false);
+  return node ? node->in_flight : 0;
+}
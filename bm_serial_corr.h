@@ -0,0 +1,146 @@
+#pragma once
+
+#include "bm_serial.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Max requests waiting for a reply (less than 256)
+#ifndef BM_SERIAL_CORR_ENTRIES
+#define BM_SERIAL_CORR_ENTRIES 64
+#endif
+
+// Hash table size (power of 2), twice the entries so chains stay short
+#define BM_SERIAL_CORR_BUCKETS 128
+
+// Round trip histogram bins, bin n counts round trips of 2^(n-1) to 2^n - 1
+// ticks (bin 0 under a tick), the last bin everything longer
+#define BM_SERIAL_CORR_HIST_BINS 16
+
+// Request types tracked
+typedef enum {
+  BM_SERIAL_CORR_CFG_GET,
+  BM_SERIAL_CORR_CFG_STATUS,
+  BM_SERIAL_CORR_CFG_DEL,
+  BM_SERIAL_CORR_INFO,
+  BM_SERIAL_CORR_RESOURCE,
+  BM_SERIAL_CORR_TYPES,
+} bm_serial_corr_type_e;
+
+typedef struct {
+  // Time to wait for a reply, in now_fn ticks
+  uint32_t timeout;
+  // Max requests waiting on one node, 0 for no limit (other than the table)
+  uint8_t max_per_node;
+  uint32_t (*now_fn)(void);
+
+  // Optional, called when a request expires without a reply
+  void (*expired_fn)(void *arg, bm_serial_message_t type, uint64_t node_id,
+                     bm_common_config_partition_e partition);
+  void *arg;
+} bm_serial_corr_cfg_t;
+
+typedef struct {
+  uint32_t tracked;
+  uint32_t matched;
+  uint32_t expired;
+  // Requests not sent because the table or the node's limit was full
+  uint32_t rejected;
+  // Replies without a request waiting for them
+  uint32_t unsolicited;
+  // Replies to requests that had expired, dropped
+  uint32_t late;
+} bm_serial_corr_stats_t;
+
+typedef struct {
+  uint32_t hist[BM_SERIAL_CORR_HIST_BINS];
+  uint32_t count;
+  uint32_t max;
+  uint64_t total;
+} bm_serial_corr_latency_t;
+
+typedef struct {
+  uint64_t node_id;
+  // When it expired if expired
+  uint32_t sent_at;
+  // FNV-1a of the key for deletes (the only reply that has it), 0 otherwise
+  uint32_t key_hash;
+  uint8_t partition;
+  // bm_serial_corr_type_e, BM_SERIAL_CORR_TYPES if free
+  uint8_t type;
+  // Index + 1 of the next entry in the bucket (or free list), 0 at the end
+  uint8_t next;
+  // No longer waiting, kept for a late reply
+  bool expired;
+} bm_serial_corr_entry_t;
+
+typedef struct {
+  uint64_t node_id;
+  uint8_t in_flight;
+  uint8_t next;
+} bm_serial_corr_node_t;
+
+//
+// Optional request/response correlation. Every config query (get, status,
+// delete) and BCMP info or resource request sent is put in a table until its
+// reply arrives or it expires. Requests are hashed on (type, node id,
+// partition, key hash) into chained buckets, so a reply finds its request in
+// constant time. Replies don't say which request they answer, so requests
+// with the same key are answered oldest first. Info and resource requests to
+// node 0 (every node) take the first reply from any node.
+//
+// Requests over the node's in-flight limit, or with the table full, aren't
+// sent (BM_SERIAL_BUSY, BM_SERIAL_OUT_OF_MEMORY). Requests expire in
+// bm_serial_corr_poll(), but keep their place in the table for another
+// timeout. A late reply is dropped there (stats.late) instead of being taken
+// for the reply to the next request with the same key. Expired requests don't
+// count against max_per_node but do take up an entry. Round trip times go in a
+// log2 histogram per request type.
+//
+// Replies are still passed on to their callbacks. Requests sent inside a
+// BM_SERIAL_BATCH aren't tracked.
+//
+struct bm_serial_corr_s {
+  bm_serial_ctx_t *ctx;
+  bm_serial_corr_cfg_t cfg;
+
+  bm_serial_corr_entry_t entries[BM_SERIAL_CORR_ENTRIES];
+  // Index + 1 of the first entry per bucket, requests in the order sent
+  uint8_t buckets[BM_SERIAL_CORR_BUCKETS];
+  uint8_t free_entry;
+  uint16_t count;
+  // Expired requests still in the table
+  uint16_t expired_count;
+
+  // Requests waiting per node, for max_per_node
+  bm_serial_corr_node_t nodes[BM_SERIAL_CORR_ENTRIES];
+  uint8_t node_buckets[BM_SERIAL_CORR_BUCKETS];
+  uint8_t free_node;
+
+  bm_serial_corr_stats_t stats;
+  bm_serial_corr_latency_t latency[BM_SERIAL_CORR_TYPES];
+};
+
+bm_serial_error_e bm_serial_corr_init(bm_serial_corr_t *corr,
+                                      bm_serial_ctx_t *ctx,
+                                      const bm_serial_corr_cfg_t *cfg);
+void bm_serial_corr_poll(bm_serial_corr_t *corr);
+uint16_t bm_serial_corr_pending(bm_serial_corr_t *corr);
+uint8_t bm_serial_corr_in_flight(bm_serial_corr_t *corr, uint64_t node_id);
+
+// Used by bm_serial.c
+bm_serial_error_e bm_serial_corr_tx(bm_serial_corr_t *corr, uint8_t type,
+                                    const uint8_t *payload, size_t len,
+                                    bm_serial_corr_entry_t **entry);
+void bm_serial_corr_drop(bm_serial_corr_t *corr,
+                         bm_serial_corr_entry_t *entry);
+bool bm_serial_corr_rx(bm_serial_corr_t *corr, uint8_t type,
+                       const uint8_t *payload, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
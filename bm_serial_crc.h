@@ -9,6 +9,15 @@ extern "C" {
 
 uint16_t bm_serial_crc16_ccitt(uint16_t seed, const uint8_t *src, size_t len);
 
+// Copy src to dst and return the crc of the copied bytes in the same pass
+uint16_t bm_serial_crc16_ccitt_copy(uint16_t seed, uint8_t *dst,
+                                    const uint8_t *src, size_t len);
+
+// crc of A followed by B from crc1 (crc of A, any seed) and crc2 (crc of B
+// with seed 0), without going over the data again
+uint16_t bm_serial_crc16_ccitt_combine(uint16_t crc1, uint16_t crc2,
+                                       size_t len2);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,248 @@
+#include "bm_serial_dfu_file.h"
+#include "bm_serial_crc.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BM_SERIAL_DFU_CHECKPOINT_MAGIC 0x44465543
+
+/*!
+  Save the transfer progress
+
+  \param[in] *file DFU file source
+  \param[in] acked bytes acknowledged
+  \return none
+*/
+static void _bm_serial_dfu_file_checkpoint(bm_serial_dfu_file_t *file,
+                                           uint32_t acked) {
+  if (file->checkpoint_fd < 0) {
+    return;
+  }
+
+  bm_serial_dfu_checkpoint_t checkpoint = {0};
+  checkpoint.magic = BM_SERIAL_DFU_CHECKPOINT_MAGIC;
+  checkpoint.start = file->start;
+  checkpoint.acked = acked;
+  checkpoint.crc16 =
+      bm_serial_crc16_ccitt(0, (const uint8_t *)&checkpoint,
+                            offsetof(bm_serial_dfu_checkpoint_t, crc16));
+
+  // Single small write at the start of the file, the crc catches a torn one
+  if (pwrite(file->checkpoint_fd, &checkpoint, sizeof(checkpoint), 0) ==
+      sizeof(checkpoint)) {
+    file->checkpointed = acked;
+  }
+}
+
+/*!
+  Load saved progress for a transfer
+
+  \param[in] *file DFU file source
+  \param[in] *start DFU start of the transfer
+  \return offset to resume from, 0 if there's no matching checkpoint
+*/
+static uint32_t _bm_serial_dfu_file_resume(bm_serial_dfu_file_t *file,
+                                           const bm_serial_dfu_start_t *start) {
+  bm_serial_dfu_checkpoint_t checkpoint;
+  if (file->checkpoint_fd < 0 ||
+      pread(file->checkpoint_fd, &checkpoint, sizeof(checkpoint), 0) !=
+          sizeof(checkpoint)) {
+    return 0;
+  }
+
+  if (checkpoint.magic != BM_SERIAL_DFU_CHECKPOINT_MAGIC ||
+      checkpoint.crc16 !=
+          bm_serial_crc16_ccitt(0, (const uint8_t *)&checkpoint,
+                                offsetof(bm_serial_dfu_checkpoint_t, crc16)) ||
+      memcmp(&checkpoint.start, start, sizeof(bm_serial_dfu_start_t)) ||
+      checkpoint.acked >= start->image_size) {
+    return 0;
+  }
+
+  return checkpoint.acked;
+}
+
+/*!
+  Sender progress, checkpoints every BM_SERIAL_DFU_FILE_CHECKPOINT_INTERVAL
+  bytes
+
+  \param[in] *arg DFU file source
+  \param[in] acked bytes acknowledged
+  \param[in] total image size
+  \return none
+*/
+static void _bm_serial_dfu_file_progress(void *arg, uint32_t acked,
+                                         uint32_t total) {
+  bm_serial_dfu_file_t *file = (bm_serial_dfu_file_t *)arg;
+
+  if (acked < total &&
+      acked - file->checkpointed >= BM_SERIAL_DFU_FILE_CHECKPOINT_INTERVAL) {
+    _bm_serial_dfu_file_checkpoint(file, acked);
+  }
+
+  if (file->cfg.progress_fn) {
+    file->cfg.progress_fn(file->cfg.arg, acked, total);
+  }
+}
+
+/*!
+  Transfer finished, the checkpoint is removed on success and brought up to
+  date otherwise
+
+  \param[in] *arg DFU file source
+  \param[in] success true if the whole image was acknowledged
+  \return none
+*/
+static void _bm_serial_dfu_file_done(void *arg, bool success) {
+  bm_serial_dfu_file_t *file = (bm_serial_dfu_file_t *)arg;
+
+  if (success) {
+    if (file->checkpoint_fd >= 0) {
+      close(file->checkpoint_fd);
+      file->checkpoint_fd = -1;
+      unlink(file->checkpoint_path);
+    }
+  } else if (file->tx.acked > file->checkpointed) {
+    _bm_serial_dfu_file_checkpoint(file, file->tx.acked);
+  }
+
+  if (file->cfg.done_fn) {
+    file->cfg.done_fn(file->cfg.arg, success);
+  }
+}
+
+/*!
+  Open and map a DFU image
+
+  \param[out] *file DFU file source
+  \param[in] *image_path image file
+  \param[in] *checkpoint_path optional checkpoint file (created if needed),
+                              NULL to always start from the beginning
+  \return BM_SERIAL_OK if opened, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_dfu_file_open(bm_serial_dfu_file_t *file,
+                                          const char *image_path,
+                                          const char *checkpoint_path) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!file || !image_path) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    memset(file, 0, sizeof(bm_serial_dfu_file_t));
+    file->fd = -1;
+    file->checkpoint_fd = -1;
+
+    file->fd = open(image_path, O_RDONLY);
+    struct stat st;
+    if (file->fd < 0 || fstat(file->fd, &st) || st.st_size <= 0) {
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+
+    // Offsets have to fit in a chunk (below DFU_CHUNK_NAK_BITFLAG)
+    if ((uint64_t)st.st_size >= (uint64_t)(uint32_t)DFU_CHUNK_NAK_BITFLAG) {
+      rval = BM_SERIAL_OVERFLOW;
+      break;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+    if (map == MAP_FAILED) {
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+    // Read mostly front to back
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    file->image = (const uint8_t *)map;
+    file->size = st.st_size;
+
+    if (checkpoint_path) {
+      file->checkpoint_path = checkpoint_path;
+      file->checkpoint_fd = open(checkpoint_path, O_RDWR | O_CREAT, 0644);
+      if (file->checkpoint_fd < 0) {
+        rval = BM_SERIAL_MISC_ERR;
+        break;
+      }
+    }
+
+  } while (0);
+
+  if (rval && file) {
+    bm_serial_dfu_file_close(file);
+  }
+
+  return rval;
+}
+
+/*!
+  Unmap the image and close the files. Progress is kept in the checkpoint.
+
+  \param[in] *file DFU file source
+  \return none
+*/
+void bm_serial_dfu_file_close(bm_serial_dfu_file_t *file) {
+  if (file->image) {
+    munmap((void *)file->image, file->size);
+    file->image = NULL;
+  }
+  if (file->fd >= 0) {
+    close(file->fd);
+    file->fd = -1;
+  }
+  if (file->checkpoint_fd >= 0) {
+    close(file->checkpoint_fd);
+    file->checkpoint_fd = -1;
+  }
+}
+
+/*!
+  Start (or resume) sending the image
+
+  \param[in] *file opened DFU file source
+  \param[in] *ctx bm_serial instance
+  \param[in,out] *start DFU start, image_size and crc16 are filled in from the
+                        image
+  \param[in] *cfg sender config, the image source and resume offset are
+                  filled in
+  \return BM_SERIAL_OK if started, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_dfu_file_start(bm_serial_dfu_file_t *file,
+                                           bm_serial_ctx_t *ctx,
+                                           bm_serial_dfu_start_t *start,
+                                           const bm_serial_dfu_tx_cfg_t *cfg) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!file || !file->image || !start || !cfg) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    start->image_size = file->size;
+    start->crc16 = bm_serial_crc16_ccitt(0, file->image, file->size);
+
+    file->start = *start;
+    file->cfg = *cfg;
+    file->resumed_at = _bm_serial_dfu_file_resume(file, start);
+    file->checkpointed = file->resumed_at;
+
+    bm_serial_dfu_tx_cfg_t tx_cfg = *cfg;
+    tx_cfg.image = file->image;
+    tx_cfg.read_fn = NULL;
+    tx_cfg.resume_offset = file->resumed_at;
+    tx_cfg.progress_fn = _bm_serial_dfu_file_progress;
+    tx_cfg.done_fn = _bm_serial_dfu_file_done;
+    tx_cfg.arg = file;
+
+    rval = bm_serial_dfu_tx_start(&file->tx, ctx, start, &tx_cfg);
+
+  } while (0);
+
+  return rval;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "bm_serial.h"
+#include "bm_serial_dfu_tx.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bytes acknowledged between checkpoint writes
+#define BM_SERIAL_DFU_FILE_CHECKPOINT_INTERVAL 4096
+
+// Saved progress of a transfer, see bm_serial_dfu_file_t
+typedef struct {
+  uint32_t magic;
+  // DFU start the transfer was for (every field has to match to resume)
+  bm_serial_dfu_start_t start;
+  // Everything before acked was received
+  uint32_t acked;
+  // crc16 of everything above, a torn write isn't resumed from
+  uint16_t crc16;
+} __attribute__((packed)) bm_serial_dfu_checkpoint_t;
+
+//
+// Host side (POSIX) DFU source. The image file is memory mapped and chunks
+// are sent straight from the mapping, nothing is read into the heap. Progress
+// is saved to a small checkpoint file every
+// BM_SERIAL_DFU_FILE_CHECKPOINT_INTERVAL bytes, so an interrupted transfer
+// of the same image resumes at the first unacknowledged offset (the receiver
+// has to keep what it got, see bm_serial_dfu_rx_start()). The checkpoint is
+// removed once the whole image was acknowledged.
+//
+// Only built with BM_SERIAL_HOST. Drive the transfer with the
+// bm_serial_dfu_tx functions on file->tx.
+//
+typedef struct {
+  int fd;
+  const uint8_t *image;
+  size_t size;
+
+  // Caller keeps the string around
+  const char *checkpoint_path;
+  int checkpoint_fd;
+  uint32_t checkpointed;
+
+  // Resumed from this offset
+  uint32_t resumed_at;
+
+  // Transfer being sent, saved with the checkpoint
+  bm_serial_dfu_start_t start;
+
+  // Caller's progress and done callbacks, chained from the sender's
+  bm_serial_dfu_tx_cfg_t cfg;
+
+  bm_serial_dfu_tx_t tx;
+} bm_serial_dfu_file_t;
+
+bm_serial_error_e bm_serial_dfu_file_open(bm_serial_dfu_file_t *file,
+                                          const char *image_path,
+                                          const char *checkpoint_path);
+void bm_serial_dfu_file_close(bm_serial_dfu_file_t *file);
+bm_serial_error_e bm_serial_dfu_file_start(bm_serial_dfu_file_t *file,
+                                           bm_serial_ctx_t *ctx,
+                                           bm_serial_dfu_start_t *start,
+                                           const bm_serial_dfu_tx_cfg_t *cfg);
+
+#ifdef __cplusplus
+}
+#endif
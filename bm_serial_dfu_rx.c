@@ -0,0 +1,328 @@
+#include "bm_serial_dfu_rx.h"
+#include "bm_serial_crc.h"
+#include <stdint.h>
+#include <string.h>
+
+/*!
+  Store part of the image
+
+  \param[in] *rx DFU receiver
+  \param[in] offset image offset
+  \param[in] *data data to store
+  \param[in] len data length
+  \param[in] seed crc16 seed
+  \param[out] *crc16 crc16 of the data
+  \return BM_SERIAL_OK if stored, nonzero otherwise
+*/
+static bm_serial_error_e _bm_serial_dfu_rx_write(bm_serial_dfu_rx_t *rx,
+                                                 uint32_t offset,
+                                                 const uint8_t *data,
+                                                 size_t len, uint16_t seed,
+                                                 uint16_t *crc16) {
+  if (rx->cfg.image) {
+    // Copy and crc in one pass
+    *crc16 = bm_serial_crc16_ccitt_copy(seed, &rx->cfg.image[offset], data,
+                                        len);
+    return BM_SERIAL_OK;
+  }
+
+  *crc16 = bm_serial_crc16_ccitt(seed, data, len);
+  return rx->cfg.write_fn(rx->cfg.arg, offset, data, len) ? BM_SERIAL_OK
+                                                          : BM_SERIAL_MISC_ERR;
+}
+
+/*!
+  Remove a range from the list
+
+  \param[in] *rx DFU receiver
+  \param[in] idx range index
+  \return none
+*/
+static void _bm_serial_dfu_rx_remove(bm_serial_dfu_rx_t *rx, uint8_t idx) {
+  rx->num_ranges--;
+  memmove(&rx->ranges[idx], &rx->ranges[idx + 1],
+          (rx->num_ranges - idx) * sizeof(bm_serial_dfu_rx_range_t));
+}
+
+/*!
+  Store data that isn't in the prefix or any range yet, and track it
+
+  \param[in] *rx DFU receiver
+  \param[in] offset image offset
+  \param[in] *data data to store
+  \param[in] len data length
+  \return BM_SERIAL_OK if stored, nonzero otherwise
+*/
+static bm_serial_error_e _bm_serial_dfu_rx_add(bm_serial_dfu_rx_t *rx,
+                                               uint32_t offset,
+                                               const uint8_t *data,
+                                               size_t len) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    uint32_t end = offset + len;
+    uint16_t crc16;
+
+    // Extends the prefix, then absorb the ranges it now reaches
+    if (offset == rx->prefix) {
+      rval = _bm_serial_dfu_rx_write(rx, offset, data, len, rx->crc16,
+                                     &rx->crc16);
+      if (rval) {
+        break;
+      }
+      rx->prefix = end;
+
+      while (rx->num_ranges && rx->ranges[0].offset == rx->prefix) {
+        rx->crc16 = bm_serial_crc16_ccitt_combine(
+            rx->crc16, rx->ranges[0].crc16, rx->ranges[0].length);
+        rx->prefix += rx->ranges[0].length;
+        _bm_serial_dfu_rx_remove(rx, 0);
+      }
+      break;
+    }
+
+    // Ranges are kept sorted, find where this one goes
+    uint8_t idx = 0;
+    while (idx < rx->num_ranges && rx->ranges[idx].offset < offset) {
+      idx++;
+    }
+    bm_serial_dfu_rx_range_t *prev = idx ? &rx->ranges[idx - 1] : NULL;
+    bm_serial_dfu_rx_range_t *next =
+        idx < rx->num_ranges ? &rx->ranges[idx] : NULL;
+    bool join_prev = prev && prev->offset + prev->length == offset;
+    bool join_next = next && next->offset == end;
+
+    if (!join_prev && !join_next &&
+        rx->num_ranges == BM_SERIAL_DFU_RX_MAX_RANGES) {
+      rval = BM_SERIAL_OUT_OF_MEMORY;
+      break;
+    }
+
+    rval = _bm_serial_dfu_rx_write(rx, offset, data, len, 0, &crc16);
+    if (rval) {
+      break;
+    }
+
+    if (join_prev) {
+      prev->crc16 = bm_serial_crc16_ccitt_combine(prev->crc16, crc16, len);
+      prev->length += len;
+      if (join_next) {
+        prev->crc16 =
+            bm_serial_crc16_ccitt_combine(prev->crc16, next->crc16,
+                                          next->length);
+        prev->length += next->length;
+        _bm_serial_dfu_rx_remove(rx, idx);
+      }
+    } else if (join_next) {
+      next->crc16 =
+          bm_serial_crc16_ccitt_combine(crc16, next->crc16, next->length);
+      next->offset = offset;
+      next->length += len;
+    } else {
+      memmove(&rx->ranges[idx + 1], &rx->ranges[idx],
+              (rx->num_ranges - idx) * sizeof(bm_serial_dfu_rx_range_t));
+      rx->ranges[idx].offset = offset;
+      rx->ranges[idx].length = len;
+      rx->ranges[idx].crc16 = crc16;
+      rx->num_ranges++;
+    }
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Initialize a DFU receiver
+
+  \param[out] *rx DFU receiver
+  \param[in] *ctx bm_serial instance to send acknowledgements and NAKs on
+  \param[in] *cfg config
+  \return BM_SERIAL_OK if initialized, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_dfu_rx_init(bm_serial_dfu_rx_t *rx,
+                                        bm_serial_ctx_t *ctx,
+                                        const bm_serial_dfu_rx_cfg_t *cfg) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!rx || !ctx || !cfg || (!cfg->image && !cfg->write_fn)) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    memset(rx, 0, sizeof(bm_serial_dfu_rx_t));
+    rx->ctx = ctx;
+    rx->cfg = *cfg;
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Start receiving an image. A repeated start for the image being received
+  keeps what was received so far, so an interrupted transfer can resume.
+
+  \param[in] *rx DFU receiver
+  \param[in] *start received DFU start
+  \return BM_SERIAL_OK if started, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_dfu_rx_start(bm_serial_dfu_rx_t *rx,
+                                         const bm_serial_dfu_start_t *start) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (rx->cfg.image && start->image_size > rx->cfg.image_len) {
+      rval = BM_SERIAL_OVERFLOW;
+      break;
+    }
+
+    if (rx->active && !rx->done &&
+        !memcmp(&rx->start, start, sizeof(bm_serial_dfu_start_t))) {
+      break;
+    }
+
+    rx->start = *start;
+    rx->active = true;
+    rx->done = false;
+    rx->prefix = 0;
+    rx->crc16 = 0;
+    rx->highest = 0;
+    rx->num_ranges = 0;
+    memset(&rx->stats, 0, sizeof(rx->stats));
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Process a received chunk. Parts that were already received are skipped.
+
+  \param[in] *rx DFU receiver
+  \param[in] offset chunk offset
+  \param[in] length chunk length
+  \param[in] *data chunk data
+  \return BM_SERIAL_OK if processed, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_dfu_rx_chunk(bm_serial_dfu_rx_t *rx,
+                                         uint32_t offset, size_t length,
+                                         const uint8_t *data) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!rx->active) {
+      rx->stats.rejected++;
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+
+    if (!length || length > rx->start.image_size ||
+        offset > rx->start.image_size - length) {
+      rx->stats.rejected++;
+      rval = BM_SERIAL_INVALID_MSG_LEN;
+      break;
+    }
+
+    rx->stats.chunks++;
+    uint32_t end = offset + length;
+    uint32_t pos = offset;
+    bool stored = false;
+
+    while (pos < end) {
+      if (pos < rx->prefix) {
+        pos = rx->prefix;
+        continue;
+      }
+
+      // First range that doesn't end before pos
+      uint8_t idx = 0;
+      while (idx < rx->num_ranges &&
+             rx->ranges[idx].offset + rx->ranges[idx].length <= pos) {
+        idx++;
+      }
+      if (idx < rx->num_ranges && rx->ranges[idx].offset <= pos) {
+        pos = rx->ranges[idx].offset + rx->ranges[idx].length;
+        continue;
+      }
+
+      uint32_t piece_end = end;
+      if (idx < rx->num_ranges && rx->ranges[idx].offset < end) {
+        piece_end = rx->ranges[idx].offset;
+      }
+
+      rval = _bm_serial_dfu_rx_add(rx, pos, &data[pos - offset],
+                                   piece_end - pos);
+      if (rval) {
+        rx->stats.rejected++;
+        break;
+      }
+      rx->stats.bytes += piece_end - pos;
+      stored = true;
+      pos = piece_end;
+    }
+    if (rval) {
+      break;
+    }
+
+    if (!stored) {
+      rx->stats.duplicates++;
+    }
+
+    // Gap before a chunk past everything else, most likely lost
+    if (offset > rx->highest) {
+      bm_serial_ctx_dfu_send_nak(rx->ctx, rx->highest, offset - rx->highest);
+      rx->stats.naks_sent++;
+    }
+    if (end > rx->highest) {
+      rx->highest = end;
+    }
+
+    bm_serial_ctx_dfu_send_nak(rx->ctx, rx->prefix, 0);
+
+    if (!rx->done && rx->prefix == rx->start.image_size) {
+      rx->done = true;
+      if (rx->cfg.done_fn) {
+        rx->cfg.done_fn(rx->cfg.arg, rx->crc16 == rx->start.crc16);
+      }
+    }
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  NAK every missing range up to the furthest chunk received, and acknowledge
+  the prefix. For when the sender stalls.
+
+  \param[in] *rx DFU receiver
+  \return BM_SERIAL_OK if sent, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_dfu_rx_send_naks(bm_serial_dfu_rx_t *rx) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!rx->active) {
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+
+    uint32_t pos = rx->prefix;
+    for (uint8_t idx = 0; idx < rx->num_ranges && !rval; idx++) {
+      rval = bm_serial_ctx_dfu_send_nak(rx->ctx, pos,
+                                        rx->ranges[idx].offset - pos);
+      rx->stats.naks_sent++;
+      pos = rx->ranges[idx].offset + rx->ranges[idx].length;
+    }
+    if (rval) {
+      break;
+    }
+
+    rval = bm_serial_ctx_dfu_send_nak(rx->ctx, rx->prefix, 0);
+
+  } while (0);
+
+  return rval;
+}
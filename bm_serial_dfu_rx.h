@@ -0,0 +1,91 @@
+#pragma once
+
+#include "bm_serial.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most separate ranges received past the complete prefix
+#define BM_SERIAL_DFU_RX_MAX_RANGES 32
+
+typedef struct {
+  // Where the image goes. Either a buffer (e.g. a memory mapped file) of
+  // image_len bytes, or write_fn (e.g. flash) if image is NULL.
+  uint8_t *image;
+  size_t image_len;
+  bool (*write_fn)(void *arg, uint32_t offset, const uint8_t *data,
+                   size_t len);
+
+  // Optional, called once the whole image is in, success is false if the
+  // crc doesn't match dfu_start.crc16
+  void (*done_fn)(void *arg, bool success);
+  void *arg;
+} bm_serial_dfu_rx_cfg_t;
+
+typedef struct {
+  uint32_t chunks;
+  uint32_t bytes;
+  // Chunks (or parts of chunks) that were already received
+  uint32_t duplicates;
+  // Chunks outside the image, or with no room to track them
+  uint32_t rejected;
+  uint32_t naks_sent;
+} bm_serial_dfu_rx_stats_t;
+
+typedef struct {
+  uint32_t offset;
+  uint32_t length;
+  // crc16 of the range with a 0 seed, folded in once the prefix reaches it
+  uint16_t crc16;
+} bm_serial_dfu_rx_range_t;
+
+//
+// DFU receiver reassembly. Chunks can arrive in any order and more than once.
+// The complete prefix of the image is tracked with its crc16, and everything
+// received past it as a sorted list of ranges, each with its own crc16. When
+// the prefix reaches a range the crcs are combined, so checking the image
+// doesn't need a second pass over it.
+//
+// Every chunk is acknowledged (bm_serial_dfu_send_nak() with length 0) with
+// the prefix, and a chunk past the furthest one received NAKs the gap before
+// it. This is what bm_serial_dfu_tx expects.
+//
+// Pass dfu_start_fn and dfu_chunk_fn (without DFU_CHUNK_NAK_BITFLAG) calls
+// to bm_serial_dfu_rx_start() and bm_serial_dfu_rx_chunk(). Not thread safe.
+//
+typedef struct {
+  bm_serial_ctx_t *ctx;
+  bm_serial_dfu_rx_cfg_t cfg;
+  bm_serial_dfu_start_t start;
+  bool active;
+  bool done;
+
+  // Everything before prefix was received, crc16 covers it
+  uint32_t prefix;
+  uint16_t crc16;
+  // End of the furthest chunk received
+  uint32_t highest;
+
+  bm_serial_dfu_rx_range_t ranges[BM_SERIAL_DFU_RX_MAX_RANGES];
+  uint8_t num_ranges;
+
+  bm_serial_dfu_rx_stats_t stats;
+} bm_serial_dfu_rx_t;
+
+bm_serial_error_e bm_serial_dfu_rx_init(bm_serial_dfu_rx_t *rx,
+                                        bm_serial_ctx_t *ctx,
+                                        const bm_serial_dfu_rx_cfg_t *cfg);
+bm_serial_error_e bm_serial_dfu_rx_start(bm_serial_dfu_rx_t *rx,
+                                         const bm_serial_dfu_start_t *start);
+bm_serial_error_e bm_serial_dfu_rx_chunk(bm_serial_dfu_rx_t *rx,
+                                         uint32_t offset, size_t length,
+                                         const uint8_t *data);
+bm_serial_error_e bm_serial_dfu_rx_send_naks(bm_serial_dfu_rx_t *rx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,336 @@
+#include "bm_serial_dfu_tx.h"
+#include <stdint.h>
+#include <string.h>
+
+static bm_serial_dfu_tx_chunk_t *_bm_serial_dfu_tx_chunk(bm_serial_dfu_tx_t *tx,
+                                                         uint8_t idx) {
+  return &tx->chunks[(tx->head + idx) % BM_SERIAL_DFU_TX_MAX_WINDOW];
+}
+
+/*!
+  End the transfer
+
+  \param[in] *tx DFU sender
+  \param[in] success true if the whole image was acknowledged
+  \return none
+*/
+static void _bm_serial_dfu_tx_finish(bm_serial_dfu_tx_t *tx, bool success) {
+  tx->state = success ? BM_SERIAL_DFU_TX_DONE : BM_SERIAL_DFU_TX_FAILED;
+  tx->done_at = tx->cfg.now_fn();
+  if (tx->cfg.done_fn) {
+    tx->cfg.done_fn(tx->cfg.arg, success);
+  }
+}
+
+/*!
+  Send one chunk of the image
+
+  \param[in] *tx DFU sender
+  \param[in] *chunk chunk to send
+  \return BM_SERIAL_OK if sent, BM_SERIAL_MISC_ERR if the image couldn't be
+          read, nonzero otherwise
+*/
+static bm_serial_error_e
+_bm_serial_dfu_tx_send(bm_serial_dfu_tx_t *tx,
+                       const bm_serial_dfu_tx_chunk_t *chunk) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (tx->cfg.image) {
+      rval = bm_serial_ctx_dfu_send_chunk(
+          tx->ctx, chunk->offset, chunk->length,
+          (uint8_t *)&tx->cfg.image[chunk->offset]);
+      break;
+    }
+
+    // Read straight into the packet
+    uint8_t *data;
+    rval = bm_serial_ctx_dfu_chunk_reserve(tx->ctx, chunk->offset,
+                                           chunk->length, &data);
+    if (rval) {
+      break;
+    }
+
+    if (!tx->cfg.read_fn(tx->cfg.arg, chunk->offset, data, chunk->length)) {
+      // Release the slot or block, or nothing else could be sent
+      bm_serial_ctx_reserve_abort(tx->ctx);
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+
+    rval = bm_serial_ctx_commit(tx->ctx);
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Adjust the chunk size to the error rate, once per window of new chunks
+
+  \param[in] *tx DFU sender
+  \return none
+*/
+static void _bm_serial_dfu_tx_adapt(bm_serial_dfu_tx_t *tx) {
+  if (tx->window_sent < tx->cfg.window) {
+    return;
+  }
+
+  if (tx->window_naks * 8 > tx->window_sent) {
+    uint16_t chunk_size = tx->chunk_size / 2;
+    if (chunk_size < tx->cfg.min_chunk_size) {
+      chunk_size = tx->cfg.min_chunk_size;
+    }
+    if (chunk_size != tx->chunk_size) {
+      tx->chunk_size = chunk_size;
+      tx->stats.shrinks++;
+    }
+  } else if (!tx->window_naks && tx->chunk_size < tx->start.chunk_size) {
+    uint32_t chunk_size = tx->chunk_size + (tx->chunk_size + 3) / 4;
+    if (chunk_size > tx->start.chunk_size) {
+      chunk_size = tx->start.chunk_size;
+    }
+    tx->chunk_size = chunk_size;
+    tx->stats.grows++;
+  }
+
+  tx->window_sent = 0;
+  tx->window_naks = 0;
+}
+
+/*!
+  Start a DFU transfer. Sends the DFU start and the first window of chunks.
+
+  \param[out] *tx DFU sender
+  \param[in] *ctx bm_serial instance
+  \param[in] *start DFU start, chunk_size is the largest chunk to send
+  \param[in] *cfg config
+  \return BM_SERIAL_OK if started, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_dfu_tx_start(bm_serial_dfu_tx_t *tx,
+                                         bm_serial_ctx_t *ctx,
+                                         const bm_serial_dfu_start_t *start,
+                                         const bm_serial_dfu_tx_cfg_t *cfg) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!tx || !ctx || !start || !cfg || !cfg->now_fn ||
+        (!cfg->image && !cfg->read_fn)) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    if (!cfg->window || cfg->window > BM_SERIAL_DFU_TX_MAX_WINDOW ||
+        !cfg->rto || !start->image_size || !cfg->min_chunk_size ||
+        cfg->min_chunk_size > start->chunk_size ||
+        cfg->resume_offset >= start->image_size) {
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+
+    memset(tx, 0, sizeof(bm_serial_dfu_tx_t));
+    tx->ctx = ctx;
+    tx->cfg = *cfg;
+    tx->start = *start;
+    if (tx->start.chunk_size > BM_SERIAL_DFU_TX_MAX_CHUNK) {
+      tx->start.chunk_size = BM_SERIAL_DFU_TX_MAX_CHUNK;
+    }
+    tx->chunk_size = tx->start.chunk_size;
+    tx->acked = cfg->resume_offset;
+    tx->next = cfg->resume_offset;
+
+    rval = bm_serial_ctx_dfu_send_start(ctx, &tx->start);
+    if (rval) {
+      break;
+    }
+
+    tx->state = BM_SERIAL_DFU_TX_SENDING;
+    tx->started_at = cfg->now_fn();
+    rval = bm_serial_dfu_tx_poll(tx);
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Resend NAK'd and timed out chunks, then fill the window with new ones.
+  Must not be called from inside the instance's transmit function.
+
+  \param[in] *tx DFU sender
+  \return BM_SERIAL_OK if everything that fits was sent (or the transfer
+          isn't running), nonzero otherwise
+*/
+bm_serial_error_e bm_serial_dfu_tx_poll(bm_serial_dfu_tx_t *tx) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  uint32_t now = tx->cfg.now_fn();
+
+  do {
+    if (tx->state != BM_SERIAL_DFU_TX_SENDING) {
+      break;
+    }
+
+    bool blocked = false;
+    for (uint8_t idx = 0; idx < tx->count; idx++) {
+      bm_serial_dfu_tx_chunk_t *chunk = _bm_serial_dfu_tx_chunk(tx, idx);
+      bool timed_out = now - chunk->sent_at >= tx->cfg.rto;
+      if (!chunk->nak && !timed_out) {
+        continue;
+      }
+
+      if (chunk->retries >= tx->cfg.max_retries) {
+        _bm_serial_dfu_tx_finish(tx, false);
+        rval = BM_SERIAL_TX_ERR;
+        break;
+      }
+
+      bm_serial_error_e tx_rval = _bm_serial_dfu_tx_send(tx, chunk);
+      if (tx_rval == BM_SERIAL_OUT_OF_MEMORY) {
+        // Link is backed up, try again on the next poll
+        blocked = true;
+        break;
+      } else if (tx_rval == BM_SERIAL_MISC_ERR) {
+        _bm_serial_dfu_tx_finish(tx, false);
+        rval = tx_rval;
+        break;
+      } else if (tx_rval) {
+        // Lost, resent once it times out
+        rval = tx_rval;
+      }
+
+      if (!chunk->nak) {
+        tx->stats.timeouts++;
+      }
+      chunk->nak = false;
+      chunk->retries++;
+      chunk->sent_at = now;
+      tx->stats.retransmits++;
+    }
+    if (tx->state != BM_SERIAL_DFU_TX_SENDING || blocked) {
+      break;
+    }
+
+    while (tx->count < tx->cfg.window && tx->next < tx->start.image_size) {
+      bm_serial_dfu_tx_chunk_t *chunk = _bm_serial_dfu_tx_chunk(tx, tx->count);
+      uint32_t remaining = tx->start.image_size - tx->next;
+      chunk->offset = tx->next;
+      chunk->length =
+          remaining < tx->chunk_size ? (uint16_t)remaining : tx->chunk_size;
+      chunk->sent_at = now;
+      chunk->retries = 0;
+      chunk->nak = false;
+
+      bm_serial_error_e tx_rval = _bm_serial_dfu_tx_send(tx, chunk);
+      if (tx_rval == BM_SERIAL_OUT_OF_MEMORY) {
+        break;
+      } else if (tx_rval == BM_SERIAL_MISC_ERR) {
+        _bm_serial_dfu_tx_finish(tx, false);
+        rval = tx_rval;
+        break;
+      } else if (tx_rval) {
+        rval = tx_rval;
+      }
+
+      tx->count++;
+      tx->next += chunk->length;
+      tx->stats.chunks_sent++;
+      tx->stats.bytes_sent += chunk->length;
+      tx->window_sent++;
+      _bm_serial_dfu_tx_adapt(tx);
+    }
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Process a NAK (or acknowledgement) from the receiver
+
+  \param[in] *tx DFU sender
+  \param[in] offset chunk offset, with or without DFU_CHUNK_NAK_BITFLAG
+  \param[in] length bytes missing, 0 if everything before offset was received
+  \return none
+*/
+void bm_serial_dfu_tx_rx_nak(bm_serial_dfu_tx_t *tx, uint32_t offset,
+                             size_t length) {
+  offset &= ~DFU_CHUNK_NAK_BITFLAG;
+
+  if (tx->state != BM_SERIAL_DFU_TX_SENDING) {
+    return;
+  }
+
+  if (!length) {
+    // Acknowledgements only move forward, an older one was resent or
+    // reordered on the way
+    if (offset < tx->acked) {
+      tx->stats.stale_acks++;
+      return;
+    }
+
+    if (offset == tx->acked) {
+      return;
+    }
+
+    // Receiver already has more than was sent (resumed transfer), skip it
+    if (offset > tx->next) {
+      tx->next = offset;
+    }
+
+    tx->acked = offset;
+    while (tx->count) {
+      bm_serial_dfu_tx_chunk_t *chunk = _bm_serial_dfu_tx_chunk(tx, 0);
+      if (chunk->offset + chunk->length > tx->acked) {
+        break;
+      }
+      tx->head = (tx->head + 1) % BM_SERIAL_DFU_TX_MAX_WINDOW;
+      tx->count--;
+    }
+
+    if (tx->cfg.progress_fn) {
+      tx->cfg.progress_fn(tx->cfg.arg, tx->acked, tx->start.image_size);
+    }
+    if (tx->acked == tx->start.image_size) {
+      _bm_serial_dfu_tx_finish(tx, true);
+    }
+    return;
+  }
+
+  tx->stats.naks++;
+  if (offset < tx->acked) {
+    // Receiver doesn't have what it acknowledged before (or what a resumed
+    // transfer skipped), start over from there
+    tx->acked = offset;
+    tx->next = offset;
+    tx->count = 0;
+    tx->stats.rewinds++;
+    return;
+  }
+
+  uint32_t end = offset + length;
+  for (uint8_t idx = 0; idx < tx->count; idx++) {
+    bm_serial_dfu_tx_chunk_t *chunk = _bm_serial_dfu_tx_chunk(tx, idx);
+    if (chunk->offset < end && offset < chunk->offset + chunk->length &&
+        !chunk->nak) {
+      chunk->nak = true;
+      tx->window_naks++;
+    }
+  }
+}
+
+/*!
+  Get the transfer rate so far
+
+  \param[in] *tx DFU sender
+  \return bytes acknowledged per 1000 now_fn ticks (bytes/s with a millisecond
+          clock), 0 before any time has passed
+*/
+uint32_t bm_serial_dfu_tx_throughput(bm_serial_dfu_tx_t *tx) {
+  uint32_t end = tx->state == BM_SERIAL_DFU_TX_SENDING ? tx->cfg.now_fn()
+                                                       : tx->done_at;
+  uint32_t elapsed = end - tx->started_at;
+  if (!elapsed) {
+    return 0;
+  }
+  return (uint32_t)((uint64_t)tx->acked * 1000 / elapsed);
+}
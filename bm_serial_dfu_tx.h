@@ -0,0 +1,137 @@
+#pragma once
+
+#include "bm_serial.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Most chunks in flight
+#define BM_SERIAL_DFU_TX_MAX_WINDOW 32
+
+// Largest chunk that fits in a packet
+#define BM_SERIAL_DFU_TX_MAX_CHUNK                                             \
+  (SERIAL_BUFF_LEN - sizeof(bm_serial_packet_t) - sizeof(bm_serial_dfu_chunk_t))
+
+typedef enum {
+  BM_SERIAL_DFU_TX_IDLE = 0,
+  BM_SERIAL_DFU_TX_SENDING,
+  BM_SERIAL_DFU_TX_DONE,
+  BM_SERIAL_DFU_TX_FAILED,
+} bm_serial_dfu_tx_state_e;
+
+typedef struct {
+  // Image in memory, or NULL to read it with read_fn
+  const uint8_t *image;
+  // Read len bytes at offset into buff, return false on error
+  bool (*read_fn)(void *arg, uint32_t offset, uint8_t *buff, size_t len);
+
+  // Where to start sending, e.g. from a checkpoint of an interrupted
+  // transfer (see bm_serial_dfu_file.h). 0 for the whole image.
+  uint32_t resume_offset;
+
+  // Max chunks in flight (1 to BM_SERIAL_DFU_TX_MAX_WINDOW)
+  uint8_t window;
+  // Smallest chunk size to shrink to when chunks get lost
+  uint16_t min_chunk_size;
+  // Time to wait for a chunk to be acknowledged before resending it, in
+  // now_fn ticks
+  uint32_t rto;
+  // Resends of a chunk before giving up on the transfer
+  uint8_t max_retries;
+  uint32_t (*now_fn)(void);
+
+  // Optional, called whenever more of the image is acknowledged
+  void (*progress_fn)(void *arg, uint32_t acked, uint32_t total);
+  // Optional, called once when the whole image was acknowledged or the
+  // transfer failed
+  void (*done_fn)(void *arg, bool success);
+  void *arg;
+} bm_serial_dfu_tx_cfg_t;
+
+typedef struct {
+  uint32_t chunks_sent;
+  uint32_t bytes_sent;
+  uint32_t retransmits;
+  uint32_t naks;
+  uint32_t timeouts;
+  // Receiver NAK'd data before what it acknowledged and the sender went back
+  // (see resume_offset)
+  uint32_t rewinds;
+  // Acknowledgements older than one already received, ignored
+  uint32_t stale_acks;
+  // Chunk size changes
+  uint32_t shrinks;
+  uint32_t grows;
+} bm_serial_dfu_tx_stats_t;
+
+typedef struct {
+  uint32_t offset;
+  uint16_t length;
+  uint32_t sent_at;
+  uint8_t retries;
+  // Receiver asked for it again
+  bool nak;
+} bm_serial_dfu_tx_chunk_t;
+
+//
+// Pipelined DFU sender. Sends the DFU start, then keeps up to window chunks in
+// flight. The receiver acknowledges the image prefix it has and NAKs missing
+// ranges with bm_serial_dfu_send_nak(), only those chunks are sent again.
+// Chunks that aren't acknowledged within rto are resent too (lost NAKs or
+// tail chunks).
+//
+// The chunk size starts at dfu_start.chunk_size (the largest the receiver
+// takes) and is halved, down to min_chunk_size, when more than 1 in 8 chunks
+// of a window get NAK'd. It grows back by a quarter after every clean window.
+//
+// A transfer can resume part way through the image (resume_offset). The
+// sender follows the receiver's acknowledgements ahead from there if it has
+// more, and goes back if it NAKs earlier data it lost. Acknowledgements never
+// move it back, an old one may just have been resent or reordered.
+//
+// Pass received DFU chunks with DFU_CHUNK_NAK_BITFLAG set in offset to
+// bm_serial_dfu_tx_rx_nak() and call bm_serial_dfu_tx_poll() periodically and
+// after every NAK. Not thread safe.
+//
+typedef struct {
+  bm_serial_ctx_t *ctx;
+  bm_serial_dfu_tx_cfg_t cfg;
+  bm_serial_dfu_start_t start;
+  bm_serial_dfu_tx_state_e state;
+
+  // Chunks in flight, in image order
+  bm_serial_dfu_tx_chunk_t chunks[BM_SERIAL_DFU_TX_MAX_WINDOW];
+  uint8_t head;
+  uint8_t count;
+
+  // Everything before acked was received, next new chunk starts at next
+  uint32_t acked;
+  uint32_t next;
+  uint16_t chunk_size;
+
+  // Current window, for the chunk size
+  uint16_t window_sent;
+  uint16_t window_naks;
+
+  uint32_t started_at;
+  uint32_t done_at;
+
+  bm_serial_dfu_tx_stats_t stats;
+} bm_serial_dfu_tx_t;
+
+bm_serial_error_e bm_serial_dfu_tx_start(bm_serial_dfu_tx_t *tx,
+                                         bm_serial_ctx_t *ctx,
+                                         const bm_serial_dfu_start_t *start,
+                                         const bm_serial_dfu_tx_cfg_t *cfg);
+bm_serial_error_e bm_serial_dfu_tx_poll(bm_serial_dfu_tx_t *tx);
+void bm_serial_dfu_tx_rx_nak(bm_serial_dfu_tx_t *tx, uint32_t offset,
+                             size_t length);
+uint32_t bm_serial_dfu_tx_throughput(bm_serial_dfu_tx_t *tx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// FNV-1a, used for the hash tables in the cache, corr and router modules.
+// Inline because the router hashes topics a character at a time.
+//
+#define BM_SERIAL_FNV_OFFSET 2166136261u
+#define BM_SERIAL_FNV_PRIME 16777619u
+
+static inline uint32_t bm_serial_fnv1a_byte(uint32_t hash, uint8_t byte) {
+  return (hash ^ byte) * BM_SERIAL_FNV_PRIME;
+}
+
+// Continue hash (BM_SERIAL_FNV_OFFSET to start) over len bytes of data
+static inline uint32_t bm_serial_fnv1a(uint32_t hash, const void *data,
+                                       size_t len) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (size_t idx = 0; idx < len; idx++) {
+    hash = bm_serial_fnv1a_byte(hash, bytes[idx]);
+  }
+  return hash;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,344 @@
+#include "bm_serial_lz.h"
+#include <stdint.h>
+#include <string.h>
+
+// Shortest match, and the block end rules (the last match starts at least
+// MFLIMIT bytes before the end, the last LASTLITERALS bytes are literals)
+#define MINMATCH 4
+#define MFLIMIT 12
+#define LASTLITERALS 5
+#define MAX_OFFSET 0xFFFF
+
+static uint32_t _bm_serial_lz_read32(const uint8_t *buff) {
+  uint32_t val;
+  memcpy(&val, buff, sizeof(val));
+  return val;
+}
+
+static uint32_t _bm_serial_lz_hash(uint32_t val) {
+  return (val * 2654435761u) >> (32 - BM_SERIAL_LZ_HASH_BITS);
+}
+
+/*!
+  Write a 4 bit length's extra bytes (255 each, then the remainder)
+
+  \param[out] *dst output
+  \param[in,out] *pos output position
+  \param[in] dst_len output size
+  \param[in] len length minus the 15 in the token
+  \return true if it fit, false otherwise
+*/
+static bool _bm_serial_lz_put_len(uint8_t *dst, size_t *pos, size_t dst_len,
+                                  size_t len) {
+  while (len >= 255) {
+    if (*pos >= dst_len) {
+      return false;
+    }
+    dst[(*pos)++] = 255;
+    len -= 255;
+  }
+  if (*pos >= dst_len) {
+    return false;
+  }
+  dst[(*pos)++] = len;
+  return true;
+}
+
+/*!
+  Write one sequence: token, literals and, unless it's the last one, the match
+
+  \param[out] *dst output
+  \param[in,out] *pos output position
+  \param[in] dst_len output size
+  \param[in] *literals literals
+  \param[in] literal_len number of literals
+  \param[in] offset match offset (ignored for the last sequence)
+  \param[in] match_len match length, 0 for the last sequence
+  \return true if it fit, false otherwise
+*/
+static bool _bm_serial_lz_put_seq(uint8_t *dst, size_t *pos, size_t dst_len,
+                                  const uint8_t *literals, size_t literal_len,
+                                  size_t offset, size_t match_len) {
+  if (*pos >= dst_len) {
+    return false;
+  }
+
+  size_t match_code = match_len ? match_len - MINMATCH : 0;
+  dst[(*pos)++] = ((literal_len < 15 ? literal_len : 15) << 4) |
+                  (match_code < 15 ? match_code : 15);
+
+  if (literal_len >= 15 &&
+      !_bm_serial_lz_put_len(dst, pos, dst_len, literal_len - 15)) {
+    return false;
+  }
+  if (literal_len > dst_len - *pos) {
+    return false;
+  }
+  if (literal_len) {
+    memcpy(&dst[*pos], literals, literal_len);
+    *pos += literal_len;
+  }
+
+  if (!match_len) {
+    return true;
+  }
+
+  if (dst_len - *pos < 2) {
+    return false;
+  }
+  dst[(*pos)++] = offset & 0xFF;
+  dst[(*pos)++] = offset >> 8;
+
+  if (match_code >= 15 &&
+      !_bm_serial_lz_put_len(dst, pos, dst_len, match_code - 15)) {
+    return false;
+  }
+
+  return true;
+}
+
+/*!
+  Enable payload compression on a bm_serial instance
+
+  \param[out] *lz compression state
+  \param[in] *ctx bm_serial instance
+  \param[in] min_len smallest payload to try compressing (at least 1)
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_lz_init(bm_serial_lz_t *lz, bm_serial_ctx_t *ctx,
+                                    uint16_t min_len) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!lz || !ctx) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    if (!min_len) {
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+
+    memset(&lz->stats, 0, sizeof(lz->stats));
+    lz->min_len = min_len;
+    ctx->lz = lz;
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Compress a buffer. Greedy single probe match finder, one pass.
+
+  \param[in] *lz compression state (hash table)
+  \param[in] *src data
+  \param[in] len data length (up to 64k)
+  \param[out] *dst compressed data
+  \param[in] dst_len dst size, BM_SERIAL_LZ_BOUND(len) always fits
+  \return compressed length, 0 if it doesn't fit in dst_len
+*/
+size_t bm_serial_lz_compress(bm_serial_lz_t *lz, const uint8_t *src,
+                             size_t len, uint8_t *dst, size_t dst_len) {
+  size_t pos = 0;
+  size_t anchor = 0;
+  size_t ip = 0;
+
+  if (len > MFLIMIT) {
+    memset(lz->table, 0, sizeof(lz->table));
+    size_t match_limit = len - MFLIMIT;
+    size_t match_end = len - LASTLITERALS;
+
+    while (ip < match_limit) {
+      uint32_t seq = _bm_serial_lz_read32(&src[ip]);
+      uint32_t hash = _bm_serial_lz_hash(seq);
+      size_t ref = lz->table[hash];
+      lz->table[hash] = ip;
+
+      if (ref >= ip || ip - ref > MAX_OFFSET ||
+          _bm_serial_lz_read32(&src[ref]) != seq) {
+        ip++;
+        continue;
+      }
+
+      // Extend backwards into the pending literals, then forwards
+      while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+        ip--;
+        ref--;
+      }
+      size_t match_len = MINMATCH;
+      while (ip + match_len < match_end &&
+             src[ref + match_len] == src[ip + match_len]) {
+        match_len++;
+      }
+
+      if (!_bm_serial_lz_put_seq(dst, &pos, dst_len, &src[anchor],
+                                 ip - anchor, ip - ref, match_len)) {
+        return 0;
+      }
+      ip += match_len;
+      anchor = ip;
+    }
+  }
+
+  if (!_bm_serial_lz_put_seq(dst, &pos, dst_len, &src[anchor], len - anchor,
+                             0, 0)) {
+    return 0;
+  }
+
+  return pos;
+}
+
+/*!
+  Decompress a buffer. Every length and offset is checked, so corrupt input
+  can't write or read out of bounds.
+
+  \param[in] *src compressed data
+  \param[in] len compressed length
+  \param[out] *dst data
+  \param[in] dst_len dst size
+  \return data length, 0 if the input is corrupt or doesn't fit in dst_len
+*/
+size_t bm_serial_lz_decompress(const uint8_t *src, size_t len, uint8_t *dst,
+                               size_t dst_len) {
+  size_t ip = 0;
+  size_t op = 0;
+
+  while (ip < len) {
+    uint8_t token = src[ip++];
+
+    size_t literal_len = token >> 4;
+    if (literal_len == 15) {
+      uint8_t extra;
+      do {
+        if (ip >= len) {
+          return 0;
+        }
+        extra = src[ip++];
+        literal_len += extra;
+      } while (extra == 255);
+    }
+    if (literal_len > len - ip || literal_len > dst_len - op) {
+      return 0;
+    }
+    if (literal_len) {
+      memcpy(&dst[op], &src[ip], literal_len);
+      ip += literal_len;
+      op += literal_len;
+    }
+
+    // Last sequence has no match
+    if (ip == len) {
+      break;
+    }
+
+    if (len - ip < 2) {
+      return 0;
+    }
+    size_t offset = src[ip] | (src[ip + 1] << 8);
+    ip += 2;
+    if (!offset || offset > op) {
+      return 0;
+    }
+
+    size_t match_len = token & 0x0F;
+    if (match_len == 15) {
+      uint8_t extra;
+      do {
+        if (ip >= len) {
+          return 0;
+        }
+        extra = src[ip++];
+        match_len += extra;
+      } while (extra == 255);
+    }
+    match_len += MINMATCH;
+    if (match_len > dst_len - op) {
+      return 0;
+    }
+
+    // Byte by byte, the match can overlap what it's copying
+    for (size_t idx = 0; idx < match_len; idx++, op++) {
+      dst[op] = dst[op - offset];
+    }
+  }
+
+  return op;
+}
+
+/*!
+  Compress a packet's payload in place if it's worth it
+
+  \param[in] *lz compression state
+  \param[in,out] *packet packet (flags get BM_SERIAL_FLAG_COMPRESSED)
+  \param[in,out] *len packet length, including the bm_serial_packet_t header
+  \return true if the payload was compressed, false if it was left alone
+*/
+bool bm_serial_lz_tx(bm_serial_lz_t *lz, bm_serial_packet_t *packet,
+                     uint16_t *len) {
+  switch (packet->type) {
+  case BM_SERIAL_PUB:
+  case BM_SERIAL_PUB_ALIAS:
+  case BM_SERIAL_NET_MSG:
+  case BM_SERIAL_BATCH:
+  case BM_SERIAL_DFU_CHUNK:
+    break;
+  default:
+    return false;
+  }
+
+  size_t payload_len = *len - sizeof(bm_serial_packet_t);
+  if (payload_len < lz->min_len) {
+    return false;
+  }
+
+  // Has to shrink by at least a byte
+  size_t compressed_len = bm_serial_lz_compress(lz, packet->payload,
+                                                payload_len, lz->tx_buff,
+                                                payload_len - 1);
+  if (!compressed_len) {
+    lz->stats.bypassed++;
+    return false;
+  }
+
+  memcpy(packet->payload, lz->tx_buff, compressed_len);
+  packet->flags |= BM_SERIAL_FLAG_COMPRESSED;
+  *len = sizeof(bm_serial_packet_t) + compressed_len;
+
+  lz->stats.compressed++;
+  lz->stats.bytes_in += payload_len;
+  lz->stats.bytes_out += compressed_len;
+
+  return true;
+}
+
+/*!
+  Decompress a received packet
+
+  \param[in] *lz compression state
+  \param[in] *packet compressed packet, crc already checked
+  \param[in,out] *len packet length, including the bm_serial_packet_t header
+  \return decompressed packet (in rx_buff), NULL if it's corrupt
+*/
+bm_serial_packet_t *bm_serial_lz_rx(bm_serial_lz_t *lz,
+                                    const bm_serial_packet_t *packet,
+                                    size_t *len) {
+  bm_serial_packet_t *out = (bm_serial_packet_t *)lz->rx_buff;
+
+  size_t payload_len = bm_serial_lz_decompress(
+      packet->payload, *len - sizeof(bm_serial_packet_t), out->payload,
+      sizeof(lz->rx_buff) - sizeof(bm_serial_packet_t));
+  if (!payload_len) {
+    lz->stats.rx_errors++;
+    return NULL;
+  }
+
+  out->type = packet->type;
+  out->flags = packet->flags & ~BM_SERIAL_FLAG_COMPRESSED;
+  out->crc16 = 0;
+  *len = sizeof(bm_serial_packet_t) + payload_len;
+  lz->stats.rx_decompressed++;
+
+  return out;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "bm_serial.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Match finder hash table size (2 bytes per entry), smaller uses less RAM but
+// finds fewer matches
+#ifndef BM_SERIAL_LZ_HASH_BITS
+#define BM_SERIAL_LZ_HASH_BITS 10
+#endif
+
+// Largest compressed size of len bytes (when nothing matches)
+#define BM_SERIAL_LZ_BOUND(len) ((len) + (len) / 255 + 16)
+
+typedef struct {
+  // Payloads sent compressed, and sent as is because they didn't shrink
+  uint32_t compressed;
+  uint32_t bypassed;
+  // Payload bytes before and after compression (compressed ones only)
+  uint32_t bytes_in;
+  uint32_t bytes_out;
+  uint32_t rx_decompressed;
+  uint32_t rx_errors;
+} bm_serial_lz_stats_t;
+
+//
+// Optional payload compression. A small LZ77 codec (LZ4 block format: a
+// token with the literal and match lengths, the literals, then a 16 bit match
+// offset) that only needs the hash table below to compress and nothing to
+// decompress.
+//
+// Pub, net msg, batch and DFU chunk payloads of at least min_len bytes are
+// compressed right before the crc is computed. Only if the result is smaller
+// is it sent, with BM_SERIAL_FLAG_COMPRESSED set. Received compressed packets
+// are decompressed into rx_buff and handled from there.
+//
+// Both ends need compression enabled to receive compressed packets. Payloads
+// sent straight from the caller's buffer (tx_iov_fn) are copied into the
+// packet instead. Not thread safe.
+//
+struct bm_serial_lz_s {
+  // Smaller payloads aren't worth compressing
+  uint16_t min_len;
+
+  // Position of the last occurrence of each 4 byte hash
+  uint16_t table[1 << BM_SERIAL_LZ_HASH_BITS];
+  // Compressed payload, copied over the original if it's smaller
+  uint8_t tx_buff[SERIAL_BUFF_LEN];
+  // Decompressed packet
+  uint8_t rx_buff[SERIAL_BUFF_LEN];
+
+  bm_serial_lz_stats_t stats;
+};
+
+bm_serial_error_e bm_serial_lz_init(bm_serial_lz_t *lz, bm_serial_ctx_t *ctx,
+                                    uint16_t min_len);
+size_t bm_serial_lz_compress(bm_serial_lz_t *lz, const uint8_t *src,
+                             size_t len, uint8_t *dst, size_t dst_len);
+size_t bm_serial_lz_decompress(const uint8_t *src, size_t len, uint8_t *dst,
+                               size_t dst_len);
+
+// Used by bm_serial.c
+bool bm_serial_lz_tx(bm_serial_lz_t *lz, bm_serial_packet_t *packet,
+                     uint16_t *len);
+bm_serial_packet_t *bm_serial_lz_rx(bm_serial_lz_t *lz,
+                                    const bm_serial_packet_t *packet,
+                                    size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -16,6 +16,9 @@ typedef enum {
   BM_SERIAL_SELF_TEST = 0x08,
   BM_SERIAL_NETWORK_INFO = 0x09,
   BM_SERIAL_REBOOT_INFO = 0x0A,
+  BM_SERIAL_BATCH = 0x0B,
+  BM_SERIAL_PUB_ALIAS = 0x0C,
+  BM_SERIAL_ALIAS_RESET = 0x0D,
 
   BM_SERIAL_DFU_START = 0x30,
   BM_SERIAL_DFU_CHUNK = 0x31,
@@ -35,6 +38,9 @@ typedef enum {
   BM_SERIAL_RESOURCE_REQ = 0x52,
   BM_SERIAL_RESOURCE_REPLY = 0x53,
 
+  // First type left for applications (see bm_serial_ctx_register_msg())
+  BM_SERIAL_APP_MSG_FIRST = 0x80,
+
 } bm_serial_message_t;
 
 typedef struct {
@@ -44,6 +50,43 @@ typedef struct {
   uint8_t payload[0];
 } __attribute__ ((packed)) bm_serial_packet_t;
 
+// bm_serial_packet_t flags: packet has a sequence number (low 6 bits) and must
+// be acknowledged with a BM_SERIAL_ACK (see bm_serial_rel.h)
+#define BM_SERIAL_FLAG_SEQ (1 << 7)
+#define BM_SERIAL_SEQ_MASK 0x3F
+
+// bm_serial_packet_t flags: payload is compressed (see bm_serial_lz.h), crc is
+// over the compressed payload
+#define BM_SERIAL_FLAG_COMPRESSED (1 << 6)
+
+// bm_serial_ack_t flags: sent by the sender instead, it gave up on every
+// sequence number before next_seq and the receiver should stop waiting for them
+#define BM_SERIAL_ACK_FLAG_FORWARD (1 << 0)
+
+typedef struct {
+  // Next sequence number expected, every earlier one was received
+  uint8_t next_seq;
+  uint8_t flags;
+  // Bit n set if sequence number next_seq + 1 + n was received (selective ack)
+  uint64_t sack;
+} __attribute__ ((packed)) bm_serial_ack_t;
+
+// bm_serial_batch_entry_t flags: BM_SERIAL_PUB with the same node id, topic,
+// type and version as the previous pub in the batch, payload is only the data
+#define BM_SERIAL_BATCH_FLAG_REPEAT (1 << 0)
+
+// BM_SERIAL_BATCH payload is a list of entries, back to back. Each entry is
+// one message, laid out like a packet (same size header) so it can be handled
+// in place. The batch packet's crc covers all of them.
+typedef struct {
+  // bm_serial_message_t of the entry
+  uint8_t type;
+  uint8_t flags;
+  // Message length, after this header
+  uint16_t len;
+  uint8_t payload[0];
+} __attribute__ ((packed)) bm_serial_batch_entry_t;
+
 typedef struct {
   uint64_t node_id;
   uint8_t type;
@@ -54,6 +97,29 @@ typedef struct {
   // len not included since we get the total len from COBS
 } __attribute__ ((packed)) bm_serial_pub_header_t;
 
+// Pub with a topic alias (see bm_serial_alias.h). A topic registers it as
+// the topic for alias, without one the topic registered last is used.
+// generation changes whenever the sender reuses alias for another topic, an
+// alias registered with a different generation is treated as unknown.
+typedef struct {
+  uint64_t node_id;
+  uint8_t type;
+  uint8_t version;
+  uint16_t alias;
+  uint16_t generation;
+  uint16_t topic_len;
+  uint8_t topic[0];
+  // message goes after topic
+} __attribute__ ((packed)) bm_serial_pub_alias_header_t;
+
+// Sent back for a pub with an alias the receiver doesn't know, the next pub
+// on that topic has to register it again
+#define BM_SERIAL_ALIAS_ALL 0xFFFF
+typedef struct {
+  // Alias to forget, BM_SERIAL_ALIAS_ALL for every one
+  uint16_t alias;
+} __attribute__ ((packed)) bm_serial_alias_reset_t;
+
 typedef struct {
   uint16_t topic_len;
   uint8_t topic[0];
@@ -111,7 +177,10 @@ typedef struct {
   uint32_t gitSHA;
 } __attribute__ ((packed)) bm_serial_dfu_start_t;
 
-#define DFU_CHUNK_NAK_BITFLAG (1<<31)
+// Set in offset for a chunk sent back by the receiver without data: length
+// bytes at offset are missing and should be resent. A length of 0
+// acknowledges everything before offset instead.
+#define DFU_CHUNK_NAK_BITFLAG (1u << 31)
 typedef struct {
   // offset from image start
   uint32_t offset;
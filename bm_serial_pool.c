@@ -0,0 +1,215 @@
+#include "bm_serial_pool.h"
+#include <stdint.h>
+#include <string.h>
+
+/*!
+  Get a block header by index
+
+  \param[in] *cls size class
+  \param[in] idx block index
+  \return block
+*/
+static bm_serial_pkt_t *_bm_serial_pool_block(bm_serial_pool_class_t *cls,
+                                              uint16_t idx) {
+  return (bm_serial_pkt_t *)&cls->storage[(size_t)idx *
+                                          BM_SERIAL_POOL_BLOCK_LEN(cls->size)];
+}
+
+/*!
+  Take a block index off the free list (bounded MPMC ring, Vyukov style)
+
+  \param[in] *cls size class
+  \param[out] *idx free block index
+  \return true if a block was free, false if the class is empty
+*/
+static bool _bm_serial_pool_pop(bm_serial_pool_class_t *cls, uint16_t *idx) {
+  size_t mask = cls->count - 1;
+  size_t pos = __atomic_load_n(&cls->tail, __ATOMIC_RELAXED);
+
+  while (true) {
+    bm_serial_pool_cell_t *cell = &cls->cells[pos & mask];
+    size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&cls->tail, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *idx = cell->idx;
+        __atomic_store_n(&cell->seq, pos + mask + 1, __ATOMIC_RELEASE);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = __atomic_load_n(&cls->tail, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/*!
+  Put a block index back on the free list. There are as many cells as blocks,
+  so this never has to wait for space.
+
+  \param[in] *cls size class
+  \param[in] idx block index
+  \return none
+*/
+static void _bm_serial_pool_push(bm_serial_pool_class_t *cls, uint16_t idx) {
+  size_t mask = cls->count - 1;
+  size_t pos = __atomic_load_n(&cls->head, __ATOMIC_RELAXED);
+
+  while (true) {
+    bm_serial_pool_cell_t *cell = &cls->cells[pos & mask];
+    size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+
+    if (seq == pos) {
+      if (__atomic_compare_exchange_n(&cls->head, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        cell->idx = idx;
+        __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+        return;
+      }
+    } else {
+      pos = __atomic_load_n(&cls->head, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/*!
+  Initialize a packet pool. All blocks start out free.
+
+  \param[out] *pool pool to initialize
+  \param[in] *classes size classes, sorted by size (smallest first)
+  \param[in] num_classes number of size classes
+  \return BM_SERIAL_OK if initialized, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_pool_init(bm_serial_pool_t *pool,
+                                      bm_serial_pool_class_t *classes,
+                                      uint8_t num_classes) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!pool || !classes || !num_classes) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    for (uint8_t class_idx = 0; class_idx < num_classes; class_idx++) {
+      bm_serial_pool_class_t *cls = &classes[class_idx];
+      if (!cls->storage || !cls->cells) {
+        rval = BM_SERIAL_NULL_BUFF;
+        break;
+      }
+
+      if (!cls->count || (cls->count & (cls->count - 1)) ||
+          (class_idx && cls->size < classes[class_idx - 1].size)) {
+        rval = BM_SERIAL_MISC_ERR;
+        break;
+      }
+    }
+    if (rval) {
+      break;
+    }
+
+    memset(pool, 0, sizeof(bm_serial_pool_t));
+    pool->classes = classes;
+    pool->num_classes = num_classes;
+
+    for (uint8_t class_idx = 0; class_idx < num_classes; class_idx++) {
+      bm_serial_pool_class_t *cls = &classes[class_idx];
+      memset(&cls->stats, 0, sizeof(bm_serial_pool_stats_t));
+      cls->tail = 0;
+      cls->head = cls->count;
+
+      for (uint16_t idx = 0; idx < cls->count; idx++) {
+        bm_serial_pkt_t *pkt = _bm_serial_pool_block(cls, idx);
+        memset(pkt, 0, sizeof(bm_serial_pkt_t));
+        pkt->cls = cls;
+        pkt->idx = idx;
+        pkt->size = cls->size;
+
+        cls->cells[idx].idx = idx;
+        __atomic_store_n(&cls->cells[idx].seq, idx + 1, __ATOMIC_RELAXED);
+      }
+    }
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Allocate a packet from the smallest class that fits. If that class is empty
+  the next bigger one is tried. Safe to call from any thread.
+
+  \param[in] *pool packet pool
+  \param[in] size bytes needed in pkt->buff
+  \return packet with one reference, NULL if nothing fits
+*/
+bm_serial_pkt_t *bm_serial_pool_alloc(bm_serial_pool_t *pool, size_t size) {
+  for (uint8_t class_idx = 0; class_idx < pool->num_classes; class_idx++) {
+    bm_serial_pool_class_t *cls = &pool->classes[class_idx];
+    if (cls->size < size) {
+      continue;
+    }
+
+    uint16_t idx;
+    if (!_bm_serial_pool_pop(cls, &idx)) {
+      __atomic_fetch_add(&cls->stats.exhausted, 1, __ATOMIC_RELAXED);
+      continue;
+    }
+
+    bm_serial_pkt_t *pkt = _bm_serial_pool_block(cls, idx);
+    __atomic_store_n(&pkt->refs, 1, __ATOMIC_RELAXED);
+    pkt->offset = 0;
+    pkt->len = 0;
+    pkt->user = 0;
+    pkt->type = 0;
+    pkt->flags = 0;
+    pkt->stamp = 0;
+
+    __atomic_fetch_add(&cls->stats.allocs, 1, __ATOMIC_RELAXED);
+    uint16_t in_use =
+        __atomic_add_fetch(&cls->stats.in_use, 1, __ATOMIC_RELAXED);
+    uint16_t high_water =
+        __atomic_load_n(&cls->stats.high_water, __ATOMIC_RELAXED);
+    while (in_use > high_water &&
+           !__atomic_compare_exchange_n(&cls->stats.high_water, &high_water,
+                                        in_use, true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+    }
+
+    return pkt;
+  }
+
+  __atomic_fetch_add(&pool->failed, 1, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+/*!
+  Take another reference to a packet (e.g. to keep it for a retransmit while
+  it's also queued)
+
+  \param[in] *pkt packet
+  \return none
+*/
+void bm_serial_pkt_retain(bm_serial_pkt_t *pkt) {
+  __atomic_fetch_add(&pkt->refs, 1, __ATOMIC_RELAXED);
+}
+
+/*!
+  Drop a reference to a packet. The block goes back to the pool when the last
+  reference is released.
+
+  \param[in] *pkt packet
+  \return none
+*/
+void bm_serial_pkt_release(bm_serial_pkt_t *pkt) {
+  if (__atomic_sub_fetch(&pkt->refs, 1, __ATOMIC_ACQ_REL)) {
+    return;
+  }
+
+  bm_serial_pool_class_t *cls = pkt->cls;
+  __atomic_fetch_sub(&cls->stats.in_use, 1, __ATOMIC_RELAXED);
+  _bm_serial_pool_push(cls, pkt->idx);
+}
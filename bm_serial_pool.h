@@ -0,0 +1,109 @@
+#pragma once
+
+#include "bm_serial.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Packet handle. Packets are built in buff and stay valid until the last
+// reference is released, so they can be queued or retransmitted later.
+typedef struct bm_serial_pkt_s {
+  struct bm_serial_pool_class_s *cls;
+  // Block index within the class
+  uint16_t idx;
+  uint16_t refs;
+
+  // Frame to transmit is buff[offset] to buff[offset + len - 1]
+  uint16_t offset;
+  uint16_t len;
+
+  // Usable bytes in buff
+  uint16_t size;
+
+  // Caller data (e.g. priority or sequence number), not used by the pool
+  uint16_t user;
+
+  // bm_serial message type and flags, set when the packet is built
+  uint8_t type;
+  uint8_t flags;
+
+  // When the packet was queued, in now_fn ticks (see bm_serial_sched.h)
+  uint32_t stamp;
+
+  uint8_t buff[0];
+} bm_serial_pkt_t;
+
+// Bytes of storage needed per block for size usable bytes (8 byte aligned)
+#define BM_SERIAL_POOL_BLOCK_LEN(size)                                         \
+  ((sizeof(bm_serial_pkt_t) + (size) + 7) & ~(size_t)7)
+
+typedef struct {
+  // Free list entry (bounded MPMC ring of free block indexes)
+  size_t seq;
+  uint16_t idx;
+} bm_serial_pool_cell_t;
+
+typedef struct {
+  uint32_t allocs;
+  // Allocations that didn't fit in this class because it was empty
+  uint32_t exhausted;
+  uint16_t in_use;
+  uint16_t high_water;
+} bm_serial_pool_stats_t;
+
+typedef struct bm_serial_pool_class_s {
+  // Usable bytes per block
+  uint16_t size;
+  // Number of blocks (must be a power of 2)
+  uint16_t count;
+  // count * BM_SERIAL_POOL_BLOCK_LEN(size) bytes, 8 byte aligned
+  uint8_t *storage;
+  // count entries
+  bm_serial_pool_cell_t *cells;
+
+  // Free list positions
+  size_t head;
+  size_t tail;
+
+  bm_serial_pool_stats_t stats;
+} bm_serial_pool_class_t;
+
+//
+// Fixed block packet pool. Classes must be sorted by size, allocations use the
+// smallest class that fits and fall back to bigger ones when it's empty.
+// Alloc/release are lock-free and O(1).
+//
+typedef struct bm_serial_pool_s {
+  bm_serial_pool_class_t *classes;
+  uint8_t num_classes;
+  // Allocations that didn't fit in any class
+  uint32_t failed;
+} bm_serial_pool_t;
+
+// Static storage for one size class
+#define BM_SERIAL_POOL_STORAGE(name, size, count)                              \
+  static uint64_t name##_storage[BM_SERIAL_POOL_BLOCK_LEN(size) * (count) /   \
+                                 sizeof(uint64_t)];                            \
+  static bm_serial_pool_cell_t name##_cells[(count)]
+
+// Class initializer using storage from BM_SERIAL_POOL_STORAGE
+#define BM_SERIAL_POOL_CLASS(name, size, count)                                \
+  {                                                                            \
+    (size), (count), (uint8_t *)name##_storage, name##_cells, 0, 0,            \
+        {0, 0, 0, 0}                                                           \
+  }
+
+bm_serial_error_e bm_serial_pool_init(bm_serial_pool_t *pool,
+                                      bm_serial_pool_class_t *classes,
+                                      uint8_t num_classes);
+bm_serial_pkt_t *bm_serial_pool_alloc(bm_serial_pool_t *pool, size_t size);
+void bm_serial_pkt_retain(bm_serial_pkt_t *pkt);
+void bm_serial_pkt_release(bm_serial_pkt_t *pkt);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,393 @@
+#include "bm_serial_rel.h"
+#include <stdint.h>
+#include <string.h>
+
+#define _SEQ(seq) ((uint8_t)((seq)&BM_SERIAL_SEQ_MASK))
+
+static bm_serial_rel_slot_t *_bm_serial_rel_slot(bm_serial_rel_t *rel,
+                                                 uint8_t seq) {
+  return &rel->slots[seq % (BM_SERIAL_REL_MAX_WINDOW + 1)];
+}
+
+/*!
+  Pass a packet on to the sink, or send it right away
+
+  \param[in] *rel reliability state
+  \param[in] *pkt packet, one reference is handed over
+  \return BM_SERIAL_OK if sent or queued, nonzero otherwise
+*/
+static bm_serial_error_e _bm_serial_rel_forward(bm_serial_rel_t *rel,
+                                                bm_serial_pkt_t *pkt) {
+  if (rel->cfg.sink) {
+    return rel->cfg.sink(rel->cfg.sink_arg, pkt);
+  }
+
+  bm_serial_error_e rval = bm_serial_ctx_pkt_send(rel->ctx, pkt);
+  bm_serial_pkt_release(pkt);
+  return rval;
+}
+
+/*!
+  Drop the reference held for a retransmit
+
+  \param[in] *rel reliability state
+  \param[in] seq sequence number acknowledged
+  \return none
+*/
+static void _bm_serial_rel_ack_slot(bm_serial_rel_t *rel, uint8_t seq) {
+  bm_serial_rel_slot_t *slot = _bm_serial_rel_slot(rel, seq);
+  if (slot->pkt) {
+    bm_serial_pkt_t *pkt = slot->pkt;
+    slot->pkt = NULL;
+    bm_serial_pkt_release(pkt);
+    rel->stats.acked++;
+  }
+}
+
+/*!
+  Send a packet again. State is updated first, the ACK may arrive before the
+  sink returns.
+
+  \param[in] *rel reliability state
+  \param[in] *slot slot holding the packet
+  \param[in] now current time
+  \return none
+*/
+static void _bm_serial_rel_resend(bm_serial_rel_t *rel,
+                                  bm_serial_rel_slot_t *slot, uint32_t now) {
+  bm_serial_pkt_t *pkt = slot->pkt;
+  slot->retries++;
+  slot->sent_at = now;
+  rel->stats.retransmits++;
+  bm_serial_pkt_retain(pkt);
+  _bm_serial_rel_forward(rel, pkt);
+}
+
+/*!
+  Move base past every acknowledged (or abandoned) packet
+
+  \param[in] *rel reliability state
+  \return none
+*/
+static void _bm_serial_rel_advance(bm_serial_rel_t *rel) {
+  while (rel->base != rel->next_seq &&
+         !_bm_serial_rel_slot(rel, rel->base)->pkt) {
+    rel->base = _SEQ(rel->base + 1);
+  }
+}
+
+/*!
+  Send an ACK with the receive state, or a forward with the send state
+
+  \param[in] *rel reliability state
+  \param[in] forward tell the receiver to skip everything before base
+  \return none
+*/
+static void _bm_serial_rel_send_ack(bm_serial_rel_t *rel, bool forward) {
+  bm_serial_ack_t ack = {0};
+  if (forward) {
+    ack.next_seq = rel->base;
+    ack.flags = BM_SERIAL_ACK_FLAG_FORWARD;
+    rel->stats.forwards_sent++;
+  } else {
+    ack.next_seq = rel->rx_next;
+    ack.sack = rel->rx_sack;
+    rel->stats.acks_sent++;
+  }
+
+  bm_serial_ctx_tx(rel->ctx, BM_SERIAL_ACK, (const uint8_t *)&ack,
+                   sizeof(ack));
+}
+
+/*!
+  Done with rx_next (received or skipped), move past it and every packet
+  already received after it
+
+  \param[in] *rel reliability state
+  \return none
+*/
+static void _bm_serial_rel_rx_slide(bm_serial_rel_t *rel) {
+  bool received;
+  do {
+    rel->rx_next = _SEQ(rel->rx_next + 1);
+    received = rel->rx_sack & 1;
+    rel->rx_sack >>= 1;
+  } while (received);
+}
+
+/*!
+  Enable reliable delivery on an instance. Packets are built in pool blocks
+  and kept there until acknowledged.
+
+  \param[out] *rel reliability state
+  \param[in] *ctx bm_serial instance
+  \param[in] *pool initialized packet pool, needs room for the window
+  \param[in] *cfg config
+  \return BM_SERIAL_OK if initialized, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_rel_init(bm_serial_rel_t *rel,
+                                     bm_serial_ctx_t *ctx,
+                                     bm_serial_pool_t *pool,
+                                     const bm_serial_rel_cfg_t *cfg) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!rel || !ctx || !pool || !cfg || !cfg->now_fn) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    if (!cfg->window || cfg->window > BM_SERIAL_REL_MAX_WINDOW || !cfg->rto) {
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+
+    memset(rel, 0, sizeof(bm_serial_rel_t));
+    rel->ctx = ctx;
+    rel->cfg = *cfg;
+
+    ctx->rel = rel;
+    bm_serial_ctx_set_pool(ctx, pool, bm_serial_rel_sink, rel);
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Packet sink (see bm_serial_ctx_set_pool()). Keeps a reference to sequenced
+  packets for retransmits and passes everything on.
+
+  \param[in] *arg reliability state
+  \param[in] *pkt finished packet
+  \return BM_SERIAL_OK if sent or kept for a retransmit, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_rel_sink(void *arg, bm_serial_pkt_t *pkt) {
+  bm_serial_rel_t *rel = (bm_serial_rel_t *)arg;
+
+  if (!(pkt->flags & BM_SERIAL_FLAG_SEQ)) {
+    return _bm_serial_rel_forward(rel, pkt);
+  }
+
+  uint8_t seq = pkt->flags & BM_SERIAL_SEQ_MASK;
+  bm_serial_rel_slot_t *slot = _bm_serial_rel_slot(rel, seq);
+  slot->pkt = pkt;
+  slot->sent_at = rel->cfg.now_fn();
+  slot->retries = 0;
+  rel->next_seq = _SEQ(seq + 1);
+  rel->stats.sent++;
+
+  // A failed send is retransmitted on timeout, so report it as sent.
+  // Otherwise the caller could send it again with a new sequence number.
+  bm_serial_pkt_retain(pkt);
+  _bm_serial_rel_forward(rel, pkt);
+
+  return BM_SERIAL_OK;
+}
+
+/*!
+  Retransmit packets that weren't acknowledged in time and give up on the
+  ones out of retries. Call periodically (every rto or so).
+
+  \param[in] *rel reliability state
+  \return none
+*/
+void bm_serial_rel_poll(bm_serial_rel_t *rel) {
+  uint32_t now = rel->cfg.now_fn();
+  uint8_t base = rel->base;
+  uint8_t in_flight = _SEQ(rel->next_seq - base);
+
+  for (uint8_t idx = 0; idx < in_flight; idx++) {
+    bm_serial_rel_slot_t *slot = _bm_serial_rel_slot(rel, base + idx);
+    if (!slot->pkt || now - slot->sent_at < rel->cfg.rto) {
+      continue;
+    }
+
+    if (slot->retries >= rel->cfg.max_retries) {
+      bm_serial_pkt_t *pkt = slot->pkt;
+      slot->pkt = NULL;
+      if (rel->cfg.fail_fn) {
+        rel->cfg.fail_fn(rel->cfg.arg, pkt);
+      }
+      bm_serial_pkt_release(pkt);
+      rel->stats.failed++;
+      rel->forward_pending = true;
+      rel->forward_at = now - rel->cfg.rto;
+      continue;
+    }
+
+    _bm_serial_rel_resend(rel, slot, now);
+  }
+
+  _bm_serial_rel_advance(rel);
+
+  // Repeated every rto until the receiver acknowledges it
+  if (rel->forward_pending && now - rel->forward_at >= rel->cfg.rto) {
+    rel->forward_at = now;
+    _bm_serial_rel_send_ack(rel, true);
+  }
+}
+
+/*!
+  Get the number of packets sent but not acknowledged yet
+
+  \param[in] *rel reliability state
+  \return packets in flight
+*/
+size_t bm_serial_rel_in_flight(bm_serial_rel_t *rel) {
+  return _SEQ(rel->next_seq - rel->base);
+}
+
+/*!
+  Get the flags byte for the next packet (tentative sequence number)
+
+  \param[in] *rel reliability state
+  \return flags
+*/
+uint8_t bm_serial_rel_peek_flags(bm_serial_rel_t *rel) {
+  return BM_SERIAL_FLAG_SEQ | rel->next_seq;
+}
+
+/*!
+  Assign a sequence number to a packet about to be sent
+
+  \param[in] *rel reliability state
+  \param[in] *pkt pool packet
+  \param[in,out] *flags packet flags, sequence number is replaced
+  \return BM_SERIAL_OK if the packet can be sent,
+          BM_SERIAL_OUT_OF_MEMORY if the window is full
+*/
+bm_serial_error_e bm_serial_rel_tx_flags(bm_serial_rel_t *rel,
+                                         const bm_serial_pkt_t *pkt,
+                                         uint8_t *flags) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    // Only pool packets can be kept for a retransmit
+    if (!pkt) {
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+
+    if (bm_serial_rel_in_flight(rel) >= rel->cfg.window) {
+      rval = BM_SERIAL_OUT_OF_MEMORY;
+      break;
+    }
+
+    *flags = (*flags & ~(BM_SERIAL_FLAG_SEQ | BM_SERIAL_SEQ_MASK)) |
+             BM_SERIAL_FLAG_SEQ | rel->next_seq;
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Process a received ACK (or forward)
+
+  \param[in] *rel reliability state
+  \param[in] *payload ACK payload
+  \param[in] len payload length
+  \return BM_SERIAL_OK if processed, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_rel_rx_ack(bm_serial_rel_t *rel,
+                                       const uint8_t *payload, size_t len) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (len < sizeof(bm_serial_ack_t)) {
+      rval = BM_SERIAL_INVALID_MSG_LEN;
+      break;
+    }
+
+    bm_serial_ack_t ack;
+    memcpy(&ack, payload, sizeof(ack));
+
+    if (ack.flags & BM_SERIAL_ACK_FLAG_FORWARD) {
+      // Only move forward, a late forward is ignored
+      uint8_t skip = _SEQ(ack.next_seq - rel->rx_next);
+      while (skip && skip <= BM_SERIAL_REL_MAX_WINDOW) {
+        _bm_serial_rel_rx_slide(rel);
+        skip = _SEQ(ack.next_seq - rel->rx_next);
+      }
+      _bm_serial_rel_send_ack(rel, false);
+      break;
+    }
+
+    rel->stats.acks_received++;
+
+    // Stale ACKs (from before base) are ignored
+    uint8_t base = rel->base;
+    uint8_t in_flight = _SEQ(rel->next_seq - base);
+    uint8_t acked = _SEQ(ack.next_seq - base);
+    if (acked > in_flight) {
+      break;
+    }
+
+    // Receiver caught up with the forward
+    rel->forward_pending = false;
+
+    for (uint8_t idx = 0; idx < acked; idx++) {
+      _bm_serial_rel_ack_slot(rel, base + idx);
+    }
+
+    uint8_t highest = 0;
+    for (uint8_t bit = 0; bit < 64; bit++) {
+      if (!(ack.sack & (1ULL << bit))) {
+        continue;
+      }
+      uint8_t offset = acked + 1 + bit;
+      if (offset >= in_flight) {
+        break;
+      }
+      _bm_serial_rel_ack_slot(rel, base + offset);
+      highest = offset;
+    }
+
+    _bm_serial_rel_advance(rel);
+
+    // Packets before the highest one received are most likely lost, don't
+    // wait for the timeout. Only the first time, after that it's up to poll.
+    uint32_t now = rel->cfg.now_fn();
+    for (uint8_t offset = acked; offset < highest; offset++) {
+      bm_serial_rel_slot_t *slot = _bm_serial_rel_slot(rel, base + offset);
+      if (slot->pkt && !slot->retries) {
+        rel->stats.fast_retransmits++;
+        _bm_serial_rel_resend(rel, slot, now);
+      }
+    }
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Process the sequence number of a received packet and acknowledge it
+
+  \param[in] *rel reliability state
+  \param[in] flags packet flags
+  \return true if the packet is new, false if it's a duplicate
+*/
+bool bm_serial_rel_rx_seq(bm_serial_rel_t *rel, uint8_t flags) {
+  uint8_t seq = flags & BM_SERIAL_SEQ_MASK;
+  uint8_t offset = _SEQ(seq - rel->rx_next);
+  bool fresh = false;
+
+  if (offset == 0) {
+    fresh = true;
+    _bm_serial_rel_rx_slide(rel);
+  } else if (offset <= BM_SERIAL_REL_MAX_WINDOW) {
+    uint64_t bit = 1ULL << (offset - 1);
+    fresh = !(rel->rx_sack & bit);
+    rel->rx_sack |= bit;
+  }
+
+  if (!fresh) {
+    rel->stats.rx_duplicates++;
+  }
+
+  _bm_serial_rel_send_ack(rel, false);
+
+  return fresh;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "bm_serial.h"
+#include "bm_serial_pool.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest window. Less than half the 6 bit sequence number space, so new and
+// old (duplicate) sequence numbers can't be mixed up.
+#define BM_SERIAL_REL_MAX_WINDOW 31
+
+typedef struct {
+  // Max packets sent but not acknowledged yet (1 to BM_SERIAL_REL_MAX_WINDOW)
+  uint16_t window;
+  // Time to wait for an ACK before retransmitting, in now_fn ticks
+  uint32_t rto;
+  // Retransmits before giving up on a packet
+  uint8_t max_retries;
+  uint32_t (*now_fn)(void);
+
+  // Optional, where packets go (e.g. bm_serial_async_sink or
+  // bm_serial_sched_sink). Sent right away with the instance's tx_fn if NULL.
+  bm_serial_pkt_sink_fn sink;
+  void *sink_arg;
+
+  // Optional, called when a packet is given up on after max_retries
+  void (*fail_fn)(void *arg, const bm_serial_pkt_t *pkt);
+  void *arg;
+} bm_serial_rel_cfg_t;
+
+typedef struct {
+  uint32_t sent;
+  uint32_t acked;
+  uint32_t retransmits;
+  // Retransmits triggered by a selective ack instead of a timeout
+  uint32_t fast_retransmits;
+  uint32_t failed;
+  uint32_t acks_sent;
+  uint32_t acks_received;
+  uint32_t rx_duplicates;
+  uint32_t forwards_sent;
+} bm_serial_rel_stats_t;
+
+typedef struct {
+  // NULL once acknowledged
+  bm_serial_pkt_t *pkt;
+  uint32_t sent_at;
+  uint8_t retries;
+} bm_serial_rel_slot_t;
+
+//
+// Optional sliding window reliable delivery (selective repeat).
+//
+// Every packet except ACKs gets a sequence number in the flags byte and is
+// kept (in its pool block) until the other end acknowledges it. The receiver
+// answers each sequenced packet with a BM_SERIAL_ACK carrying the next
+// sequence number it expects plus a bitmap of the packets it already has past
+// that. Packets that time out are retransmitted from bm_serial_rel_poll(),
+// holes reported by the bitmap are retransmitted as soon as the ACK arrives.
+//
+// Packets are passed on as they arrive (duplicates are dropped), they are not
+// put back in order. When the sender gives up on a packet it sends an ACK
+// with BM_SERIAL_ACK_FLAG_FORWARD so the receiver stops waiting for it.
+//
+// Both ends need reliability enabled. Not thread safe, send from one thread.
+//
+struct bm_serial_rel_s {
+  bm_serial_ctx_t *ctx;
+  bm_serial_rel_cfg_t cfg;
+
+  // Sender, oldest unacknowledged and next sequence numbers
+  uint8_t base;
+  uint8_t next_seq;
+  bm_serial_rel_slot_t slots[BM_SERIAL_REL_MAX_WINDOW + 1];
+
+  // Packets were given up on, tell the receiver to skip them
+  bool forward_pending;
+  uint32_t forward_at;
+
+  // Receiver, next sequence number expected and packets received past it
+  uint8_t rx_next;
+  uint64_t rx_sack;
+
+  bm_serial_rel_stats_t stats;
+};
+
+bm_serial_error_e bm_serial_rel_init(bm_serial_rel_t *rel,
+                                     bm_serial_ctx_t *ctx,
+                                     bm_serial_pool_t *pool,
+                                     const bm_serial_rel_cfg_t *cfg);
+bm_serial_error_e bm_serial_rel_sink(void *arg, bm_serial_pkt_t *pkt);
+void bm_serial_rel_poll(bm_serial_rel_t *rel);
+size_t bm_serial_rel_in_flight(bm_serial_rel_t *rel);
+
+// Used by bm_serial.c
+uint8_t bm_serial_rel_peek_flags(bm_serial_rel_t *rel);
+bm_serial_error_e bm_serial_rel_tx_flags(bm_serial_rel_t *rel,
+                                         const bm_serial_pkt_t *pkt,
+                                         uint8_t *flags);
+bm_serial_error_e bm_serial_rel_rx_ack(bm_serial_rel_t *rel,
+                                       const uint8_t *payload, size_t len);
+bool bm_serial_rel_rx_seq(bm_serial_rel_t *rel, uint8_t flags);
+
+#ifdef __cplusplus
+}
+#endif
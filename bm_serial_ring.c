@@ -0,0 +1,123 @@
+#include "bm_serial_ring.h"
+#include <stdint.h>
+#include <string.h>
+
+/*!
+  Initialize an empty ring
+
+  \param[out] *ring ring to initialize
+  \param[in] *cells cell storage
+  \param[in] num_cells capacity (must be a power of 2)
+  \return BM_SERIAL_OK if initialized, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_ring_init(bm_serial_ring_t *ring,
+                                      bm_serial_ring_cell_t *cells,
+                                      size_t num_cells) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!ring || !cells) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    if (num_cells < 2 || (num_cells & (num_cells - 1))) {
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+
+    memset(ring, 0, sizeof(bm_serial_ring_t));
+    ring->cells = cells;
+    ring->mask = num_cells - 1;
+
+    for (size_t idx = 0; idx < num_cells; idx++) {
+      cells[idx].ptr = NULL;
+      __atomic_store_n(&cells[idx].seq, idx, __ATOMIC_RELAXED);
+    }
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Add a pointer to the ring. Safe to call from any number of threads.
+
+  The cell is published seq_cst so a consumer that checks the ring after
+  giving up ownership of it (store, then peek) can't miss the push.
+
+  \param[in] *ring ring
+  \param[in] *ptr pointer to add
+  \return true if added, false if the ring is full
+*/
+bool bm_serial_ring_push(bm_serial_ring_t *ring, void *ptr) {
+  size_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+  while (true) {
+    bm_serial_ring_cell_t *cell = &ring->cells[pos & ring->mask];
+    size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        cell->ptr = ptr;
+        __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_SEQ_CST);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/*!
+  Get the oldest pointer without removing it. Consumer only.
+
+  \param[in] *ring ring
+  \return oldest pointer, NULL if none are ready
+*/
+void *bm_serial_ring_peek(bm_serial_ring_t *ring) {
+  size_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  bm_serial_ring_cell_t *cell = &ring->cells[pos & ring->mask];
+
+  if (__atomic_load_n(&cell->seq, __ATOMIC_SEQ_CST) != pos + 1) {
+    return NULL;
+  }
+
+  return cell->ptr;
+}
+
+/*!
+  Remove the oldest pointer. Consumer only.
+
+  \param[in] *ring ring
+  \return oldest pointer, NULL if none are ready
+*/
+void *bm_serial_ring_pop(bm_serial_ring_t *ring) {
+  size_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  bm_serial_ring_cell_t *cell = &ring->cells[pos & ring->mask];
+
+  if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+    return NULL;
+  }
+
+  void *ptr = cell->ptr;
+  __atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&ring->tail, pos + 1, __ATOMIC_RELEASE);
+
+  return ptr;
+}
+
+/*!
+  Number of pointers in the ring (approximate while others are pushing)
+
+  \param[in] *ring ring
+  \return pointers in the ring
+*/
+size_t bm_serial_ring_count(bm_serial_ring_t *ring) {
+  return __atomic_load_n(&ring->head, __ATOMIC_RELAXED) -
+         __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+}
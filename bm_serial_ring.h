@@ -0,0 +1,38 @@
+#pragma once
+
+#include "bm_serial.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  size_t seq;
+  void *ptr;
+} bm_serial_ring_cell_t;
+
+//
+// Bounded lock-free ring of pointers (Vyukov style sequence numbered cells).
+// Any number of threads can push, only one thread at a time may peek/pop.
+//
+typedef struct {
+  bm_serial_ring_cell_t *cells;
+  size_t mask;
+  size_t head;
+  size_t tail;
+} bm_serial_ring_t;
+
+bm_serial_error_e bm_serial_ring_init(bm_serial_ring_t *ring,
+                                      bm_serial_ring_cell_t *cells,
+                                      size_t num_cells);
+bool bm_serial_ring_push(bm_serial_ring_t *ring, void *ptr);
+void *bm_serial_ring_peek(bm_serial_ring_t *ring);
+void *bm_serial_ring_pop(bm_serial_ring_t *ring);
+size_t bm_serial_ring_count(bm_serial_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
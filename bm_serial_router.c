@@ -0,0 +1,208 @@
+#include "bm_serial_router.h"
+#include "bm_serial_hash.h"
+#include <stdint.h>
+#include <string.h>
+
+_Static_assert(BM_SERIAL_ROUTER_ROUTES < 256, "bucket index is 8 bits");
+_Static_assert((BM_SERIAL_ROUTER_ROUTES & (BM_SERIAL_ROUTER_ROUTES - 1)) == 0,
+               "BM_SERIAL_ROUTER_ROUTES must be a power of 2");
+
+/*!
+  Find a route in the hash table
+
+  \param[in] *router router
+  \param[in] *topic topic (or prefix)
+  \param[in] topic_len topic length
+  \param[in] hash hash of topic
+  \param[in] prefix look for a wildcard route instead of an exact one
+  \return route, NULL if there isn't one
+*/
+static bm_serial_route_t *_bm_serial_router_find(bm_serial_router_t *router,
+                                                 const char *topic,
+                                                 uint16_t topic_len,
+                                                 uint32_t hash, bool prefix) {
+  for (uint32_t probe = 0; probe < BM_SERIAL_ROUTER_BUCKETS; probe++) {
+    uint8_t idx = router->buckets[(hash + probe) % BM_SERIAL_ROUTER_BUCKETS];
+    if (!idx) {
+      break;
+    }
+
+    bm_serial_route_t *route = &router->routes[idx - 1];
+    if (route->hash == hash && route->prefix == prefix &&
+        route->topic_len == topic_len &&
+        !memcmp(route->topic, topic, topic_len)) {
+      return route;
+    }
+  }
+
+  return NULL;
+}
+
+/*!
+  Enable pub routing on a bm_serial instance. Removes all routes if called
+  again.
+
+  \param[out] *router router
+  \param[in] *ctx bm_serial instance
+  \param[in] fallback_fn handler for topics without a route, NULL to pass them
+             on to the pub_fn callback
+  \param[in] *fallback_arg argument passed to fallback_fn
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_router_init(bm_serial_router_t *router,
+                                        bm_serial_ctx_t *ctx,
+                                        bm_serial_route_fn fallback_fn,
+                                        void *fallback_arg) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!router || !ctx) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    memset(router, 0, sizeof(bm_serial_router_t));
+    router->fallback_fn = fallback_fn;
+    router->fallback_arg = fallback_arg;
+
+    ctx->router = router;
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Register a handler for a topic. A topic ending in "/#" (or just "#") is a
+  wildcard for every topic starting with what comes before the '#'.
+
+  \param[in] *router router
+  \param[in] *topic topic, must stay valid while the route is registered
+  \param[in] topic_len topic length
+  \param[in] fn handler
+  \param[in] *arg argument passed to fn
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_router_add(bm_serial_router_t *router,
+                                       const char *topic, uint16_t topic_len,
+                                       bm_serial_route_fn fn, void *arg) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!router || !topic || !fn) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    if (!topic_len) {
+      rval = BM_SERIAL_INVALID_TOPIC_LEN;
+      break;
+    }
+
+    bool prefix = topic[topic_len - 1] == BM_SERIAL_ROUTER_WILDCARD;
+    if (prefix) {
+      // Wildcard only matches whole levels
+      topic_len--;
+      if (topic_len && topic[topic_len - 1] != '/') {
+        rval = BM_SERIAL_MISC_ERR;
+        break;
+      }
+    }
+
+    uint32_t hash = BM_SERIAL_FNV_OFFSET;
+    for (uint16_t idx = 0; idx < topic_len; idx++) {
+      hash = bm_serial_fnv1a_byte(hash, (uint8_t)topic[idx]);
+    }
+
+    // Same topic registered twice
+    if (_bm_serial_router_find(router, topic, topic_len, hash, prefix)) {
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+
+    if (router->count == BM_SERIAL_ROUTER_ROUTES) {
+      rval = BM_SERIAL_OUT_OF_MEMORY;
+      break;
+    }
+
+    bm_serial_route_t *route = &router->routes[router->count++];
+    route->topic = topic;
+    route->topic_len = topic_len;
+    route->prefix = prefix;
+    route->hash = hash;
+    route->fn = fn;
+    route->arg = arg;
+
+    // Table is never more than half full, there's always a free bucket
+    uint32_t bucket = hash % BM_SERIAL_ROUTER_BUCKETS;
+    while (router->buckets[bucket]) {
+      bucket = (bucket + 1) % BM_SERIAL_ROUTER_BUCKETS;
+    }
+    router->buckets[bucket] = router->count;
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Pass a received pub to its handler
+
+  \param[in] *router router
+  \param[in] *topic topic
+  \param[in] topic_len topic length
+  \param[in] node_id publisher
+  \param[in] *payload pub data
+  \param[in] len pub data length
+  \param[in] type pub type
+  \param[in] version pub version
+  \return true if a handler or the fallback took it, false to pass it on to
+          pub_fn
+*/
+bool bm_serial_router_route(bm_serial_router_t *router, const char *topic,
+                            uint16_t topic_len, uint64_t node_id,
+                            const uint8_t *payload, size_t len, uint8_t type,
+                            uint8_t version) {
+  bm_serial_route_t *match = NULL;
+  uint32_t hash = BM_SERIAL_FNV_OFFSET;
+
+  // Wildcards at the start and after every level, the last one found is the
+  // longest
+  for (uint16_t idx = 0; idx <= topic_len; idx++) {
+    if (idx == 0 || topic[idx - 1] == '/') {
+      bm_serial_route_t *route =
+          _bm_serial_router_find(router, topic, idx, hash, true);
+      if (route) {
+        match = route;
+      }
+    }
+    if (idx < topic_len) {
+      hash = bm_serial_fnv1a_byte(hash, (uint8_t)topic[idx]);
+    }
+  }
+
+  bm_serial_route_t *exact =
+      _bm_serial_router_find(router, topic, topic_len, hash, false);
+  if (exact) {
+    router->stats.exact++;
+    match = exact;
+  } else if (match) {
+    router->stats.prefix++;
+  }
+
+  if (match && match->fn(match->arg, topic, topic_len, node_id, payload, len,
+                         type, version)) {
+    return true;
+  }
+
+  if (router->fallback_fn) {
+    router->stats.fallback++;
+    if (router->fallback_fn(router->fallback_arg, topic, topic_len, node_id,
+                            payload, len, type, version)) {
+      return true;
+    }
+  }
+
+  router->stats.unmatched++;
+  return false;
+}
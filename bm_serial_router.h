@@ -0,0 +1,94 @@
+#pragma once
+
+#include "bm_serial.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Max handlers
+#ifndef BM_SERIAL_ROUTER_ROUTES
+#define BM_SERIAL_ROUTER_ROUTES 32
+#endif
+
+// Hash table size, twice the number of routes so probe sequences stay short
+// (BM_SERIAL_ROUTER_ROUTES must be a power of 2, less than 256)
+#define BM_SERIAL_ROUTER_BUCKETS (BM_SERIAL_ROUTER_ROUTES * 2)
+
+// Last character of a wildcard topic ("sensor/#", or "#" for everything)
+#define BM_SERIAL_ROUTER_WILDCARD '#'
+
+// Return false to decline a pub, passing it on to the fallback (or from the
+// fallback to pub_fn)
+typedef bool (*bm_serial_route_fn)(void *arg, const char *topic,
+                                   uint16_t topic_len, uint64_t node_id,
+                                   const uint8_t *payload, size_t len,
+                                   uint8_t type, uint8_t version);
+
+typedef struct {
+  // Exact topic, or the prefix before the wildcard. Not copied, must stay
+  // valid while the route is registered.
+  const char *topic;
+  uint16_t topic_len;
+  bool prefix;
+  uint32_t hash;
+  bm_serial_route_fn fn;
+  void *arg;
+} bm_serial_route_t;
+
+typedef struct {
+  uint32_t exact;
+  uint32_t prefix;
+  uint32_t fallback;
+  // No handler or fallback took it, passed on to pub_fn
+  uint32_t unmatched;
+} bm_serial_router_stats_t;
+
+//
+// Optional pub router. Handlers are registered for an exact topic or for every
+// topic under a prefix ("sensor/#" matches "sensor/temp" and
+// "sensor/1/temp"). Received pubs go to the exact match if there is one,
+// otherwise to the longest matching prefix, otherwise to the fallback, and if
+// there's no fallback either to the pub_fn callback. A handler returning
+// false moves the pub on to the next step the same way.
+//
+// Topics are hashed (FNV-1a) into an open addressing table when registered.
+// A lookup hashes the received topic once, probing the table at the start and
+// after every '/' for prefixes and at the end for the exact topic, so it takes
+// time proportional to the topic length however many handlers there are.
+//
+// Routes can't be removed, only all of them with bm_serial_router_init().
+// Handlers run in the receive path, same as the other callbacks.
+//
+struct bm_serial_router_s {
+  bm_serial_route_t routes[BM_SERIAL_ROUTER_ROUTES];
+  uint16_t count;
+  // Index + 1 into routes, 0 if empty
+  uint8_t buckets[BM_SERIAL_ROUTER_BUCKETS];
+
+  bm_serial_route_fn fallback_fn;
+  void *fallback_arg;
+
+  bm_serial_router_stats_t stats;
+};
+
+bm_serial_error_e bm_serial_router_init(bm_serial_router_t *router,
+                                        bm_serial_ctx_t *ctx,
+                                        bm_serial_route_fn fallback_fn,
+                                        void *fallback_arg);
+bm_serial_error_e bm_serial_router_add(bm_serial_router_t *router,
+                                       const char *topic, uint16_t topic_len,
+                                       bm_serial_route_fn fn, void *arg);
+
+// Used by bm_serial.c
+bool bm_serial_router_route(bm_serial_router_t *router, const char *topic,
+                            uint16_t topic_len, uint64_t node_id,
+                            const uint8_t *payload, size_t len, uint8_t type,
+                            uint8_t version);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,228 @@
+#include "bm_serial_sched.h"
+#include <stdint.h>
+#include <string.h>
+
+/*!
+  Initialize a transmit scheduler and attach it to an instance
+
+  \param[out] *sched scheduler
+  \param[in] *ctx bm_serial instance
+  \param[in] *pool initialized packet pool
+  \param[in] *cfg BM_SERIAL_SCHED_NUM_CLASSES queue configs
+  \param[in] now_fn optional time source for latency stats
+  \return BM_SERIAL_OK if initialized, nonzero otherwise
+*/
+bm_serial_error_e
+bm_serial_sched_init(bm_serial_sched_t *sched, bm_serial_ctx_t *ctx,
+                     bm_serial_pool_t *pool,
+                     const bm_serial_sched_queue_cfg_t *cfg,
+                     uint32_t (*now_fn)(void)) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!sched || !ctx || !pool || !cfg) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    memset(sched, 0, sizeof(bm_serial_sched_t));
+    sched->ctx = ctx;
+    sched->now_fn = now_fn;
+
+    for (uint8_t cls = 0; cls < BM_SERIAL_SCHED_NUM_CLASSES; cls++) {
+      rval = bm_serial_ring_init(&sched->queues[cls].ring, cfg[cls].cells,
+                                 cfg[cls].num_cells);
+      if (rval) {
+        break;
+      }
+      sched->queues[cls].weight = cfg[cls].weight;
+    }
+    if (rval) {
+      break;
+    }
+
+    bm_serial_ctx_set_pool(ctx, pool, bm_serial_sched_sink, sched);
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Get the scheduler class for a message type
+
+  \param[in] type bm_serial message type
+  \return class
+*/
+bm_serial_sched_class_e bm_serial_sched_classify(uint8_t type) {
+  switch (type) {
+  case BM_SERIAL_PUB:
+  case BM_SERIAL_NET_MSG:
+  case BM_SERIAL_PUB_ALIAS:
+  // Batches are (mostly) small pubs, they mustn't jump config traffic
+  case BM_SERIAL_BATCH:
+    return BM_SERIAL_SCHED_PUB;
+
+  case BM_SERIAL_DEBUG:
+  case BM_SERIAL_LOG:
+    return BM_SERIAL_SCHED_LOG;
+
+  case BM_SERIAL_DFU_CHUNK:
+  case BM_SERIAL_NETWORK_INFO:
+    return BM_SERIAL_SCHED_BULK;
+
+  case BM_SERIAL_CFG_GET:
+  case BM_SERIAL_CFG_SET:
+  case BM_SERIAL_CFG_VALUE:
+  case BM_SERIAL_CFG_COMMIT:
+  case BM_SERIAL_CFG_STATUS_REQ:
+  case BM_SERIAL_CFG_STATUS_RESP:
+  case BM_SERIAL_CFG_DEL_REQ:
+  case BM_SERIAL_CFG_DEL_RESP:
+    return BM_SERIAL_SCHED_CONFIG;
+
+  // Aliased pubs are dropped until the sender gets the reset
+  case BM_SERIAL_ALIAS_RESET:
+  default:
+    return BM_SERIAL_SCHED_CONTROL;
+  }
+}
+
+/*!
+  Packet sink (see bm_serial_ctx_set_pool()) that queues packets by class.
+  Safe to call from any number of threads.
+
+  \param[in] *arg scheduler
+  \param[in] *pkt finished packet
+  \return BM_SERIAL_OK if queued, BM_SERIAL_OUT_OF_MEMORY if the queue is full
+*/
+bm_serial_error_e bm_serial_sched_sink(void *arg, bm_serial_pkt_t *pkt) {
+  bm_serial_sched_t *sched = (bm_serial_sched_t *)arg;
+  bm_serial_sched_queue_t *queue =
+      &sched->queues[bm_serial_sched_classify(pkt->type)];
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    pkt->stamp = sched->now_fn ? sched->now_fn() : 0;
+    if (!bm_serial_ring_push(&queue->ring, pkt)) {
+      __atomic_fetch_add(&queue->stats.dropped, 1, __ATOMIC_RELAXED);
+      bm_serial_pkt_release(pkt);
+      rval = BM_SERIAL_OUT_OF_MEMORY;
+      break;
+    }
+    __atomic_fetch_add(&queue->stats.enqueued, 1, __ATOMIC_RELAXED);
+
+    uint16_t depth = bm_serial_ring_count(&queue->ring);
+    uint16_t max_depth =
+        __atomic_load_n(&queue->stats.max_depth, __ATOMIC_RELAXED);
+    while (depth > max_depth &&
+           !__atomic_compare_exchange_n(&queue->stats.max_depth, &max_depth,
+                                        depth, true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+    }
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Take a packet off a queue and update its stats
+
+  \param[in] *sched scheduler
+  \param[in] *queue queue with a packet ready
+  \return packet
+*/
+static bm_serial_pkt_t *_bm_serial_sched_pop(bm_serial_sched_t *sched,
+                                             bm_serial_sched_queue_t *queue) {
+  bm_serial_pkt_t *pkt = (bm_serial_pkt_t *)bm_serial_ring_pop(&queue->ring);
+
+  queue->stats.sent++;
+  queue->stats.bytes += pkt->len;
+  if (sched->now_fn) {
+    uint32_t latency = sched->now_fn() - pkt->stamp;
+    queue->stats.latency_total += latency;
+    if (latency > queue->stats.latency_max) {
+      queue->stats.latency_max = latency;
+    }
+  }
+
+  return pkt;
+}
+
+/*!
+  Get the next packet to send. Strict priority classes are served first, in
+  class order. The weighted classes then share the link by bytes sent (deficit
+  round robin). Writer thread only.
+
+  \param[in] *sched scheduler
+  \return packet (caller must release it), NULL if nothing is queued
+*/
+bm_serial_pkt_t *bm_serial_sched_next(bm_serial_sched_t *sched) {
+  for (uint8_t cls = 0; cls < BM_SERIAL_SCHED_NUM_CLASSES; cls++) {
+    bm_serial_sched_queue_t *queue = &sched->queues[cls];
+    if (!queue->weight && bm_serial_ring_peek(&queue->ring)) {
+      return _bm_serial_sched_pop(sched, queue);
+    }
+  }
+
+  // Keep going round until a packet has enough credit. Stop after a full
+  // round without any weighted packets.
+  uint8_t empty = 0;
+  while (empty < BM_SERIAL_SCHED_NUM_CLASSES) {
+    bm_serial_sched_queue_t *queue = &sched->queues[sched->current];
+    bm_serial_pkt_t *pkt =
+        queue->weight ? (bm_serial_pkt_t *)bm_serial_ring_peek(&queue->ring)
+                      : NULL;
+
+    if (pkt) {
+      empty = 0;
+      if (!sched->credited) {
+        queue->deficit += (uint32_t)queue->weight * BM_SERIAL_SCHED_QUANTUM;
+        sched->credited = true;
+      }
+
+      if (pkt->len <= queue->deficit) {
+        queue->deficit -= pkt->len;
+        return _bm_serial_sched_pop(sched, queue);
+      }
+    } else {
+      // Idle classes don't save up credit
+      queue->deficit = 0;
+      empty++;
+    }
+
+    sched->current = (sched->current + 1) % BM_SERIAL_SCHED_NUM_CLASSES;
+    sched->credited = false;
+  }
+
+  return NULL;
+}
+
+/*!
+  Send queued packets in scheduler order. Writer thread only.
+
+  Packets that fail to send are dropped and counted in stats.tx_errors.
+
+  \param[in] *sched scheduler
+  \param[in] max_packets max packets to send, 0 for all of them
+  \return BM_SERIAL_OK if all packets were sent, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_sched_flush(bm_serial_sched_t *sched,
+                                        size_t max_packets) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  size_t sent = 0;
+
+  bm_serial_pkt_t *pkt;
+  while ((!max_packets || sent < max_packets) &&
+         (pkt = bm_serial_sched_next(sched))) {
+    bm_serial_error_e tx_rval = bm_serial_ctx_pkt_send(sched->ctx, pkt);
+    if (tx_rval) {
+      rval = tx_rval;
+    }
+    bm_serial_pkt_release(pkt);
+    sent++;
+  }
+
+  return rval;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "bm_serial.h"
+#include "bm_serial_pool.h"
+#include "bm_serial_ring.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Message classes, each with its own queue. See bm_serial_sched_classify()
+typedef enum {
+  // ACK, sub/unsub, RTC, self test, reboot info, device info, DFU start/result
+  BM_SERIAL_SCHED_CONTROL = 0,
+  BM_SERIAL_SCHED_CONFIG,
+  BM_SERIAL_SCHED_PUB,
+  BM_SERIAL_SCHED_LOG,
+  // DFU chunks, network info
+  BM_SERIAL_SCHED_BULK,
+  BM_SERIAL_SCHED_NUM_CLASSES,
+} bm_serial_sched_class_e;
+
+// Bytes a weighted class can send per round, per unit of weight
+#define BM_SERIAL_SCHED_QUANTUM 256
+
+typedef struct {
+  // Queue storage
+  bm_serial_ring_cell_t *cells;
+  // Must be a power of 2
+  size_t num_cells;
+  // 0 for strict priority (served before every weighted class, in class
+  // order), otherwise share of the link left over by the strict classes
+  uint16_t weight;
+} bm_serial_sched_queue_cfg_t;
+
+typedef struct {
+  uint32_t enqueued;
+  uint32_t sent;
+  uint32_t bytes;
+  // Packets dropped because the queue was full
+  uint32_t dropped;
+  uint16_t max_depth;
+  // Time spent queued, in now_fn ticks
+  uint32_t latency_max;
+  uint64_t latency_total;
+} bm_serial_sched_stats_t;
+
+typedef struct {
+  bm_serial_ring_t ring;
+  uint16_t weight;
+  // Deficit round robin credit, in bytes
+  uint32_t deficit;
+  bm_serial_sched_stats_t stats;
+} bm_serial_sched_queue_t;
+
+//
+// Transmit scheduler. Packets built by the instance (in pool blocks) are
+// queued per message class, and sent by a single writer thread in priority
+// order with bm_serial_sched_flush() (or taken one at a time with
+// bm_serial_sched_next()). Strict classes go first, the rest share the link
+// with deficit round robin, so small control packets only ever wait for the
+// packet already on the wire.
+//
+typedef struct {
+  bm_serial_ctx_t *ctx;
+  bm_serial_sched_queue_t queues[BM_SERIAL_SCHED_NUM_CLASSES];
+
+  // Optional time source for latency stats
+  uint32_t (*now_fn)(void);
+
+  // Weighted class being served, and whether its deficit was topped up yet
+  uint8_t current;
+  bool credited;
+} bm_serial_sched_t;
+
+bm_serial_error_e
+bm_serial_sched_init(bm_serial_sched_t *sched, bm_serial_ctx_t *ctx,
+                     bm_serial_pool_t *pool,
+                     const bm_serial_sched_queue_cfg_t *cfg,
+                     uint32_t (*now_fn)(void));
+bm_serial_sched_class_e bm_serial_sched_classify(uint8_t type);
+bm_serial_error_e bm_serial_sched_sink(void *arg, bm_serial_pkt_t *pkt);
+bm_serial_pkt_t *bm_serial_sched_next(bm_serial_sched_t *sched);
+bm_serial_error_e bm_serial_sched_flush(bm_serial_sched_t *sched,
+                                        size_t max_packets);
+
+#ifdef __cplusplus
+}
+#endif
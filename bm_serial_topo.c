@@ -0,0 +1,264 @@
+#include "bm_serial_topo.h"
+#include <stdint.h>
+#include <string.h>
+
+_Static_assert(BM_SERIAL_TOPO_SNAPSHOTS >= 2,
+               "need a snapshot to fill while the current one is read");
+
+/*!
+  Sort node ids, dropping duplicates. Insertion sort, node lists usually
+  come in (nearly) sorted.
+
+  \param[in,out] *nodes node ids
+  \param[in] count number of node ids
+  \return number of node ids left
+*/
+static uint16_t _bm_serial_topo_sort(uint64_t *nodes, uint16_t count) {
+  uint16_t len = 0;
+  for (uint16_t idx = 0; idx < count; idx++) {
+    uint64_t node_id = nodes[idx];
+    uint16_t pos = len;
+    while (pos && nodes[pos - 1] > node_id) {
+      pos--;
+    }
+    if (pos && nodes[pos - 1] == node_id) {
+      continue;
+    }
+    memmove(&nodes[pos + 1], &nodes[pos], (len - pos) * sizeof(uint64_t));
+    nodes[pos] = node_id;
+    len++;
+  }
+  return len;
+}
+
+/*!
+  Find the nodes that joined and left since the previous snapshot, by merging
+  the two sorted node lists
+
+  \param[in,out] *snapshot new snapshot, nodes already sorted
+  \param[in] *previous previous snapshot, NULL if there is none
+  \return none
+*/
+static void _bm_serial_topo_diff(bm_serial_topo_snapshot_t *snapshot,
+                                 const bm_serial_topo_snapshot_t *previous) {
+  uint16_t num_previous = previous ? previous->num_nodes : 0;
+  uint16_t idx = 0;
+  uint16_t prev_idx = 0;
+
+  snapshot->num_joined = 0;
+  snapshot->num_left = 0;
+  while (idx < snapshot->num_nodes || prev_idx < num_previous) {
+    if (prev_idx == num_previous ||
+        (idx < snapshot->num_nodes &&
+         snapshot->nodes[idx] < previous->nodes[prev_idx])) {
+      snapshot->joined[snapshot->num_joined++] = snapshot->nodes[idx++];
+    } else if (idx == snapshot->num_nodes ||
+               previous->nodes[prev_idx] < snapshot->nodes[idx]) {
+      snapshot->left[snapshot->num_left++] = previous->nodes[prev_idx++];
+    } else {
+      idx++;
+      prev_idx++;
+    }
+  }
+}
+
+/*!
+  Check if a snapshot has anything the previous one didn't
+
+  \param[in] *snapshot new snapshot
+  \param[in] *previous previous snapshot
+  \return true if they're the same
+*/
+static bool _bm_serial_topo_same(const bm_serial_topo_snapshot_t *snapshot,
+                                 const bm_serial_topo_snapshot_t *previous) {
+  return !snapshot->num_joined && !snapshot->num_left &&
+         snapshot->network_crc32 == previous->network_crc32 &&
+         !memcmp(&snapshot->config_crc, &previous->config_crc,
+                 sizeof(bm_common_config_crc_t)) &&
+         !memcmp(&snapshot->fw_info, &previous->fw_info,
+                 sizeof(bm_common_fw_version_t)) &&
+         snapshot->map_size == previous->map_size &&
+         snapshot->map_len == previous->map_len &&
+         !memcmp(snapshot->map, previous->map, snapshot->map_len);
+}
+
+/*!
+  Enable topology snapshots on a bm_serial instance. Must not be called
+  again while readers hold a snapshot.
+
+  \param[out] *topo topology
+  \param[in] *ctx bm_serial instance
+  \param[in] *cfg configuration (copied), NULL for none
+  \return BM_SERIAL_OK if ok, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_topo_init(bm_serial_topo_t *topo,
+                                      bm_serial_ctx_t *ctx,
+                                      const bm_serial_topo_cfg_t *cfg) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!topo || !ctx) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    memset(topo, 0, sizeof(bm_serial_topo_t));
+    topo->ctx = ctx;
+    if (cfg) {
+      topo->cfg = *cfg;
+    }
+
+    ctx->topo = topo;
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Get the current snapshot. Release it with bm_serial_topo_release() when
+  done, it stays the same until then.
+
+  \param[in] *topo topology
+  \return current snapshot, NULL before the first network info
+*/
+const bm_serial_topo_snapshot_t *
+bm_serial_topo_acquire(bm_serial_topo_t *topo) {
+  while (true) {
+    bm_serial_topo_snapshot_t *snapshot =
+        __atomic_load_n(&topo->current, __ATOMIC_SEQ_CST);
+    if (!snapshot) {
+      return NULL;
+    }
+
+    __atomic_fetch_add(&snapshot->readers, 1, __ATOMIC_SEQ_CST);
+    // Only counts if it's still current, otherwise it may be getting refilled
+    if (__atomic_load_n(&topo->current, __ATOMIC_SEQ_CST) == snapshot) {
+      return snapshot;
+    }
+    __atomic_fetch_sub(&snapshot->readers, 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+/*!
+  Release a snapshot from bm_serial_topo_acquire()
+
+  \param[in] *topo topology
+  \param[in] *snapshot snapshot, can be NULL
+  \return none
+*/
+void bm_serial_topo_release(bm_serial_topo_t *topo,
+                            const bm_serial_topo_snapshot_t *snapshot) {
+  (void)topo;
+  if (snapshot) {
+    __atomic_fetch_sub(&((bm_serial_topo_snapshot_t *)snapshot)->readers, 1,
+                       __ATOMIC_SEQ_CST);
+  }
+}
+
+/*!
+  Check if a node is in the network
+
+  \param[in] *snapshot snapshot
+  \param[in] node_id node
+  \return true if it is
+*/
+bool bm_serial_topo_has(const bm_serial_topo_snapshot_t *snapshot,
+                        uint64_t node_id) {
+  uint16_t low = 0;
+  uint16_t high = snapshot->num_nodes;
+  while (low < high) {
+    uint16_t mid = low + (high - low) / 2;
+    if (snapshot->nodes[mid] < node_id) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low < snapshot->num_nodes && snapshot->nodes[low] == node_id;
+}
+
+/*!
+  Make a snapshot from a received network info and swap it in
+
+  \param[in] *topo topology
+  \param[in] *payload bm_common_network_info_t
+  \param[in] len payload length
+  \return BM_SERIAL_OK if ok (or nothing changed), nonzero if the network
+          info was dropped
+*/
+bm_serial_error_e bm_serial_topo_rx(bm_serial_topo_t *topo,
+                                    const uint8_t *payload, size_t len) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  const bm_common_network_info_t *info =
+      (const bm_common_network_info_t *)payload;
+
+  do {
+    if (len < sizeof(*info) ||
+        (size_t)info->num_nodes * sizeof(uint64_t) + info->map_size_bytes >
+            len - sizeof(*info)) {
+      topo->stats.invalid++;
+      rval = BM_SERIAL_INVALID_MSG_LEN;
+      break;
+    }
+
+    if (info->num_nodes > BM_SERIAL_TOPO_MAX_NODES) {
+      topo->stats.too_big++;
+      rval = BM_SERIAL_OVERFLOW;
+      break;
+    }
+
+    // Only this thread swaps snapshots, so current can't change under us
+    bm_serial_topo_snapshot_t *previous = topo->current;
+    bm_serial_topo_snapshot_t *snapshot = NULL;
+    for (uint16_t idx = 0; idx < BM_SERIAL_TOPO_SNAPSHOTS; idx++) {
+      bm_serial_topo_snapshot_t *candidate = &topo->snapshots[idx];
+      if (candidate != previous &&
+          !__atomic_load_n(&candidate->readers, __ATOMIC_SEQ_CST)) {
+        snapshot = candidate;
+        break;
+      }
+    }
+    if (!snapshot) {
+      topo->stats.busy++;
+      rval = BM_SERIAL_BUSY;
+      break;
+    }
+
+    snapshot->network_crc32 = info->network_crc32;
+    memcpy(&snapshot->config_crc, &info->config_crc,
+           sizeof(bm_common_config_crc_t));
+    memcpy(&snapshot->fw_info, &info->fw_info, sizeof(bm_common_fw_version_t));
+
+    // Node ids aren't aligned in the payload
+    memcpy(snapshot->nodes, info->node_list_and_cbor_config_map,
+           info->num_nodes * sizeof(uint64_t));
+    snapshot->num_nodes = _bm_serial_topo_sort(snapshot->nodes,
+                                               info->num_nodes);
+    _bm_serial_topo_diff(snapshot, previous);
+
+    snapshot->map_offset =
+        (uint16_t)(sizeof(*info) + info->num_nodes * sizeof(uint64_t));
+    snapshot->map_size = info->map_size_bytes;
+    snapshot->map_len =
+        (info->map_size_bytes <= BM_SERIAL_TOPO_MAP_LEN) ? snapshot->map_size
+                                                         : 0;
+    memcpy(snapshot->map, &payload[snapshot->map_offset], snapshot->map_len);
+
+    if (previous && _bm_serial_topo_same(snapshot, previous)) {
+      topo->stats.unchanged++;
+      break;
+    }
+
+    snapshot->seq = previous ? previous->seq + 1 : 1;
+    __atomic_store_n(&topo->current, snapshot, __ATOMIC_SEQ_CST);
+    topo->stats.updates++;
+
+    if (topo->cfg.updated_fn) {
+      topo->cfg.updated_fn(topo->cfg.arg, snapshot);
+    }
+
+  } while (0);
+
+  return rval;
+}
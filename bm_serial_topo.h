@@ -0,0 +1,118 @@
+#pragma once
+
+#include "bm_serial.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest network (bigger network infos are dropped)
+#ifndef BM_SERIAL_TOPO_MAX_NODES
+#define BM_SERIAL_TOPO_MAX_NODES 64
+#endif
+
+// Largest CBOR config map kept with a snapshot
+#ifndef BM_SERIAL_TOPO_MAP_LEN
+#define BM_SERIAL_TOPO_MAP_LEN 512
+#endif
+
+// Snapshots to swap between, the current one plus ones readers may still hold
+#ifndef BM_SERIAL_TOPO_SNAPSHOTS
+#define BM_SERIAL_TOPO_SNAPSHOTS 3
+#endif
+
+// Network as of one network info. Never changes while a reader holds it.
+typedef struct {
+  // 1 for the first network info, +1 for every change after
+  uint32_t seq;
+  uint32_t network_crc32;
+  bm_common_config_crc_t config_crc;
+  bm_common_fw_version_t fw_info;
+
+  // Node ids, sorted
+  uint64_t nodes[BM_SERIAL_TOPO_MAX_NODES];
+  uint16_t num_nodes;
+
+  // Nodes that aren't / are no longer in the network since the previous
+  // snapshot (all of them are joined in the first one), sorted
+  uint64_t joined[BM_SERIAL_TOPO_MAX_NODES];
+  uint16_t num_joined;
+  uint64_t left[BM_SERIAL_TOPO_MAX_NODES];
+  uint16_t num_left;
+
+  // CBOR config map, and where it started in the network info payload.
+  // map_len is 0 if it didn't fit (see map_size)
+  uint16_t map_offset;
+  uint16_t map_size;
+  uint16_t map_len;
+  uint8_t map[BM_SERIAL_TOPO_MAP_LEN];
+
+  // Readers holding it, internal
+  uint32_t readers;
+} bm_serial_topo_snapshot_t;
+
+typedef struct {
+  // Optional, called (from bm_serial_process_packet()) after a new snapshot
+  // is swapped in
+  void (*updated_fn)(void *arg, const bm_serial_topo_snapshot_t *snapshot);
+  void *arg;
+} bm_serial_topo_cfg_t;
+
+typedef struct {
+  // Snapshots swapped in
+  uint32_t updates;
+  // Network infos with nothing new
+  uint32_t unchanged;
+  // Network infos dropped because they were too short for their node list
+  // and map, had more than BM_SERIAL_TOPO_MAX_NODES nodes, or readers held
+  // every other snapshot
+  uint32_t invalid;
+  uint32_t too_big;
+  uint32_t busy;
+} bm_serial_topo_stats_t;
+
+//
+// Optional network topology. Every network info received is parsed into an
+// immutable snapshot: the node ids sorted (looked up with a binary search),
+// the nodes that joined and left since the previous one, and a copy of the
+// config map. network_info_fn still gets the raw message.
+//
+// Readers on any thread call bm_serial_topo_acquire() and
+// bm_serial_topo_release() around their use of a snapshot, without locks.
+// The thread calling bm_serial_process_packet() fills a snapshot no reader
+// holds and swaps it in atomically. If readers hold all the others, the
+// network info is dropped (until the next one). Requires lock-free word sized
+// atomics (__atomic builtins).
+//
+struct bm_serial_topo_s {
+  bm_serial_ctx_t *ctx;
+  bm_serial_topo_cfg_t cfg;
+
+  bm_serial_topo_snapshot_t snapshots[BM_SERIAL_TOPO_SNAPSHOTS];
+  // NULL until the first network info
+  bm_serial_topo_snapshot_t *current;
+
+  bm_serial_topo_stats_t stats;
+};
+
+bm_serial_error_e bm_serial_topo_init(bm_serial_topo_t *topo,
+                                      bm_serial_ctx_t *ctx,
+                                      const bm_serial_topo_cfg_t *cfg);
+
+// Reader side (any thread)
+const bm_serial_topo_snapshot_t *bm_serial_topo_acquire(bm_serial_topo_t *topo);
+void bm_serial_topo_release(bm_serial_topo_t *topo,
+                            const bm_serial_topo_snapshot_t *snapshot);
+bool bm_serial_topo_has(const bm_serial_topo_snapshot_t *snapshot,
+                        uint64_t node_id);
+
+// Used by bm_serial.c
+bm_serial_error_e bm_serial_topo_rx(bm_serial_topo_t *topo,
+                                    const uint8_t *payload, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,124 @@
+#include "bm_serial_txq.h"
+#include <stdint.h>
+#include <string.h>
+
+/*!
+  Initialize a tx queue
+
+  \param[out] *txq queue to initialize
+  \param[in] *slots slot storage
+  \param[in] num_slots number of slots (must be a power of 2)
+  \return BM_SERIAL_OK if initialized, nonzero otherwise
+*/
+bm_serial_error_e bm_serial_txq_init(bm_serial_txq_t *txq,
+                                     bm_serial_txq_slot_t *slots,
+                                     size_t num_slots) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+
+  do {
+    if (!txq || !slots) {
+      rval = BM_SERIAL_NULL_BUFF;
+      break;
+    }
+
+    if (num_slots < 2 || (num_slots & (num_slots - 1))) {
+      rval = BM_SERIAL_MISC_ERR;
+      break;
+    }
+
+    memset(txq, 0, sizeof(bm_serial_txq_t));
+    txq->slots = slots;
+    txq->mask = num_slots - 1;
+
+    for (size_t idx = 0; idx < num_slots; idx++) {
+      slots[idx].len = 0;
+      __atomic_store_n(&slots[idx].seq, idx, __ATOMIC_RELAXED);
+    }
+
+  } while (0);
+
+  return rval;
+}
+
+/*!
+  Claim the next free slot to build a frame in. Safe to call from any number of
+  threads. Every claimed slot MUST be published (with len 0 to abandon it),
+  the consumer waits for slots in claim order.
+
+  \param[in] *txq queue
+  \return slot if available, NULL if the queue is full
+*/
+bm_serial_txq_slot_t *bm_serial_txq_claim(bm_serial_txq_t *txq) {
+  size_t pos = __atomic_load_n(&txq->head, __ATOMIC_RELAXED);
+
+  while (true) {
+    bm_serial_txq_slot_t *slot = &txq->slots[pos & txq->mask];
+    size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+    if (diff == 0) {
+      // Slot is free, try to take it (pos is updated on failure)
+      if (__atomic_compare_exchange_n(&txq->head, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return slot;
+      }
+    } else if (diff < 0) {
+      // Consumer hasn't released this slot from the previous lap yet
+      __atomic_fetch_add(&txq->full, 1, __ATOMIC_RELAXED);
+      return NULL;
+    } else {
+      // Another producer claimed it first
+      pos = __atomic_load_n(&txq->head, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/*!
+  Hand a claimed slot to the consumer
+
+  \param[in] *txq queue
+  \param[in] *slot slot from bm_serial_txq_claim()
+  \param[in] offset frame offset in slot->buff
+  \param[in] len frame length, 0 to abandon the slot
+  \return none
+*/
+void bm_serial_txq_publish(bm_serial_txq_t *txq, bm_serial_txq_slot_t *slot,
+                           uint16_t offset, uint16_t len) {
+  (void)txq;
+  slot->offset = offset;
+  slot->len = len;
+
+  // Only the claiming producer touches seq until it's published
+  __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+}
+
+/*!
+  Get the oldest published frame. Consumer thread only.
+
+  \param[in] *txq queue
+  \return slot if the next frame is ready, NULL otherwise
+*/
+bm_serial_txq_slot_t *bm_serial_txq_peek(bm_serial_txq_t *txq) {
+  size_t pos = __atomic_load_n(&txq->tail, __ATOMIC_RELAXED);
+  bm_serial_txq_slot_t *slot = &txq->slots[pos & txq->mask];
+
+  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+    return NULL;
+  }
+
+  return slot;
+}
+
+/*!
+  Return a sent slot to the producers. Consumer thread only.
+
+  \param[in] *txq queue
+  \param[in] *slot slot from bm_serial_txq_peek()
+  \return none
+*/
+void bm_serial_txq_release(bm_serial_txq_t *txq, bm_serial_txq_slot_t *slot) {
+  size_t pos = __atomic_load_n(&txq->tail, __ATOMIC_RELAXED);
+
+  __atomic_store_n(&slot->seq, pos + txq->mask + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&txq->tail, pos + 1, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "bm_serial.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Keep producer and consumer indexes on separate cache lines
+#define BM_SERIAL_TXQ_ALIGN 64
+
+// One queued frame. Packets are built directly in buff, with the same layout
+// as the bm_serial_ctx_t tx buffer so COBS encoding still happens in place.
+typedef struct bm_serial_txq_slot_s {
+  // Sequence number used to hand the slot between producers and the consumer
+  size_t seq;
+
+  // Frame to transmit is buff[offset] to buff[offset + len - 1]. Slots that
+  // were claimed but abandoned (e.g. message too long) have len 0
+  uint16_t offset;
+  uint16_t len;
+
+  uint8_t buff[BM_SERIAL_TX_BUFF_LEN];
+} bm_serial_txq_slot_t;
+
+//
+// Bounded lock-free multi producer/single consumer queue of tx frames
+// (Vyukov style sequence numbered slots).
+//
+// Any number of threads build packets into claimed slots at the same time.
+// A single writer thread owns tx_fn/tx_iov_fn and sends published frames in
+// claim order with bm_serial_ctx_txq_flush().
+//
+// Requires lock-free word sized atomics (__atomic builtins).
+//
+typedef struct bm_serial_txq_s {
+  bm_serial_txq_slot_t *slots;
+  size_t mask;
+
+  // Next slot producers claim
+  size_t head __attribute__((aligned(BM_SERIAL_TXQ_ALIGN)));
+
+  // Next slot the consumer sends
+  size_t tail __attribute__((aligned(BM_SERIAL_TXQ_ALIGN)));
+
+  // Claims that failed because the queue was full
+  uint32_t full;
+} bm_serial_txq_t;
+
+bm_serial_error_e bm_serial_txq_init(bm_serial_txq_t *txq,
+                                     bm_serial_txq_slot_t *slots,
+                                     size_t num_slots);
+
+// Producer side
+bm_serial_txq_slot_t *bm_serial_txq_claim(bm_serial_txq_t *txq);
+void bm_serial_txq_publish(bm_serial_txq_t *txq, bm_serial_txq_slot_t *slot,
+                           uint16_t offset, uint16_t len);
+
+// Consumer side (single thread)
+bm_serial_txq_slot_t *bm_serial_txq_peek(bm_serial_txq_t *txq);
+void bm_serial_txq_release(bm_serial_txq_t *txq, bm_serial_txq_slot_t *slot);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,385 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_alias.h"
+
+#include <deque>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static bm_serial_ctx_t a_ctx;
+static bm_serial_ctx_t b_ctx;
+static bm_serial_alias_t a_alias;
+static bm_serial_alias_t b_alias;
+
+typedef std::vector<uint8_t> frame_t;
+static std::deque<frame_t> a_to_b;
+static std::deque<frame_t> b_to_a;
+
+struct pub_t {
+  std::string topic;
+  uint64_t node_id;
+  uint32_t value;
+};
+static std::vector<pub_t> received;
+
+static bool a_tx_fail;
+static bool a_tx_fn(const uint8_t *buff, size_t len) {
+  if (a_tx_fail) {
+    return false;
+  }
+  a_to_b.emplace_back(buff, buff + len);
+  return true;
+}
+
+static bool b_tx_fn(const uint8_t *buff, size_t len) {
+  b_to_a.emplace_back(buff, buff + len);
+  return true;
+}
+
+static bool pub_fn(const char *topic, uint16_t topic_len, uint64_t node_id,
+                   const uint8_t *payload, size_t len, uint8_t type,
+                   uint8_t version) {
+  EXPECT_EQ(type, 3);
+  EXPECT_EQ(version, 4);
+  pub_t pub = {std::string(topic, topic_len), node_id, 0};
+  EXPECT_EQ(len, sizeof(pub.value));
+  memcpy(&pub.value, payload, sizeof(pub.value));
+  received.push_back(pub);
+  return true;
+}
+
+static bm_serial_error_e pub(const std::string &topic, uint32_t value) {
+  return bm_serial_ctx_pub(&a_ctx, 1234, topic.data(), topic.size(),
+                           (const uint8_t *)&value, sizeof(value), 3, 4);
+}
+
+// Deliver the oldest frame from a to b
+static bm_serial_error_e deliver(void) {
+  frame_t frame = a_to_b.front();
+  a_to_b.pop_front();
+  return bm_serial_ctx_process_packet(
+      &b_ctx, (bm_serial_packet_t *)frame.data(), frame.size());
+}
+
+// Deliver every frame from b to a
+static void deliver_resets(void) {
+  while (!b_to_a.empty()) {
+    frame_t frame = b_to_a.front();
+    b_to_a.pop_front();
+    EXPECT_EQ(bm_serial_ctx_process_packet(
+                  &a_ctx, (bm_serial_packet_t *)frame.data(), frame.size()),
+              BM_SERIAL_OK);
+  }
+}
+
+static std::string topic(int idx) {
+  return "spotter/sensor/" + std::to_string(idx) + "/temperature";
+}
+
+class AliasTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    bm_serial_callbacks_t a_callbacks = {};
+    a_callbacks.tx_fn = a_tx_fn;
+    bm_serial_ctx_init(&a_ctx, &a_callbacks);
+    ASSERT_EQ(bm_serial_alias_init(&a_alias, &a_ctx), BM_SERIAL_OK);
+
+    bm_serial_callbacks_t b_callbacks = {};
+    b_callbacks.tx_fn = b_tx_fn;
+    b_callbacks.pub_fn = pub_fn;
+    bm_serial_ctx_init(&b_ctx, &b_callbacks);
+    ASSERT_EQ(bm_serial_alias_init(&b_alias, &b_ctx), BM_SERIAL_OK);
+
+    a_to_b.clear();
+    b_to_a.clear();
+    received.clear();
+    a_tx_fail = false;
+  }
+};
+
+TEST_F(AliasTest, Errors) {
+  EXPECT_EQ(bm_serial_alias_init(NULL, &a_ctx), BM_SERIAL_NULL_BUFF);
+  EXPECT_EQ(bm_serial_alias_init(&a_alias, NULL), BM_SERIAL_NULL_BUFF);
+
+  // Topic runs past the end of the packet
+  uint8_t payload[sizeof(bm_serial_pub_alias_header_t) + 4] = {};
+  bm_serial_pub_alias_header_t *header =
+      (bm_serial_pub_alias_header_t *)payload;
+  header->topic_len = 5;
+  EXPECT_EQ(bm_serial_ctx_tx(&a_ctx, BM_SERIAL_PUB_ALIAS, payload,
+                             sizeof(payload)),
+            BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_INVALID_TOPIC_LEN);
+
+  // Header cut short
+  EXPECT_EQ(bm_serial_ctx_tx(&a_ctx, BM_SERIAL_PUB_ALIAS, payload, 4),
+            BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_INVALID_MSG_LEN);
+  EXPECT_TRUE(received.empty());
+}
+
+TEST_F(AliasTest, Alias) {
+  std::string name = topic(0);
+  ASSERT_EQ(pub(name, 1), BM_SERIAL_OK);
+  ASSERT_EQ(pub(name, 2), BM_SERIAL_OK);
+  ASSERT_EQ(a_to_b.size(), 2u);
+
+  // Topic only goes out the first time
+  EXPECT_EQ(a_to_b[0][0], BM_SERIAL_PUB_ALIAS);
+  EXPECT_EQ(a_to_b[0].size(), sizeof(bm_serial_packet_t) +
+                                  sizeof(bm_serial_pub_alias_header_t) +
+                                  name.size() + sizeof(uint32_t));
+  EXPECT_EQ(a_to_b[1].size(), sizeof(bm_serial_packet_t) +
+                                  sizeof(bm_serial_pub_alias_header_t) +
+                                  sizeof(uint32_t));
+  EXPECT_LT(a_to_b[1].size() * 2, a_to_b[0].size());
+
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  ASSERT_EQ(received.size(), 2u);
+  for (uint32_t idx = 0; idx < 2; idx++) {
+    EXPECT_EQ(received[idx].topic, name);
+    EXPECT_EQ(received[idx].node_id, 1234u);
+    EXPECT_EQ(received[idx].value, idx + 1);
+  }
+  EXPECT_EQ(a_alias.stats.tx_registrations, 1u);
+  EXPECT_EQ(a_alias.stats.tx_hits, 1u);
+  EXPECT_EQ(b_alias.stats.rx_hits, 1u);
+
+  // No topic, no alias
+  ASSERT_EQ(bm_serial_ctx_pub(&a_ctx, 1, "", 0, (const uint8_t *)"abcd", 4, 3,
+                              4),
+            BM_SERIAL_OK);
+  EXPECT_EQ(a_to_b[0][0], BM_SERIAL_PUB);
+}
+
+TEST_F(AliasTest, Evict) {
+  // One more topic than fits, the oldest is evicted and its alias reused
+  for (int idx = 0; idx <= BM_SERIAL_ALIAS_ENTRIES; idx++) {
+    ASSERT_EQ(pub(topic(idx), idx), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(a_alias.stats.tx_evictions, 1u);
+
+  // Topic 1 is the oldest now
+  ASSERT_EQ(pub(topic(0), 100), BM_SERIAL_OK);
+  ASSERT_EQ(pub(topic(BM_SERIAL_ALIAS_ENTRIES), 101), BM_SERIAL_OK);
+  EXPECT_EQ(a_alias.stats.tx_evictions, 2u);
+  EXPECT_EQ(a_alias.stats.tx_hits, 1u);
+
+  while (!a_to_b.empty()) {
+    EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  }
+  ASSERT_EQ(received.size(), BM_SERIAL_ALIAS_ENTRIES + 3u);
+  for (int idx = 0; idx <= BM_SERIAL_ALIAS_ENTRIES; idx++) {
+    EXPECT_EQ(received[idx].topic, topic(idx));
+    EXPECT_EQ(received[idx].value, (uint32_t)idx);
+  }
+  EXPECT_EQ(received[BM_SERIAL_ALIAS_ENTRIES + 1].topic, topic(0));
+  EXPECT_EQ(received[BM_SERIAL_ALIAS_ENTRIES + 2].topic,
+            topic(BM_SERIAL_ALIAS_ENTRIES));
+  EXPECT_EQ(b_alias.stats.rx_evictions, 0u);
+}
+
+TEST_F(AliasTest, Unknown) {
+  std::string name = topic(7);
+
+  // Registration lost
+  ASSERT_EQ(pub(name, 1), BM_SERIAL_OK);
+  a_to_b.clear();
+  ASSERT_EQ(pub(name, 2), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_UNKNOWN_ALIAS);
+  EXPECT_TRUE(received.empty());
+  ASSERT_EQ(b_to_a.size(), 1u);
+  EXPECT_EQ(b_to_a[0][0], BM_SERIAL_ALIAS_RESET);
+  deliver_resets();
+  EXPECT_EQ(a_alias.stats.resets_received, 1u);
+
+  // Registered again
+  ASSERT_EQ(pub(name, 3), BM_SERIAL_OK);
+  ASSERT_EQ(pub(name, 4), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  ASSERT_EQ(received.size(), 2u);
+  EXPECT_EQ(received[0].topic, name);
+  EXPECT_EQ(received[1].topic, name);
+  EXPECT_EQ(received[1].value, 4u);
+
+  // Receiver restarted
+  ASSERT_EQ(bm_serial_alias_init(&b_alias, &b_ctx), BM_SERIAL_OK);
+  ASSERT_EQ(pub(name, 5), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_UNKNOWN_ALIAS);
+  deliver_resets();
+  ASSERT_EQ(pub(name, 6), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  EXPECT_EQ(received.back().topic, name);
+  EXPECT_EQ(received.back().value, 6u);
+}
+
+// Alias asked for in a reset frame
+static uint16_t reset_alias(const frame_t &frame) {
+  bm_serial_alias_reset_t reset;
+  EXPECT_EQ(frame.size(), sizeof(bm_serial_packet_t) + sizeof(reset));
+  memcpy(&reset, &frame[sizeof(bm_serial_packet_t)], sizeof(reset));
+  return reset.alias;
+}
+
+TEST_F(AliasTest, EvictLost) {
+  for (int idx = 0; idx < BM_SERIAL_ALIAS_ENTRIES; idx++) {
+    ASSERT_EQ(pub(topic(idx), idx), BM_SERIAL_OK);
+    EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  }
+  received.clear();
+
+  // Topic 0's alias goes to a new topic, and that registration is lost
+  std::string name = topic(BM_SERIAL_ALIAS_ENTRIES);
+  ASSERT_EQ(pub(name, 100), BM_SERIAL_OK);
+  EXPECT_EQ(a_alias.stats.tx_evictions, 1u);
+  a_to_b.clear();
+
+  // Receiver still has the alias for topic 0, the pub isn't delivered as that
+  ASSERT_EQ(pub(name, 101), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_UNKNOWN_ALIAS);
+  EXPECT_TRUE(received.empty());
+  EXPECT_EQ(b_alias.stats.rx_stale, 1u);
+  ASSERT_EQ(b_to_a.size(), 1u);
+  EXPECT_EQ(reset_alias(b_to_a[0]), a_alias.tx[0].alias);
+  deliver_resets();
+
+  ASSERT_EQ(pub(name, 102), BM_SERIAL_OK);
+  ASSERT_EQ(pub(name, 103), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  ASSERT_EQ(received.size(), 2u);
+  EXPECT_EQ(received[0].topic, name);
+  EXPECT_EQ(received[0].value, 102u);
+  EXPECT_EQ(received[1].topic, name);
+  EXPECT_EQ(received[1].value, 103u);
+}
+
+TEST_F(AliasTest, SendFailed) {
+  std::string name = topic(7);
+
+  // Registration never went out, the next pub carries the topic again
+  a_tx_fail = true;
+  EXPECT_EQ(pub(name, 1), BM_SERIAL_TX_ERR);
+  a_tx_fail = false;
+  ASSERT_EQ(pub(name, 2), BM_SERIAL_OK);
+  ASSERT_EQ(a_to_b.size(), 1u);
+  EXPECT_EQ(a_to_b[0].size(), sizeof(bm_serial_packet_t) +
+                                  sizeof(bm_serial_pub_alias_header_t) +
+                                  name.size() + sizeof(uint32_t));
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  ASSERT_EQ(received.size(), 1u);
+  EXPECT_EQ(received[0].topic, name);
+  EXPECT_EQ(a_alias.stats.tx_registrations, 2u);
+}
+
+TEST_F(AliasTest, Reserved) {
+  std::string name = topic(7);
+  std::string reply = topic(8);
+  uint32_t value = 9;
+  uint8_t *data;
+  a_ctx.callbacks.pub_fn = pub_fn;
+
+  ASSERT_EQ(pub(name, 1), BM_SERIAL_OK);
+  a_to_b.clear();
+  ASSERT_EQ(pub(name, 2), BM_SERIAL_OK);
+
+  // The reset waits for the pub being filled in, instead of overwriting it
+  ASSERT_EQ(bm_serial_ctx_pub_reserve(&b_ctx, 5678, reply.data(),
+                                      reply.size(), sizeof(value), 3, 4,
+                                      &data),
+            BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_UNKNOWN_ALIAS);
+  EXPECT_TRUE(b_to_a.empty());
+  memcpy(data, &value, sizeof(value));
+  ASSERT_EQ(bm_serial_ctx_commit(&b_ctx), BM_SERIAL_OK);
+
+  ASSERT_EQ(b_to_a.size(), 2u);
+  EXPECT_EQ(b_to_a[1][0], BM_SERIAL_ALIAS_RESET);
+  EXPECT_EQ(reset_alias(b_to_a[1]), a_alias.tx[0].alias);
+  deliver_resets();
+  ASSERT_EQ(received.size(), 1u);
+  EXPECT_EQ(received[0].topic, reply);
+  EXPECT_EQ(received[0].value, value);
+  EXPECT_EQ(a_alias.stats.resets_received, 1u);
+
+  // More than one alias waiting, all of them are reset
+  std::string other = topic(9);
+  ASSERT_EQ(pub(name, 3), BM_SERIAL_OK);
+  ASSERT_EQ(pub(other, 4), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_alias_init(&b_alias, &b_ctx), BM_SERIAL_OK);
+  ASSERT_EQ(pub(name, 5), BM_SERIAL_OK);
+  ASSERT_EQ(pub(other, 6), BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_ctx_pub_reserve(&b_ctx, 5678, reply.data(),
+                                      reply.size(), sizeof(value), 3, 4,
+                                      &data),
+            BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_UNKNOWN_ALIAS);
+  EXPECT_EQ(deliver(), BM_SERIAL_UNKNOWN_ALIAS);
+  EXPECT_TRUE(b_to_a.empty());
+
+  // Sent when the reservation is dropped too
+  ASSERT_EQ(bm_serial_ctx_pub_reserve(&b_ctx, 5678, reply.data(),
+                                      reply.size(), sizeof(value), 3, 4,
+                                      &data),
+            BM_SERIAL_OK);
+  ASSERT_EQ(b_to_a.size(), 1u);
+  EXPECT_EQ(reset_alias(b_to_a[0]), BM_SERIAL_ALIAS_ALL);
+  memcpy(data, &value, sizeof(value));
+  ASSERT_EQ(bm_serial_ctx_commit(&b_ctx), BM_SERIAL_OK);
+  received.clear();
+  deliver_resets();
+  ASSERT_EQ(received.size(), 1u);
+  EXPECT_EQ(received[0].topic, reply);
+  EXPECT_EQ(a_alias.stats.resets_received, 2u);
+
+  ASSERT_EQ(pub(name, 7), BM_SERIAL_OK);
+  ASSERT_EQ(pub(other, 8), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+}
+
+TEST_F(AliasTest, NoAlias) {
+  // Receiver without aliasing still takes registrations
+  b_ctx.alias = NULL;
+  ASSERT_EQ(pub(topic(1), 1), BM_SERIAL_OK);
+  ASSERT_EQ(pub(topic(1), 2), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_UNKNOWN_ALIAS);
+  EXPECT_EQ(received.size(), 1u);
+  EXPECT_TRUE(b_to_a.empty());
+}
+
+TEST_F(AliasTest, ReceiverEvict) {
+  // Receiver tracks fewer aliases than the sender uses
+  for (uint16_t idx = 0; idx <= BM_SERIAL_ALIAS_ENTRIES; idx++) {
+    std::string name = topic(idx);
+    bm_serial_alias_rx_set(&b_alias, idx + 100, 1, name.data(), name.size());
+  }
+  EXPECT_EQ(b_alias.stats.rx_evictions, 1u);
+
+  uint16_t topic_len;
+  EXPECT_EQ(bm_serial_alias_rx_get(&b_alias, 100, 1, &topic_len), nullptr);
+  const char *name = bm_serial_alias_rx_get(&b_alias, 101, 1, &topic_len);
+  ASSERT_NE(name, nullptr);
+  EXPECT_EQ(std::string(name, topic_len), topic(1));
+
+  // Most recently used survives
+  bm_serial_alias_rx_set(&b_alias, 999, 1, "x", 1);
+  EXPECT_NE(bm_serial_alias_rx_get(&b_alias, 101, 1, &topic_len), nullptr);
+  EXPECT_EQ(bm_serial_alias_rx_get(&b_alias, 102, 1, &topic_len), nullptr);
+
+  // Registering a known alias again replaces its topic
+  bm_serial_alias_rx_set(&b_alias, 999, 2, "yz", 2);
+  name = bm_serial_alias_rx_get(&b_alias, 999, 2, &topic_len);
+  ASSERT_NE(name, nullptr);
+  EXPECT_EQ(std::string(name, topic_len), "yz");
+
+  // Pub for the other generation of the alias
+  EXPECT_EQ(bm_serial_alias_rx_get(&b_alias, 999, 1, &topic_len), nullptr);
+  EXPECT_EQ(b_alias.stats.rx_stale, 1u);
+}
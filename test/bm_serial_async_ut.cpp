@@ -0,0 +1,293 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_async.h"
+#include "bm_serial_pool.h"
+
+#include <atomic>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+BM_SERIAL_POOL_STORAGE(async_small, 128, 8);
+BM_SERIAL_POOL_STORAGE(async_large, 2048, 2);
+
+static bm_serial_pool_class_t classes[] = {
+    BM_SERIAL_POOL_CLASS(async_small, 128, 8),
+    BM_SERIAL_POOL_CLASS(async_large, 2048, 2),
+};
+static bm_serial_pool_t pool;
+static bm_serial_ring_cell_t cells[4];
+static bm_serial_async_t async;
+static bm_serial_ctx_t tx_ctx;
+static bm_serial_ctx_t rx_ctx;
+
+// Fake driver
+static std::atomic<bool> in_flight;
+static const uint8_t *in_flight_buff;
+static size_t in_flight_len;
+static bool complete_now;
+static bool start_ok;
+static size_t num_started;
+
+// Receiving end
+static std::vector<uint32_t> rx_seqs;
+static std::vector<bool> completions;
+static std::vector<bool> watermarks;
+static std::mutex watermarks_mutex;
+
+static bool async_pub_fn(const char *topic, uint16_t topic_len,
+                         uint64_t node_id, const uint8_t *payload, size_t len,
+                         uint8_t type, uint8_t version) {
+  (void)topic;
+  (void)topic_len;
+  (void)node_id;
+  (void)type;
+  (void)version;
+  uint32_t seq;
+  EXPECT_GE(len, sizeof(seq));
+  memcpy(&seq, payload, sizeof(seq));
+  rx_seqs.push_back(seq);
+  return true;
+}
+
+static void deliver(const uint8_t *buff, size_t len) {
+  uint8_t packet[SERIAL_BUFF_LEN];
+  memcpy(packet, buff, len);
+  EXPECT_EQ(bm_serial_ctx_process_packet(&rx_ctx, (bm_serial_packet_t *)packet,
+                                         len),
+            BM_SERIAL_OK);
+}
+
+static bool tx_start_fn(void *arg, const uint8_t *buff, size_t len) {
+  (void)arg;
+  EXPECT_FALSE(in_flight.load());
+  num_started++;
+  if (!start_ok) {
+    return false;
+  }
+
+  in_flight_buff = buff;
+  in_flight_len = len;
+  in_flight = true;
+
+  // Blocking driver, finishes before returning
+  if (complete_now) {
+    deliver(buff, len);
+    in_flight = false;
+    bm_serial_async_tx_done(&async, true);
+  }
+  return true;
+}
+
+// Finish the transfer in flight, like the uart tx complete interrupt would
+static void finish_tx(bool success) {
+  ASSERT_TRUE(in_flight.load());
+  if (success) {
+    deliver(in_flight_buff, in_flight_len);
+  }
+  in_flight = false;
+  bm_serial_async_tx_done(&async, success);
+}
+
+static void complete_fn(void *arg, const bm_serial_pkt_t *pkt, bool success) {
+  (void)arg;
+  EXPECT_NE(pkt, nullptr);
+  completions.push_back(success);
+}
+
+static void watermark_fn(void *arg, bool above) {
+  (void)arg;
+  // Raised by producers, released by whoever is draining the ring
+  std::lock_guard<std::mutex> lock(watermarks_mutex);
+  watermarks.push_back(above);
+}
+
+static bm_serial_error_e pub_seq(uint32_t seq) {
+  uint8_t payload[sizeof(seq) + 16] = {};
+  memcpy(payload, &seq, sizeof(seq));
+  return bm_serial_ctx_pub(&tx_ctx, 0, "async", 5, payload, sizeof(payload), 0,
+                           0);
+}
+
+class AsyncTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_EQ(bm_serial_pool_init(&pool, classes, 2), BM_SERIAL_OK);
+
+    bm_serial_callbacks_t rx_callbacks = {};
+    rx_callbacks.pub_fn = async_pub_fn;
+    bm_serial_ctx_init(&rx_ctx, &rx_callbacks);
+
+    // tx_fn is never used in async mode
+    bm_serial_callbacks_t tx_callbacks = {};
+    tx_callbacks.tx_fn = [](const uint8_t *, size_t) {
+      ADD_FAILURE();
+      return false;
+    };
+    bm_serial_ctx_init(&tx_ctx, &tx_callbacks);
+
+    cfg = {};
+    cfg.tx_start_fn = tx_start_fn;
+    cfg.complete_fn = complete_fn;
+    cfg.watermark_fn = watermark_fn;
+    cfg.high_watermark = 3;
+    cfg.low_watermark = 1;
+    ASSERT_EQ(bm_serial_async_init(&async, &tx_ctx, &pool, cells, 4, &cfg),
+              BM_SERIAL_OK);
+
+    in_flight = false;
+    complete_now = false;
+    start_ok = true;
+    num_started = 0;
+    rx_seqs.clear();
+    completions.clear();
+    watermarks.clear();
+  }
+
+  bm_serial_async_cfg_t cfg;
+};
+
+TEST_F(AsyncTest, Errors) {
+  bm_serial_async_t bad;
+  EXPECT_EQ(bm_serial_async_init(&bad, &tx_ctx, NULL, cells, 4, &cfg),
+            BM_SERIAL_NULL_BUFF);
+  EXPECT_EQ(bm_serial_async_init(&bad, &tx_ctx, &pool, cells, 3, &cfg),
+            BM_SERIAL_MISC_ERR);
+
+  // Watermarks must fit in the ring
+  cfg.high_watermark = 5;
+  EXPECT_EQ(bm_serial_async_init(&bad, &tx_ctx, &pool, cells, 4, &cfg),
+            BM_SERIAL_MISC_ERR);
+  cfg.high_watermark = 1;
+  EXPECT_EQ(bm_serial_async_init(&bad, &tx_ctx, &pool, cells, 4, &cfg),
+            BM_SERIAL_MISC_ERR);
+
+  cfg.tx_start_fn = NULL;
+  EXPECT_EQ(bm_serial_async_init(&bad, &tx_ctx, &pool, cells, 4, &cfg),
+            BM_SERIAL_MISSING_CALLBACK);
+}
+
+TEST_F(AsyncTest, Queue) {
+  // First packet starts right away, the rest wait for the driver
+  for (uint32_t seq = 0; seq < 4; seq++) {
+    EXPECT_EQ(pub_seq(seq), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(num_started, 1u);
+  EXPECT_EQ(bm_serial_async_pending(&async), 3u);
+  EXPECT_TRUE(rx_seqs.empty());
+
+  // Backpressure once 3 are waiting
+  ASSERT_EQ(watermarks.size(), 1u);
+  EXPECT_TRUE(watermarks[0]);
+
+  // Ring is full
+  EXPECT_EQ(pub_seq(4), BM_SERIAL_OK);
+  EXPECT_EQ(pub_seq(5), BM_SERIAL_OUT_OF_MEMORY);
+  EXPECT_EQ(async.stats.dropped, 1u);
+  EXPECT_EQ(async.stats.max_depth, 4);
+
+  finish_tx(true);
+  finish_tx(false);
+  EXPECT_EQ(watermarks.size(), 1u);
+  finish_tx(true);
+  ASSERT_EQ(watermarks.size(), 2u);
+  EXPECT_FALSE(watermarks[1]);
+  finish_tx(true);
+  finish_tx(true);
+  EXPECT_FALSE(in_flight.load());
+  EXPECT_EQ(bm_serial_async_pending(&async), 0u);
+
+  ASSERT_EQ(rx_seqs.size(), 4u);
+  EXPECT_EQ(rx_seqs[0], 0u);
+  EXPECT_EQ(rx_seqs[1], 2u);
+  EXPECT_EQ(rx_seqs[2], 3u);
+  EXPECT_EQ(rx_seqs[3], 4u);
+  EXPECT_EQ(completions, std::vector<bool>({true, false, true, true, true}));
+  EXPECT_EQ(async.stats.enqueued, 5u);
+  EXPECT_EQ(async.stats.completed, 4u);
+  EXPECT_EQ(async.stats.failed, 1u);
+  EXPECT_EQ(tx_ctx.stats.tx_packets, 4u);
+  EXPECT_EQ(tx_ctx.stats.tx_errors, 1u);
+  EXPECT_EQ(classes[0].stats.in_use, 0);
+
+  // Idle again, next packet starts right away
+  EXPECT_EQ(pub_seq(6), BM_SERIAL_OK);
+  finish_tx(true);
+  EXPECT_EQ(rx_seqs.back(), 6u);
+}
+
+TEST_F(AsyncTest, BlockingDriver) {
+  // Completion from inside tx_start_fn doesn't recurse
+  complete_now = true;
+  for (uint32_t seq = 0; seq < 32; seq++) {
+    EXPECT_EQ(pub_seq(seq), BM_SERIAL_OK);
+  }
+  ASSERT_EQ(rx_seqs.size(), 32u);
+  EXPECT_EQ(rx_seqs[31], 31u);
+  EXPECT_EQ(completions.size(), 32u);
+  EXPECT_TRUE(watermarks.empty());
+
+  // Transfers that don't start are reported as failed
+  start_ok = false;
+  EXPECT_EQ(pub_seq(32), BM_SERIAL_OK);
+  EXPECT_EQ(completions.back(), false);
+  EXPECT_EQ(tx_ctx.stats.tx_errors, 1u);
+  EXPECT_EQ(classes[0].stats.in_use, 0);
+}
+
+TEST_F(AsyncTest, Threads) {
+  constexpr int num_producers = 4;
+  constexpr uint32_t pubs_per_producer = 500;
+  std::atomic<bool> done(false);
+
+  // Pretend uart interrupt, finishes whatever is in flight
+  std::thread uart([&]() {
+    while (!done.load() || in_flight.load()) {
+      if (in_flight.load()) {
+        finish_tx(true);
+      }
+      std::this_thread::yield();
+    }
+  });
+
+  std::vector<std::thread> producers;
+  for (int producer = 0; producer < num_producers; producer++) {
+    producers.emplace_back([&, producer]() {
+      for (uint32_t count = 0; count < pubs_per_producer;) {
+        uint32_t seq = producer * pubs_per_producer + count;
+        bm_serial_error_e rval = pub_seq(seq);
+        if (rval == BM_SERIAL_OUT_OF_MEMORY) {
+          // Ring or pool full, back off
+          std::this_thread::yield();
+          continue;
+        }
+        ASSERT_EQ(rval, BM_SERIAL_OK);
+        count++;
+      }
+    });
+  }
+
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  while (bm_serial_async_pending(&async) || in_flight.load()) {
+    std::this_thread::yield();
+  }
+  done = true;
+  uart.join();
+
+  // Every packet arrived, in order per producer
+  ASSERT_EQ(rx_seqs.size(), num_producers * pubs_per_producer);
+  uint32_t next[num_producers] = {};
+  for (uint32_t seq : rx_seqs) {
+    uint32_t producer = seq / pubs_per_producer;
+    EXPECT_EQ(seq % pubs_per_producer, next[producer]);
+    next[producer]++;
+  }
+  EXPECT_EQ(tx_ctx.stats.tx_packets, num_producers * pubs_per_producer);
+  EXPECT_EQ(classes[0].stats.in_use, 0);
+  // Backpressure released once drained
+  ASSERT_FALSE(watermarks.empty());
+  EXPECT_FALSE(watermarks.back());
+}
@@ -0,0 +1,316 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_batch.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+static bm_serial_ctx_t tx_ctx;
+static bm_serial_ctx_t rx_ctx;
+static bm_serial_batch_t batch;
+
+static uint32_t now;
+static uint32_t now_fn(void) { return now; }
+
+typedef std::vector<uint8_t> frame_t;
+static std::vector<frame_t> frames;
+
+struct pub_t {
+  std::string topic;
+  uint64_t node_id;
+  uint32_t value;
+};
+static std::vector<pub_t> received;
+static std::vector<std::string> logs;
+
+static bool tx_fn(const uint8_t *buff, size_t len) {
+  frames.emplace_back(buff, buff + len);
+  return true;
+}
+
+static bool pub_fn(const char *topic, uint16_t topic_len, uint64_t node_id,
+                   const uint8_t *payload, size_t len, uint8_t type,
+                   uint8_t version) {
+  (void)type;
+  (void)version;
+  pub_t pub = {std::string(topic, topic_len), node_id, 0};
+  EXPECT_EQ(len, sizeof(pub.value));
+  memcpy(&pub.value, payload, sizeof(pub.value));
+  received.push_back(pub);
+  return true;
+}
+
+static bool log_fn(uint64_t node_id, const uint8_t *data, size_t len) {
+  (void)node_id;
+  logs.emplace_back((const char *)data, len);
+  return true;
+}
+
+// Deliver every frame sent so far
+static void deliver(void) {
+  for (auto &frame : frames) {
+    EXPECT_EQ(bm_serial_ctx_process_packet(
+                  &rx_ctx, (bm_serial_packet_t *)frame.data(), frame.size()),
+              BM_SERIAL_OK);
+  }
+  frames.clear();
+}
+
+static bm_serial_error_e pub(uint32_t value, uint64_t node_id = 1234) {
+  return bm_serial_batch_pub(&batch, node_id, "sensor/temp", 11,
+                             (const uint8_t *)&value, sizeof(value), 1, 1);
+}
+
+class BatchTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    bm_serial_callbacks_t tx_callbacks = {};
+    tx_callbacks.tx_fn = tx_fn;
+    bm_serial_ctx_init(&tx_ctx, &tx_callbacks);
+
+    bm_serial_callbacks_t rx_callbacks = {};
+    rx_callbacks.pub_fn = pub_fn;
+    rx_callbacks.log_fn = log_fn;
+    bm_serial_ctx_init(&rx_ctx, &rx_callbacks);
+
+    cfg.max_len = 256;
+    cfg.max_delay = 10;
+    cfg.now_fn = now_fn;
+    ASSERT_EQ(bm_serial_batch_init(&batch, &tx_ctx, &cfg), BM_SERIAL_OK);
+
+    now = 0;
+    frames.clear();
+    received.clear();
+    logs.clear();
+  }
+
+  bm_serial_batch_cfg_t cfg = {};
+};
+
+TEST_F(BatchTest, Errors) {
+  bm_serial_batch_t bad;
+  EXPECT_EQ(bm_serial_batch_init(&bad, NULL, &cfg), BM_SERIAL_NULL_BUFF);
+  cfg.max_len = BM_SERIAL_BATCH_MAX_LEN + 1;
+  EXPECT_EQ(bm_serial_batch_init(&bad, &tx_ctx, &cfg), BM_SERIAL_MISC_ERR);
+  cfg.max_len = sizeof(bm_serial_batch_entry_t);
+  EXPECT_EQ(bm_serial_batch_init(&bad, &tx_ctx, &cfg), BM_SERIAL_MISC_ERR);
+
+  uint8_t data[4] = {};
+  EXPECT_EQ(bm_serial_batch_tx(&batch, BM_SERIAL_ACK, data, sizeof(data)),
+            BM_SERIAL_UNSUPPORTED_MSG);
+  EXPECT_EQ(bm_serial_batch_tx(&batch, BM_SERIAL_BATCH, data, sizeof(data)),
+            BM_SERIAL_UNSUPPORTED_MSG);
+  EXPECT_EQ(bm_serial_batch_tx(&batch, BM_SERIAL_LOG, NULL, 0),
+            BM_SERIAL_NULL_BUFF);
+  EXPECT_EQ(bm_serial_batch_pub(&batch, 0, NULL, 0, NULL, 0, 0, 0),
+            BM_SERIAL_NULL_BUFF);
+
+  // Same checks as bm_serial_pub()
+  std::string topic(65, 't');
+  EXPECT_EQ(bm_serial_batch_pub(&batch, 0, topic.data(), topic.size(), data,
+                                sizeof(data), 0, 0),
+            BM_SERIAL_INVALID_TOPIC_LEN);
+  tx_ctx.callbacks.tx_fn = NULL;
+  EXPECT_EQ(bm_serial_batch_pub(&batch, 0, "sensor/temp", 11, data,
+                                sizeof(data), 0, 0),
+            BM_SERIAL_MISSING_CALLBACK);
+  EXPECT_EQ(batch.count, 0);
+}
+
+TEST_F(BatchTest, Deadline) {
+  for (uint32_t value = 0; value < 3; value++) {
+    EXPECT_EQ(pub(value), BM_SERIAL_OK);
+    now++;
+  }
+  EXPECT_EQ(bm_serial_batch_poll(&batch), BM_SERIAL_OK);
+  EXPECT_TRUE(frames.empty());
+
+  now = 10;
+  EXPECT_EQ(bm_serial_batch_poll(&batch), BM_SERIAL_OK);
+  ASSERT_EQ(frames.size(), 1u);
+  EXPECT_EQ(((bm_serial_packet_t *)frames[0].data())->type, BM_SERIAL_BATCH);
+  EXPECT_EQ(batch.stats.deadline_flushes, 1u);
+  EXPECT_EQ(batch.stats.batches, 1u);
+
+  deliver();
+  ASSERT_EQ(received.size(), 3u);
+  for (uint32_t value = 0; value < 3; value++) {
+    EXPECT_EQ(received[value].topic, "sensor/temp");
+    EXPECT_EQ(received[value].node_id, 1234u);
+    EXPECT_EQ(received[value].value, value);
+  }
+  EXPECT_EQ(rx_ctx.stats.rx_packets, 1u);
+
+  // Nothing pending
+  now = 100;
+  EXPECT_EQ(bm_serial_batch_poll(&batch), BM_SERIAL_OK);
+  EXPECT_TRUE(frames.empty());
+}
+
+TEST_F(BatchTest, Size) {
+  // 4 + 12 + 11 + 4 bytes per entry, 8 fit in 256
+  for (uint32_t value = 0; value < 20; value++) {
+    EXPECT_EQ(pub(value, value % 2), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(frames.size(), 2u);
+  EXPECT_EQ(batch.stats.size_flushes, 2u);
+  EXPECT_EQ(batch.count, 4);
+
+  EXPECT_EQ(bm_serial_batch_flush(&batch), BM_SERIAL_OK);
+  EXPECT_EQ(frames.size(), 3u);
+  deliver();
+  ASSERT_EQ(received.size(), 20u);
+  for (uint32_t value = 0; value < 20; value++) {
+    EXPECT_EQ(received[value].value, value);
+    EXPECT_EQ(received[value].node_id, value % 2);
+  }
+  EXPECT_EQ(batch.stats.repeats, 0u);
+}
+
+TEST_F(BatchTest, Repeat) {
+  // First pub has the header, the next ones only their data
+  for (uint32_t value = 0; value < 5; value++) {
+    EXPECT_EQ(pub(value), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(batch.stats.repeats, 4u);
+  EXPECT_EQ(batch.len, 31 + 4 * 8);
+
+  // Anything else in between is fine, a different header starts over
+  EXPECT_EQ(bm_serial_batch_tx(&batch, BM_SERIAL_LOG, (const uint8_t *)"a", 1),
+            BM_SERIAL_OK);
+  EXPECT_EQ(pub(5), BM_SERIAL_OK);
+  EXPECT_EQ(pub(6, 99), BM_SERIAL_OK);
+  EXPECT_EQ(pub(7, 99), BM_SERIAL_OK);
+  EXPECT_EQ(batch.stats.repeats, 6u);
+
+  // Raw pubs aren't repeated
+  uint8_t raw[sizeof(bm_serial_pub_header_t) + 4] = {};
+  bm_serial_pub_header_t *header = (bm_serial_pub_header_t *)raw;
+  header->node_id = 5;
+  EXPECT_EQ(bm_serial_batch_tx(&batch, BM_SERIAL_PUB, raw, sizeof(raw)),
+            BM_SERIAL_OK);
+  EXPECT_EQ(pub(8, 99), BM_SERIAL_OK);
+  EXPECT_EQ(batch.stats.repeats, 6u);
+
+  EXPECT_EQ(bm_serial_batch_flush(&batch), BM_SERIAL_OK);
+  ASSERT_EQ(frames.size(), 1u);
+  deliver();
+  ASSERT_EQ(received.size(), 10u);
+  const uint64_t node_ids[] = {1234, 1234, 1234, 1234, 1234,
+                               1234, 99,   99,   5,    99};
+  const uint32_t values[] = {0, 1, 2, 3, 4, 5, 6, 7, 0, 8};
+  for (size_t idx = 0; idx < received.size(); idx++) {
+    EXPECT_EQ(received[idx].topic, idx == 8 ? "" : "sensor/temp");
+    EXPECT_EQ(received[idx].node_id, node_ids[idx]);
+    EXPECT_EQ(received[idx].value, values[idx]);
+  }
+  EXPECT_EQ(logs.size(), 1u);
+}
+
+TEST_F(BatchTest, Single) {
+  // Sent as is, no batch wrapper
+  EXPECT_EQ(pub(7), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_batch_flush(&batch), BM_SERIAL_OK);
+  ASSERT_EQ(frames.size(), 1u);
+  EXPECT_EQ(((bm_serial_packet_t *)frames[0].data())->type, BM_SERIAL_PUB);
+  EXPECT_EQ(batch.stats.singles, 1u);
+
+  deliver();
+  ASSERT_EQ(received.size(), 1u);
+  EXPECT_EQ(received[0].value, 7u);
+
+  // No delay, everything goes out right away
+  cfg.max_delay = 0;
+  ASSERT_EQ(bm_serial_batch_init(&batch, &tx_ctx, &cfg), BM_SERIAL_OK);
+  EXPECT_EQ(pub(8), BM_SERIAL_OK);
+  EXPECT_EQ(frames.size(), 1u);
+}
+
+TEST_F(BatchTest, Direct) {
+  EXPECT_EQ(pub(1), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_batch_tx(&batch, BM_SERIAL_LOG, (const uint8_t *)"a", 1),
+            BM_SERIAL_OK);
+
+  // Too big to batch, the pending batch goes first
+  std::string big(300, 'x');
+  EXPECT_EQ(bm_serial_batch_tx(&batch, BM_SERIAL_LOG,
+                               (const uint8_t *)big.data(), big.size()),
+            BM_SERIAL_OK);
+  ASSERT_EQ(frames.size(), 2u);
+  EXPECT_EQ(((bm_serial_packet_t *)frames[0].data())->type, BM_SERIAL_BATCH);
+  EXPECT_EQ(((bm_serial_packet_t *)frames[1].data())->type, BM_SERIAL_LOG);
+  EXPECT_EQ(batch.stats.direct, 1u);
+
+  deliver();
+  ASSERT_EQ(received.size(), 1u);
+  ASSERT_EQ(logs.size(), 2u);
+  EXPECT_EQ(logs[0], "a");
+  EXPECT_EQ(logs[1], big);
+}
+
+TEST_F(BatchTest, Overhead) {
+  bm_serial_ctx_set_cobs_tx(&tx_ctx, true);
+  for (uint32_t value = 0; value < 64; value++) {
+    uint32_t data = value | 0x01010100;
+    EXPECT_EQ(bm_serial_ctx_pub(&tx_ctx, 1234, "sensor/temp", 11,
+                                (const uint8_t *)&data, sizeof(data), 1, 1),
+              BM_SERIAL_OK);
+  }
+  uint32_t unbatched = tx_ctx.stats.tx_bytes;
+
+  tx_ctx.stats.tx_bytes = 0;
+  cfg.max_len = BM_SERIAL_BATCH_MAX_LEN;
+  ASSERT_EQ(bm_serial_batch_init(&batch, &tx_ctx, &cfg), BM_SERIAL_OK);
+  for (uint32_t value = 0; value < 64; value++) {
+    EXPECT_EQ(pub(value | 0x01010100), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(bm_serial_batch_flush(&batch), BM_SERIAL_OK);
+  EXPECT_LT(tx_ctx.stats.tx_bytes * 3, unbatched);
+}
+
+TEST_F(BatchTest, Malformed) {
+  uint8_t payload[64] = {};
+  bm_serial_batch_entry_t *entry = (bm_serial_batch_entry_t *)payload;
+  entry->type = BM_SERIAL_LOG;
+  entry->len = 2;
+  memcpy(entry->payload, "hi", 2);
+
+  // Nested batch is skipped, the other entries still get through
+  entry = (bm_serial_batch_entry_t *)&payload[6];
+  entry->type = BM_SERIAL_BATCH;
+  entry->len = 0;
+  entry = (bm_serial_batch_entry_t *)&payload[10];
+  entry->type = BM_SERIAL_LOG;
+  entry->len = 2;
+  memcpy(entry->payload, "yo", 2);
+  EXPECT_EQ(bm_serial_ctx_tx(&tx_ctx, BM_SERIAL_BATCH, payload, 16),
+            BM_SERIAL_OK);
+  ASSERT_EQ(frames.size(), 1u);
+  EXPECT_EQ(bm_serial_ctx_process_packet(
+                &rx_ctx, (bm_serial_packet_t *)frames[0].data(),
+                frames[0].size()),
+            BM_SERIAL_UNSUPPORTED_MSG);
+  ASSERT_EQ(logs.size(), 2u);
+  EXPECT_EQ(logs[1], "yo");
+  frames.clear();
+
+  // Entry runs past the end of the packet
+  entry->len = 40;
+  EXPECT_EQ(bm_serial_ctx_tx(&tx_ctx, BM_SERIAL_BATCH, payload, 16),
+            BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_ctx_process_packet(
+                &rx_ctx, (bm_serial_packet_t *)frames[0].data(),
+                frames[0].size()),
+            BM_SERIAL_INVALID_MSG_LEN);
+  EXPECT_EQ(logs.size(), 3u);
+  frames.clear();
+
+  // Truncated header
+  EXPECT_EQ(bm_serial_ctx_tx(&tx_ctx, BM_SERIAL_BATCH, payload, 8),
+            BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_ctx_process_packet(
+                &rx_ctx, (bm_serial_packet_t *)frames[0].data(),
+                frames[0].size()),
+            BM_SERIAL_INVALID_MSG_LEN);
+}
@@ -0,0 +1,347 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_cache.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Host getting values, node whose replies go straight to the host
+static bm_serial_ctx_t cache_host;
+static bm_serial_ctx_t cache_node;
+static bm_serial_cache_t cache;
+static uint32_t cache_now;
+static size_t cache_sent;
+static size_t cache_hooked;
+
+struct cache_value_t {
+  uint64_t node_id;
+  bm_common_config_partition_e partition;
+  uint32_t data;
+};
+static std::vector<cache_value_t> cache_values;
+
+static uint32_t cache_now_fn(void) { return cache_now; }
+
+static bool cache_host_tx_fn(const uint8_t *buff, size_t len) {
+  (void)buff;
+  (void)len;
+  cache_sent++;
+  return true;
+}
+
+static bool cache_node_tx_fn(const uint8_t *buff, size_t len) {
+  std::vector<uint8_t> packet(buff, buff + len);
+  EXPECT_EQ(bm_serial_ctx_process_packet(&cache_host,
+                                         (bm_serial_packet_t *)packet.data(),
+                                         len),
+            BM_SERIAL_OK);
+  return true;
+}
+
+static bool cache_cfg_value_fn(uint64_t node_id,
+                               bm_common_config_partition_e partition,
+                               uint32_t data_length, void *data) {
+  uint32_t value = 0;
+  EXPECT_EQ(data_length, sizeof(value));
+  memcpy(&value, data, sizeof(value));
+  cache_values.push_back({node_id, partition, value});
+  return true;
+}
+
+static bool cache_rx_hook(void *arg, uint8_t type, const uint8_t *payload,
+                          size_t len) {
+  (void)arg;
+  (void)payload;
+  (void)len;
+  if (type == BM_SERIAL_CFG_VALUE) {
+    cache_hooked++;
+  }
+  return false;
+}
+
+static uint32_t cache_ttl_fn(void *arg, uint64_t node_id,
+                             bm_common_config_partition_e partition,
+                             size_t key_len, const char *key) {
+  (void)arg;
+  (void)node_id;
+  (void)partition;
+  std::string name(key, key_len);
+  return (name == "volatile") ? 0 : (name == "short") ? 10 : 1000;
+}
+
+static bm_serial_error_e get(uint64_t node_id, const char *key,
+                             bm_common_config_partition_e partition =
+                                 BM_COMMON_CFG_PARTITION_USER) {
+  return bm_serial_ctx_cfg_get(&cache_host, node_id, partition, strlen(key),
+                               key);
+}
+
+static void value(uint64_t node_id, uint32_t data,
+                  bm_common_config_partition_e partition =
+                      BM_COMMON_CFG_PARTITION_USER) {
+  ASSERT_EQ(bm_serial_ctx_cfg_value(&cache_node, node_id, partition,
+                                    sizeof(data), &data),
+            BM_SERIAL_OK);
+}
+
+class CacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    bm_serial_callbacks_t callbacks = {};
+    callbacks.tx_fn = cache_host_tx_fn;
+    callbacks.cfg_value_fn = cache_cfg_value_fn;
+    bm_serial_ctx_init(&cache_host, &callbacks);
+    bm_serial_ctx_set_cobs_tx(&cache_host, false);
+
+    callbacks = {};
+    callbacks.tx_fn = cache_node_tx_fn;
+    bm_serial_ctx_init(&cache_node, &callbacks);
+    bm_serial_ctx_set_cobs_tx(&cache_node, false);
+
+    bm_serial_cache_cfg_t cfg = {};
+    cfg.ttl = 100;
+    cfg.reply_timeout = 50;
+    cfg.now_fn = cache_now_fn;
+    ASSERT_EQ(bm_serial_cache_init(&cache, &cache_host, &cfg), BM_SERIAL_OK);
+
+    cache_now = 0;
+    cache_sent = 0;
+    cache_hooked = 0;
+    cache_values.clear();
+  }
+};
+
+TEST_F(CacheTest, Hit) {
+  ASSERT_EQ(get(1234, "key"), BM_SERIAL_OK);
+  EXPECT_EQ(cache_sent, 1u);
+  value(1234, 7);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 1u);
+
+  // Answered right away, through the hook and the callback
+  bm_serial_ctx_set_rx_hook(&cache_host, cache_rx_hook, NULL);
+  cache_now = 99;
+  ASSERT_EQ(get(1234, "key"), BM_SERIAL_OK);
+  EXPECT_EQ(cache_sent, 1u);
+  EXPECT_EQ(cache_hooked, 1u);
+  ASSERT_EQ(cache_values.size(), 2u);
+  EXPECT_EQ(cache_values[1].node_id, 1234u);
+  EXPECT_EQ(cache_values[1].partition, BM_COMMON_CFG_PARTITION_USER);
+  EXPECT_EQ(cache_values[1].data, 7u);
+
+  // Other nodes, partitions and keys aren't
+  ASSERT_EQ(get(5678, "key"), BM_SERIAL_OK);
+  ASSERT_EQ(get(1234, "key", BM_COMMON_CFG_PARTITION_SYSTEM), BM_SERIAL_OK);
+  ASSERT_EQ(get(1234, "ke"), BM_SERIAL_OK);
+  EXPECT_EQ(cache_sent, 4u);
+
+  // ttl ran out
+  cache_now = 100;
+  ASSERT_EQ(get(1234, "key"), BM_SERIAL_OK);
+  EXPECT_EQ(cache_sent, 5u);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 0u);
+
+  EXPECT_EQ(cache.stats.hits, 1u);
+  EXPECT_EQ(cache.stats.misses, 5u);
+  EXPECT_EQ(cache.stats.stores, 1u);
+  EXPECT_EQ(cache.stats.expired, 1u);
+}
+
+TEST_F(CacheTest, Order) {
+  // Values answer the gets in the order sent
+  ASSERT_EQ(get(1234, "a"), BM_SERIAL_OK);
+  ASSERT_EQ(get(5678, "a"), BM_SERIAL_OK);
+  ASSERT_EQ(get(1234, "b"), BM_SERIAL_OK);
+  value(1234, 1);
+  value(1234, 2);
+  value(5678, 3);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 3u);
+
+  cache_values.clear();
+  ASSERT_EQ(get(1234, "b"), BM_SERIAL_OK);
+  ASSERT_EQ(get(5678, "a"), BM_SERIAL_OK);
+  ASSERT_EQ(get(1234, "a"), BM_SERIAL_OK);
+  EXPECT_EQ(cache_sent, 3u);
+  ASSERT_EQ(cache_values.size(), 3u);
+  EXPECT_EQ(cache_values[0].data, 2u);
+  EXPECT_EQ(cache_values[1].data, 3u);
+  EXPECT_EQ(cache_values[2].data, 1u);
+
+  // Nobody asked
+  value(1234, 4);
+  EXPECT_EQ(cache.stats.stores, 3u);
+
+  // Once a get goes unanswered, a late value could be anyone's
+  bm_serial_cache_flush(&cache);
+  ASSERT_EQ(get(1234, "a"), BM_SERIAL_OK);
+  cache_now = 30;
+  ASSERT_EQ(get(1234, "b"), BM_SERIAL_OK);
+  cache_now = 50;
+  value(1234, 5);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 0u);
+
+  // Back in sync
+  ASSERT_EQ(get(1234, "b"), BM_SERIAL_OK);
+  value(1234, 6);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 1u);
+}
+
+TEST_F(CacheTest, InFlight) {
+  ASSERT_EQ(get(1234, "b"), BM_SERIAL_OK);
+  value(1234, 2);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 1u);
+
+  // "b" is cached, but answering it now would overtake the get for "a"
+  cache_values.clear();
+  ASSERT_EQ(get(1234, "a"), BM_SERIAL_OK);
+  ASSERT_EQ(get(1234, "b"), BM_SERIAL_OK);
+  EXPECT_EQ(cache_sent, 3u);
+  EXPECT_TRUE(cache_values.empty());
+
+  // Other nodes and partitions still hit
+  ASSERT_EQ(get(5678, "x"), BM_SERIAL_OK);
+  value(5678, 9);
+  ASSERT_EQ(get(5678, "x"), BM_SERIAL_OK);
+  EXPECT_EQ(cache_sent, 4u);
+
+  value(1234, 1);
+  value(1234, 2);
+  ASSERT_EQ(cache_values.size(), 4u);
+  EXPECT_EQ(cache_values[0].data, 9u);
+  EXPECT_EQ(cache_values[1].data, 9u);
+  EXPECT_EQ(cache_values[2].data, 1u);
+  EXPECT_EQ(cache_values[3].data, 2u);
+
+  // Nothing in flight, both hit
+  ASSERT_EQ(get(1234, "a"), BM_SERIAL_OK);
+  ASSERT_EQ(get(1234, "b"), BM_SERIAL_OK);
+  EXPECT_EQ(cache_sent, 4u);
+  ASSERT_EQ(cache_values.size(), 6u);
+  EXPECT_EQ(cache_values[4].data, 1u);
+  EXPECT_EQ(cache_values[5].data, 2u);
+
+  // A get that went unanswered stops holding hits back after reply_timeout
+  ASSERT_EQ(get(1234, "c"), BM_SERIAL_OK);
+  ASSERT_EQ(get(1234, "b"), BM_SERIAL_OK);
+  EXPECT_EQ(cache_sent, 6u);
+  cache_now = 50;
+  ASSERT_EQ(get(1234, "b"), BM_SERIAL_OK);
+  EXPECT_EQ(cache_sent, 6u);
+  EXPECT_EQ(cache_values.back().data, 2u);
+}
+
+TEST_F(CacheTest, Invalidate) {
+  for (const char *key : {"a", "b"}) {
+    for (uint64_t node_id : {1234, 5678}) {
+      ASSERT_EQ(get(node_id, key), BM_SERIAL_OK);
+      value(node_id, 1);
+    }
+  }
+  ASSERT_EQ(get(1234, "a", BM_COMMON_CFG_PARTITION_SYSTEM), BM_SERIAL_OK);
+  value(1234, 1, BM_COMMON_CFG_PARTITION_SYSTEM);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 5u);
+
+  uint32_t data = 2;
+  ASSERT_EQ(bm_serial_ctx_cfg_set(&cache_host, 1234,
+                                  BM_COMMON_CFG_PARTITION_USER, 1, "a",
+                                  sizeof(data), &data),
+            BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 4u);
+
+  ASSERT_EQ(bm_serial_ctx_cfg_delete_response(&cache_node, 5678,
+                                              BM_COMMON_CFG_PARTITION_USER, 1,
+                                              "b", true),
+            BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 3u);
+
+  // The whole partition, only on that node
+  ASSERT_EQ(bm_serial_ctx_cfg_commit(&cache_node, 1234,
+                                     BM_COMMON_CFG_PARTITION_USER),
+            BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 2u);
+  cache_sent = 0;
+  ASSERT_EQ(get(5678, "a"), BM_SERIAL_OK);
+  ASSERT_EQ(get(1234, "a", BM_COMMON_CFG_PARTITION_SYSTEM), BM_SERIAL_OK);
+  EXPECT_EQ(cache_sent, 0u);
+
+  // A set while the get is in flight, the old value isn't cached
+  ASSERT_EQ(get(1234, "b"), BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_ctx_cfg_set(&cache_host, 1234,
+                                  BM_COMMON_CFG_PARTITION_USER, 1, "b",
+                                  sizeof(data), &data),
+            BM_SERIAL_OK);
+  value(1234, 1);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 2u);
+
+  // Config crc changes drop the partition on every node
+  bm_common_config_crc_t crc = {BM_COMMON_CFG_PARTITION_SYSTEM, 1};
+  bm_common_fw_version_t fw_info = {};
+  uint64_t nodes[] = {1234, 5678};
+  uint8_t map[] = {0xa0};
+  ASSERT_EQ(bm_serial_ctx_send_network_info(&cache_node, 0, &crc, &fw_info, 2,
+                                            nodes, sizeof(map), map),
+            BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_ctx_send_network_info(&cache_node, 0, &crc, &fw_info, 2,
+                                            nodes, sizeof(map), map),
+            BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 2u);
+  crc.crc32 = 2;
+  ASSERT_EQ(bm_serial_ctx_send_network_info(&cache_node, 0, &crc, &fw_info, 2,
+                                            nodes, sizeof(map), map),
+            BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 1u);
+
+  bm_serial_cache_flush(&cache);
+  EXPECT_EQ(bm_serial_cache_count(&cache), 0u);
+  EXPECT_EQ(cache.stats.invalidated, 5u);
+}
+
+TEST_F(CacheTest, Ttl) {
+  bm_serial_cache_cfg_t cfg = cache.cfg;
+  cfg.ttl_fn = cache_ttl_fn;
+  cfg.reply_timeout = 10000;
+  ASSERT_EQ(bm_serial_cache_init(&cache, &cache_host, &cfg), BM_SERIAL_OK);
+
+  for (const char *key : {"volatile", "short", "long"}) {
+    ASSERT_EQ(get(1234, key), BM_SERIAL_OK);
+    value(1234, 1);
+  }
+  EXPECT_EQ(bm_serial_cache_count(&cache), 2u);
+
+  cache_now = 10;
+  cache_sent = 0;
+  for (const char *key : {"long", "volatile", "short"}) {
+    ASSERT_EQ(get(1234, key), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(cache_sent, 2u);
+  EXPECT_EQ(cache.stats.hits, 1u);
+
+  // Answered so they don't hold back hits, "short" dropped again
+  value(1234, 1);
+  value(1234, 1);
+  bm_serial_cache_invalidate(&cache, 1234, BM_COMMON_CFG_PARTITION_USER, 5,
+                             "short");
+  EXPECT_EQ(bm_serial_cache_count(&cache), 1u);
+
+  // Full, the oldest goes
+  for (int idx = 0; idx < BM_SERIAL_CACHE_ENTRIES; idx++) {
+    std::string key = std::to_string(idx);
+    cache_now = 20 + idx;
+    ASSERT_EQ(get(1, key.c_str()), BM_SERIAL_OK);
+    value(1, idx);
+  }
+  EXPECT_EQ(bm_serial_cache_count(&cache), BM_SERIAL_CACHE_ENTRIES);
+  EXPECT_EQ(cache.stats.evicted, 1u);
+  cache_sent = 0;
+  ASSERT_EQ(get(1234, "long"), BM_SERIAL_OK);
+  ASSERT_EQ(get(1, "0"), BM_SERIAL_OK);
+  ASSERT_EQ(get(1, "1"), BM_SERIAL_OK);
+  EXPECT_EQ(cache_sent, 1u);
+
+  // Too long to cache
+  std::string key(BM_SERIAL_CACHE_KEY_LEN + 1, 'k');
+  ASSERT_EQ(get(1, key.c_str()), BM_SERIAL_OK);
+  value(1, 1);
+  ASSERT_EQ(get(1, key.c_str()), BM_SERIAL_OK);
+  EXPECT_EQ(cache_sent, 3u);
+}
@@ -0,0 +1,270 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_cobs.h"
+
+#include <string.h>
+
+static bm_serial_callbacks_t _callbacks;
+
+// Everything transmitted gets appended here, like bytes on a wire
+static uint8_t wire_buff[4096];
+static size_t wire_len;
+
+static uint8_t rx_buff[2048];
+static bm_serial_cobs_rx_t rx;
+
+class COBSTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    memset(&_callbacks, 0, sizeof(_callbacks));
+    bm_serial_set_callbacks(&_callbacks);
+    bm_serial_set_cobs_tx(true);
+
+    memset(wire_buff, 0x00, sizeof(wire_buff));
+    wire_len = 0;
+
+    bm_serial_cobs_rx_init(&rx, rx_buff, sizeof(rx_buff));
+  }
+
+  void TearDown() override {
+    bm_serial_set_cobs_tx(false);
+  }
+};
+
+static bool wire_tx_fn(const uint8_t *buff, size_t len) {
+  if(wire_len + len > sizeof(wire_buff)) {
+    return false;
+  }
+
+  memcpy(&wire_buff[wire_len], buff, len);
+  wire_len += len;
+
+  return true;
+}
+
+static uint32_t sub_count;
+static bool cobs_sub_fn(const char *topic, uint16_t topic_len) {
+  EXPECT_EQ(topic_len, sizeof("cobs_topic"));
+  EXPECT_STREQ(topic, "cobs_topic");
+  sub_count++;
+  return true;
+}
+
+static uint32_t pub_count;
+static size_t pub_len;
+static bool cobs_pub_fn(const char *topic, uint16_t topic_len, uint64_t node_id,
+                        const uint8_t *payload, size_t len, uint8_t type,
+                        uint8_t version) {
+  (void)topic;
+  (void)topic_len;
+  (void)node_id;
+  (void)type;
+  (void)version;
+
+  // Payload is a counting pattern with lots of zeros
+  for (size_t idx = 0; idx < len; idx++) {
+    EXPECT_EQ(payload[idx], (uint8_t)idx);
+  }
+  pub_len = len;
+  pub_count++;
+  return true;
+}
+
+TEST_F(COBSTest, EncodeDecode) {
+  uint8_t raw[1024];
+  uint8_t encoded[BM_SERIAL_COBS_MAX_ENCODED_LEN(sizeof(raw))];
+  uint8_t decoded[sizeof(raw)];
+
+  // Mix of zeros, short runs and runs longer than a single COBS block
+  for (size_t idx = 0; idx < sizeof(raw); idx++) {
+    raw[idx] = (idx % 300 < 3) ? 0 : (uint8_t)(idx | 1);
+  }
+
+  const size_t lens[] = {1, 2, 253, 254, 255, 508, sizeof(raw)};
+  for (size_t len : lens) {
+    size_t encoded_len = bm_serial_cobs_encode(raw, len, encoded, sizeof(encoded));
+    ASSERT_GT(encoded_len, len);
+    EXPECT_LE(encoded_len, BM_SERIAL_COBS_MAX_ENCODED_LEN(len));
+    EXPECT_EQ(memchr(encoded, 0, encoded_len), nullptr);
+
+    memset(decoded, 0xAA, sizeof(decoded));
+    EXPECT_EQ(bm_serial_cobs_decode(encoded, encoded_len, decoded, sizeof(decoded)), len);
+    EXPECT_EQ(memcmp(raw, decoded, len), 0);
+  }
+
+  // All zeros and no zeros
+  memset(raw, 0, sizeof(raw));
+  size_t encoded_len = bm_serial_cobs_encode(raw, sizeof(raw), encoded, sizeof(encoded));
+  EXPECT_EQ(encoded_len, sizeof(raw) + 1);
+  EXPECT_EQ(bm_serial_cobs_decode(encoded, encoded_len, encoded, encoded_len), sizeof(raw));
+  EXPECT_EQ(memcmp(raw, encoded, sizeof(raw)), 0);
+
+  memset(raw, 0x55, sizeof(raw));
+  encoded_len = bm_serial_cobs_encode(raw, sizeof(raw), encoded, sizeof(encoded));
+  EXPECT_EQ(bm_serial_cobs_decode(encoded, encoded_len, encoded, encoded_len), sizeof(raw));
+  EXPECT_EQ(memcmp(raw, encoded, sizeof(raw)), 0);
+}
+
+TEST_F(COBSTest, InPlaceEncode) {
+  uint8_t buff[BM_SERIAL_COBS_MAX_ENCODED_LEN(600)];
+  uint8_t raw[600];
+  uint8_t expected[sizeof(buff)];
+
+  for (size_t idx = 0; idx < sizeof(raw); idx++) {
+    raw[idx] = (idx % 17) ? (uint8_t)idx : 0;
+  }
+  size_t expected_len = bm_serial_cobs_encode(raw, sizeof(raw), expected, sizeof(expected));
+
+  uint8_t *src = &buff[BM_SERIAL_COBS_OVERHEAD(sizeof(raw))];
+  memcpy(src, raw, sizeof(raw));
+  EXPECT_EQ(bm_serial_cobs_encode(src, sizeof(raw), buff, sizeof(buff)), expected_len);
+  EXPECT_EQ(memcmp(buff, expected, expected_len), 0);
+}
+
+TEST_F(COBSTest, Kernels) {
+  const bm_serial_cobs_kernel_e kernels[] = {
+    BM_SERIAL_COBS_KERNEL_SCALAR,
+    BM_SERIAL_COBS_KERNEL_SSE2,
+    BM_SERIAL_COBS_KERNEL_AVX2,
+  };
+
+  uint8_t raw[SERIAL_BUFF_LEN];
+  for (size_t idx = 0; idx < sizeof(raw); idx++) {
+    // Zeros at irregular spacing so they land on every lane of a vector
+    raw[idx] = (idx * 7919 % 61) ? (uint8_t)(idx * 31 + 1) : 0;
+  }
+
+  uint8_t expected[BM_SERIAL_COBS_MAX_ENCODED_LEN(sizeof(raw))];
+  ASSERT_TRUE(bm_serial_cobs_set_kernel(BM_SERIAL_COBS_KERNEL_SCALAR));
+  size_t expected_len = bm_serial_cobs_encode(raw, sizeof(raw), expected, sizeof(expected));
+  ASSERT_GT(expected_len, 0u);
+
+  for (bm_serial_cobs_kernel_e kernel : kernels) {
+    if (!bm_serial_cobs_set_kernel(kernel)) {
+      continue;
+    }
+    EXPECT_EQ(bm_serial_cobs_get_kernel(), kernel);
+
+    // Every length/alignment combination around vector widths
+    for (size_t offset = 0; offset < 33; offset++) {
+      for (size_t len = 0; len < 100; len++) {
+        uint8_t encoded[BM_SERIAL_COBS_MAX_ENCODED_LEN(100)];
+        uint8_t decoded[100];
+        size_t encoded_len = bm_serial_cobs_encode(&raw[offset], len, encoded, sizeof(encoded));
+        ASSERT_GT(encoded_len, 0u);
+        EXPECT_EQ(memchr(encoded, 0, encoded_len), nullptr);
+        EXPECT_EQ(bm_serial_cobs_find_delimiter(encoded, encoded_len), encoded_len);
+        EXPECT_EQ(bm_serial_cobs_find_delimiter(&raw[offset], len),
+                  (const uint8_t *)(memchr(&raw[offset], 0, len) ?: &raw[offset + len]) - &raw[offset]);
+        EXPECT_EQ(bm_serial_cobs_decode(encoded, encoded_len, decoded, sizeof(decoded)), len);
+        EXPECT_EQ(memcmp(&raw[offset], decoded, len), 0);
+      }
+    }
+
+    uint8_t encoded[sizeof(expected)];
+    EXPECT_EQ(bm_serial_cobs_encode(raw, sizeof(raw), encoded, sizeof(encoded)), expected_len);
+    EXPECT_EQ(memcmp(encoded, expected, expected_len), 0);
+  }
+
+  EXPECT_TRUE(bm_serial_cobs_set_kernel(BM_SERIAL_COBS_KERNEL_AUTO));
+  EXPECT_NE(bm_serial_cobs_get_kernel(), BM_SERIAL_COBS_KERNEL_AUTO);
+}
+
+TEST_F(COBSTest, Errors) {
+  uint8_t buff[8];
+  uint8_t raw[] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+  // Output too small
+  EXPECT_EQ(bm_serial_cobs_encode(raw, sizeof(raw), buff, sizeof(raw)), 0u);
+
+  // Block runs past the end of the frame
+  uint8_t truncated[] = {0x05, 0x01, 0x02};
+  EXPECT_EQ(bm_serial_cobs_decode(truncated, sizeof(truncated), buff, sizeof(buff)), 0u);
+
+  // Delimiter in the middle of a frame
+  uint8_t delimited[] = {0x02, 0x01, 0x00, 0x02, 0x01};
+  EXPECT_EQ(bm_serial_cobs_decode(delimited, sizeof(delimited), buff, sizeof(buff)), 0u);
+
+  // Not initialized
+  bm_serial_cobs_rx_t empty_rx;
+  bm_serial_cobs_rx_init(&empty_rx, NULL, 0);
+  EXPECT_EQ(bm_serial_cobs_rx_feed(&empty_rx, raw, sizeof(raw)), BM_SERIAL_NULL_BUFF);
+}
+
+TEST_F(COBSTest, StreamRx) {
+  _callbacks.tx_fn = wire_tx_fn;
+  _callbacks.sub_fn = cobs_sub_fn;
+  _callbacks.pub_fn = cobs_pub_fn;
+  bm_serial_set_callbacks(&_callbacks);
+
+  uint8_t payload[700];
+  for (size_t idx = 0; idx < sizeof(payload); idx++) {
+    payload[idx] = (uint8_t)idx;
+  }
+
+  EXPECT_EQ(bm_serial_sub("cobs_topic", sizeof("cobs_topic")), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_pub(0x1234, "cobs_topic", sizeof("cobs_topic"), payload, sizeof(payload), 1, 1), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_sub("cobs_topic", sizeof("cobs_topic")), BM_SERIAL_OK);
+
+  // Three frames, each terminated by a delimiter
+  uint32_t delimiters = 0;
+  for (size_t idx = 0; idx < wire_len; idx++) {
+    delimiters += (wire_buff[idx] == 0);
+  }
+  EXPECT_EQ(delimiters, 3u);
+  EXPECT_EQ(wire_buff[wire_len - 1], 0);
+
+  // Feed the same stream in different chunk sizes, split frames land in rx_buff
+  const size_t chunk_sizes[] = {1, 3, 64, 1000, sizeof(wire_buff)};
+  for (size_t chunk_size : chunk_sizes) {
+    uint8_t stream[sizeof(wire_buff)];
+    memcpy(stream, wire_buff, wire_len);
+
+    sub_count = 0;
+    pub_count = 0;
+    pub_len = 0;
+    for (size_t idx = 0; idx < wire_len; idx += chunk_size) {
+      size_t len = (wire_len - idx) < chunk_size ? (wire_len - idx) : chunk_size;
+      EXPECT_EQ(bm_serial_cobs_rx_feed(&rx, &stream[idx], len), BM_SERIAL_OK);
+    }
+    EXPECT_EQ(sub_count, 2u);
+    EXPECT_EQ(pub_count, 1u);
+    EXPECT_EQ(pub_len, sizeof(payload));
+  }
+  EXPECT_EQ(rx.frames, 3u * (sizeof(chunk_sizes)/sizeof(chunk_sizes[0])));
+  EXPECT_EQ(rx.dropped, 0u);
+}
+
+TEST_F(COBSTest, StreamRxErrors) {
+  _callbacks.tx_fn = wire_tx_fn;
+  _callbacks.sub_fn = cobs_sub_fn;
+  bm_serial_set_callbacks(&_callbacks);
+
+  uint8_t small_buff[8];
+  bm_serial_cobs_rx_init(&rx, small_buff, sizeof(small_buff));
+
+  // Frame split across chunks that doesn't fit in the receive buffer
+  uint8_t stream[256];
+  EXPECT_EQ(bm_serial_sub("cobs_topic", sizeof("cobs_topic")), BM_SERIAL_OK);
+  memcpy(stream, wire_buff, wire_len);
+  sub_count = 0;
+  EXPECT_EQ(bm_serial_cobs_rx_feed(&rx, stream, 4), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_cobs_rx_feed(&rx, &stream[4], wire_len - 4), BM_SERIAL_OVERFLOW);
+  EXPECT_EQ(sub_count, 0u);
+  EXPECT_EQ(rx.dropped, 1u);
+
+  // Receiver recovers on the next frame, which fits in a single chunk
+  memcpy(stream, wire_buff, wire_len);
+  EXPECT_EQ(bm_serial_cobs_rx_feed(&rx, stream, wire_len), BM_SERIAL_OK);
+  EXPECT_EQ(sub_count, 1u);
+
+  // Garbage (truncated block) followed by a delimiter
+  uint8_t garbage[] = {0x09, 0x01, 0x02, 0x00};
+  EXPECT_EQ(bm_serial_cobs_rx_feed(&rx, garbage, sizeof(garbage)), BM_SERIAL_COBS_ERR);
+
+  // Bad crc
+  memcpy(stream, wire_buff, wire_len);
+  stream[wire_len - 3] ^= 0x40;
+  EXPECT_EQ(bm_serial_cobs_rx_feed(&rx, stream, wire_len), BM_SERIAL_CRC_ERR);
+  EXPECT_EQ(sub_count, 1u);
+}
@@ -0,0 +1,384 @@
+#include "gtest/gtest.h"
+#include "bm_serial_coro.hpp"
+
+// Coroutines need C++20, see test/CMakeLists.txt
+#if __cplusplus >= 202002L
+
+#include <string.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+using namespace bm_serial;
+
+// Host sending queries and a node answering them, linked by packet queues
+static bm_serial_ctx_t host_ctx;
+static bm_serial_ctx_t node_ctx;
+static std::deque<std::vector<uint8_t>> to_node;
+static std::deque<std::vector<uint8_t>> to_host;
+static bool coro_tx_ok;
+static bool node_answers;
+static uint32_t coro_now;
+static int host_cfg_values;
+
+static uint32_t coro_now_fn(void) { return coro_now; }
+
+static bool host_tx_fn(const uint8_t *buff, size_t len) {
+  to_node.emplace_back(buff, buff + len);
+  return coro_tx_ok;
+}
+
+static bool node_tx_fn(const uint8_t *buff, size_t len) {
+  to_host.emplace_back(buff, buff + len);
+  return true;
+}
+
+static bool host_cfg_value_fn(uint64_t node_id,
+                              bm_common_config_partition_e partition,
+                              uint32_t data_length, void *data) {
+  (void)node_id;
+  (void)partition;
+  (void)data_length;
+  (void)data;
+  host_cfg_values++;
+  return true;
+}
+
+// Value of a key is "<key>=<node id>"
+static bool node_cfg_get_fn(uint64_t node_id,
+                            bm_common_config_partition_e partition,
+                            size_t key_len, const char *key) {
+  if (node_answers) {
+    std::string value =
+        std::string(key, key_len) + "=" + std::to_string(node_id);
+    bm_serial_ctx_cfg_value(&node_ctx, node_id, partition, value.size(),
+                            value.data());
+  }
+  return true;
+}
+
+static bool node_cfg_status_fn(uint64_t node_id,
+                               bm_common_config_partition_e partition) {
+  const uint8_t keys[] = {1, 'a', 2, 'b', 'c'};
+  bm_serial_ctx_cfg_status_response(&node_ctx, node_id, partition, true, 2,
+                                    (void *)keys);
+  return true;
+}
+
+static bool node_cfg_del_fn(uint64_t node_id,
+                            bm_common_config_partition_e partition,
+                            size_t key_len, const char *key) {
+  // Only "missing" fails
+  bool success = std::string(key, key_len) != "missing";
+  bm_serial_ctx_cfg_delete_response(&node_ctx, node_id, partition, key_len,
+                                    key, success);
+  return true;
+}
+
+static bool node_info_fn(uint64_t node_id) {
+  uint8_t buff[sizeof(bm_serial_device_info_reply_t) + 16] = {};
+  bm_serial_device_info_reply_t *reply = (bm_serial_device_info_reply_t *)buff;
+  // Asked for every node, 42 answers
+  reply->info.node_id = node_id ? node_id : 42;
+  reply->info.git_sha = 0x1234;
+  reply->ver_str_len = 5;
+  reply->dev_name_len = 7;
+  memcpy(reply->strings, "1.2.3spotter", 12);
+  bm_serial_ctx_send_info_reply(&node_ctx, node_id, reply);
+  return true;
+}
+
+static bool node_resource_fn(uint64_t node_id) {
+  uint8_t buff[sizeof(bm_serial_resource_table_reply_t) + 32] = {};
+  bm_serial_resource_table_reply_t *reply =
+      (bm_serial_resource_table_reply_t *)buff;
+  reply->node_id = node_id;
+  reply->num_pubs = 1;
+  reply->num_subs = 2;
+  const uint8_t list[] = {3, 0, 'p', '/', '1', 1, 0, 'a', 2, 0, 'b', 'c'};
+  memcpy(reply->resource_list, list, sizeof(list));
+  bm_serial_ctx_send_resource_reply(&node_ctx, node_id, reply);
+  return true;
+}
+
+static void deliver(bm_serial_ctx_t *ctx, std::vector<uint8_t> &packet) {
+  EXPECT_EQ(bm_serial_ctx_process_packet(ctx,
+                                         (bm_serial_packet_t *)packet.data(),
+                                         packet.size()),
+            BM_SERIAL_OK);
+}
+
+// Pass packets both ways and resume coroutines until nothing moves
+static void pump(executor &ex) {
+  while (true) {
+    bool moved = !to_node.empty() || !to_host.empty();
+    while (!to_node.empty()) {
+      std::vector<uint8_t> packet = std::move(to_node.front());
+      to_node.pop_front();
+      deliver(&node_ctx, packet);
+    }
+    while (!to_host.empty()) {
+      std::vector<uint8_t> packet = std::move(to_host.front());
+      to_host.pop_front();
+      deliver(&host_ctx, packet);
+    }
+    if (!ex.poll() && !moved) {
+      break;
+    }
+  }
+}
+
+class CoroTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    bm_serial_callbacks_t host_callbacks = {};
+    host_callbacks.tx_fn = host_tx_fn;
+    host_callbacks.cfg_value_fn = host_cfg_value_fn;
+    bm_serial_ctx_init(&host_ctx, &host_callbacks);
+    bm_serial_ctx_set_cobs_tx(&host_ctx, false);
+
+    bm_serial_callbacks_t node_callbacks = {};
+    node_callbacks.tx_fn = node_tx_fn;
+    node_callbacks.cfg_get_fn = node_cfg_get_fn;
+    node_callbacks.cfg_status_request_fn = node_cfg_status_fn;
+    node_callbacks.cfg_key_del_request_fn = node_cfg_del_fn;
+    node_callbacks.bcmp_info_request_fn = node_info_fn;
+    node_callbacks.bcmp_resource_request_fn = node_resource_fn;
+    bm_serial_ctx_init(&node_ctx, &node_callbacks);
+    bm_serial_ctx_set_cobs_tx(&node_ctx, false);
+
+    to_node.clear();
+    to_host.clear();
+    coro_tx_ok = true;
+    node_answers = true;
+    coro_now = 0;
+    host_cfg_values = 0;
+  }
+};
+
+static task<void> get_key(executor &ex, uint64_t node_id, std::string key,
+                          std::string *value, bm_serial_error_e *err) {
+  auto reply = co_await ex.cfg_get(node_id, BM_COMMON_CFG_PARTITION_USER, key);
+  *err = reply.err;
+  if (reply) {
+    EXPECT_EQ(reply->node_id, node_id);
+    EXPECT_EQ(reply->partition, BM_COMMON_CFG_PARTITION_USER);
+    value->assign(reply->data.begin(), reply->data.end());
+  }
+}
+
+TEST_F(CoroTest, CfgGet) {
+  executor ex(host_ctx, coro_now_fn, 100);
+  std::string value;
+  bm_serial_error_e err = BM_SERIAL_MISC_ERR;
+
+  ex.spawn(get_key(ex, 1234, "period", &value, &err));
+  EXPECT_EQ(ex.pending(), 1u);
+  EXPECT_EQ(ex.tasks(), 1u);
+  EXPECT_EQ(to_node.size(), 1u);
+
+  pump(ex);
+  EXPECT_EQ(err, BM_SERIAL_OK);
+  EXPECT_EQ(value, "period=1234");
+  EXPECT_EQ(ex.pending(), 0u);
+  EXPECT_EQ(ex.tasks(), 0u);
+
+  // The reply went to the coroutine, not the callback
+  EXPECT_EQ(host_cfg_values, 0);
+
+  // Replies nobody waits for still go to the callback
+  bm_serial_ctx_cfg_value(&node_ctx, 1234, BM_COMMON_CFG_PARTITION_USER, 1,
+                          (void *)"x");
+  pump(ex);
+  EXPECT_EQ(host_cfg_values, 1);
+}
+
+TEST_F(CoroTest, Outstanding) {
+  executor ex(host_ctx, coro_now_fn, 100);
+  const int num_queries = 300;
+  std::vector<std::string> values(num_queries);
+  std::vector<bm_serial_error_e> errs(num_queries, BM_SERIAL_MISC_ERR);
+
+  // Two keys per node, every query sent before any reply
+  for (int idx = 0; idx < num_queries; idx++) {
+    ex.spawn(get_key(ex, 1000 + idx / 2, "key" + std::to_string(idx),
+                     &values[idx], &errs[idx]));
+  }
+  EXPECT_EQ(ex.pending(), (size_t)num_queries);
+  EXPECT_EQ(to_node.size(), (size_t)num_queries);
+
+  pump(ex);
+  for (int idx = 0; idx < num_queries; idx++) {
+    EXPECT_EQ(errs[idx], BM_SERIAL_OK);
+    EXPECT_EQ(values[idx], "key" + std::to_string(idx) + "=" +
+                               std::to_string(1000 + idx / 2));
+  }
+  EXPECT_EQ(ex.pending(), 0u);
+  EXPECT_EQ(ex.tasks(), 0u);
+}
+
+TEST_F(CoroTest, Timeout) {
+  executor ex(host_ctx, coro_now_fn, 100);
+  std::string value;
+  bm_serial_error_e err = BM_SERIAL_MISC_ERR;
+  node_answers = false;
+
+  ex.spawn(get_key(ex, 1234, "period", &value, &err));
+  coro_now = 99;
+  pump(ex);
+  EXPECT_EQ(ex.pending(), 1u);
+
+  coro_now = 100;
+  pump(ex);
+  EXPECT_EQ(err, BM_SERIAL_TIMEOUT);
+  EXPECT_EQ(ex.pending(), 0u);
+  EXPECT_EQ(ex.tasks(), 0u);
+
+  // A late reply goes to the callback
+  bm_serial_ctx_cfg_value(&node_ctx, 1234, BM_COMMON_CFG_PARTITION_USER, 1,
+                          (void *)"x");
+  pump(ex);
+  EXPECT_EQ(host_cfg_values, 1);
+}
+
+TEST_F(CoroTest, LateReply) {
+  executor ex(host_ctx, coro_now_fn, 100);
+  std::string first, second, third, other;
+  bm_serial_error_e first_err = BM_SERIAL_MISC_ERR;
+  bm_serial_error_e second_err = BM_SERIAL_MISC_ERR;
+  bm_serial_error_e third_err = BM_SERIAL_MISC_ERR;
+  bm_serial_error_e other_err = BM_SERIAL_MISC_ERR;
+  node_answers = false;
+
+  ex.spawn(get_key(ex, 1234, "a", &first, &first_err));
+  coro_now = 50;
+  ex.spawn(get_key(ex, 1234, "b", &second, &second_err));
+  pump(ex);
+  EXPECT_EQ(ex.pending(), 2u);
+
+  // The second get can't tell its value from a late one for the first
+  coro_now = 100;
+  pump(ex);
+  EXPECT_EQ(first_err, BM_SERIAL_TIMEOUT);
+  EXPECT_EQ(second_err, BM_SERIAL_TIMEOUT);
+  EXPECT_EQ(ex.pending(), 0u);
+  EXPECT_EQ(ex.tasks(), 0u);
+
+  // New gets to that node and partition are refused for a while
+  ex.spawn(get_key(ex, 1234, "c", &third, &third_err));
+  EXPECT_EQ(third_err, BM_SERIAL_BUSY);
+  EXPECT_TRUE(to_node.empty());
+  pump(ex);
+  EXPECT_EQ(ex.tasks(), 0u);
+
+  // The late value goes to the callback, not to a get
+  node_answers = true;
+  ex.spawn(get_key(ex, 5678, "d", &other, &other_err));
+  bm_serial_ctx_cfg_value(&node_ctx, 1234, BM_COMMON_CFG_PARTITION_USER, 5,
+                          (void *)"a=old");
+  pump(ex);
+  EXPECT_EQ(host_cfg_values, 1);
+  EXPECT_EQ(other_err, BM_SERIAL_OK);
+  EXPECT_EQ(other, "d=5678");
+
+  coro_now = 200;
+  ex.spawn(get_key(ex, 1234, "c", &third, &third_err));
+  pump(ex);
+  EXPECT_EQ(third_err, BM_SERIAL_OK);
+  EXPECT_EQ(third, "c=1234");
+  EXPECT_EQ(host_cfg_values, 1);
+}
+
+TEST_F(CoroTest, SendError) {
+  executor ex(host_ctx, coro_now_fn, 100);
+  std::string value;
+  bm_serial_error_e err = BM_SERIAL_OK;
+  coro_tx_ok = false;
+
+  // Doesn't wait for a reply
+  ex.spawn(get_key(ex, 1234, "period", &value, &err));
+  EXPECT_EQ(err, BM_SERIAL_TX_ERR);
+  EXPECT_EQ(ex.pending(), 0u);
+  ex.poll();
+  EXPECT_EQ(ex.tasks(), 0u);
+}
+
+static task<int> count_keys(executor &ex, uint64_t node_id) {
+  auto status = co_await ex.cfg_status(node_id, BM_COMMON_CFG_PARTITION_SYSTEM);
+  EXPECT_EQ(status.err, BM_SERIAL_OK);
+  EXPECT_TRUE(status->committed);
+  EXPECT_EQ(status->partition, BM_COMMON_CFG_PARTITION_SYSTEM);
+  EXPECT_EQ(status->keys, (std::vector<std::string>{"a", "bc"}));
+  co_return status->keys.size();
+}
+
+static task<void> queries(executor &ex, int *step) {
+  // Nested task
+  EXPECT_EQ(co_await count_keys(ex, 1234), 2);
+  *step = 1;
+
+  auto del =
+      co_await ex.cfg_delete(1234, BM_COMMON_CFG_PARTITION_USER, "period");
+  EXPECT_EQ(del.err, BM_SERIAL_OK);
+  EXPECT_EQ(del->key, "period");
+  EXPECT_TRUE(del->success);
+  del = co_await ex.cfg_delete(1234, BM_COMMON_CFG_PARTITION_USER, "missing");
+  EXPECT_FALSE(del->success);
+  *step = 2;
+
+  auto info = co_await ex.device_info(1234);
+  EXPECT_EQ(info.err, BM_SERIAL_OK);
+  EXPECT_EQ(info->info.node_id, 1234u);
+  EXPECT_EQ(info->info.git_sha, 0x1234u);
+  EXPECT_EQ(info->version, "1.2.3");
+  EXPECT_EQ(info->name, "spotter");
+
+  // Any node answers a query to every node
+  info = co_await ex.device_info(0);
+  EXPECT_EQ(info.err, BM_SERIAL_OK);
+  EXPECT_EQ(info->info.node_id, 42u);
+  *step = 3;
+
+  auto resources = co_await ex.resources(1234);
+  EXPECT_EQ(resources.err, BM_SERIAL_OK);
+  EXPECT_EQ(resources->node_id, 1234u);
+  EXPECT_EQ(resources->pubs, (std::vector<std::string>{"p/1"}));
+  EXPECT_EQ(resources->subs, (std::vector<std::string>{"a", "bc"}));
+  *step = 4;
+}
+
+TEST_F(CoroTest, Queries) {
+  executor ex(host_ctx, coro_now_fn, 100);
+  int step = 0;
+  ex.spawn(queries(ex, &step));
+  pump(ex);
+  EXPECT_EQ(step, 4);
+  EXPECT_EQ(ex.tasks(), 0u);
+}
+
+TEST_F(CoroTest, Destroyed) {
+  std::string value;
+  bm_serial_error_e err = BM_SERIAL_MISC_ERR;
+  {
+    executor ex(host_ctx, coro_now_fn, 100);
+    // Tasks destroyed while their queries wait
+    ex.spawn(get_key(ex, 1234, "period", &value, &err));
+    ex.spawn(get_key(ex, 1234, "period", &value, &err));
+    EXPECT_EQ(ex.pending(), 2u);
+  }
+
+  // Executor gone, replies go back to the callbacks
+  EXPECT_EQ(host_ctx.rx_hook, nullptr);
+  while (!to_node.empty()) {
+    deliver(&node_ctx, to_node.front());
+    to_node.pop_front();
+  }
+  while (!to_host.empty()) {
+    deliver(&host_ctx, to_host.front());
+    to_host.pop_front();
+  }
+  EXPECT_EQ(err, BM_SERIAL_MISC_ERR);
+  EXPECT_EQ(host_cfg_values, 2);
+}
+
+#endif // __cplusplus >= 202002L
@@ -0,0 +1,306 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_corr.h"
+
+#include <string.h>
+#include <vector>
+
+// Host sending requests, node whose replies go straight to the host
+static bm_serial_ctx_t corr_host;
+static bm_serial_ctx_t corr_node;
+static bm_serial_corr_t corr;
+static uint32_t corr_now;
+static size_t corr_sent;
+static bool corr_tx_ok;
+static int corr_values;
+
+struct corr_expired_t {
+  bm_serial_message_t type;
+  uint64_t node_id;
+  bm_common_config_partition_e partition;
+};
+static std::vector<corr_expired_t> corr_expired;
+
+static uint32_t corr_now_fn(void) { return corr_now; }
+
+static bool corr_host_tx_fn(const uint8_t *buff, size_t len) {
+  (void)buff;
+  (void)len;
+  corr_sent++;
+  return corr_tx_ok;
+}
+
+static bool corr_node_tx_fn(const uint8_t *buff, size_t len) {
+  std::vector<uint8_t> packet(buff, buff + len);
+  EXPECT_EQ(bm_serial_ctx_process_packet(&corr_host,
+                                         (bm_serial_packet_t *)packet.data(),
+                                         len),
+            BM_SERIAL_OK);
+  return true;
+}
+
+static bool corr_cfg_value_fn(uint64_t node_id,
+                              bm_common_config_partition_e partition,
+                              uint32_t data_length, void *data) {
+  (void)node_id;
+  (void)partition;
+  (void)data_length;
+  (void)data;
+  corr_values++;
+  return true;
+}
+
+static void corr_expired_fn(void *arg, bm_serial_message_t type,
+                            uint64_t node_id,
+                            bm_common_config_partition_e partition) {
+  EXPECT_EQ(arg, &corr);
+  corr_expired.push_back({type, node_id, partition});
+}
+
+static bm_serial_error_e get(uint64_t node_id) {
+  return bm_serial_ctx_cfg_get(&corr_host, node_id,
+                               BM_COMMON_CFG_PARTITION_USER, 3, "key");
+}
+
+static void value(uint64_t node_id) {
+  uint32_t data = 1;
+  ASSERT_EQ(bm_serial_ctx_cfg_value(&corr_node, node_id,
+                                    BM_COMMON_CFG_PARTITION_USER,
+                                    sizeof(data), &data),
+            BM_SERIAL_OK);
+}
+
+class CorrTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    bm_serial_callbacks_t callbacks = {};
+    callbacks.tx_fn = corr_host_tx_fn;
+    callbacks.cfg_value_fn = corr_cfg_value_fn;
+    bm_serial_ctx_init(&corr_host, &callbacks);
+    bm_serial_ctx_set_cobs_tx(&corr_host, false);
+
+    callbacks = {};
+    callbacks.tx_fn = corr_node_tx_fn;
+    bm_serial_ctx_init(&corr_node, &callbacks);
+    bm_serial_ctx_set_cobs_tx(&corr_node, false);
+
+    bm_serial_corr_cfg_t cfg = {};
+    cfg.timeout = 100;
+    cfg.now_fn = corr_now_fn;
+    cfg.expired_fn = corr_expired_fn;
+    cfg.arg = &corr;
+    ASSERT_EQ(bm_serial_corr_init(&corr, &corr_host, &cfg), BM_SERIAL_OK);
+
+    corr_now = 0;
+    corr_sent = 0;
+    corr_tx_ok = true;
+    corr_values = 0;
+    corr_expired.clear();
+  }
+};
+
+TEST_F(CorrTest, Match) {
+  corr_now = 1000;
+  ASSERT_EQ(get(1234), BM_SERIAL_OK);
+  ASSERT_EQ(get(5678), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_corr_pending(&corr), 2u);
+  EXPECT_EQ(bm_serial_corr_in_flight(&corr, 1234), 1u);
+  EXPECT_EQ(bm_serial_corr_in_flight(&corr, 1), 0u);
+
+  // Replies still reach the callback
+  corr_now = 1005;
+  value(5678);
+  EXPECT_EQ(corr_values, 1);
+  EXPECT_EQ(bm_serial_corr_in_flight(&corr, 5678), 0u);
+  corr_now = 1040;
+  value(1234);
+  EXPECT_EQ(bm_serial_corr_pending(&corr), 0u);
+
+  // No request for this one
+  value(1234);
+  EXPECT_EQ(corr_values, 3);
+
+  EXPECT_EQ(corr.stats.tracked, 2u);
+  EXPECT_EQ(corr.stats.matched, 2u);
+  EXPECT_EQ(corr.stats.unsolicited, 1u);
+
+  // 5 ticks in [4, 8), 40 in [32, 64)
+  const bm_serial_corr_latency_t *latency =
+      &corr.latency[BM_SERIAL_CORR_CFG_GET];
+  EXPECT_EQ(latency->count, 2u);
+  EXPECT_EQ(latency->hist[3], 1u);
+  EXPECT_EQ(latency->hist[6], 1u);
+  EXPECT_EQ(latency->max, 40u);
+  EXPECT_EQ(latency->total, 45u);
+}
+
+TEST_F(CorrTest, Keys) {
+  // Deletes are matched on the key
+  ASSERT_EQ(bm_serial_ctx_cfg_delete_request(&corr_host, 1234,
+                                             BM_COMMON_CFG_PARTITION_USER, 1,
+                                             "a"),
+            BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_ctx_cfg_delete_request(&corr_host, 1234,
+                                             BM_COMMON_CFG_PARTITION_USER, 1,
+                                             "b"),
+            BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_ctx_cfg_delete_response(&corr_node, 1234,
+                                              BM_COMMON_CFG_PARTITION_USER, 1,
+                                              "c", true),
+            BM_SERIAL_OK);
+  EXPECT_EQ(corr.stats.unsolicited, 1u);
+  ASSERT_EQ(bm_serial_ctx_cfg_delete_response(&corr_node, 1234,
+                                              BM_COMMON_CFG_PARTITION_USER, 1,
+                                              "b", true),
+            BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_corr_pending(&corr), 1u);
+
+  // Partition has to match too
+  ASSERT_EQ(bm_serial_ctx_cfg_delete_response(&corr_node, 1234,
+                                              BM_COMMON_CFG_PARTITION_SYSTEM,
+                                              1, "a", true),
+            BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_corr_pending(&corr), 1u);
+  ASSERT_EQ(bm_serial_ctx_cfg_delete_response(&corr_node, 1234,
+                                              BM_COMMON_CFG_PARTITION_USER, 1,
+                                              "a", true),
+            BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_corr_pending(&corr), 0u);
+  EXPECT_EQ(corr.latency[BM_SERIAL_CORR_CFG_DEL].count, 2u);
+
+  // A request to every node is answered by any of them
+  ASSERT_EQ(bm_serial_ctx_send_info_request(&corr_host, 0), BM_SERIAL_OK);
+  bm_serial_device_info_reply_t info = {};
+  info.info.node_id = 42;
+  ASSERT_EQ(bm_serial_ctx_send_info_reply(&corr_node, 42, &info),
+            BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_corr_pending(&corr), 0u);
+  EXPECT_EQ(corr.latency[BM_SERIAL_CORR_INFO].count, 1u);
+}
+
+TEST_F(CorrTest, Limits) {
+  bm_serial_corr_cfg_t cfg = corr.cfg;
+  cfg.max_per_node = 2;
+  ASSERT_EQ(bm_serial_corr_init(&corr, &corr_host, &cfg), BM_SERIAL_OK);
+
+  ASSERT_EQ(get(1234), BM_SERIAL_OK);
+  ASSERT_EQ(get(1234), BM_SERIAL_OK);
+  EXPECT_EQ(get(1234), BM_SERIAL_BUSY);
+  EXPECT_EQ(corr_sent, 2u);
+
+  // Other nodes aren't held up
+  EXPECT_EQ(get(5678), BM_SERIAL_OK);
+
+  // Room again once a reply comes in
+  value(1234);
+  EXPECT_EQ(get(1234), BM_SERIAL_OK);
+  EXPECT_EQ(corr.stats.rejected, 1u);
+
+  // Table full
+  cfg.max_per_node = 0;
+  ASSERT_EQ(bm_serial_corr_init(&corr, &corr_host, &cfg), BM_SERIAL_OK);
+  for (int idx = 0; idx < BM_SERIAL_CORR_ENTRIES; idx++) {
+    ASSERT_EQ(get(idx % 3), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(get(1234), BM_SERIAL_OUT_OF_MEMORY);
+  value(2);
+  EXPECT_EQ(get(1234), BM_SERIAL_OK);
+
+  // Not sent, not tracked
+  corr_tx_ok = false;
+  uint16_t pending = bm_serial_corr_pending(&corr);
+  value(1);
+  EXPECT_NE(get(1234), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_corr_pending(&corr), pending - 1);
+}
+
+TEST_F(CorrTest, Expire) {
+  ASSERT_EQ(get(1234), BM_SERIAL_OK);
+  corr_now = 50;
+  ASSERT_EQ(bm_serial_ctx_cfg_status_request(&corr_host, 5678,
+                                             BM_COMMON_CFG_PARTITION_SYSTEM),
+            BM_SERIAL_OK);
+
+  corr_now = 99;
+  bm_serial_corr_poll(&corr);
+  EXPECT_TRUE(corr_expired.empty());
+
+  corr_now = 100;
+  bm_serial_corr_poll(&corr);
+  ASSERT_EQ(corr_expired.size(), 1u);
+  EXPECT_EQ(corr_expired[0].type, BM_SERIAL_CFG_GET);
+  EXPECT_EQ(corr_expired[0].node_id, 1234u);
+  EXPECT_EQ(corr_expired[0].partition, BM_COMMON_CFG_PARTITION_USER);
+  EXPECT_EQ(bm_serial_corr_in_flight(&corr, 1234), 0u);
+
+  corr_now = 150;
+  bm_serial_corr_poll(&corr);
+  ASSERT_EQ(corr_expired.size(), 2u);
+  EXPECT_EQ(corr_expired[1].type, BM_SERIAL_CFG_STATUS_REQ);
+  EXPECT_EQ(corr_expired[1].partition, BM_COMMON_CFG_PARTITION_SYSTEM);
+
+  // Works across the timer wrapping
+  corr_now = UINT32_MAX - 10;
+  ASSERT_EQ(get(1234), BM_SERIAL_OK);
+  corr_now = 50;
+  bm_serial_corr_poll(&corr);
+  EXPECT_EQ(corr_expired.size(), 2u);
+  corr_now = 89;
+  bm_serial_corr_poll(&corr);
+  EXPECT_EQ(corr_expired.size(), 3u);
+
+  // Late reply
+  value(1234);
+  EXPECT_EQ(corr.stats.late, 1u);
+  EXPECT_EQ(corr.stats.unsolicited, 0u);
+  EXPECT_EQ(corr.stats.expired, 3u);
+  EXPECT_EQ(bm_serial_corr_pending(&corr), 0u);
+  EXPECT_EQ(corr_values, 1);
+}
+
+TEST_F(CorrTest, LateReply) {
+  ASSERT_EQ(get(1234), BM_SERIAL_OK);
+  corr_now = 100;
+  bm_serial_corr_poll(&corr);
+  EXPECT_EQ(corr.stats.expired, 1u);
+  EXPECT_EQ(bm_serial_corr_pending(&corr), 0u);
+  EXPECT_EQ(bm_serial_corr_in_flight(&corr, 1234), 0u);
+
+  // The first reply is the expired request's, not the new one's
+  corr_now = 120;
+  ASSERT_EQ(get(1234), BM_SERIAL_OK);
+  corr_now = 130;
+  value(1234);
+  EXPECT_EQ(corr.stats.late, 1u);
+  EXPECT_EQ(corr.stats.matched, 0u);
+  EXPECT_EQ(bm_serial_corr_pending(&corr), 1u);
+
+  corr_now = 140;
+  value(1234);
+  EXPECT_EQ(corr.stats.matched, 1u);
+  EXPECT_EQ(corr.latency[BM_SERIAL_CORR_CFG_GET].max, 20u);
+  EXPECT_EQ(corr_values, 2);
+
+  // Expired requests are kept for one more timeout
+  ASSERT_EQ(get(1234), BM_SERIAL_OK);
+  corr_now = 240;
+  bm_serial_corr_poll(&corr);
+  EXPECT_EQ(corr.expired_count, 1u);
+  corr_now = 339;
+  bm_serial_corr_poll(&corr);
+  EXPECT_EQ(corr.expired_count, 1u);
+  corr_now = 340;
+  bm_serial_corr_poll(&corr);
+  EXPECT_EQ(corr.expired_count, 0u);
+
+  // After that, a reply is unsolicited
+  value(1234);
+  EXPECT_EQ(corr.stats.late, 1u);
+  EXPECT_EQ(corr.stats.unsolicited, 1u);
+
+  // The entries are free again
+  for (int idx = 0; idx < BM_SERIAL_CORR_ENTRIES; idx++) {
+    ASSERT_EQ(get(idx), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(get(1234), BM_SERIAL_OUT_OF_MEMORY);
+}
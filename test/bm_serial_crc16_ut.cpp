@@ -0,0 +1,92 @@
+#include "gtest/gtest.h"
+#include "bm_serial_crc.h"
+
+#include <random>
+#include <string.h>
+
+// Original shift based implementation, everything else must match it
+static uint16_t reference_crc16(uint16_t seed, const uint8_t *src, size_t len) {
+  for (; len > 0; len--) {
+    uint8_t e, f;
+
+    e = seed ^ *src++;
+    f = e ^ (e << 4);
+    seed = (seed >> 8) ^ ((uint16_t)f << 8) ^ ((uint16_t)f << 3) ^ ((uint16_t)f >> 4);
+  }
+  return seed;
+}
+
+TEST(CRC16Test, CheckValue) {
+  // CRC-16/KERMIT check value
+  const char check[] = "123456789";
+  EXPECT_EQ(bm_serial_crc16_ccitt(0, (const uint8_t *)check, strlen(check)), 0x2189);
+  EXPECT_EQ(bm_serial_crc16_ccitt(0x1234, NULL, 0), 0x1234);
+}
+
+TEST(CRC16Test, MatchesReference) {
+  std::mt19937 rng(42);
+  uint8_t buff[4096 + 16];
+  for (auto &byte : buff) {
+    byte = (uint8_t)rng();
+  }
+
+  // Every length up to a few fold blocks, at every alignment, plus large ones
+  for (size_t offset = 0; offset < 16; offset++) {
+    for (size_t len = 0; len < 200; len++) {
+      uint16_t seed = (uint16_t)rng();
+      ASSERT_EQ(bm_serial_crc16_ccitt(seed, &buff[offset], len),
+                reference_crc16(seed, &buff[offset], len)) << "len " << len << " offset " << offset;
+    }
+  }
+
+  for (size_t len : {1000, 2047, 2048, 4096}) {
+    EXPECT_EQ(bm_serial_crc16_ccitt(0, buff, len), reference_crc16(0, buff, len));
+  }
+
+  // Incremental crc matches single pass
+  uint16_t crc = 0;
+  for (size_t idx = 0; idx < 4096; idx += 333) {
+    size_t len = (4096 - idx) < 333 ? (4096 - idx) : 333;
+    crc = bm_serial_crc16_ccitt(crc, &buff[idx], len);
+  }
+  EXPECT_EQ(crc, reference_crc16(0, buff, 4096));
+}
+
+TEST(CRC16Test, CopyMatchesReference) {
+  std::mt19937 rng(7);
+  uint8_t src[2048 + 16];
+  uint8_t dst[sizeof(src) + 16];
+  for (auto &byte : src) {
+    byte = (uint8_t)rng();
+  }
+
+  // Different src/dst alignment so vector loads and stores don't line up
+  for (size_t offset = 0; offset < 16; offset++) {
+    for (size_t len : {0, 1, 7, 15, 16, 31, 32, 33, 100, 255, 2048}) {
+      uint16_t seed = (uint16_t)rng();
+      memset(dst, 0xAA, sizeof(dst));
+      ASSERT_EQ(bm_serial_crc16_ccitt_copy(seed, &dst[15 - offset], &src[offset], len),
+                reference_crc16(seed, &src[offset], len)) << "len " << len << " offset " << offset;
+      EXPECT_EQ(memcmp(&dst[15 - offset], &src[offset], len), 0);
+
+      // Nothing written past the end
+      EXPECT_EQ(dst[15 - offset + len], 0xAA);
+    }
+  }
+}
+
+TEST(CRC16Test, Combine) {
+  std::mt19937 rng(3);
+  uint8_t buff[3000];
+  for (auto &byte : buff) {
+    byte = (uint8_t)rng();
+  }
+
+  for (size_t split : {0, 1, 17, 1000, 2999, 3000}) {
+    uint16_t seed = (uint16_t)rng();
+    uint16_t crc1 = bm_serial_crc16_ccitt(seed, buff, split);
+    uint16_t crc2 = bm_serial_crc16_ccitt(0, &buff[split], sizeof(buff) - split);
+    EXPECT_EQ(bm_serial_crc16_ccitt_combine(crc1, crc2, sizeof(buff) - split),
+              reference_crc16(seed, buff, sizeof(buff))) << "split " << split;
+  }
+}
@@ -0,0 +1,255 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_dfu_file.h"
+#include "bm_serial_dfu_rx.h"
+
+#include <deque>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static bm_serial_ctx_t tx_ctx;
+static bm_serial_ctx_t rx_ctx;
+static bm_serial_dfu_file_t dfu_file;
+static bm_serial_dfu_rx_t dfu_rx;
+
+static std::deque<std::vector<uint8_t>> to_rx;
+static std::deque<std::vector<uint8_t>> to_tx;
+static uint32_t now;
+static uint32_t now_fn(void) { return now; }
+
+static std::vector<uint8_t> image;
+static std::vector<uint8_t> rx_image;
+static int done_count;
+static bool done_success;
+
+static bool tx_fn(const uint8_t *buff, size_t len) {
+  to_rx.emplace_back(buff, buff + len);
+  return true;
+}
+
+static bool rx_tx_fn(const uint8_t *buff, size_t len) {
+  to_tx.emplace_back(buff, buff + len);
+  return true;
+}
+
+static bool rx_start_fn(bm_serial_dfu_start_t *start) {
+  return bm_serial_dfu_rx_start(&dfu_rx, start) == BM_SERIAL_OK;
+}
+
+static bool rx_chunk_fn(uint32_t offset, size_t length, uint8_t *data) {
+  return bm_serial_dfu_rx_chunk(&dfu_rx, offset, length, data) ==
+         BM_SERIAL_OK;
+}
+
+static bool tx_nak_fn(uint32_t offset, size_t length, uint8_t *data) {
+  (void)data;
+  bm_serial_dfu_tx_rx_nak(&dfu_file.tx, offset, length);
+  return true;
+}
+
+static void done_fn(void *arg, bool success) {
+  (void)arg;
+  done_count++;
+  done_success = success;
+}
+
+// Run until done, or until stop_at bytes were acknowledged
+static void run(uint32_t stop_at) {
+  for (int tick = 0; tick < 100000 &&
+                     dfu_file.tx.state == BM_SERIAL_DFU_TX_SENDING &&
+                     dfu_file.tx.acked < stop_at;
+       tick++) {
+    while (!to_rx.empty() || !to_tx.empty()) {
+      if (!to_rx.empty()) {
+        std::vector<uint8_t> frame = to_rx.front();
+        to_rx.pop_front();
+        bm_serial_ctx_process_packet(&rx_ctx,
+                                     (bm_serial_packet_t *)frame.data(),
+                                     frame.size());
+      }
+      if (!to_tx.empty()) {
+        std::vector<uint8_t> frame = to_tx.front();
+        to_tx.pop_front();
+        bm_serial_ctx_process_packet(&tx_ctx,
+                                     (bm_serial_packet_t *)frame.data(),
+                                     frame.size());
+      }
+    }
+    now++;
+    bm_serial_dfu_tx_poll(&dfu_file.tx);
+  }
+}
+
+class DfuFileTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    bm_serial_callbacks_t tx_callbacks = {};
+    tx_callbacks.tx_fn = tx_fn;
+    tx_callbacks.dfu_chunk_fn = tx_nak_fn;
+    bm_serial_ctx_init(&tx_ctx, &tx_callbacks);
+
+    bm_serial_callbacks_t rx_callbacks = {};
+    rx_callbacks.tx_fn = rx_tx_fn;
+    rx_callbacks.dfu_start_fn = rx_start_fn;
+    rx_callbacks.dfu_chunk_fn = rx_chunk_fn;
+    bm_serial_ctx_init(&rx_ctx, &rx_callbacks);
+
+    std::mt19937 rng(13);
+    image.resize(100000);
+    for (auto &byte : image) {
+      byte = (uint8_t)rng();
+    }
+
+    char path[] = "/tmp/bm_serial_dfu_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(write(fd, image.data(), image.size()), (ssize_t)image.size());
+    close(fd);
+    image_path = path;
+    checkpoint_path = image_path + ".checkpoint";
+
+    rx_image.assign(image.size(), 0);
+    bm_serial_dfu_rx_cfg_t rx_cfg = {};
+    rx_cfg.image = rx_image.data();
+    rx_cfg.image_len = rx_image.size();
+    ASSERT_EQ(bm_serial_dfu_rx_init(&dfu_rx, &rx_ctx, &rx_cfg), BM_SERIAL_OK);
+
+    start = {};
+    start.chunk_size = 1024;
+    start.gitSHA = 0x1234;
+
+    cfg = {};
+    cfg.window = 8;
+    cfg.min_chunk_size = 256;
+    cfg.rto = 10;
+    cfg.max_retries = 3;
+    cfg.now_fn = now_fn;
+    cfg.done_fn = done_fn;
+
+    now = 0;
+    to_rx.clear();
+    to_tx.clear();
+    done_count = 0;
+    done_success = false;
+  }
+
+  void TearDown() override {
+    unlink(image_path.c_str());
+    unlink(checkpoint_path.c_str());
+  }
+
+  // Start, interrupt the transfer half way and drop everything on the wire
+  void interrupt() {
+    ASSERT_EQ(bm_serial_dfu_file_open(&dfu_file, image_path.c_str(),
+                                      checkpoint_path.c_str()),
+              BM_SERIAL_OK);
+    ASSERT_EQ(bm_serial_dfu_file_start(&dfu_file, &tx_ctx, &start, &cfg),
+              BM_SERIAL_OK);
+    EXPECT_EQ(dfu_file.resumed_at, 0u);
+    EXPECT_EQ(start.image_size, image.size());
+
+    run(50000);
+    ASSERT_GE(dfu_file.tx.acked, 50000u);
+    bm_serial_dfu_file_close(&dfu_file);
+    to_rx.clear();
+    to_tx.clear();
+    EXPECT_EQ(access(checkpoint_path.c_str(), F_OK), 0);
+  }
+
+  std::string image_path;
+  std::string checkpoint_path;
+  bm_serial_dfu_start_t start;
+  bm_serial_dfu_tx_cfg_t cfg;
+};
+
+TEST_F(DfuFileTest, Errors) {
+  EXPECT_EQ(bm_serial_dfu_file_open(&dfu_file, "/tmp/does/not/exist", NULL),
+            BM_SERIAL_MISC_ERR);
+  EXPECT_EQ(bm_serial_dfu_file_start(&dfu_file, &tx_ctx, &start, &cfg),
+            BM_SERIAL_NULL_BUFF);
+
+  // 2 GiB (sparse), offsets would run into DFU_CHUNK_NAK_BITFLAG
+  ASSERT_EQ(truncate(image_path.c_str(), 1LL << 31), 0);
+  EXPECT_EQ(bm_serial_dfu_file_open(&dfu_file, image_path.c_str(), NULL),
+            BM_SERIAL_OVERFLOW);
+  EXPECT_EQ(dfu_file.fd, -1);
+}
+
+TEST_F(DfuFileTest, Resume) {
+  interrupt();
+
+  // Picks up from the last checkpoint, the receiver kept its data
+  ASSERT_EQ(bm_serial_dfu_file_open(&dfu_file, image_path.c_str(),
+                                    checkpoint_path.c_str()),
+            BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_dfu_file_start(&dfu_file, &tx_ctx, &start, &cfg),
+            BM_SERIAL_OK);
+  EXPECT_GT(dfu_file.resumed_at,
+            50000u - BM_SERIAL_DFU_FILE_CHECKPOINT_INTERVAL);
+  EXPECT_LE(dfu_file.resumed_at, dfu_rx.prefix);
+
+  run(UINT32_MAX);
+  ASSERT_EQ(done_count, 1);
+  EXPECT_TRUE(done_success);
+  EXPECT_EQ(rx_image, image);
+  EXPECT_LT(dfu_file.tx.stats.bytes_sent, image.size() - 40000);
+  EXPECT_EQ(dfu_file.tx.stats.rewinds, 0u);
+
+  // Checkpoint is gone once done
+  EXPECT_NE(access(checkpoint_path.c_str(), F_OK), 0);
+  bm_serial_dfu_file_close(&dfu_file);
+}
+
+TEST_F(DfuFileTest, ReceiverRestarted) {
+  interrupt();
+
+  // Receiver lost everything, the sender goes back to the start
+  bm_serial_dfu_rx_cfg_t rx_cfg = dfu_rx.cfg;
+  ASSERT_EQ(bm_serial_dfu_rx_init(&dfu_rx, &rx_ctx, &rx_cfg), BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_dfu_file_open(&dfu_file, image_path.c_str(),
+                                    checkpoint_path.c_str()),
+            BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_dfu_file_start(&dfu_file, &tx_ctx, &start, &cfg),
+            BM_SERIAL_OK);
+  EXPECT_GT(dfu_file.resumed_at, 0u);
+
+  run(UINT32_MAX);
+  ASSERT_EQ(done_count, 1);
+  EXPECT_TRUE(done_success);
+  EXPECT_EQ(rx_image, image);
+  EXPECT_GT(dfu_file.tx.stats.rewinds, 0u);
+  bm_serial_dfu_file_close(&dfu_file);
+}
+
+TEST_F(DfuFileTest, BadCheckpoint) {
+  interrupt();
+
+  // Torn write
+  FILE *checkpoint = fopen(checkpoint_path.c_str(), "r+");
+  ASSERT_NE(checkpoint, nullptr);
+  fseek(checkpoint, offsetof(bm_serial_dfu_checkpoint_t, acked), SEEK_SET);
+  fputc(0xFF, checkpoint);
+  fclose(checkpoint);
+
+  ASSERT_EQ(bm_serial_dfu_file_open(&dfu_file, image_path.c_str(),
+                                    checkpoint_path.c_str()),
+            BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_dfu_file_start(&dfu_file, &tx_ctx, &start, &cfg),
+            BM_SERIAL_OK);
+  EXPECT_EQ(dfu_file.resumed_at, 0u);
+  bm_serial_dfu_file_close(&dfu_file);
+
+  // Different image
+  start.gitSHA++;
+  ASSERT_EQ(bm_serial_dfu_file_open(&dfu_file, image_path.c_str(),
+                                    checkpoint_path.c_str()),
+            BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_dfu_file_start(&dfu_file, &tx_ctx, &start, &cfg),
+            BM_SERIAL_OK);
+  EXPECT_EQ(dfu_file.resumed_at, 0u);
+  bm_serial_dfu_file_close(&dfu_file);
+}
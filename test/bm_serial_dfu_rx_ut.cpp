@@ -0,0 +1,310 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_crc.h"
+#include "bm_serial_dfu_rx.h"
+#include "bm_serial_dfu_tx.h"
+
+#include <deque>
+#include <random>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+static bm_serial_ctx_t rx_ctx;
+static bm_serial_dfu_rx_t dfu_rx;
+
+static std::vector<uint8_t> image;
+static std::vector<uint8_t> rx_image;
+static bm_serial_dfu_start_t start;
+
+// NAKs and acknowledgements sent by the receiver (offset, length)
+static std::vector<std::pair<uint32_t, uint32_t>> naks;
+static int done_count;
+static bool done_success;
+
+static bool nak_tx_fn(const uint8_t *buff, size_t len) {
+  const bm_serial_packet_t *packet = (const bm_serial_packet_t *)buff;
+  EXPECT_EQ(packet->type, BM_SERIAL_DFU_CHUNK);
+  EXPECT_EQ(len, sizeof(bm_serial_packet_t) + sizeof(bm_serial_dfu_chunk_t));
+  const bm_serial_dfu_chunk_t *chunk =
+      (const bm_serial_dfu_chunk_t *)packet->payload;
+  EXPECT_TRUE(chunk->offset & DFU_CHUNK_NAK_BITFLAG);
+  naks.emplace_back(chunk->offset & ~DFU_CHUNK_NAK_BITFLAG, chunk->length);
+  return true;
+}
+
+static void done_fn(void *arg, bool success) {
+  (void)arg;
+  done_count++;
+  done_success = success;
+}
+
+static bm_serial_error_e chunk(uint32_t offset, size_t length) {
+  return bm_serial_dfu_rx_chunk(&dfu_rx, offset, length, &image[offset]);
+}
+
+class DfuRxTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    bm_serial_callbacks_t callbacks = {};
+    callbacks.tx_fn = nak_tx_fn;
+    bm_serial_ctx_init(&rx_ctx, &callbacks);
+
+    std::mt19937 rng(11);
+    image.resize(10000);
+    for (auto &byte : image) {
+      byte = (uint8_t)rng();
+    }
+    rx_image.assign(image.size(), 0);
+
+    start = {};
+    start.image_size = image.size();
+    start.chunk_size = 1000;
+    start.crc16 = bm_serial_crc16_ccitt(0, image.data(), image.size());
+
+    cfg = {};
+    cfg.image = rx_image.data();
+    cfg.image_len = rx_image.size();
+    cfg.done_fn = done_fn;
+    ASSERT_EQ(bm_serial_dfu_rx_init(&dfu_rx, &rx_ctx, &cfg), BM_SERIAL_OK);
+
+    naks.clear();
+    done_count = 0;
+    done_success = false;
+  }
+
+  bm_serial_dfu_rx_cfg_t cfg;
+};
+
+TEST_F(DfuRxTest, Errors) {
+  cfg.image = NULL;
+  EXPECT_EQ(bm_serial_dfu_rx_init(&dfu_rx, &rx_ctx, &cfg),
+            BM_SERIAL_NULL_BUFF);
+  cfg.image = rx_image.data();
+  ASSERT_EQ(bm_serial_dfu_rx_init(&dfu_rx, &rx_ctx, &cfg), BM_SERIAL_OK);
+
+  // Not started
+  EXPECT_EQ(chunk(0, 100), BM_SERIAL_MISC_ERR);
+
+  // Doesn't fit
+  start.image_size = rx_image.size() + 1;
+  EXPECT_EQ(bm_serial_dfu_rx_start(&dfu_rx, &start), BM_SERIAL_OVERFLOW);
+  start.image_size = rx_image.size();
+  ASSERT_EQ(bm_serial_dfu_rx_start(&dfu_rx, &start), BM_SERIAL_OK);
+  EXPECT_EQ(chunk(9990, 11), BM_SERIAL_INVALID_MSG_LEN);
+  EXPECT_EQ(chunk(0, 0), BM_SERIAL_INVALID_MSG_LEN);
+  EXPECT_EQ(dfu_rx.stats.rejected, 2u);
+  EXPECT_TRUE(naks.empty());
+}
+
+TEST_F(DfuRxTest, InOrder) {
+  ASSERT_EQ(bm_serial_dfu_rx_start(&dfu_rx, &start), BM_SERIAL_OK);
+  for (uint32_t offset = 0; offset < image.size(); offset += 1000) {
+    ASSERT_EQ(chunk(offset, 1000), BM_SERIAL_OK);
+    ASSERT_EQ(naks.back(), std::make_pair(offset + 1000, 0u));
+  }
+  EXPECT_EQ(naks.size(), 10u);
+  EXPECT_EQ(dfu_rx.num_ranges, 0);
+  ASSERT_EQ(done_count, 1);
+  EXPECT_TRUE(done_success);
+  EXPECT_EQ(rx_image, image);
+}
+
+TEST_F(DfuRxTest, OutOfOrder) {
+  ASSERT_EQ(bm_serial_dfu_rx_start(&dfu_rx, &start), BM_SERIAL_OK);
+
+  // Gap before the first chunk past everything else is NAK'd
+  ASSERT_EQ(chunk(3000, 1000), BM_SERIAL_OK);
+  ASSERT_EQ(naks.size(), 2u);
+  EXPECT_EQ(naks[0], std::make_pair(0u, 3000u));
+  EXPECT_EQ(naks[1], std::make_pair(0u, 0u));
+
+  // Adjacent ranges merge, different chunk sizes
+  ASSERT_EQ(chunk(1000, 500), BM_SERIAL_OK);
+  ASSERT_EQ(chunk(2500, 500), BM_SERIAL_OK);
+  ASSERT_EQ(chunk(6000, 2000), BM_SERIAL_OK);
+  EXPECT_EQ(dfu_rx.num_ranges, 3);
+  ASSERT_EQ(chunk(1500, 1000), BM_SERIAL_OK);
+  EXPECT_EQ(dfu_rx.num_ranges, 2);
+  EXPECT_EQ(dfu_rx.ranges[0].offset, 1000u);
+  EXPECT_EQ(dfu_rx.ranges[0].length, 3000u);
+
+  naks.clear();
+  EXPECT_EQ(bm_serial_dfu_rx_send_naks(&dfu_rx), BM_SERIAL_OK);
+  ASSERT_EQ(naks.size(), 3u);
+  EXPECT_EQ(naks[0], std::make_pair(0u, 1000u));
+  EXPECT_EQ(naks[1], std::make_pair(4000u, 2000u));
+  EXPECT_EQ(naks[2], std::make_pair(0u, 0u));
+
+  // Duplicates, and a chunk overlapping received data on both sides
+  ASSERT_EQ(chunk(3000, 1000), BM_SERIAL_OK);
+  EXPECT_EQ(dfu_rx.stats.duplicates, 1u);
+  ASSERT_EQ(chunk(3500, 3000), BM_SERIAL_OK);
+  EXPECT_EQ(dfu_rx.num_ranges, 1);
+
+  // Prefix reaches the range, crcs are combined
+  ASSERT_EQ(chunk(0, 1000), BM_SERIAL_OK);
+  EXPECT_EQ(dfu_rx.prefix, 8000u);
+  EXPECT_EQ(dfu_rx.crc16, bm_serial_crc16_ccitt(0, image.data(), 8000));
+  EXPECT_EQ(done_count, 0);
+
+  ASSERT_EQ(chunk(8000, 2000), BM_SERIAL_OK);
+  ASSERT_EQ(done_count, 1);
+  EXPECT_TRUE(done_success);
+  EXPECT_EQ(rx_image, image);
+  EXPECT_EQ(dfu_rx.stats.bytes, image.size());
+}
+
+TEST_F(DfuRxTest, BadCrc) {
+  start.crc16 ^= 1;
+  ASSERT_EQ(bm_serial_dfu_rx_start(&dfu_rx, &start), BM_SERIAL_OK);
+  ASSERT_EQ(chunk(5000, 5000), BM_SERIAL_OK);
+  ASSERT_EQ(chunk(0, 5000), BM_SERIAL_OK);
+  ASSERT_EQ(done_count, 1);
+  EXPECT_FALSE(done_success);
+}
+
+TEST_F(DfuRxTest, Ranges) {
+  ASSERT_EQ(bm_serial_dfu_rx_start(&dfu_rx, &start), BM_SERIAL_OK);
+
+  // Every other 10 bytes, until there's no room to track more
+  for (uint32_t idx = 0; idx < BM_SERIAL_DFU_RX_MAX_RANGES; idx++) {
+    ASSERT_EQ(chunk(idx * 20 + 10, 10), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(chunk(BM_SERIAL_DFU_RX_MAX_RANGES * 20 + 10, 10),
+            BM_SERIAL_OUT_OF_MEMORY);
+
+  // Filling gaps still works
+  for (uint32_t idx = 0; idx <= BM_SERIAL_DFU_RX_MAX_RANGES; idx++) {
+    ASSERT_EQ(chunk(idx * 20, 10), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(dfu_rx.prefix, BM_SERIAL_DFU_RX_MAX_RANGES * 20u + 10u);
+  EXPECT_EQ(dfu_rx.num_ranges, 0);
+}
+
+static std::vector<uint8_t> flash;
+static bool flash_write_fn(void *arg, uint32_t offset, const uint8_t *data,
+                           size_t len) {
+  (void)arg;
+  memcpy(&flash[offset], data, len);
+  return true;
+}
+
+TEST_F(DfuRxTest, Resume) {
+  flash.assign(image.size(), 0);
+  cfg.image = NULL;
+  cfg.write_fn = flash_write_fn;
+  ASSERT_EQ(bm_serial_dfu_rx_init(&dfu_rx, &rx_ctx, &cfg), BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_dfu_rx_start(&dfu_rx, &start), BM_SERIAL_OK);
+  ASSERT_EQ(chunk(0, 4000), BM_SERIAL_OK);
+
+  // Same image, keeps going where it left off
+  ASSERT_EQ(bm_serial_dfu_rx_start(&dfu_rx, &start), BM_SERIAL_OK);
+  EXPECT_EQ(dfu_rx.prefix, 4000u);
+  ASSERT_EQ(chunk(4000, 6000), BM_SERIAL_OK);
+  ASSERT_EQ(done_count, 1);
+  EXPECT_TRUE(done_success);
+  EXPECT_EQ(flash, image);
+
+  // A new image starts over
+  start.gitSHA++;
+  ASSERT_EQ(bm_serial_dfu_rx_start(&dfu_rx, &start), BM_SERIAL_OK);
+  EXPECT_EQ(dfu_rx.prefix, 0u);
+}
+
+//
+// Sender and receiver over a lossy link
+//
+static bm_serial_ctx_t tx_ctx;
+static bm_serial_ctx_t link_rx_ctx;
+static bm_serial_dfu_tx_t dfu_tx;
+static std::deque<std::vector<uint8_t>> to_rx;
+static std::deque<std::vector<uint8_t>> to_tx;
+static std::mt19937 loss_rng;
+static uint32_t now;
+
+static uint32_t now_fn(void) { return now; }
+
+static bool link_tx_fn(const uint8_t *buff, size_t len) {
+  // 10% loss, the start always makes it
+  if (((const bm_serial_packet_t *)buff)->type == BM_SERIAL_DFU_START ||
+      loss_rng() % 10) {
+    to_rx.emplace_back(buff, buff + len);
+  }
+  return true;
+}
+
+static bool link_rx_tx_fn(const uint8_t *buff, size_t len) {
+  to_tx.emplace_back(buff, buff + len);
+  return true;
+}
+
+static bool link_start_fn(bm_serial_dfu_start_t *dfu_start) {
+  return bm_serial_dfu_rx_start(&dfu_rx, dfu_start) == BM_SERIAL_OK;
+}
+
+static bool link_chunk_fn(uint32_t offset, size_t length, uint8_t *data) {
+  return bm_serial_dfu_rx_chunk(&dfu_rx, offset, length, data) ==
+         BM_SERIAL_OK;
+}
+
+static bool link_nak_fn(uint32_t offset, size_t length, uint8_t *data) {
+  (void)data;
+  bm_serial_dfu_tx_rx_nak(&dfu_tx, offset, length);
+  return true;
+}
+
+TEST_F(DfuRxTest, Link) {
+  bm_serial_callbacks_t tx_callbacks = {};
+  tx_callbacks.tx_fn = link_tx_fn;
+  tx_callbacks.dfu_chunk_fn = link_nak_fn;
+  bm_serial_ctx_init(&tx_ctx, &tx_callbacks);
+
+  bm_serial_callbacks_t rx_callbacks = {};
+  rx_callbacks.tx_fn = link_rx_tx_fn;
+  rx_callbacks.dfu_start_fn = link_start_fn;
+  rx_callbacks.dfu_chunk_fn = link_chunk_fn;
+  bm_serial_ctx_init(&link_rx_ctx, &rx_callbacks);
+  ASSERT_EQ(bm_serial_dfu_rx_init(&dfu_rx, &link_rx_ctx, &cfg), BM_SERIAL_OK);
+
+  bm_serial_dfu_tx_cfg_t tx_cfg = {};
+  tx_cfg.image = image.data();
+  tx_cfg.window = 8;
+  tx_cfg.min_chunk_size = 64;
+  tx_cfg.rto = 10;
+  tx_cfg.max_retries = 10;
+  tx_cfg.now_fn = now_fn;
+  start.chunk_size = 512;
+  now = 0;
+  loss_rng.seed(5);
+  ASSERT_EQ(bm_serial_dfu_tx_start(&dfu_tx, &tx_ctx, &start, &tx_cfg),
+            BM_SERIAL_OK);
+
+  for (int tick = 0; tick < 10000 && dfu_tx.state == BM_SERIAL_DFU_TX_SENDING;
+       tick++) {
+    while (!to_rx.empty() || !to_tx.empty()) {
+      if (!to_rx.empty()) {
+        std::vector<uint8_t> frame = to_rx.front();
+        to_rx.pop_front();
+        bm_serial_ctx_process_packet(&link_rx_ctx,
+                                     (bm_serial_packet_t *)frame.data(),
+                                     frame.size());
+      }
+      if (!to_tx.empty()) {
+        std::vector<uint8_t> frame = to_tx.front();
+        to_tx.pop_front();
+        bm_serial_ctx_process_packet(&tx_ctx,
+                                     (bm_serial_packet_t *)frame.data(),
+                                     frame.size());
+      }
+    }
+    now++;
+    bm_serial_dfu_tx_poll(&dfu_tx);
+  }
+
+  EXPECT_EQ(dfu_tx.state, BM_SERIAL_DFU_TX_DONE);
+  ASSERT_EQ(done_count, 1);
+  EXPECT_TRUE(done_success);
+  EXPECT_EQ(rx_image, image);
+  EXPECT_GT(dfu_tx.stats.retransmits, 0u);
+}
@@ -0,0 +1,350 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_dfu_tx.h"
+#include "bm_serial_txq.h"
+
+#include <deque>
+#include <string.h>
+#include <vector>
+
+static bm_serial_ctx_t tx_ctx;
+static bm_serial_ctx_t rx_ctx;
+static bm_serial_dfu_tx_t dfu;
+
+static uint32_t now;
+static uint32_t now_fn(void) { return now; }
+
+typedef std::vector<uint8_t> frame_t;
+static std::deque<frame_t> to_rx;
+static std::deque<frame_t> to_tx;
+
+// Sender frames so far, and which ones to lose (every lose_every'th, or all)
+static size_t tx_frames;
+static size_t lose_every;
+static bool lose_all;
+
+static std::vector<uint8_t> image;
+static bool read_ok;
+
+// Receiver state
+static std::vector<uint8_t> rx_image;
+static std::vector<bool> rx_have;
+static uint32_t rx_prefix;
+static uint32_t rx_highest;
+static bool rx_started;
+
+static std::vector<uint32_t> progress;
+static int done_count;
+static bool done_success;
+
+static bool tx_fn(const uint8_t *buff, size_t len) {
+  size_t frame = tx_frames++;
+  if (lose_all || (lose_every && frame && frame % lose_every == 0)) {
+    return true;
+  }
+  to_rx.emplace_back(buff, buff + len);
+  return true;
+}
+
+static bool rx_tx_fn(const uint8_t *buff, size_t len) {
+  to_tx.emplace_back(buff, buff + len);
+  return true;
+}
+
+static bool rx_dfu_start_fn(bm_serial_dfu_start_t *start) {
+  rx_image.assign(start->image_size, 0);
+  rx_have.assign(start->image_size, false);
+  rx_prefix = 0;
+  rx_highest = 0;
+  rx_started = true;
+  return true;
+}
+
+// Minimal receiver: NAK the gap before a chunk past the highest one seen,
+// then acknowledge the complete prefix
+static bool rx_dfu_chunk_fn(uint32_t offset, size_t length, uint8_t *data) {
+  EXPECT_FALSE(offset & DFU_CHUNK_NAK_BITFLAG);
+  EXPECT_LE(offset + length, rx_image.size());
+  memcpy(&rx_image[offset], data, length);
+  for (size_t idx = 0; idx < length; idx++) {
+    rx_have[offset + idx] = true;
+  }
+
+  if (offset > rx_highest) {
+    bm_serial_ctx_dfu_send_nak(&rx_ctx, rx_highest, offset - rx_highest);
+  }
+  if (offset + length > rx_highest) {
+    rx_highest = offset + length;
+  }
+
+  while (rx_prefix < rx_have.size() && rx_have[rx_prefix]) {
+    rx_prefix++;
+  }
+  bm_serial_ctx_dfu_send_nak(&rx_ctx, rx_prefix, 0);
+  return true;
+}
+
+static bool tx_dfu_chunk_fn(uint32_t offset, size_t length, uint8_t *data) {
+  (void)data;
+  EXPECT_TRUE(offset & DFU_CHUNK_NAK_BITFLAG);
+  bm_serial_dfu_tx_rx_nak(&dfu, offset, length);
+  return true;
+}
+
+static bool read_fn(void *arg, uint32_t offset, uint8_t *buff, size_t len) {
+  (void)arg;
+  memcpy(buff, &image[offset], len);
+  return read_ok;
+}
+
+static void progress_fn(void *arg, uint32_t acked, uint32_t total) {
+  (void)arg;
+  EXPECT_EQ(total, image.size());
+  progress.push_back(acked);
+}
+
+static void done_fn(void *arg, bool success) {
+  (void)arg;
+  done_count++;
+  done_success = success;
+}
+
+static void pump(void) {
+  while (!to_rx.empty() || !to_tx.empty()) {
+    if (!to_rx.empty()) {
+      frame_t frame = to_rx.front();
+      to_rx.pop_front();
+      bm_serial_ctx_process_packet(&rx_ctx, (bm_serial_packet_t *)frame.data(),
+                                   frame.size());
+    }
+    if (!to_tx.empty()) {
+      frame_t frame = to_tx.front();
+      to_tx.pop_front();
+      bm_serial_ctx_process_packet(&tx_ctx, (bm_serial_packet_t *)frame.data(),
+                                   frame.size());
+    }
+  }
+}
+
+// Run the transfer, one poll per tick
+static void run(uint32_t max_ticks) {
+  pump();
+  for (uint32_t tick = 0;
+       tick < max_ticks && dfu.state == BM_SERIAL_DFU_TX_SENDING; tick++) {
+    now++;
+    bm_serial_dfu_tx_poll(&dfu);
+    pump();
+  }
+}
+
+class DfuTxTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    bm_serial_callbacks_t tx_callbacks = {};
+    tx_callbacks.tx_fn = tx_fn;
+    tx_callbacks.dfu_chunk_fn = tx_dfu_chunk_fn;
+    bm_serial_ctx_init(&tx_ctx, &tx_callbacks);
+
+    bm_serial_callbacks_t rx_callbacks = {};
+    rx_callbacks.tx_fn = rx_tx_fn;
+    rx_callbacks.dfu_start_fn = rx_dfu_start_fn;
+    rx_callbacks.dfu_chunk_fn = rx_dfu_chunk_fn;
+    bm_serial_ctx_init(&rx_ctx, &rx_callbacks);
+
+    image.resize(20000);
+    for (size_t idx = 0; idx < image.size(); idx++) {
+      image[idx] = (uint8_t)(idx * 7 + (idx >> 8));
+    }
+    read_ok = true;
+
+    start = {};
+    start.image_size = image.size();
+    start.chunk_size = 1024;
+
+    cfg = {};
+    cfg.image = image.data();
+    cfg.window = 8;
+    cfg.min_chunk_size = 128;
+    cfg.rto = 20;
+    cfg.max_retries = 3;
+    cfg.now_fn = now_fn;
+    cfg.progress_fn = progress_fn;
+    cfg.done_fn = done_fn;
+
+    now = 0;
+    to_rx.clear();
+    to_tx.clear();
+    tx_frames = 0;
+    lose_every = 0;
+    lose_all = false;
+    rx_started = false;
+    progress.clear();
+    done_count = 0;
+    done_success = false;
+  }
+
+  bm_serial_dfu_start_t start;
+  bm_serial_dfu_tx_cfg_t cfg;
+};
+
+TEST_F(DfuTxTest, Errors) {
+  cfg.image = NULL;
+  EXPECT_EQ(bm_serial_dfu_tx_start(&dfu, &tx_ctx, &start, &cfg),
+            BM_SERIAL_NULL_BUFF);
+  cfg.image = image.data();
+  cfg.window = BM_SERIAL_DFU_TX_MAX_WINDOW + 1;
+  EXPECT_EQ(bm_serial_dfu_tx_start(&dfu, &tx_ctx, &start, &cfg),
+            BM_SERIAL_MISC_ERR);
+  cfg.window = 8;
+  cfg.min_chunk_size = 2048;
+  EXPECT_EQ(bm_serial_dfu_tx_start(&dfu, &tx_ctx, &start, &cfg),
+            BM_SERIAL_MISC_ERR);
+  EXPECT_EQ(tx_frames, 0u);
+}
+
+TEST_F(DfuTxTest, Transfer) {
+  ASSERT_EQ(bm_serial_dfu_tx_start(&dfu, &tx_ctx, &start, &cfg), BM_SERIAL_OK);
+
+  // Start plus a full window, before anything is acknowledged
+  EXPECT_EQ(tx_frames, 9u);
+  EXPECT_EQ(dfu.count, 8);
+
+  run(1000);
+  ASSERT_EQ(done_count, 1);
+  EXPECT_TRUE(done_success);
+  EXPECT_TRUE(rx_started);
+  EXPECT_EQ(rx_image, image);
+
+  EXPECT_EQ(dfu.stats.chunks_sent, 20u);
+  EXPECT_EQ(dfu.stats.bytes_sent, image.size());
+  EXPECT_EQ(dfu.stats.retransmits, 0u);
+  EXPECT_EQ(dfu.stats.shrinks, 0u);
+  ASSERT_FALSE(progress.empty());
+  EXPECT_EQ(progress.back(), image.size());
+
+  // Took a window per tick, the rate stops counting once done
+  EXPECT_EQ(dfu.done_at, 2u);
+  now = 10;
+  EXPECT_EQ(bm_serial_dfu_tx_throughput(&dfu), image.size() * 1000 / 2);
+}
+
+TEST_F(DfuTxTest, Lossy) {
+  // Every 4th chunk is lost, read from a function this time
+  cfg.image = NULL;
+  cfg.read_fn = read_fn;
+  lose_every = 4;
+  ASSERT_EQ(bm_serial_dfu_tx_start(&dfu, &tx_ctx, &start, &cfg), BM_SERIAL_OK);
+
+  run(1000);
+  ASSERT_EQ(done_count, 1);
+  EXPECT_TRUE(done_success);
+  EXPECT_EQ(rx_image, image);
+
+  // Only the lost chunks were resent, and chunks got smaller
+  EXPECT_GT(dfu.stats.naks, 0u);
+  EXPECT_GT(dfu.stats.retransmits, 0u);
+  EXPECT_LT(dfu.stats.retransmits, dfu.stats.chunks_sent);
+  EXPECT_GT(dfu.stats.shrinks, 0u);
+  EXPECT_LT(dfu.chunk_size, 1024);
+  EXPECT_GE(dfu.chunk_size, 128);
+}
+
+TEST_F(DfuTxTest, Grow) {
+  // Starts small after losses, grows back once the link is clean
+  ASSERT_EQ(bm_serial_dfu_tx_start(&dfu, &tx_ctx, &start, &cfg), BM_SERIAL_OK);
+  dfu.chunk_size = 128;
+  run(1000);
+  ASSERT_EQ(done_count, 1);
+  EXPECT_TRUE(done_success);
+  EXPECT_GT(dfu.stats.grows, 0u);
+  EXPECT_GT(dfu.chunk_size, 128);
+  EXPECT_EQ(rx_image, image);
+}
+
+TEST_F(DfuTxTest, Timeout) {
+  // Last chunk lost, nothing after it to trigger a NAK
+  image.resize(4096);
+  start.image_size = image.size();
+  lose_every = 4;
+  ASSERT_EQ(bm_serial_dfu_tx_start(&dfu, &tx_ctx, &start, &cfg), BM_SERIAL_OK);
+  run(1000);
+  ASSERT_EQ(done_count, 1);
+  EXPECT_TRUE(done_success);
+  EXPECT_EQ(dfu.stats.timeouts, 1u);
+  EXPECT_GE(now, cfg.rto);
+  EXPECT_EQ(rx_image, image);
+}
+
+TEST_F(DfuTxTest, StaleAck) {
+  ASSERT_EQ(bm_serial_dfu_tx_start(&dfu, &tx_ctx, &start, &cfg), BM_SERIAL_OK);
+  bm_serial_dfu_tx_rx_nak(&dfu, DFU_CHUNK_NAK_BITFLAG | 4096, 0);
+  EXPECT_EQ(dfu.acked, 4096u);
+  EXPECT_EQ(dfu.count, 4);
+
+  // Older ack (e.g. resent by the link) arriving late doesn't go back
+  bm_serial_dfu_tx_rx_nak(&dfu, DFU_CHUNK_NAK_BITFLAG | 1024, 0);
+  EXPECT_EQ(dfu.acked, 4096u);
+  EXPECT_EQ(dfu.next, 8192u);
+  EXPECT_EQ(dfu.count, 4);
+  EXPECT_EQ(dfu.stats.rewinds, 0u);
+  EXPECT_EQ(dfu.stats.stale_acks, 1u);
+
+  // NAK for data before the ack does
+  bm_serial_dfu_tx_rx_nak(&dfu, DFU_CHUNK_NAK_BITFLAG | 1024, 1024);
+  EXPECT_EQ(dfu.acked, 1024u);
+  EXPECT_EQ(dfu.next, 1024u);
+  EXPECT_EQ(dfu.count, 0);
+  EXPECT_EQ(dfu.stats.rewinds, 1u);
+
+  run(1000);
+  ASSERT_EQ(done_count, 1);
+  EXPECT_TRUE(done_success);
+  EXPECT_EQ(rx_image, image);
+}
+
+TEST_F(DfuTxTest, Fail) {
+  // Link is down
+  lose_all = true;
+  ASSERT_EQ(bm_serial_dfu_tx_start(&dfu, &tx_ctx, &start, &cfg), BM_SERIAL_OK);
+  run(1000);
+  ASSERT_EQ(done_count, 1);
+  EXPECT_FALSE(done_success);
+  EXPECT_EQ(dfu.state, BM_SERIAL_DFU_TX_FAILED);
+  EXPECT_EQ(dfu.stats.timeouts, 3u * 8u);
+
+  // Image can't be read
+  lose_all = false;
+  cfg.image = NULL;
+  cfg.read_fn = read_fn;
+  read_ok = false;
+  EXPECT_EQ(bm_serial_dfu_tx_start(&dfu, &tx_ctx, &start, &cfg),
+            BM_SERIAL_MISC_ERR);
+  EXPECT_EQ(done_count, 2);
+  EXPECT_EQ(dfu.state, BM_SERIAL_DFU_TX_FAILED);
+
+  // The chunk it was read into isn't left reserved
+  EXPECT_EQ(bm_serial_ctx_commit(&tx_ctx), BM_SERIAL_MISC_ERR);
+  EXPECT_EQ(bm_serial_ctx_dfu_send_finish(&tx_ctx, 0, false, 0),
+            BM_SERIAL_OK);
+}
+
+TEST_F(DfuTxTest, ReadFailTxq) {
+  // A slot claimed for the chunk would hold up everything queued after it
+  static bm_serial_txq_slot_t slots[4];
+  static bm_serial_txq_t txq;
+  ASSERT_EQ(bm_serial_txq_init(&txq, slots, 4), BM_SERIAL_OK);
+  bm_serial_ctx_set_txq(&tx_ctx, &txq);
+
+  cfg.image = NULL;
+  cfg.read_fn = read_fn;
+  read_ok = false;
+  EXPECT_EQ(bm_serial_dfu_tx_start(&dfu, &tx_ctx, &start, &cfg),
+            BM_SERIAL_MISC_ERR);
+  EXPECT_EQ(bm_serial_ctx_dfu_send_finish(&tx_ctx, 0, false, 0),
+            BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_ctx_txq_flush(&tx_ctx), BM_SERIAL_OK);
+
+  // DFU start and finish
+  EXPECT_EQ(tx_frames, 2u);
+  EXPECT_EQ(tx_ctx.stats.tx_packets, 2u);
+}
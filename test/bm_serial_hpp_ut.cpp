@@ -0,0 +1,525 @@
+#include "gtest/gtest.h"
+#include "bm_serial.hpp"
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace bm_serial;
+
+static bm_serial_ctx_t ctx;
+
+// Last packet sent by ctx, without COBS
+static std::vector<uint8_t> hpp_sent;
+
+static bool hpp_tx_fn(const uint8_t *buff, size_t len) {
+  hpp_sent.assign(buff, buff + len);
+  return true;
+}
+
+// Last pub and rtc received by ctx
+static std::string hpp_topic;
+static std::string hpp_data;
+static uint64_t hpp_node_id;
+static bm_serial_time_t hpp_time;
+
+static bool hpp_pub_fn(const char *topic, uint16_t topic_len, uint64_t node_id,
+                       const uint8_t *payload, size_t len, uint8_t type,
+                       uint8_t version) {
+  EXPECT_EQ(type, 3);
+  EXPECT_EQ(version, 4);
+  hpp_topic.assign(topic, topic_len);
+  hpp_data.assign((const char *)payload, len);
+  hpp_node_id = node_id;
+  return true;
+}
+
+static bool hpp_rtc_set_fn(bm_serial_time_t *time) {
+  hpp_time = *time;
+  return true;
+}
+
+// Recompute the crc of a packet after editing it
+static void hpp_fix_crc(uint8_t *buff, size_t len) {
+  buff[2] = buff[3] = 0;
+  uint16_t crc16 = bm_serial_crc16_ccitt(0, buff, len);
+  memcpy(&buff[2], &crc16, sizeof(crc16));
+}
+
+class CodecTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    bm_serial_callbacks_t callbacks = {};
+    callbacks.tx_fn = hpp_tx_fn;
+    callbacks.pub_fn = hpp_pub_fn;
+    callbacks.rtc_set_fn = hpp_rtc_set_fn;
+    bm_serial_ctx_init(&ctx, &callbacks);
+    bm_serial_ctx_set_cobs_tx(&ctx, false);
+    hpp_sent.clear();
+    hpp_topic.clear();
+    hpp_data.clear();
+    hpp_node_id = 0;
+    memset(&hpp_time, 0, sizeof(hpp_time));
+  }
+};
+
+TEST_F(CodecTest, Fixed) {
+  bm_serial_self_test_t self_test = {1234, 0xABCD};
+  uint8_t buff[message<BM_SERIAL_SELF_TEST>::wire_size];
+  static_assert(sizeof(buff) == 16);
+
+  size_t len = message<BM_SERIAL_SELF_TEST>::encode(buff, self_test);
+  ASSERT_EQ(len, sizeof(buff));
+
+  bm_serial_self_test_t decoded = {};
+  EXPECT_EQ(message<BM_SERIAL_SELF_TEST>::decode(buff, decoded), BM_SERIAL_OK);
+  EXPECT_EQ(decoded.node_id, 1234u);
+  EXPECT_EQ(decoded.result, 0xABCDu);
+
+  // Same bytes as the C api
+  ASSERT_EQ(bm_serial_ctx_send_self_test(&ctx, 1234, 0xABCD), BM_SERIAL_OK);
+  ASSERT_EQ(hpp_sent.size(), len);
+  EXPECT_EQ(memcmp(hpp_sent.data(), buff, len), 0);
+
+  // Doesn't fit
+  EXPECT_EQ(message<BM_SERIAL_SELF_TEST>::encode({buff, len - 1}, self_test),
+            0u);
+}
+
+TEST_F(CodecTest, Raw) {
+  const char log[] = "some log line";
+  std::vector<uint8_t> buff(message<BM_SERIAL_LOG>::wire_size(sizeof(log)));
+  ASSERT_EQ(message<BM_SERIAL_LOG>::encode(
+                buff, {(const uint8_t *)log, sizeof(log)}),
+            buff.size());
+
+  const_bytes data;
+  EXPECT_EQ(message<BM_SERIAL_LOG>::decode(buff, data), BM_SERIAL_OK);
+  ASSERT_EQ(data.size(), sizeof(log));
+  EXPECT_EQ(memcmp(data.data(), log, sizeof(log)), 0);
+
+  // Not a debug message
+  EXPECT_EQ(message<BM_SERIAL_DEBUG>::decode(buff, data),
+            BM_SERIAL_UNSUPPORTED_MSG);
+}
+
+TEST_F(CodecTest, Topic) {
+  uint8_t buff[128];
+  size_t len = message<BM_SERIAL_SUB>::encode(buff, "sensor/temp");
+  ASSERT_EQ(len, message<BM_SERIAL_SUB>::wire_size(11));
+
+  std::string_view topic;
+  EXPECT_EQ(message<BM_SERIAL_SUB>::decode({buff, len}, topic), BM_SERIAL_OK);
+  EXPECT_EQ(topic, "sensor/temp");
+
+  ASSERT_EQ(bm_serial_ctx_sub(&ctx, "sensor/temp", 11), BM_SERIAL_OK);
+  ASSERT_EQ(hpp_sent.size(), len);
+  EXPECT_EQ(memcmp(hpp_sent.data(), buff, len), 0);
+
+  // Empty and too long
+  EXPECT_EQ(message<BM_SERIAL_SUB>::encode(buff, ""), 0u);
+  EXPECT_EQ(message<BM_SERIAL_SUB>::encode(buff, std::string(65, 'a')), 0u);
+  EXPECT_EQ(message<BM_SERIAL_SUB>::encode(buff, std::string(64, 'a')),
+            message<BM_SERIAL_SUB>::wire_size(64));
+
+  // Topic length past the end of the packet
+  len = message<BM_SERIAL_UNSUB>::encode(buff, "sensor/temp");
+  buff[header_size] = 12;
+  hpp_fix_crc(buff, len);
+  EXPECT_EQ(message<BM_SERIAL_UNSUB>::decode({buff, len}, topic),
+            BM_SERIAL_INVALID_TOPIC_LEN);
+}
+
+TEST_F(CodecTest, Pub) {
+  uint8_t buff[128];
+  const uint8_t data[] = {'d', 'a', 't', 'a'};
+  size_t len =
+      message<BM_SERIAL_PUB>::encode(buff, 1234, "sensor/temp", data, 3, 4);
+  ASSERT_EQ(len, message<BM_SERIAL_PUB>::wire_size(11, sizeof(data)));
+
+  pub_view pub = {};
+  ASSERT_EQ(message<BM_SERIAL_PUB>::decode({buff, len}, pub), BM_SERIAL_OK);
+  EXPECT_EQ(pub.node_id, 1234u);
+  EXPECT_EQ(pub.topic, "sensor/temp");
+  ASSERT_EQ(pub.data.size(), sizeof(data));
+  EXPECT_EQ(memcmp(pub.data.data(), data, sizeof(data)), 0);
+  EXPECT_EQ(pub.type, 3);
+  EXPECT_EQ(pub.version, 4);
+
+  // bm_serial.c takes it as is
+  ASSERT_EQ(bm_serial_ctx_process_packet(&ctx, (bm_serial_packet_t *)buff,
+                                         len),
+            BM_SERIAL_OK);
+  EXPECT_EQ(hpp_topic, "sensor/temp");
+  EXPECT_EQ(hpp_data, "data");
+  EXPECT_EQ(hpp_node_id, 1234u);
+
+  // And the codec takes what bm_serial.c sends
+  ASSERT_EQ(bm_serial_ctx_pub(&ctx, 5678, "other", 5, data, sizeof(data), 3, 4),
+            BM_SERIAL_OK);
+  ASSERT_EQ(message<BM_SERIAL_PUB>::decode(hpp_sent, pub), BM_SERIAL_OK);
+  EXPECT_EQ(pub.node_id, 5678u);
+  EXPECT_EQ(pub.topic, "other");
+  EXPECT_EQ(pub.data.size(), sizeof(data));
+}
+
+TEST_F(CodecTest, Rtc) {
+  bm_serial_rtc_t rtc = {};
+  rtc.time.year = 2024;
+  rtc.time.month = 5;
+  rtc.time.second = 30;
+  rtc.time.us = 1000;
+  uint8_t buff[message<BM_SERIAL_RTC_SET>::wire_size];
+  ASSERT_EQ(message<BM_SERIAL_RTC_SET>::encode(buff, rtc), sizeof(buff));
+
+  ASSERT_EQ(bm_serial_ctx_process_packet(&ctx, (bm_serial_packet_t *)buff,
+                                         sizeof(buff)),
+            BM_SERIAL_OK);
+  EXPECT_EQ(hpp_time.year, 2024);
+  EXPECT_EQ(hpp_time.month, 5);
+  EXPECT_EQ(hpp_time.second, 30);
+  EXPECT_EQ(hpp_time.us, 1000u);
+}
+
+TEST_F(CodecTest, NetMsgAndDfuChunk) {
+  uint8_t buff[128];
+  const uint8_t data[] = {1, 2, 3, 4, 5};
+
+  size_t len = message<BM_SERIAL_NET_MSG>::encode(buff, 1234, data);
+  ASSERT_EQ(len, message<BM_SERIAL_NET_MSG>::wire_size(sizeof(data)));
+  net_msg_view msg = {};
+  ASSERT_EQ(message<BM_SERIAL_NET_MSG>::decode({buff, len}, msg),
+            BM_SERIAL_OK);
+  EXPECT_EQ(msg.node_id, 1234u);
+  EXPECT_EQ(msg.flags, 0);
+  EXPECT_EQ(msg.data.size(), sizeof(data));
+
+  len = message<BM_SERIAL_DFU_CHUNK>::encode(buff, 256, data);
+  ASSERT_EQ(len, message<BM_SERIAL_DFU_CHUNK>::wire_size(sizeof(data)));
+  dfu_chunk_view chunk = {};
+  ASSERT_EQ(message<BM_SERIAL_DFU_CHUNK>::decode({buff, len}, chunk),
+            BM_SERIAL_OK);
+  EXPECT_EQ(chunk.offset, 256u);
+  EXPECT_EQ(chunk.length, sizeof(data));
+  EXPECT_EQ(memcmp(chunk.data.data(), data, sizeof(data)), 0);
+
+  // Naks from bm_serial.c have a length but no data
+  ASSERT_EQ(bm_serial_ctx_dfu_send_nak(&ctx, 512, 64), BM_SERIAL_OK);
+  ASSERT_EQ(message<BM_SERIAL_DFU_CHUNK>::decode(hpp_sent, chunk),
+            BM_SERIAL_OK);
+  EXPECT_EQ(chunk.offset, 512u | DFU_CHUNK_NAK_BITFLAG);
+  EXPECT_EQ(chunk.length, 64u);
+  EXPECT_TRUE(chunk.data.empty());
+
+  // Length doesn't match the data
+  len = message<BM_SERIAL_DFU_CHUNK>::encode(buff, 256, data);
+  hpp_fix_crc(buff, len - 1);
+  EXPECT_EQ(message<BM_SERIAL_DFU_CHUNK>::decode({buff, len - 1}, chunk),
+            BM_SERIAL_INVALID_MSG_LEN);
+}
+
+TEST_F(CodecTest, Errors) {
+  uint8_t buff[message<BM_SERIAL_ALIAS_RESET>::wire_size];
+  bm_serial_alias_reset_t reset = {BM_SERIAL_ALIAS_ALL};
+  ASSERT_EQ(message<BM_SERIAL_ALIAS_RESET>::encode(buff, reset), sizeof(buff));
+
+  // Short
+  EXPECT_EQ(message<BM_SERIAL_ALIAS_RESET>::decode({buff, 3}, reset),
+            BM_SERIAL_INVALID_MSG_LEN);
+
+  // Bad crc
+  buff[4] ^= 1;
+  EXPECT_EQ(message<BM_SERIAL_ALIAS_RESET>::decode(buff, reset),
+            BM_SERIAL_CRC_ERR);
+  buff[4] ^= 1;
+
+  // Wrong type
+  EXPECT_EQ(message<BM_SERIAL_DFU_START>::encode(
+                buff, bm_serial_dfu_start_t{}),
+            0u);
+  bm_serial_device_info_request_t request = {};
+  EXPECT_EQ(message<BM_SERIAL_DEVICE_INFO_REQ>::decode(buff, request),
+            BM_SERIAL_UNSUPPORTED_MSG);
+
+  // Compressed payloads go through bm_serial.c
+  buff[1] = BM_SERIAL_FLAG_COMPRESSED;
+  hpp_fix_crc(buff, sizeof(buff));
+  EXPECT_EQ(message<BM_SERIAL_ALIAS_RESET>::decode(buff, reset),
+            BM_SERIAL_UNSUPPORTED_MSG);
+}
+
+TEST_F(CodecTest, PubAlias) {
+  uint8_t buff[128];
+  const uint8_t data[] = {'d', 'a', 't', 'a'};
+  size_t len = message<BM_SERIAL_PUB_ALIAS>::encode(buff, 1234, 7, 2,
+                                                    "sensor/temp", data, 3, 4);
+  ASSERT_EQ(len, message<BM_SERIAL_PUB_ALIAS>::wire_size(11, sizeof(data)));
+
+  pub_alias_view pub = {};
+  ASSERT_EQ(message<BM_SERIAL_PUB_ALIAS>::decode({buff, len}, pub),
+            BM_SERIAL_OK);
+  EXPECT_EQ(pub.node_id, 1234u);
+  EXPECT_EQ(pub.alias, 7);
+  EXPECT_EQ(pub.generation, 2);
+  EXPECT_EQ(pub.topic, "sensor/temp");
+  EXPECT_EQ(pub.data.size(), sizeof(data));
+
+  // bm_serial.c takes the topic, even without aliasing
+  ASSERT_EQ(bm_serial_ctx_process_packet(&ctx, (bm_serial_packet_t *)buff,
+                                         len),
+            BM_SERIAL_OK);
+  EXPECT_EQ(hpp_topic, "sensor/temp");
+  EXPECT_EQ(hpp_data, "data");
+
+  // Alias only
+  len = message<BM_SERIAL_PUB_ALIAS>::encode(buff, 1234, 7, 2, "", data, 3, 4);
+  ASSERT_EQ(message<BM_SERIAL_PUB_ALIAS>::decode({buff, len}, pub),
+            BM_SERIAL_OK);
+  EXPECT_TRUE(pub.topic.empty());
+  EXPECT_EQ(pub.data.size(), sizeof(data));
+
+  // Topic past the end of the payload
+  EXPECT_EQ(message<BM_SERIAL_PUB_ALIAS>::decode_payload(
+                {&buff[header_size], 10}, pub),
+            BM_SERIAL_INVALID_MSG_LEN);
+  buff[header_size + offsetof(bm_serial_pub_alias_header_t, topic_len)] = 5;
+  EXPECT_EQ(message<BM_SERIAL_PUB_ALIAS>::decode_payload(
+                {&buff[header_size], len - header_size}, pub),
+            BM_SERIAL_INVALID_TOPIC_LEN);
+}
+
+TEST_F(CodecTest, CfgRequests) {
+  uint8_t buff[128];
+
+  // Same bytes as the C api
+  size_t len = message<BM_SERIAL_CFG_GET>::encode(
+      buff, 1234, BM_COMMON_CFG_PARTITION_SYSTEM, "period");
+  ASSERT_EQ(len, message<BM_SERIAL_CFG_GET>::wire_size(6));
+  ASSERT_EQ(bm_serial_ctx_cfg_get(&ctx, 1234, BM_COMMON_CFG_PARTITION_SYSTEM,
+                                  6, "period"),
+            BM_SERIAL_OK);
+  ASSERT_EQ(hpp_sent.size(), len);
+  EXPECT_EQ(memcmp(hpp_sent.data(), buff, len), 0);
+
+  cfg_key_view key = {};
+  ASSERT_EQ(message<BM_SERIAL_CFG_GET>::decode({buff, len}, key),
+            BM_SERIAL_OK);
+  EXPECT_EQ(key.target_node_id, 1234u);
+  EXPECT_EQ(key.partition, BM_COMMON_CFG_PARTITION_SYSTEM);
+  EXPECT_EQ(key.key, "period");
+  EXPECT_EQ(message<BM_SERIAL_CFG_DEL_REQ>::decode({buff, len}, key),
+            BM_SERIAL_UNSUPPORTED_MSG);
+
+  len = message<BM_SERIAL_CFG_DEL_REQ>::encode(
+      buff, 1234, BM_COMMON_CFG_PARTITION_USER, "period");
+  ASSERT_EQ(bm_serial_ctx_cfg_delete_request(
+                &ctx, 1234, BM_COMMON_CFG_PARTITION_USER, 6, "period"),
+            BM_SERIAL_OK);
+  ASSERT_EQ(hpp_sent.size(), len);
+  EXPECT_EQ(memcmp(hpp_sent.data(), buff, len), 0);
+
+  uint32_t value = 100;
+  len = message<BM_SERIAL_CFG_SET>::encode(
+      buff, 1234, BM_COMMON_CFG_PARTITION_USER, "period",
+      {(const uint8_t *)&value, sizeof(value)});
+  ASSERT_EQ(len, message<BM_SERIAL_CFG_SET>::wire_size(6, sizeof(value)));
+  ASSERT_EQ(bm_serial_ctx_cfg_set(&ctx, 1234, BM_COMMON_CFG_PARTITION_USER, 6,
+                                  "period", sizeof(value), &value),
+            BM_SERIAL_OK);
+  ASSERT_EQ(hpp_sent.size(), len);
+  EXPECT_EQ(memcmp(hpp_sent.data(), buff, len), 0);
+
+  cfg_set_view set = {};
+  ASSERT_EQ(message<BM_SERIAL_CFG_SET>::decode({buff, len}, set),
+            BM_SERIAL_OK);
+  EXPECT_EQ(set.key, "period");
+  ASSERT_EQ(set.data.size(), sizeof(value));
+  EXPECT_EQ(memcmp(set.data.data(), &value, sizeof(value)), 0);
+
+  bm_common_config_commit_t commit = {};
+  commit.header.target_node_id = 1234;
+  commit.partition = BM_COMMON_CFG_PARTITION_USER;
+  len = message<BM_SERIAL_CFG_COMMIT>::encode(buff, commit);
+  ASSERT_EQ(bm_serial_ctx_cfg_commit(&ctx, 1234,
+                                     BM_COMMON_CFG_PARTITION_USER),
+            BM_SERIAL_OK);
+  ASSERT_EQ(hpp_sent.size(), len);
+  EXPECT_EQ(memcmp(hpp_sent.data(), buff, len), 0);
+
+  // Key longer than the data
+  len = message<BM_SERIAL_CFG_SET>::encode(
+      buff, 1234, BM_COMMON_CFG_PARTITION_USER, "period",
+      {(const uint8_t *)&value, sizeof(value)});
+  hpp_fix_crc(buff, len - 1);
+  EXPECT_EQ(message<BM_SERIAL_CFG_SET>::decode({buff, len - 1}, set),
+            BM_SERIAL_INVALID_MSG_LEN);
+  EXPECT_EQ(message<BM_SERIAL_CFG_GET>::encode(
+                buff, 1234, BM_COMMON_CFG_PARTITION_USER,
+                std::string(256, 'k')),
+            0u);
+}
+
+TEST_F(CodecTest, CfgReplies) {
+  uint8_t buff[128];
+
+  // The codec takes what bm_serial.c sends
+  uint32_t value = 100;
+  ASSERT_EQ(bm_serial_ctx_cfg_value(&ctx, 1234, BM_COMMON_CFG_PARTITION_USER,
+                                    sizeof(value), &value),
+            BM_SERIAL_OK);
+  cfg_value_view cfg_value = {};
+  ASSERT_EQ(message<BM_SERIAL_CFG_VALUE>::decode(hpp_sent, cfg_value),
+            BM_SERIAL_OK);
+  EXPECT_EQ(cfg_value.source_node_id, 1234u);
+  EXPECT_EQ(cfg_value.target_node_id, 0u);
+  ASSERT_EQ(cfg_value.data.size(), sizeof(value));
+  EXPECT_EQ(memcmp(cfg_value.data.data(), &value, sizeof(value)), 0);
+
+  // And sends the same bytes
+  size_t len = message<BM_SERIAL_CFG_VALUE>::encode(
+      buff, 1234, BM_COMMON_CFG_PARTITION_USER,
+      {(const uint8_t *)&value, sizeof(value)});
+  ASSERT_EQ(hpp_sent.size(), len);
+  EXPECT_EQ(memcmp(hpp_sent.data(), buff, len), 0);
+
+  const std::string_view keys[] = {"period", "", "name"};
+  len = message<BM_SERIAL_CFG_STATUS_RESP>::encode(
+      buff, 1234, BM_COMMON_CFG_PARTITION_SYSTEM, true, keys);
+  ASSERT_EQ(len, message<BM_SERIAL_CFG_STATUS_RESP>::wire_size(keys));
+  ASSERT_EQ(bm_serial_ctx_cfg_status_response(
+                &ctx, 1234, BM_COMMON_CFG_PARTITION_SYSTEM, true, 3,
+                &buff[message<BM_SERIAL_CFG_STATUS_RESP>::keys_offset]),
+            BM_SERIAL_OK);
+  ASSERT_EQ(hpp_sent.size(), len);
+  EXPECT_EQ(memcmp(hpp_sent.data(), buff, len), 0);
+
+  cfg_status_view status = {};
+  ASSERT_EQ(message<BM_SERIAL_CFG_STATUS_RESP>::decode({buff, len}, status),
+            BM_SERIAL_OK);
+  EXPECT_EQ(status.source_node_id, 1234u);
+  EXPECT_TRUE(status.committed);
+  EXPECT_EQ(status.num_keys, 3);
+  std::vector<std::string> decoded_keys;
+  message<BM_SERIAL_CFG_STATUS_RESP>::for_each_key(
+      status, [&](std::string_view key) { decoded_keys.emplace_back(key); });
+  EXPECT_EQ(decoded_keys, (std::vector<std::string>{"period", "", "name"}));
+
+  // Last key cut short
+  hpp_fix_crc(buff, len - 1);
+  EXPECT_EQ(message<BM_SERIAL_CFG_STATUS_RESP>::decode({buff, len - 1},
+                                                       status),
+            BM_SERIAL_INVALID_MSG_LEN);
+
+  len = message<BM_SERIAL_CFG_DEL_RESP>::encode(
+      buff, 1234, BM_COMMON_CFG_PARTITION_USER, "period", true);
+  ASSERT_EQ(bm_serial_ctx_cfg_delete_response(
+                &ctx, 1234, BM_COMMON_CFG_PARTITION_USER, 6, "period", true),
+            BM_SERIAL_OK);
+  ASSERT_EQ(hpp_sent.size(), len);
+  EXPECT_EQ(memcmp(hpp_sent.data(), buff, len), 0);
+
+  cfg_del_view del = {};
+  ASSERT_EQ(message<BM_SERIAL_CFG_DEL_RESP>::decode({buff, len}, del),
+            BM_SERIAL_OK);
+  EXPECT_EQ(del.source_node_id, 1234u);
+  EXPECT_EQ(del.key, "period");
+  EXPECT_TRUE(del.success);
+}
+
+static std::vector<uint64_t> hpp_nodes;
+
+static bool hpp_network_info_fn(bm_common_network_info_t *info) {
+  hpp_nodes.resize(info->num_nodes);
+  memcpy(hpp_nodes.data(), info->node_list_and_cbor_config_map,
+         info->num_nodes * sizeof(uint64_t));
+  return true;
+}
+
+TEST_F(CodecTest, NetworkInfo) {
+  uint8_t buff[128];
+  bm_common_network_info_t info = {};
+  info.network_crc32 = 0xdeadbeef;
+  info.fw_info.major = 2;
+  const uint64_t nodes[] = {1, 2, 0x123456789abcdef0};
+  const uint8_t map[] = {0xa1, 0x01, 0x02};
+
+  size_t len = message<BM_SERIAL_NETWORK_INFO>::encode(buff, info, nodes, map);
+  ASSERT_EQ(len, message<BM_SERIAL_NETWORK_INFO>::wire_size(3, sizeof(map)));
+
+  network_info_view view = {};
+  ASSERT_EQ(message<BM_SERIAL_NETWORK_INFO>::decode({buff, len}, view),
+            BM_SERIAL_OK);
+  EXPECT_EQ(view.network_crc32, 0xdeadbeefu);
+  EXPECT_EQ(view.fw_info.major, 2);
+  ASSERT_EQ(view.num_nodes, 3);
+  EXPECT_EQ(view.node(2), 0x123456789abcdef0u);
+  ASSERT_EQ(view.map.size(), sizeof(map));
+  EXPECT_EQ(memcmp(view.map.data(), map, sizeof(map)), 0);
+
+  ctx.callbacks.network_info_fn = hpp_network_info_fn;
+  ASSERT_EQ(bm_serial_ctx_process_packet(&ctx, (bm_serial_packet_t *)buff,
+                                         len),
+            BM_SERIAL_OK);
+  EXPECT_EQ(hpp_nodes, std::vector<uint64_t>(nodes, nodes + 3));
+
+  // Map runs past the end
+  hpp_fix_crc(buff, len - 1);
+  EXPECT_EQ(message<BM_SERIAL_NETWORK_INFO>::decode({buff, len - 1}, view),
+            BM_SERIAL_INVALID_MSG_LEN);
+}
+
+TEST_F(CodecTest, DeviceInfoAndResources) {
+  uint8_t buff[128];
+  bm_serial_device_info_t info = {};
+  info.node_id = 1234;
+  info.ver_major = 3;
+
+  size_t len = message<BM_SERIAL_DEVICE_INFO_REPLY>::encode(buff, info,
+                                                            "v3.0", "spotter");
+  ASSERT_EQ(len, message<BM_SERIAL_DEVICE_INFO_REPLY>::wire_size(4, 7));
+  device_info_view device = {};
+  ASSERT_EQ(message<BM_SERIAL_DEVICE_INFO_REPLY>::decode({buff, len}, device),
+            BM_SERIAL_OK);
+  EXPECT_EQ(device.info.node_id, 1234u);
+  EXPECT_EQ(device.info.ver_major, 3);
+  EXPECT_EQ(device.version, "v3.0");
+  EXPECT_EQ(device.name, "spotter");
+
+  // Same bytes as the C api
+  ASSERT_EQ(bm_serial_ctx_send_info_reply(
+                &ctx, 1234,
+                (bm_serial_device_info_reply_t *)&buff[header_size]),
+            BM_SERIAL_OK);
+  ASSERT_EQ(hpp_sent.size(), len);
+  EXPECT_EQ(memcmp(hpp_sent.data(), buff, len), 0);
+
+  const std::string_view pubs[] = {"sensor/temp", "sensor/humidity"};
+  const std::string_view subs[] = {"cmd"};
+  len = message<BM_SERIAL_RESOURCE_REPLY>::encode(buff, 1234, pubs, subs);
+  ASSERT_EQ(len, message<BM_SERIAL_RESOURCE_REPLY>::wire_size(pubs, subs));
+  ASSERT_EQ(bm_serial_ctx_send_resource_reply(
+                &ctx, 1234,
+                (bm_serial_resource_table_reply_t *)&buff[header_size]),
+            BM_SERIAL_OK);
+  ASSERT_EQ(hpp_sent.size(), len);
+  EXPECT_EQ(memcmp(hpp_sent.data(), buff, len), 0);
+
+  resource_table_view table = {};
+  ASSERT_EQ(message<BM_SERIAL_RESOURCE_REPLY>::decode({buff, len}, table),
+            BM_SERIAL_OK);
+  EXPECT_EQ(table.node_id, 1234u);
+  std::vector<std::pair<std::string, bool>> resources;
+  message<BM_SERIAL_RESOURCE_REPLY>::for_each_resource(
+      table, [&](std::string_view name, bool pub) {
+        resources.emplace_back(name, pub);
+      });
+  ASSERT_EQ(resources.size(), 3u);
+  EXPECT_EQ(resources[0], std::make_pair(std::string("sensor/temp"), true));
+  EXPECT_EQ(resources[1].second, true);
+  EXPECT_EQ(resources[2], std::make_pair(std::string("cmd"), false));
+
+  // Truncated
+  hpp_fix_crc(buff, len - 1);
+  EXPECT_EQ(message<BM_SERIAL_RESOURCE_REPLY>::decode({buff, len - 1}, table),
+            BM_SERIAL_INVALID_MSG_LEN);
+}
@@ -0,0 +1,318 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_batch.h"
+#include "bm_serial_crc.h"
+#include "bm_serial_lz.h"
+
+#include <random>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static bm_serial_ctx_t tx_ctx;
+static bm_serial_ctx_t rx_ctx;
+static bm_serial_lz_t tx_lz;
+static bm_serial_lz_t rx_lz;
+
+typedef std::vector<uint8_t> frame_t;
+static std::vector<frame_t> frames;
+
+struct lz_pub_t {
+  std::string topic;
+  std::vector<uint8_t> data;
+};
+static std::vector<lz_pub_t> received;
+static std::vector<uint8_t> chunk;
+
+static bool tx_fn(const uint8_t *buff, size_t len) {
+  frames.emplace_back(buff, buff + len);
+  return true;
+}
+
+static bool pub_fn(const char *topic, uint16_t topic_len, uint64_t node_id,
+                   const uint8_t *payload, size_t len, uint8_t type,
+                   uint8_t version) {
+  (void)node_id;
+  (void)type;
+  (void)version;
+  received.push_back({std::string(topic, topic_len),
+                      std::vector<uint8_t>(payload, payload + len)});
+  return true;
+}
+
+static bool dfu_chunk_fn(uint32_t offset, size_t length, uint8_t *data) {
+  (void)offset;
+  chunk.assign(data, data + length);
+  return true;
+}
+
+static uint32_t now_fn(void) { return 0; }
+
+static std::vector<uint8_t> random_data(size_t len) {
+  std::mt19937 rng(1234);
+  std::vector<uint8_t> data(len);
+  for (auto &byte : data) {
+    byte = rng();
+  }
+  return data;
+}
+
+// Sensor readings as text, compresses well
+static std::vector<uint8_t> text_data(size_t len) {
+  std::string text;
+  for (uint32_t sample = 0; text.size() < len; sample++) {
+    text += std::to_string(1700000000 + sample) + ",21." +
+            std::to_string(sample % 7) + ",1013\n";
+  }
+  return std::vector<uint8_t>(text.begin(), text.begin() + len);
+}
+
+static void round_trip(const std::vector<uint8_t> &data) {
+  std::vector<uint8_t> compressed(BM_SERIAL_LZ_BOUND(data.size()));
+  size_t compressed_len = bm_serial_lz_compress(
+      &tx_lz, data.data(), data.size(), compressed.data(), compressed.size());
+  ASSERT_GT(compressed_len, 0u);
+
+  std::vector<uint8_t> out(data.size());
+  EXPECT_EQ(bm_serial_lz_decompress(compressed.data(), compressed_len,
+                                    out.data(), out.size()),
+            data.size());
+  EXPECT_EQ(out, data);
+
+  // Output one byte short
+  if (data.size()) {
+    EXPECT_EQ(bm_serial_lz_decompress(compressed.data(), compressed_len,
+                                      out.data(), out.size() - 1),
+              0u);
+  }
+}
+
+// Deliver every frame sent so far
+static bm_serial_error_e deliver(void) {
+  bm_serial_error_e rval = BM_SERIAL_OK;
+  for (auto &frame : frames) {
+    bm_serial_error_e frame_rval = bm_serial_ctx_process_packet(
+        &rx_ctx, (bm_serial_packet_t *)frame.data(), frame.size());
+    if (frame_rval && !rval) {
+      rval = frame_rval;
+    }
+  }
+  frames.clear();
+  return rval;
+}
+
+static bm_serial_error_e pub(const std::vector<uint8_t> &data) {
+  return bm_serial_ctx_pub(&tx_ctx, 1234, "sensor/log", 10, data.data(),
+                           data.size(), 1, 1);
+}
+
+class LzTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    bm_serial_callbacks_t tx_callbacks = {};
+    tx_callbacks.tx_fn = tx_fn;
+    bm_serial_ctx_init(&tx_ctx, &tx_callbacks);
+    ASSERT_EQ(bm_serial_lz_init(&tx_lz, &tx_ctx, 32), BM_SERIAL_OK);
+
+    bm_serial_callbacks_t rx_callbacks = {};
+    rx_callbacks.pub_fn = pub_fn;
+    rx_callbacks.dfu_chunk_fn = dfu_chunk_fn;
+    bm_serial_ctx_init(&rx_ctx, &rx_callbacks);
+    ASSERT_EQ(bm_serial_lz_init(&rx_lz, &rx_ctx, 32), BM_SERIAL_OK);
+
+    frames.clear();
+    received.clear();
+    chunk.clear();
+  }
+};
+
+TEST_F(LzTest, Errors) {
+  EXPECT_EQ(bm_serial_lz_init(NULL, &tx_ctx, 32), BM_SERIAL_NULL_BUFF);
+  EXPECT_EQ(bm_serial_lz_init(&tx_lz, NULL, 32), BM_SERIAL_NULL_BUFF);
+  EXPECT_EQ(bm_serial_lz_init(&tx_lz, &tx_ctx, 0), BM_SERIAL_MISC_ERR);
+}
+
+TEST_F(LzTest, RoundTrip) {
+  const size_t sizes[] = {0, 1, 12, 13, 100, 255, 256, 1000, 2048};
+  for (size_t size : sizes) {
+    round_trip(std::vector<uint8_t>(size, 0));
+    round_trip(random_data(size));
+    round_trip(text_data(size));
+  }
+
+  // Short period repeats (overlapping matches) and long literal/match runs
+  std::vector<uint8_t> data;
+  for (size_t idx = 0; idx < 300; idx++) {
+    data.push_back("abc"[idx % 3]);
+  }
+  std::vector<uint8_t> noise = random_data(600);
+  data.insert(data.end(), noise.begin(), noise.end());
+  data.insert(data.end(), noise.begin(), noise.end());
+  round_trip(data);
+
+  // Zeros shrink a lot, random data doesn't fit in its own size
+  std::vector<uint8_t> zeros(1024, 0);
+  uint8_t compressed[BM_SERIAL_LZ_BOUND(1024)];
+  EXPECT_LT(bm_serial_lz_compress(&tx_lz, zeros.data(), zeros.size(),
+                                  compressed, sizeof(compressed)),
+            32u);
+  std::vector<uint8_t> noisy = random_data(1024);
+  EXPECT_EQ(
+      bm_serial_lz_compress(&tx_lz, noisy.data(), noisy.size(), compressed,
+                            noisy.size() - 1),
+      0u);
+}
+
+TEST_F(LzTest, Malformed) {
+  uint8_t out[64];
+
+  // Literal length runs past the input
+  const uint8_t literals[] = {0x50, 'a', 'b'};
+  EXPECT_EQ(bm_serial_lz_decompress(literals, sizeof(literals), out,
+                                    sizeof(out)),
+            0u);
+
+  // Offset before the start of the output
+  const uint8_t offset[] = {0x10, 'a', 0x02, 0x00};
+  EXPECT_EQ(bm_serial_lz_decompress(offset, sizeof(offset), out, sizeof(out)),
+            0u);
+
+  // Zero offset
+  const uint8_t zero[] = {0x10, 'a', 0x00, 0x00};
+  EXPECT_EQ(bm_serial_lz_decompress(zero, sizeof(zero), out, sizeof(out)),
+            0u);
+
+  // Offset cut short
+  const uint8_t short_offset[] = {0x10, 'a', 0x01};
+  EXPECT_EQ(bm_serial_lz_decompress(short_offset, sizeof(short_offset), out,
+                                    sizeof(out)),
+            0u);
+
+  // Extra length bytes missing
+  const uint8_t extra[] = {0xF0};
+  EXPECT_EQ(bm_serial_lz_decompress(extra, sizeof(extra), out, sizeof(out)),
+            0u);
+
+  // Match longer than the output
+  const uint8_t long_match[] = {0x1F, 'a', 0x01, 0x00, 0xFF, 0x00};
+  EXPECT_EQ(bm_serial_lz_decompress(long_match, sizeof(long_match), out,
+                                    sizeof(out)),
+            0u);
+
+  // Overlapping match
+  const uint8_t overlap[] = {0x13, 'a', 0x01, 0x00, 0x00};
+  EXPECT_EQ(bm_serial_lz_decompress(overlap, sizeof(overlap) - 1, out,
+                                    sizeof(out)),
+            8u);
+  EXPECT_EQ(std::string((const char *)out, 8), "aaaaaaaa");
+
+  // Corrupt payload with a good crc
+  frame_t frame(sizeof(bm_serial_packet_t));
+  frame.insert(frame.end(), offset, offset + sizeof(offset));
+  bm_serial_packet_t *packet = (bm_serial_packet_t *)frame.data();
+  packet->type = BM_SERIAL_PUB;
+  packet->flags = BM_SERIAL_FLAG_COMPRESSED;
+  packet->crc16 = bm_serial_crc16_ccitt(0, frame.data(), frame.size());
+  frames.push_back(frame);
+  EXPECT_EQ(deliver(), BM_SERIAL_COMPRESSION_ERR);
+  EXPECT_EQ(rx_lz.stats.rx_errors, 1u);
+  EXPECT_TRUE(received.empty());
+}
+
+TEST_F(LzTest, Pub) {
+  std::vector<uint8_t> data = text_data(1024);
+  ASSERT_EQ(pub(data), BM_SERIAL_OK);
+  ASSERT_EQ(frames.size(), 1u);
+
+  bm_serial_packet_t *packet = (bm_serial_packet_t *)frames[0].data();
+  EXPECT_EQ(packet->type, BM_SERIAL_PUB);
+  EXPECT_TRUE(packet->flags & BM_SERIAL_FLAG_COMPRESSED);
+  EXPECT_LT(frames[0].size() * 2, data.size());
+  EXPECT_EQ(tx_lz.stats.compressed, 1u);
+  EXPECT_EQ(tx_lz.stats.bytes_out, frames[0].size() - sizeof(*packet));
+
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  ASSERT_EQ(received.size(), 1u);
+  EXPECT_EQ(received[0].topic, "sensor/log");
+  EXPECT_EQ(received[0].data, data);
+  EXPECT_EQ(rx_lz.stats.rx_decompressed, 1u);
+}
+
+TEST_F(LzTest, Bypass) {
+  // Random data doesn't shrink, short payloads aren't tried
+  std::vector<uint8_t> data = random_data(512);
+  ASSERT_EQ(pub(data), BM_SERIAL_OK);
+  std::vector<uint8_t> small(8, 0);
+  ASSERT_EQ(pub(small), BM_SERIAL_OK);
+  ASSERT_EQ(frames.size(), 2u);
+  for (auto &frame : frames) {
+    EXPECT_FALSE(((bm_serial_packet_t *)frame.data())->flags &
+                 BM_SERIAL_FLAG_COMPRESSED);
+  }
+  EXPECT_EQ(tx_lz.stats.bypassed, 1u);
+  EXPECT_EQ(tx_lz.stats.compressed, 0u);
+
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  ASSERT_EQ(received.size(), 2u);
+  EXPECT_EQ(received[0].data, data);
+  EXPECT_EQ(received[1].data, small);
+}
+
+TEST_F(LzTest, NoLz) {
+  // Receiver can't decompress
+  rx_ctx.lz = NULL;
+  ASSERT_EQ(pub(text_data(256)), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_UNSUPPORTED_MSG);
+  EXPECT_TRUE(received.empty());
+
+  // Sender without compression is still understood
+  tx_ctx.lz = NULL;
+  rx_ctx.lz = &rx_lz;
+  ASSERT_EQ(pub(text_data(256)), BM_SERIAL_OK);
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  EXPECT_EQ(received.size(), 1u);
+}
+
+TEST_F(LzTest, DfuChunk) {
+  // Mostly erased flash
+  std::vector<uint8_t> data(1024, 0xFF);
+  std::vector<uint8_t> code = random_data(64);
+  std::copy(code.begin(), code.end(), data.begin());
+
+  ASSERT_EQ(bm_serial_ctx_dfu_send_chunk(&tx_ctx, 0, data.size(), data.data()),
+            BM_SERIAL_OK);
+  ASSERT_EQ(frames.size(), 1u);
+  EXPECT_TRUE(((bm_serial_packet_t *)frames[0].data())->flags &
+              BM_SERIAL_FLAG_COMPRESSED);
+  EXPECT_LT(frames[0].size(), 128u);
+
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  EXPECT_EQ(chunk, data);
+}
+
+TEST_F(LzTest, Batch) {
+  static bm_serial_batch_t batch;
+  bm_serial_batch_cfg_t cfg = {};
+  cfg.max_len = BM_SERIAL_BATCH_MAX_LEN;
+  cfg.max_delay = 10;
+  cfg.now_fn = now_fn;
+  ASSERT_EQ(bm_serial_batch_init(&batch, &tx_ctx, &cfg), BM_SERIAL_OK);
+
+  // Batch of pubs to different topics, the topics compress
+  for (uint32_t idx = 0; idx < 16; idx++) {
+    std::string topic = "spotter/sensor/" + std::to_string(idx) + "/temp";
+    ASSERT_EQ(bm_serial_batch_pub(&batch, 1234, topic.data(), topic.size(),
+                                  (const uint8_t *)&idx, sizeof(idx), 1, 1),
+              BM_SERIAL_OK);
+  }
+  ASSERT_EQ(bm_serial_batch_flush(&batch), BM_SERIAL_OK);
+  ASSERT_EQ(frames.size(), 1u);
+  bm_serial_packet_t *packet = (bm_serial_packet_t *)frames[0].data();
+  EXPECT_EQ(packet->type, BM_SERIAL_BATCH);
+  EXPECT_TRUE(packet->flags & BM_SERIAL_FLAG_COMPRESSED);
+  EXPECT_LT(tx_lz.stats.bytes_out * 2, tx_lz.stats.bytes_in);
+
+  EXPECT_EQ(deliver(), BM_SERIAL_OK);
+  ASSERT_EQ(received.size(), 16u);
+  EXPECT_EQ(received[15].topic, "spotter/sensor/15/temp");
+}
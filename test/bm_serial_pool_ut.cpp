@@ -0,0 +1,301 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_cobs.h"
+#include "bm_serial_pool.h"
+
+#include <string.h>
+#include <thread>
+#include <vector>
+
+BM_SERIAL_POOL_STORAGE(small, 64, 4);
+BM_SERIAL_POOL_STORAGE(medium, 256, 2);
+BM_SERIAL_POOL_STORAGE(large, 2048, 2);
+
+static bm_serial_pool_class_t classes[] = {
+    BM_SERIAL_POOL_CLASS(small, 64, 4),
+    BM_SERIAL_POOL_CLASS(medium, 256, 2),
+    BM_SERIAL_POOL_CLASS(large, 2048, 2),
+};
+static bm_serial_pool_t pool;
+
+class PoolTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_EQ(bm_serial_pool_init(&pool, classes, 3), BM_SERIAL_OK);
+  }
+};
+
+TEST_F(PoolTest, Errors) {
+  EXPECT_EQ(bm_serial_pool_init(&pool, NULL, 3), BM_SERIAL_NULL_BUFF);
+  EXPECT_EQ(bm_serial_pool_init(&pool, classes, 0), BM_SERIAL_NULL_BUFF);
+
+  // Count must be a power of 2
+  bm_serial_pool_class_t bad_count[] = {BM_SERIAL_POOL_CLASS(small, 64, 3)};
+  EXPECT_EQ(bm_serial_pool_init(&pool, bad_count, 1), BM_SERIAL_MISC_ERR);
+
+  // Classes must be sorted by size
+  bm_serial_pool_class_t unsorted[] = {
+      BM_SERIAL_POOL_CLASS(medium, 256, 2),
+      BM_SERIAL_POOL_CLASS(small, 64, 4),
+  };
+  EXPECT_EQ(bm_serial_pool_init(&pool, unsorted, 2), BM_SERIAL_MISC_ERR);
+
+  // Nothing fits
+  ASSERT_EQ(bm_serial_pool_init(&pool, classes, 3), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_pool_alloc(&pool, 4096), nullptr);
+  EXPECT_EQ(pool.failed, 1u);
+}
+
+TEST_F(PoolTest, SizeClasses) {
+  // Smallest class that fits
+  bm_serial_pkt_t *pkt = bm_serial_pool_alloc(&pool, 64);
+  ASSERT_NE(pkt, nullptr);
+  EXPECT_EQ(pkt->cls, &classes[0]);
+  EXPECT_EQ(pkt->size, 64);
+  bm_serial_pkt_release(pkt);
+
+  pkt = bm_serial_pool_alloc(&pool, 65);
+  ASSERT_NE(pkt, nullptr);
+  EXPECT_EQ(pkt->cls, &classes[1]);
+  bm_serial_pkt_release(pkt);
+
+  // Falls back to bigger classes when empty
+  bm_serial_pkt_t *pkts[8];
+  for (auto &small_pkt : pkts) {
+    small_pkt = bm_serial_pool_alloc(&pool, 16);
+    ASSERT_NE(small_pkt, nullptr);
+    memset(small_pkt->buff, 0xA5, small_pkt->size);
+  }
+  EXPECT_EQ(pkts[3]->cls, &classes[0]);
+  EXPECT_EQ(pkts[4]->cls, &classes[1]);
+  EXPECT_EQ(pkts[7]->cls, &classes[2]);
+  EXPECT_EQ(bm_serial_pool_alloc(&pool, 16), nullptr);
+
+  // Every block is distinct
+  for (size_t idx = 0; idx < 8; idx++) {
+    for (size_t other = idx + 1; other < 8; other++) {
+      EXPECT_NE(pkts[idx], pkts[other]);
+    }
+  }
+
+  EXPECT_EQ(classes[0].stats.in_use, 4);
+  EXPECT_EQ(classes[0].stats.high_water, 4);
+  EXPECT_EQ(classes[0].stats.exhausted, 5u);
+  EXPECT_EQ(classes[1].stats.exhausted, 3u);
+  EXPECT_EQ(classes[2].stats.exhausted, 1u);
+  EXPECT_EQ(pool.failed, 1u);
+
+  for (auto &small_pkt : pkts) {
+    bm_serial_pkt_release(small_pkt);
+  }
+  EXPECT_EQ(classes[0].stats.in_use, 0);
+  EXPECT_EQ(classes[0].stats.high_water, 4);
+  EXPECT_EQ(classes[0].stats.allocs, 5u);
+
+  // Blocks can be allocated again
+  pkt = bm_serial_pool_alloc(&pool, 16);
+  ASSERT_NE(pkt, nullptr);
+  EXPECT_EQ(pkt->cls, &classes[0]);
+  bm_serial_pkt_release(pkt);
+}
+
+TEST_F(PoolTest, References) {
+  bm_serial_pkt_t *pkt = bm_serial_pool_alloc(&pool, 32);
+  ASSERT_NE(pkt, nullptr);
+  bm_serial_pkt_retain(pkt);
+  EXPECT_EQ(pkt->refs, 2);
+
+  bm_serial_pkt_release(pkt);
+  EXPECT_EQ(classes[0].stats.in_use, 1);
+  bm_serial_pkt_release(pkt);
+  EXPECT_EQ(classes[0].stats.in_use, 0);
+}
+
+TEST_F(PoolTest, Threads) {
+  constexpr int num_threads = 4;
+  constexpr int iterations = 2000;
+  std::vector<std::thread> threads;
+  std::vector<int> errors(num_threads);
+
+  for (int thread = 0; thread < num_threads; thread++) {
+    threads.emplace_back([thread, &errors]() {
+      for (int iteration = 0; iteration < iterations; iteration++) {
+        bm_serial_pkt_t *pkt = bm_serial_pool_alloc(&pool, 16);
+        if (!pkt) {
+          std::this_thread::yield();
+          continue;
+        }
+
+        // Nobody else may own the block while we do
+        pkt->user = thread;
+        memset(pkt->buff, thread, pkt->size);
+        std::this_thread::yield();
+        for (uint16_t idx = 0; idx < pkt->size; idx++) {
+          if (pkt->buff[idx] != thread) {
+            errors[thread]++;
+            break;
+          }
+        }
+        if (pkt->user != thread) {
+          errors[thread]++;
+        }
+        bm_serial_pkt_release(pkt);
+      }
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (int thread = 0; thread < num_threads; thread++) {
+    EXPECT_EQ(errors[thread], 0);
+  }
+  for (auto &cls : classes) {
+    EXPECT_EQ(cls.stats.in_use, 0);
+  }
+}
+
+// Packets handed to the sink, kept for retransmits
+static bm_serial_pkt_t *held[8];
+static size_t num_held;
+
+static bm_serial_error_e hold_sink(void *arg, bm_serial_pkt_t *pkt) {
+  (void)arg;
+  if (num_held >= sizeof(held) / sizeof(held[0])) {
+    bm_serial_pkt_release(pkt);
+    return BM_SERIAL_OUT_OF_MEMORY;
+  }
+  held[num_held++] = pkt;
+  return BM_SERIAL_OK;
+}
+
+static bm_serial_ctx_t rx_ctx;
+static uint32_t rx_seq[8];
+static size_t rx_count;
+
+static bool pool_pub_fn(const char *topic, uint16_t topic_len,
+                        uint64_t node_id, const uint8_t *payload, size_t len,
+                        uint8_t type, uint8_t version) {
+  (void)topic_len;
+  (void)node_id;
+  (void)type;
+  (void)version;
+  EXPECT_EQ(strncmp(topic, "pool", 4), 0);
+  EXPECT_GE(len, sizeof(uint32_t));
+  if (rx_count < 8) {
+    memcpy(&rx_seq[rx_count], payload, sizeof(uint32_t));
+  }
+  rx_count++;
+  return true;
+}
+
+static bool cobs_tx_fn(const uint8_t *buff, size_t len) {
+  uint8_t packet[SERIAL_BUFF_LEN];
+  EXPECT_EQ(buff[len - 1], 0);
+  size_t decoded = bm_serial_cobs_decode(buff, len - 1, packet, sizeof(packet));
+  return bm_serial_ctx_process_packet(&rx_ctx, (bm_serial_packet_t *)packet,
+                                      decoded) == BM_SERIAL_OK;
+}
+
+TEST_F(PoolTest, Context) {
+  bm_serial_callbacks_t rx_callbacks = {};
+  rx_callbacks.pub_fn = pool_pub_fn;
+  bm_serial_ctx_init(&rx_ctx, &rx_callbacks);
+  rx_count = 0;
+  num_held = 0;
+
+  static bm_serial_ctx_t tx_ctx;
+  bm_serial_callbacks_t tx_callbacks = {};
+  tx_callbacks.tx_fn = cobs_tx_fn;
+  bm_serial_ctx_init(&tx_ctx, &tx_callbacks);
+  bm_serial_ctx_set_cobs_tx(&tx_ctx, true);
+  bm_serial_ctx_set_pool(&tx_ctx, &pool, hold_sink, NULL);
+
+  // Small and large packets go to their own size classes and are held
+  uint8_t payload[1024] = {};
+  uint32_t seq = 1;
+  memcpy(payload, &seq, sizeof(seq));
+  EXPECT_EQ(bm_serial_ctx_pub(&tx_ctx, 0, "pool", 4, payload, 8, 0, 0),
+            BM_SERIAL_OK);
+  seq = 2;
+  memcpy(payload, &seq, sizeof(seq));
+  EXPECT_EQ(bm_serial_ctx_pub(&tx_ctx, 0, "pool", 4, payload, sizeof(payload),
+                              0, 0),
+            BM_SERIAL_OK);
+  ASSERT_EQ(num_held, 2u);
+  EXPECT_EQ(held[0]->cls, &classes[0]);
+  EXPECT_EQ(held[1]->cls, &classes[2]);
+  EXPECT_EQ(rx_count, 0u);
+  EXPECT_EQ(tx_ctx.stats.tx_packets, 0u);
+
+  // Send out of order, and retransmit
+  EXPECT_EQ(bm_serial_ctx_pkt_send(&tx_ctx, held[1]), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_ctx_pkt_send(&tx_ctx, held[0]), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_ctx_pkt_send(&tx_ctx, held[0]), BM_SERIAL_OK);
+  ASSERT_EQ(rx_count, 3u);
+  EXPECT_EQ(rx_seq[0], 2u);
+  EXPECT_EQ(rx_seq[1], 1u);
+  EXPECT_EQ(rx_seq[2], 1u);
+  EXPECT_EQ(rx_ctx.stats.rx_errors, 0u);
+
+  bm_serial_pkt_release(held[0]);
+  bm_serial_pkt_release(held[1]);
+  EXPECT_EQ(classes[0].stats.in_use, 0);
+  EXPECT_EQ(classes[2].stats.in_use, 0);
+
+  // Reservations aren't overwritten by other sends
+  uint8_t *data;
+  ASSERT_EQ(bm_serial_ctx_pub_reserve(&tx_ctx, 0, "pool", 4, sizeof(seq), 0, 0,
+                                      &data),
+            BM_SERIAL_OK);
+  seq = 3;
+  memcpy(payload, &seq, sizeof(seq));
+  EXPECT_EQ(bm_serial_ctx_pub(&tx_ctx, 0, "pool", 4, payload, 8, 0, 0),
+            BM_SERIAL_OK);
+  seq = 4;
+  memcpy(data, &seq, sizeof(seq));
+  EXPECT_EQ(bm_serial_ctx_commit(&tx_ctx), BM_SERIAL_OK);
+  ASSERT_EQ(num_held, 4u);
+
+  // Without a sink packets are sent and released right away
+  bm_serial_ctx_set_pool(&tx_ctx, &pool, NULL, NULL);
+  seq = 5;
+  memcpy(payload, &seq, sizeof(seq));
+  EXPECT_EQ(bm_serial_ctx_pub(&tx_ctx, 0, "pool", 4, payload, 8, 0, 0),
+            BM_SERIAL_OK);
+  ASSERT_EQ(rx_count, 4u);
+  EXPECT_EQ(rx_seq[3], 5u);
+  EXPECT_EQ(classes[0].stats.in_use, 2);
+
+  for (size_t idx = 2; idx < 4; idx++) {
+    EXPECT_EQ(bm_serial_ctx_pkt_send(&tx_ctx, held[idx]), BM_SERIAL_OK);
+    bm_serial_pkt_release(held[idx]);
+  }
+  ASSERT_EQ(rx_count, 6u);
+  EXPECT_EQ(rx_seq[4], 3u);
+  EXPECT_EQ(rx_seq[5], 4u);
+  EXPECT_EQ(classes[0].stats.in_use, 0);
+
+  // Aborted reservations go back to the pool
+  ASSERT_EQ(bm_serial_ctx_pub_reserve(&tx_ctx, 0, "pool", 4, sizeof(seq), 0, 0,
+                                      &data),
+            BM_SERIAL_OK);
+  EXPECT_EQ(classes[0].stats.in_use, 1);
+  bm_serial_ctx_reserve_abort(&tx_ctx);
+  EXPECT_EQ(classes[0].stats.in_use, 0);
+  EXPECT_EQ(bm_serial_ctx_commit(&tx_ctx), BM_SERIAL_MISC_ERR);
+  EXPECT_EQ(rx_count, 6u);
+
+  // Pool exhaustion
+  bm_serial_pkt_t *pkts[8];
+  for (auto &pkt : pkts) {
+    pkt = bm_serial_pool_alloc(&pool, 1);
+  }
+  EXPECT_EQ(bm_serial_ctx_pub(&tx_ctx, 0, "pool", 4, payload, 8, 0, 0),
+            BM_SERIAL_OUT_OF_MEMORY);
+  for (auto &pkt : pkts) {
+    bm_serial_pkt_release(pkt);
+  }
+  EXPECT_EQ(bm_serial_ctx_pkt_send(&tx_ctx, NULL), BM_SERIAL_NULL_BUFF);
+}
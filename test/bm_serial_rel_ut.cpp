@@ -0,0 +1,270 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_pool.h"
+#include "bm_serial_rel.h"
+
+#include <deque>
+#include <string.h>
+#include <vector>
+
+BM_SERIAL_POOL_STORAGE(rel_a, 128, 64);
+BM_SERIAL_POOL_STORAGE(rel_b, 128, 64);
+
+static bm_serial_pool_class_t a_classes[] = {
+    BM_SERIAL_POOL_CLASS(rel_a, 128, 64),
+};
+static bm_serial_pool_class_t b_classes[] = {
+    BM_SERIAL_POOL_CLASS(rel_b, 128, 64),
+};
+static bm_serial_pool_t a_pool;
+static bm_serial_pool_t b_pool;
+static bm_serial_ctx_t a_ctx;
+static bm_serial_ctx_t b_ctx;
+static bm_serial_rel_t a_rel;
+static bm_serial_rel_t b_rel;
+
+static uint32_t now;
+static uint32_t now_fn(void) { return now; }
+
+// Frames on the wire in each direction, delivered with pump()
+typedef std::vector<uint8_t> frame_t;
+static std::deque<frame_t> a_to_b;
+static std::deque<frame_t> b_to_a;
+
+// Frames sent from a to b so far, and which of them to lose (by index)
+static size_t a_frames;
+static std::vector<size_t> a_lose;
+static bool lose_acks;
+
+static std::vector<uint32_t> b_received;
+static std::vector<uint32_t> a_failed;
+
+static bool a_tx_fn(const uint8_t *buff, size_t len) {
+  size_t frame = a_frames++;
+  for (size_t lost : a_lose) {
+    if (lost == frame) {
+      return true;
+    }
+  }
+  a_to_b.emplace_back(buff, buff + len);
+  return true;
+}
+
+static bool b_tx_fn(const uint8_t *buff, size_t len) {
+  if (!lose_acks) {
+    b_to_a.emplace_back(buff, buff + len);
+  }
+  return true;
+}
+
+static bool b_pub_fn(const char *topic, uint16_t topic_len, uint64_t node_id,
+                     const uint8_t *payload, size_t len, uint8_t type,
+                     uint8_t version) {
+  (void)topic;
+  (void)topic_len;
+  (void)node_id;
+  (void)type;
+  (void)version;
+  uint32_t value;
+  EXPECT_EQ(len, sizeof(value));
+  memcpy(&value, payload, sizeof(value));
+  b_received.push_back(value);
+  return true;
+}
+
+static void a_fail_fn(void *arg, const bm_serial_pkt_t *pkt) {
+  (void)arg;
+  uint32_t value;
+  memcpy(&value, &pkt->buff[pkt->offset + pkt->len - sizeof(value)],
+         sizeof(value));
+  a_failed.push_back(value);
+}
+
+// Deliver everything on the wire, both ways
+static void pump(void) {
+  while (!a_to_b.empty() || !b_to_a.empty()) {
+    if (!a_to_b.empty()) {
+      frame_t frame = a_to_b.front();
+      a_to_b.pop_front();
+      bm_serial_ctx_process_packet(&b_ctx, (bm_serial_packet_t *)frame.data(),
+                                   frame.size());
+    }
+    if (!b_to_a.empty()) {
+      frame_t frame = b_to_a.front();
+      b_to_a.pop_front();
+      bm_serial_ctx_process_packet(&a_ctx, (bm_serial_packet_t *)frame.data(),
+                                   frame.size());
+    }
+  }
+}
+
+static bm_serial_error_e pub(uint32_t value) {
+  return bm_serial_ctx_pub(&a_ctx, 0, "rel", 3, (const uint8_t *)&value,
+                           sizeof(value), 0, 0);
+}
+
+class RelTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_EQ(bm_serial_pool_init(&a_pool, a_classes, 1), BM_SERIAL_OK);
+    ASSERT_EQ(bm_serial_pool_init(&b_pool, b_classes, 1), BM_SERIAL_OK);
+
+    bm_serial_callbacks_t a_callbacks = {};
+    a_callbacks.tx_fn = a_tx_fn;
+    bm_serial_ctx_init(&a_ctx, &a_callbacks);
+
+    bm_serial_callbacks_t b_callbacks = {};
+    b_callbacks.tx_fn = b_tx_fn;
+    b_callbacks.pub_fn = b_pub_fn;
+    bm_serial_ctx_init(&b_ctx, &b_callbacks);
+
+    cfg.window = 8;
+    cfg.rto = 10;
+    cfg.max_retries = 2;
+    cfg.now_fn = now_fn;
+    cfg.fail_fn = a_fail_fn;
+    ASSERT_EQ(bm_serial_rel_init(&a_rel, &a_ctx, &a_pool, &cfg), BM_SERIAL_OK);
+    ASSERT_EQ(bm_serial_rel_init(&b_rel, &b_ctx, &b_pool, &cfg), BM_SERIAL_OK);
+
+    now = 0;
+    a_to_b.clear();
+    b_to_a.clear();
+    a_frames = 0;
+    a_lose.clear();
+    lose_acks = false;
+    b_received.clear();
+    a_failed.clear();
+  }
+
+  void TearDown() override {
+    EXPECT_EQ(a_classes[0].stats.in_use, bm_serial_rel_in_flight(&a_rel));
+    EXPECT_EQ(b_classes[0].stats.in_use, 0);
+  }
+
+  bm_serial_rel_cfg_t cfg = {};
+};
+
+TEST_F(RelTest, Errors) {
+  bm_serial_rel_t rel;
+  EXPECT_EQ(bm_serial_rel_init(&rel, &a_ctx, NULL, &cfg), BM_SERIAL_NULL_BUFF);
+  cfg.window = BM_SERIAL_REL_MAX_WINDOW + 1;
+  EXPECT_EQ(bm_serial_rel_init(&rel, &a_ctx, &a_pool, &cfg),
+            BM_SERIAL_MISC_ERR);
+  cfg.window = 8;
+  cfg.rto = 0;
+  EXPECT_EQ(bm_serial_rel_init(&rel, &a_ctx, &a_pool, &cfg),
+            BM_SERIAL_MISC_ERR);
+
+  // Short ACK
+  uint8_t ack[2] = {};
+  EXPECT_EQ(bm_serial_rel_rx_ack(&a_rel, ack, sizeof(ack)),
+            BM_SERIAL_INVALID_MSG_LEN);
+}
+
+TEST_F(RelTest, Delivery) {
+  for (uint32_t value = 0; value < 200; value++) {
+    ASSERT_EQ(pub(value), BM_SERIAL_OK);
+    pump();
+  }
+
+  // Sequence numbers wrapped, nothing left in flight
+  ASSERT_EQ(b_received.size(), 200u);
+  for (uint32_t value = 0; value < 200; value++) {
+    EXPECT_EQ(b_received[value], value);
+  }
+  EXPECT_EQ(bm_serial_rel_in_flight(&a_rel), 0u);
+  EXPECT_EQ(a_rel.stats.sent, 200u);
+  EXPECT_EQ(a_rel.stats.acked, 200u);
+  EXPECT_EQ(a_rel.stats.retransmits, 0u);
+  EXPECT_EQ(b_rel.stats.acks_sent, 200u);
+  EXPECT_EQ(b_ctx.stats.rx_errors, 0u);
+}
+
+TEST_F(RelTest, Window) {
+  // Window full until ACKs come back
+  for (uint32_t value = 0; value < 8; value++) {
+    ASSERT_EQ(pub(value), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(pub(8), BM_SERIAL_OUT_OF_MEMORY);
+  EXPECT_EQ(bm_serial_rel_in_flight(&a_rel), 8u);
+  EXPECT_EQ(a_classes[0].stats.in_use, 8);
+
+  pump();
+  EXPECT_EQ(bm_serial_rel_in_flight(&a_rel), 0u);
+  EXPECT_EQ(pub(8), BM_SERIAL_OK);
+  pump();
+  EXPECT_EQ(b_received.size(), 9u);
+}
+
+TEST_F(RelTest, Retransmit) {
+  // Data lost, then the ACK for the retransmit is lost too
+  a_lose = {0};
+  ASSERT_EQ(pub(1), BM_SERIAL_OK);
+  pump();
+  EXPECT_TRUE(b_received.empty());
+
+  now = 5;
+  bm_serial_rel_poll(&a_rel);
+  EXPECT_EQ(a_frames, 1u);
+
+  now = 10;
+  lose_acks = true;
+  bm_serial_rel_poll(&a_rel);
+  pump();
+  ASSERT_EQ(b_received.size(), 1u);
+  EXPECT_EQ(bm_serial_rel_in_flight(&a_rel), 1u);
+
+  // Duplicate isn't passed on, but is acknowledged again
+  now = 20;
+  lose_acks = false;
+  bm_serial_rel_poll(&a_rel);
+  pump();
+  EXPECT_EQ(b_received.size(), 1u);
+  EXPECT_EQ(b_rel.stats.rx_duplicates, 1u);
+  EXPECT_EQ(a_rel.stats.retransmits, 2u);
+  EXPECT_EQ(bm_serial_rel_in_flight(&a_rel), 0u);
+}
+
+TEST_F(RelTest, SelectiveAck) {
+  // Second packet lost, the ACKs for the later ones report the hole
+  a_lose = {1};
+  for (uint32_t value = 0; value < 4; value++) {
+    ASSERT_EQ(pub(value), BM_SERIAL_OK);
+  }
+  pump();
+
+  // Resent without waiting for the timeout, only once
+  EXPECT_EQ(a_rel.stats.fast_retransmits, 1u);
+  ASSERT_EQ(b_received.size(), 4u);
+  EXPECT_EQ(b_received[3], 1u);
+  EXPECT_EQ(bm_serial_rel_in_flight(&a_rel), 0u);
+  EXPECT_EQ(b_rel.rx_next, 4);
+  EXPECT_EQ(b_rel.rx_sack, 0u);
+}
+
+TEST_F(RelTest, GiveUp) {
+  // Every copy of the first packet is lost
+  a_lose = {0, 2, 3};
+  ASSERT_EQ(pub(7), BM_SERIAL_OK);
+  ASSERT_EQ(pub(8), BM_SERIAL_OK);
+  pump();
+  EXPECT_EQ(b_rel.rx_next, 0);
+
+  for (now = 10; now <= 30; now += 10) {
+    bm_serial_rel_poll(&a_rel);
+    pump();
+  }
+  ASSERT_EQ(a_failed.size(), 1u);
+  EXPECT_EQ(a_failed[0], 7u);
+  EXPECT_EQ(a_rel.stats.failed, 1u);
+  EXPECT_EQ(a_rel.stats.forwards_sent, 1u);
+
+  // Receiver skipped it, and keeps going
+  EXPECT_EQ(b_rel.rx_next, 2);
+  EXPECT_FALSE(a_rel.forward_pending);
+  ASSERT_EQ(pub(9), BM_SERIAL_OK);
+  pump();
+  ASSERT_EQ(b_received.size(), 2u);
+  EXPECT_EQ(b_received[1], 9u);
+  EXPECT_EQ(bm_serial_rel_in_flight(&a_rel), 0u);
+}
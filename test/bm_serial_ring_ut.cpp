@@ -0,0 +1,33 @@
+#include "gtest/gtest.h"
+#include "bm_serial_ring.h"
+
+static bm_serial_ring_cell_t cells[4];
+static bm_serial_ring_t ring;
+
+TEST(RingTest, Ring) {
+  EXPECT_EQ(bm_serial_ring_init(&ring, NULL, 4), BM_SERIAL_NULL_BUFF);
+  EXPECT_EQ(bm_serial_ring_init(&ring, cells, 1), BM_SERIAL_MISC_ERR);
+  EXPECT_EQ(bm_serial_ring_init(&ring, cells, 3), BM_SERIAL_MISC_ERR);
+  ASSERT_EQ(bm_serial_ring_init(&ring, cells, 4), BM_SERIAL_OK);
+
+  EXPECT_EQ(bm_serial_ring_peek(&ring), nullptr);
+  EXPECT_EQ(bm_serial_ring_pop(&ring), nullptr);
+
+  int values[6];
+  for (int idx = 0; idx < 4; idx++) {
+    EXPECT_TRUE(bm_serial_ring_push(&ring, &values[idx]));
+  }
+  EXPECT_FALSE(bm_serial_ring_push(&ring, &values[4]));
+  EXPECT_EQ(bm_serial_ring_count(&ring), 4u);
+
+  // FIFO, and wraps around
+  EXPECT_EQ(bm_serial_ring_peek(&ring), &values[0]);
+  EXPECT_EQ(bm_serial_ring_pop(&ring), &values[0]);
+  EXPECT_EQ(bm_serial_ring_pop(&ring), &values[1]);
+  EXPECT_TRUE(bm_serial_ring_push(&ring, &values[4]));
+  EXPECT_TRUE(bm_serial_ring_push(&ring, &values[5]));
+  for (int idx = 2; idx < 6; idx++) {
+    EXPECT_EQ(bm_serial_ring_pop(&ring), &values[idx]);
+  }
+  EXPECT_EQ(bm_serial_ring_count(&ring), 0u);
+}
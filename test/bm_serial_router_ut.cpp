@@ -0,0 +1,219 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_crc.h"
+#include "bm_serial_router.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+static bm_serial_ctx_t ctx;
+static bm_serial_router_t router;
+
+// Handler and topic for every pub received
+typedef std::pair<std::string, std::string> route_t;
+static std::vector<route_t> routed;
+
+static bool handler_fn(void *arg, const char *topic, uint16_t topic_len,
+                       uint64_t node_id, const uint8_t *payload, size_t len,
+                       uint8_t type, uint8_t version) {
+  EXPECT_EQ(node_id, 1234u);
+  EXPECT_EQ(len, 4u);
+  EXPECT_EQ(memcmp(payload, "data", 4), 0);
+  EXPECT_EQ(type, 3);
+  EXPECT_EQ(version, 4);
+  routed.emplace_back((const char *)arg, std::string(topic, topic_len));
+  return true;
+}
+
+static bool pub_fn(const char *topic, uint16_t topic_len, uint64_t node_id,
+                   const uint8_t *payload, size_t len, uint8_t type,
+                   uint8_t version) {
+  return handler_fn((void *)"pub_fn", topic, topic_len, node_id, payload, len,
+                    type, version);
+}
+
+static bm_serial_error_e add(const char *topic, const char *name) {
+  return bm_serial_router_add(&router, topic, strlen(topic), handler_fn,
+                              (void *)name);
+}
+
+// Receive a pub on topic, return the handler that got it
+static std::string receive(const std::string &topic) {
+  uint8_t packet[256] = {};
+  bm_serial_packet_t *header = (bm_serial_packet_t *)packet;
+  bm_serial_pub_header_t *pub_header =
+      (bm_serial_pub_header_t *)header->payload;
+  header->type = BM_SERIAL_PUB;
+  pub_header->node_id = 1234;
+  pub_header->type = 3;
+  pub_header->version = 4;
+  pub_header->topic_len = topic.size();
+  memcpy(pub_header->topic, topic.data(), topic.size());
+  memcpy(&pub_header->topic[topic.size()], "data", 4);
+  size_t len = sizeof(bm_serial_packet_t) + sizeof(bm_serial_pub_header_t) +
+               topic.size() + 4;
+  header->crc16 = bm_serial_crc16_ccitt(0, packet, len);
+
+  routed.clear();
+  EXPECT_EQ(bm_serial_ctx_process_packet(&ctx, header, len), BM_SERIAL_OK);
+  if (routed.size() != 1) {
+    return "";
+  }
+  EXPECT_EQ(routed[0].second, topic);
+  return routed[0].first;
+}
+
+class RouterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    bm_serial_callbacks_t callbacks = {};
+    callbacks.pub_fn = pub_fn;
+    bm_serial_ctx_init(&ctx, &callbacks);
+    ASSERT_EQ(bm_serial_router_init(&router, &ctx, NULL, NULL), BM_SERIAL_OK);
+    routed.clear();
+  }
+};
+
+TEST_F(RouterTest, Errors) {
+  EXPECT_EQ(bm_serial_router_init(NULL, &ctx, NULL, NULL),
+            BM_SERIAL_NULL_BUFF);
+  EXPECT_EQ(bm_serial_router_init(&router, NULL, NULL, NULL),
+            BM_SERIAL_NULL_BUFF);
+  EXPECT_EQ(bm_serial_router_add(&router, "a", 1, NULL, NULL),
+            BM_SERIAL_NULL_BUFF);
+  EXPECT_EQ(bm_serial_router_add(&router, NULL, 1, handler_fn, NULL),
+            BM_SERIAL_NULL_BUFF);
+  EXPECT_EQ(bm_serial_router_add(&router, "a", 0, handler_fn, NULL),
+            BM_SERIAL_INVALID_TOPIC_LEN);
+
+  // Wildcard in the middle of a level
+  EXPECT_EQ(add("sensor#", "bad"), BM_SERIAL_MISC_ERR);
+
+  // Registered twice
+  EXPECT_EQ(add("sensor/temp", "a"), BM_SERIAL_OK);
+  EXPECT_EQ(add("sensor/temp", "b"), BM_SERIAL_MISC_ERR);
+  EXPECT_EQ(add("sensor/#", "c"), BM_SERIAL_OK);
+  EXPECT_EQ(add("sensor/#", "d"), BM_SERIAL_MISC_ERR);
+
+  // Full
+  static char topics[BM_SERIAL_ROUTER_ROUTES][16];
+  for (int idx = 2; idx < BM_SERIAL_ROUTER_ROUTES; idx++) {
+    snprintf(topics[idx], sizeof(topics[idx]), "topic/%d", idx);
+    EXPECT_EQ(add(topics[idx], "x"), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(add("one/more", "x"), BM_SERIAL_OUT_OF_MEMORY);
+}
+
+TEST_F(RouterTest, Exact) {
+  ASSERT_EQ(add("sensor/temp", "temp"), BM_SERIAL_OK);
+  ASSERT_EQ(add("sensor/humidity", "humidity"), BM_SERIAL_OK);
+
+  EXPECT_EQ(receive("sensor/temp"), "temp");
+  EXPECT_EQ(receive("sensor/humidity"), "humidity");
+
+  // Not a prefix match, unmatched goes to pub_fn
+  EXPECT_EQ(receive("sensor/temp/1"), "pub_fn");
+  EXPECT_EQ(receive("sensor/tem"), "pub_fn");
+  EXPECT_EQ(router.stats.exact, 2u);
+  EXPECT_EQ(router.stats.unmatched, 2u);
+}
+
+TEST_F(RouterTest, Wildcard) {
+  ASSERT_EQ(add("#", "all"), BM_SERIAL_OK);
+  ASSERT_EQ(add("sensor/#", "sensor"), BM_SERIAL_OK);
+  ASSERT_EQ(add("sensor/1/#", "sensor1"), BM_SERIAL_OK);
+  ASSERT_EQ(add("sensor/1/temp", "temp1"), BM_SERIAL_OK);
+
+  // Exact beats the longest prefix, which beats shorter ones
+  EXPECT_EQ(receive("sensor/1/temp"), "temp1");
+  EXPECT_EQ(receive("sensor/1/humidity"), "sensor1");
+  EXPECT_EQ(receive("sensor/1/a/b/c"), "sensor1");
+  EXPECT_EQ(receive("sensor/2/temp"), "sensor");
+  EXPECT_EQ(receive("sensor/"), "sensor");
+  EXPECT_EQ(receive("sensor"), "all");
+  EXPECT_EQ(receive("sensors/1"), "all");
+  EXPECT_EQ(receive("other"), "all");
+  EXPECT_EQ(router.stats.exact, 1u);
+  EXPECT_EQ(router.stats.prefix, 7u);
+}
+
+TEST_F(RouterTest, Fallback) {
+  ASSERT_EQ(bm_serial_router_init(&router, &ctx, handler_fn,
+                                  (void *)"fallback"),
+            BM_SERIAL_OK);
+  ASSERT_EQ(add("sensor/#", "sensor"), BM_SERIAL_OK);
+  EXPECT_EQ(receive("sensor/temp"), "sensor");
+  EXPECT_EQ(receive("other/temp"), "fallback");
+  EXPECT_EQ(router.stats.fallback, 1u);
+
+  // Without a pub_fn
+  ctx.callbacks.pub_fn = NULL;
+  EXPECT_EQ(receive("sensor/temp"), "sensor");
+
+  // Init again removes the routes
+  ASSERT_EQ(bm_serial_router_init(&router, &ctx, NULL, NULL), BM_SERIAL_OK);
+  EXPECT_EQ(receive("sensor/temp"), "");
+}
+
+static bool decline_fn(void *arg, const char *topic, uint16_t topic_len,
+                       uint64_t node_id, const uint8_t *payload, size_t len,
+                       uint8_t type, uint8_t version) {
+  handler_fn(arg, topic, topic_len, node_id, payload, len, type, version);
+  return false;
+}
+
+TEST_F(RouterTest, Declined) {
+  ASSERT_EQ(bm_serial_router_add(&router, "sensor/#", 8, decline_fn,
+                                 (void *)"sensor"),
+            BM_SERIAL_OK);
+
+  // Declined by the handler, goes to pub_fn
+  EXPECT_EQ(receive("sensor/temp"), "");
+  ASSERT_EQ(routed.size(), 2u);
+  EXPECT_EQ(routed[0].first, "sensor");
+  EXPECT_EQ(routed[1].first, "pub_fn");
+  EXPECT_EQ(router.stats.unmatched, 1u);
+
+  // Then by the fallback too
+  ASSERT_EQ(bm_serial_router_init(&router, &ctx, decline_fn,
+                                  (void *)"fallback"),
+            BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_router_add(&router, "sensor/#", 8, decline_fn,
+                                 (void *)"sensor"),
+            BM_SERIAL_OK);
+  EXPECT_EQ(receive("sensor/temp"), "");
+  ASSERT_EQ(routed.size(), 3u);
+  EXPECT_EQ(routed[0].first, "sensor");
+  EXPECT_EQ(routed[1].first, "fallback");
+  EXPECT_EQ(routed[2].first, "pub_fn");
+  EXPECT_EQ(router.stats.fallback, 1u);
+  EXPECT_EQ(router.stats.unmatched, 1u);
+
+  // Taken by the fallback
+  ASSERT_EQ(bm_serial_router_init(&router, &ctx, handler_fn,
+                                  (void *)"fallback"),
+            BM_SERIAL_OK);
+  ASSERT_EQ(bm_serial_router_add(&router, "sensor/#", 8, decline_fn,
+                                 (void *)"sensor"),
+            BM_SERIAL_OK);
+  EXPECT_EQ(receive("sensor/temp"), "");
+  ASSERT_EQ(routed.size(), 2u);
+  EXPECT_EQ(routed[1].first, "fallback");
+  EXPECT_EQ(router.stats.unmatched, 0u);
+}
+
+TEST_F(RouterTest, Many) {
+  // Every route is found, with colliding hash buckets
+  static char topics[BM_SERIAL_ROUTER_ROUTES][32];
+  for (int idx = 0; idx < BM_SERIAL_ROUTER_ROUTES; idx++) {
+    snprintf(topics[idx], sizeof(topics[idx]), "node/%d/%s", idx,
+             (idx % 2) ? "#" : "temp");
+    ASSERT_EQ(add(topics[idx], topics[idx]), BM_SERIAL_OK);
+  }
+  for (int idx = 0; idx < BM_SERIAL_ROUTER_ROUTES; idx++) {
+    std::string topic = "node/" + std::to_string(idx) + "/temp";
+    EXPECT_EQ(receive(topic), topics[idx]);
+  }
+  EXPECT_EQ(receive("node/100/temp"), "pub_fn");
+}
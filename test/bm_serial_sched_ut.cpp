@@ -0,0 +1,200 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_pool.h"
+#include "bm_serial_sched.h"
+
+#include <string.h>
+#include <vector>
+
+BM_SERIAL_POOL_STORAGE(sched_small, 128, 32);
+BM_SERIAL_POOL_STORAGE(sched_large, 2048, 8);
+
+static bm_serial_pool_class_t classes[] = {
+    BM_SERIAL_POOL_CLASS(sched_small, 128, 32),
+    BM_SERIAL_POOL_CLASS(sched_large, 2048, 8),
+};
+static bm_serial_pool_t pool;
+static bm_serial_ring_cell_t cells[BM_SERIAL_SCHED_NUM_CLASSES][8];
+static bm_serial_sched_t sched;
+static bm_serial_ctx_t ctx;
+
+static uint32_t now;
+static uint32_t now_fn(void) { return now; }
+
+// Message types in the order they hit the wire
+static std::vector<uint8_t> sent_types;
+
+static bool sched_tx_fn(const uint8_t *buff, size_t len) {
+  EXPECT_GE(len, sizeof(bm_serial_packet_t));
+  sent_types.push_back(((const bm_serial_packet_t *)buff)->type);
+  return true;
+}
+
+static bm_serial_error_e pub(size_t len) {
+  uint8_t payload[SERIAL_BUFF_LEN] = {};
+  return bm_serial_ctx_pub(&ctx, 0, "sched", 5, payload, len, 0, 0);
+}
+
+static bm_serial_error_e dfu_chunk(size_t len) {
+  uint8_t chunk[SERIAL_BUFF_LEN] = {};
+  return bm_serial_ctx_dfu_send_chunk(&ctx, 0, len, chunk);
+}
+
+class SchedTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_EQ(bm_serial_pool_init(&pool, classes, 2), BM_SERIAL_OK);
+
+    bm_serial_callbacks_t callbacks = {};
+    callbacks.tx_fn = sched_tx_fn;
+    bm_serial_ctx_init(&ctx, &callbacks);
+
+    // Control is strict priority, everything else shares the link
+    const uint16_t weights[] = {0, 2, 4, 1, 1};
+    for (int cls = 0; cls < BM_SERIAL_SCHED_NUM_CLASSES; cls++) {
+      cfg[cls].cells = cells[cls];
+      cfg[cls].num_cells = 8;
+      cfg[cls].weight = weights[cls];
+    }
+    ASSERT_EQ(bm_serial_sched_init(&sched, &ctx, &pool, cfg, now_fn),
+              BM_SERIAL_OK);
+
+    now = 0;
+    sent_types.clear();
+  }
+
+  bm_serial_sched_queue_cfg_t cfg[BM_SERIAL_SCHED_NUM_CLASSES];
+};
+
+TEST_F(SchedTest, Classify) {
+  EXPECT_EQ(bm_serial_sched_classify(BM_SERIAL_RTC_SET),
+            BM_SERIAL_SCHED_CONTROL);
+  EXPECT_EQ(bm_serial_sched_classify(BM_SERIAL_SELF_TEST),
+            BM_SERIAL_SCHED_CONTROL);
+  EXPECT_EQ(bm_serial_sched_classify(BM_SERIAL_DFU_START),
+            BM_SERIAL_SCHED_CONTROL);
+  EXPECT_EQ(bm_serial_sched_classify(BM_SERIAL_CFG_SET),
+            BM_SERIAL_SCHED_CONFIG);
+  EXPECT_EQ(bm_serial_sched_classify(BM_SERIAL_PUB), BM_SERIAL_SCHED_PUB);
+  EXPECT_EQ(bm_serial_sched_classify(BM_SERIAL_BATCH), BM_SERIAL_SCHED_PUB);
+  EXPECT_EQ(bm_serial_sched_classify(BM_SERIAL_PUB_ALIAS),
+            BM_SERIAL_SCHED_PUB);
+  EXPECT_EQ(bm_serial_sched_classify(BM_SERIAL_ALIAS_RESET),
+            BM_SERIAL_SCHED_CONTROL);
+  EXPECT_EQ(bm_serial_sched_classify(BM_SERIAL_LOG), BM_SERIAL_SCHED_LOG);
+  EXPECT_EQ(bm_serial_sched_classify(BM_SERIAL_DFU_CHUNK),
+            BM_SERIAL_SCHED_BULK);
+  EXPECT_EQ(bm_serial_sched_classify(BM_SERIAL_NETWORK_INFO),
+            BM_SERIAL_SCHED_BULK);
+}
+
+TEST_F(SchedTest, Errors) {
+  EXPECT_EQ(bm_serial_sched_init(&sched, &ctx, NULL, cfg, now_fn),
+            BM_SERIAL_NULL_BUFF);
+  cfg[BM_SERIAL_SCHED_LOG].num_cells = 6;
+  EXPECT_EQ(bm_serial_sched_init(&sched, &ctx, &pool, cfg, now_fn),
+            BM_SERIAL_MISC_ERR);
+}
+
+TEST_F(SchedTest, Priority) {
+  // Control traffic jumps the bulk transfer
+  for (int chunk = 0; chunk < 4; chunk++) {
+    EXPECT_EQ(dfu_chunk(1024), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(pub(16), BM_SERIAL_OK);
+  bm_serial_time_t time = {};
+  EXPECT_EQ(bm_serial_ctx_set_rtc(&ctx, &time), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_ctx_send_self_test(&ctx, 0, 1), BM_SERIAL_OK);
+  EXPECT_TRUE(sent_types.empty());
+
+  EXPECT_EQ(bm_serial_sched_flush(&sched, 3), BM_SERIAL_OK);
+  ASSERT_EQ(sent_types.size(), 3u);
+  EXPECT_EQ(sent_types[0], BM_SERIAL_RTC_SET);
+  EXPECT_EQ(sent_types[1], BM_SERIAL_SELF_TEST);
+  EXPECT_EQ(sent_types[2], BM_SERIAL_PUB);
+
+  // Arrives mid transfer, only waits for the packet on the wire
+  EXPECT_EQ(bm_serial_sched_flush(&sched, 1), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_ctx_set_rtc(&ctx, &time), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_sched_flush(&sched, 0), BM_SERIAL_OK);
+  ASSERT_EQ(sent_types.size(), 8u);
+  EXPECT_EQ(sent_types[3], BM_SERIAL_DFU_CHUNK);
+  EXPECT_EQ(sent_types[4], BM_SERIAL_RTC_SET);
+  EXPECT_EQ(sent_types[7], BM_SERIAL_DFU_CHUNK);
+
+  EXPECT_EQ(sched.queues[BM_SERIAL_SCHED_BULK].stats.sent, 4u);
+  EXPECT_EQ(sched.queues[BM_SERIAL_SCHED_CONTROL].stats.sent, 3u);
+  EXPECT_EQ(ctx.stats.tx_packets, 8u);
+  EXPECT_EQ(classes[0].stats.in_use, 0);
+  EXPECT_EQ(classes[1].stats.in_use, 0);
+  EXPECT_EQ(bm_serial_sched_next(&sched), nullptr);
+}
+
+TEST_F(SchedTest, WeightedFair) {
+  // Keep both classes backlogged, bytes sent should follow the 4:1 weights
+  size_t pub_bytes = 0;
+  size_t bulk_bytes = 0;
+  for (int iteration = 0; iteration < 400; iteration++) {
+    while (bm_serial_ring_count(&sched.queues[BM_SERIAL_SCHED_PUB].ring) < 4) {
+      ASSERT_EQ(pub(100), BM_SERIAL_OK);
+    }
+    while (bm_serial_ring_count(&sched.queues[BM_SERIAL_SCHED_BULK].ring) < 2) {
+      ASSERT_EQ(dfu_chunk(512), BM_SERIAL_OK);
+    }
+
+    bm_serial_pkt_t *pkt = bm_serial_sched_next(&sched);
+    ASSERT_NE(pkt, nullptr);
+    if (pkt->type == BM_SERIAL_PUB) {
+      pub_bytes += pkt->len;
+    } else {
+      EXPECT_EQ(pkt->type, BM_SERIAL_DFU_CHUNK);
+      bulk_bytes += pkt->len;
+    }
+    bm_serial_pkt_release(pkt);
+  }
+
+  // Bulk isn't starved
+  ASSERT_GT(bulk_bytes, 0u);
+  double ratio = (double)pub_bytes / bulk_bytes;
+  EXPECT_GT(ratio, 3.0);
+  EXPECT_LT(ratio, 5.0);
+
+  // Strict priority only
+  for (auto &queue_cfg : cfg) {
+    queue_cfg.weight = 0;
+  }
+  ASSERT_EQ(bm_serial_sched_init(&sched, &ctx, &pool, cfg, now_fn),
+            BM_SERIAL_OK);
+  EXPECT_EQ(dfu_chunk(16), BM_SERIAL_OK);
+  EXPECT_EQ(pub(16), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_sched_flush(&sched, 0), BM_SERIAL_OK);
+  ASSERT_EQ(sent_types.size(), 2u);
+  EXPECT_EQ(sent_types[0], BM_SERIAL_PUB);
+  EXPECT_EQ(sent_types[1], BM_SERIAL_DFU_CHUNK);
+}
+
+TEST_F(SchedTest, Stats) {
+  EXPECT_EQ(pub(16), BM_SERIAL_OK);
+  now = 5;
+  EXPECT_EQ(pub(16), BM_SERIAL_OK);
+  now = 20;
+  EXPECT_EQ(bm_serial_sched_flush(&sched, 0), BM_SERIAL_OK);
+
+  bm_serial_sched_stats_t *stats = &sched.queues[BM_SERIAL_SCHED_PUB].stats;
+  EXPECT_EQ(stats->enqueued, 2u);
+  EXPECT_EQ(stats->sent, 2u);
+  EXPECT_EQ(stats->latency_max, 20u);
+  EXPECT_EQ(stats->latency_total, 35u);
+  EXPECT_EQ(stats->max_depth, 2);
+  EXPECT_EQ(stats->bytes, ctx.stats.tx_bytes);
+
+  // Full queue
+  for (int count = 0; count < 8; count++) {
+    EXPECT_EQ(pub(16), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(pub(16), BM_SERIAL_OUT_OF_MEMORY);
+  EXPECT_EQ(stats->dropped, 1u);
+  EXPECT_EQ(stats->max_depth, 8);
+  EXPECT_EQ(bm_serial_sched_flush(&sched, 0), BM_SERIAL_OK);
+  EXPECT_EQ(classes[0].stats.in_use, 0);
+}
@@ -0,0 +1,288 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_topo.h"
+
+#include <atomic>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// Host keeping the topology, node whose network infos go straight to it
+static bm_serial_ctx_t topo_host;
+static bm_serial_ctx_t topo_node;
+static bm_serial_topo_t topo;
+static std::vector<uint32_t> topo_updates;
+static size_t topo_infos;
+
+static bool topo_node_tx_fn(const uint8_t *buff, size_t len) {
+  std::vector<uint8_t> packet(buff, buff + len);
+  EXPECT_EQ(bm_serial_ctx_process_packet(&topo_host,
+                                         (bm_serial_packet_t *)packet.data(),
+                                         len),
+            BM_SERIAL_OK);
+  return true;
+}
+
+static bool topo_network_info_fn(bm_common_network_info_t *network_info) {
+  (void)network_info;
+  topo_infos++;
+  return true;
+}
+
+static void topo_updated_fn(void *arg,
+                            const bm_serial_topo_snapshot_t *snapshot) {
+  EXPECT_EQ(arg, &topo);
+  topo_updates.push_back(snapshot->seq);
+}
+
+static void topo_send(std::vector<uint64_t> nodes,
+                      std::vector<uint8_t> map = {0xa0},
+                      uint32_t network_crc32 = 0) {
+  bm_common_config_crc_t crc = {BM_COMMON_CFG_PARTITION_SYSTEM, 1};
+  bm_common_fw_version_t fw_info = {1, 2, 3, 4};
+  ASSERT_EQ(bm_serial_ctx_send_network_info(&topo_node, network_crc32, &crc,
+                                            &fw_info, nodes.size(),
+                                            nodes.data(), map.size(),
+                                            map.data()),
+            BM_SERIAL_OK);
+}
+
+// Network info payload, num_nodes and map_size as given
+static std::vector<uint8_t> topo_payload(uint16_t num_nodes,
+                                         uint16_t map_size, size_t len) {
+  std::vector<uint8_t> payload(len);
+  bm_common_network_info_t *info =
+      (bm_common_network_info_t *)payload.data();
+  info->num_nodes = num_nodes;
+  info->map_size_bytes = map_size;
+  for (uint16_t idx = 0; idx < num_nodes; idx++) {
+    uint64_t node_id = idx + 1;
+    size_t offset = sizeof(*info) + idx * sizeof(node_id);
+    if (offset + sizeof(node_id) <= len) {
+      memcpy(&payload[offset], &node_id, sizeof(node_id));
+    }
+  }
+  return payload;
+}
+
+class TopoTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    bm_serial_callbacks_t callbacks = {};
+    callbacks.network_info_fn = topo_network_info_fn;
+    bm_serial_ctx_init(&topo_host, &callbacks);
+    bm_serial_ctx_set_cobs_tx(&topo_host, false);
+
+    callbacks = {};
+    callbacks.tx_fn = topo_node_tx_fn;
+    bm_serial_ctx_init(&topo_node, &callbacks);
+    bm_serial_ctx_set_cobs_tx(&topo_node, false);
+
+    bm_serial_topo_cfg_t cfg = {};
+    cfg.updated_fn = topo_updated_fn;
+    cfg.arg = &topo;
+    ASSERT_EQ(bm_serial_topo_init(&topo, &topo_host, &cfg), BM_SERIAL_OK);
+
+    topo_updates.clear();
+    topo_infos = 0;
+  }
+};
+
+TEST_F(TopoTest, Snapshot) {
+  EXPECT_EQ(bm_serial_topo_acquire(&topo), nullptr);
+
+  topo_send({30, 10, 20, 10}, {0xa1, 0x01, 0x02}, 1234);
+  EXPECT_EQ(topo_infos, 1u);
+  const bm_serial_topo_snapshot_t *snapshot = bm_serial_topo_acquire(&topo);
+  ASSERT_NE(snapshot, nullptr);
+
+  EXPECT_EQ(snapshot->seq, 1u);
+  EXPECT_EQ(snapshot->network_crc32, 1234u);
+  EXPECT_EQ(snapshot->config_crc.partition, BM_COMMON_CFG_PARTITION_SYSTEM);
+  EXPECT_EQ(snapshot->config_crc.crc32, 1u);
+  EXPECT_EQ(snapshot->fw_info.revision, 3);
+
+  // Sorted, without the duplicate
+  ASSERT_EQ(snapshot->num_nodes, 3u);
+  EXPECT_EQ(snapshot->nodes[0], 10u);
+  EXPECT_EQ(snapshot->nodes[1], 20u);
+  EXPECT_EQ(snapshot->nodes[2], 30u);
+  EXPECT_TRUE(bm_serial_topo_has(snapshot, 10));
+  EXPECT_TRUE(bm_serial_topo_has(snapshot, 30));
+  EXPECT_FALSE(bm_serial_topo_has(snapshot, 15));
+  EXPECT_FALSE(bm_serial_topo_has(snapshot, 31));
+  EXPECT_FALSE(bm_serial_topo_has(snapshot, 0));
+
+  // Everything joined the first time
+  EXPECT_EQ(snapshot->num_joined, 3u);
+  EXPECT_EQ(snapshot->num_left, 0u);
+
+  EXPECT_EQ(snapshot->map_offset,
+            sizeof(bm_common_network_info_t) + 4 * sizeof(uint64_t));
+  EXPECT_EQ(snapshot->map_size, 3u);
+  ASSERT_EQ(snapshot->map_len, 3u);
+  EXPECT_EQ(snapshot->map[0], 0xa1);
+  EXPECT_EQ(snapshot->map[2], 0x02);
+  bm_serial_topo_release(&topo, snapshot);
+
+  ASSERT_EQ(topo_updates.size(), 1u);
+  EXPECT_EQ(topo_updates[0], 1u);
+}
+
+TEST_F(TopoTest, Diff) {
+  topo_send({10, 20, 30});
+  topo_send({40, 10, 30, 50});
+
+  const bm_serial_topo_snapshot_t *snapshot = bm_serial_topo_acquire(&topo);
+  ASSERT_NE(snapshot, nullptr);
+  EXPECT_EQ(snapshot->seq, 2u);
+  ASSERT_EQ(snapshot->num_joined, 2u);
+  EXPECT_EQ(snapshot->joined[0], 40u);
+  EXPECT_EQ(snapshot->joined[1], 50u);
+  ASSERT_EQ(snapshot->num_left, 1u);
+  EXPECT_EQ(snapshot->left[0], 20u);
+  bm_serial_topo_release(&topo, snapshot);
+
+  // Nothing new, the snapshot stays
+  topo_send({50, 40, 30, 10});
+  EXPECT_EQ(topo.stats.unchanged, 1u);
+  EXPECT_EQ(topo_infos, 3u);
+
+  // Only the map changed
+  topo_send({10, 30, 40, 50}, {0xa0, 0x00});
+  snapshot = bm_serial_topo_acquire(&topo);
+  EXPECT_EQ(snapshot->seq, 3u);
+  EXPECT_EQ(snapshot->num_joined, 0u);
+  EXPECT_EQ(snapshot->num_left, 0u);
+  EXPECT_EQ(snapshot->map_len, 2u);
+  bm_serial_topo_release(&topo, snapshot);
+
+  // Everyone left
+  topo_send({60});
+  snapshot = bm_serial_topo_acquire(&topo);
+  EXPECT_EQ(snapshot->num_joined, 1u);
+  EXPECT_EQ(snapshot->num_left, 4u);
+  bm_serial_topo_release(&topo, snapshot);
+
+  EXPECT_EQ(topo.stats.updates, 4u);
+  EXPECT_EQ(topo_updates, (std::vector<uint32_t>{1, 2, 3, 4}));
+}
+
+TEST_F(TopoTest, Invalid) {
+  topo_send({1});
+
+  // Node list or map cut short
+  std::vector<uint8_t> payload =
+      topo_payload(2, 1, sizeof(bm_common_network_info_t) + 16);
+  EXPECT_EQ(bm_serial_topo_rx(&topo, payload.data(), payload.size()),
+            BM_SERIAL_INVALID_MSG_LEN);
+  payload = topo_payload(3, 0, sizeof(bm_common_network_info_t) + 16);
+  EXPECT_EQ(bm_serial_topo_rx(&topo, payload.data(), payload.size()),
+            BM_SERIAL_INVALID_MSG_LEN);
+  EXPECT_EQ(topo.stats.invalid, 2u);
+
+  // Too many nodes
+  uint16_t num_nodes = BM_SERIAL_TOPO_MAX_NODES + 1;
+  payload = topo_payload(num_nodes, 0,
+                         sizeof(bm_common_network_info_t) +
+                             num_nodes * sizeof(uint64_t));
+  EXPECT_EQ(bm_serial_topo_rx(&topo, payload.data(), payload.size()),
+            BM_SERIAL_OVERFLOW);
+  EXPECT_EQ(topo.stats.too_big, 1u);
+
+  const bm_serial_topo_snapshot_t *snapshot = bm_serial_topo_acquire(&topo);
+  EXPECT_EQ(snapshot->seq, 1u);
+  bm_serial_topo_release(&topo, snapshot);
+
+  // Map too big to keep, the nodes are still there
+  uint16_t map_size = BM_SERIAL_TOPO_MAP_LEN + 1;
+  payload = topo_payload(2, map_size,
+                         sizeof(bm_common_network_info_t) +
+                             2 * sizeof(uint64_t) + map_size);
+  EXPECT_EQ(bm_serial_topo_rx(&topo, payload.data(), payload.size()),
+            BM_SERIAL_OK);
+  snapshot = bm_serial_topo_acquire(&topo);
+  EXPECT_EQ(snapshot->num_nodes, 2u);
+  EXPECT_EQ(snapshot->map_size, map_size);
+  EXPECT_EQ(snapshot->map_len, 0u);
+  bm_serial_topo_release(&topo, snapshot);
+}
+
+TEST_F(TopoTest, Busy) {
+  static_assert(BM_SERIAL_TOPO_SNAPSHOTS == 3, "test assumes 3 snapshots");
+
+  const bm_serial_topo_snapshot_t *held[3];
+  for (int idx = 0; idx < 3; idx++) {
+    topo_send({(uint64_t)idx + 1});
+    held[idx] = bm_serial_topo_acquire(&topo);
+  }
+
+  // Readers hold both snapshots that aren't current
+  topo_send({4});
+  EXPECT_EQ(topo.stats.busy, 1u);
+  EXPECT_EQ(topo_infos, 4u);
+
+  // Held snapshots don't change
+  for (int idx = 0; idx < 3; idx++) {
+    EXPECT_EQ(held[idx]->seq, (uint32_t)idx + 1);
+    EXPECT_EQ(held[idx]->nodes[0], (uint64_t)idx + 1);
+  }
+
+  bm_serial_topo_release(&topo, held[1]);
+  topo_send({4});
+  const bm_serial_topo_snapshot_t *snapshot = bm_serial_topo_acquire(&topo);
+  EXPECT_EQ(snapshot, held[1]);
+  EXPECT_EQ(snapshot->seq, 4u);
+  EXPECT_EQ(snapshot->left[0], 3u);
+  bm_serial_topo_release(&topo, snapshot);
+  bm_serial_topo_release(&topo, held[0]);
+  bm_serial_topo_release(&topo, held[2]);
+}
+
+// Readers on other threads always see a whole snapshot
+TEST_F(TopoTest, Threads) {
+  const uint32_t generations = 2000;
+  std::atomic<bool> done(false);
+  std::atomic<uint32_t> torn(0);
+
+  auto reader = [&]() {
+    uint32_t last = 0;
+    while (!done.load()) {
+      const bm_serial_topo_snapshot_t *snapshot = bm_serial_topo_acquire(&topo);
+      if (!snapshot) {
+        continue;
+      }
+      // Generation g has nodes g * 1000 + 0..(g % 8)
+      uint32_t gen = snapshot->network_crc32;
+      bool ok = snapshot->num_nodes == gen % 8 + 1 && snapshot->seq >= last;
+      for (uint16_t idx = 0; idx < snapshot->num_nodes; idx++) {
+        ok = ok && snapshot->nodes[idx] == (uint64_t)gen * 1000 + idx;
+      }
+      ok = ok && bm_serial_topo_has(snapshot, (uint64_t)gen * 1000);
+      last = snapshot->seq;
+      bm_serial_topo_release(&topo, snapshot);
+      if (!ok) {
+        torn++;
+      }
+    }
+  };
+
+  std::thread readers[] = {std::thread(reader), std::thread(reader)};
+  for (uint32_t gen = 1; gen <= generations; gen++) {
+    std::vector<uint64_t> nodes;
+    for (uint32_t idx = 0; idx <= gen % 8; idx++) {
+      nodes.push_back((uint64_t)gen * 1000 + idx);
+    }
+    topo_send(nodes, {0xa0}, gen);
+  }
+  done = true;
+  for (auto &thread : readers) {
+    thread.join();
+  }
+
+  EXPECT_EQ(torn.load(), 0u);
+  EXPECT_EQ(topo.stats.updates + topo.stats.busy, generations);
+  const bm_serial_topo_snapshot_t *snapshot = bm_serial_topo_acquire(&topo);
+  EXPECT_EQ(snapshot->seq, topo.stats.updates);
+  bm_serial_topo_release(&topo, snapshot);
+}
@@ -0,0 +1,189 @@
+#include "gtest/gtest.h"
+#include "bm_serial.h"
+#include "bm_serial_txq.h"
+
+#include <atomic>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+static bm_serial_txq_slot_t slots[8];
+static bm_serial_txq_t txq;
+
+TEST(TxqTest, Queue) {
+  EXPECT_EQ(bm_serial_txq_init(&txq, NULL, 8), BM_SERIAL_NULL_BUFF);
+  EXPECT_EQ(bm_serial_txq_init(&txq, slots, 6), BM_SERIAL_MISC_ERR);
+  ASSERT_EQ(bm_serial_txq_init(&txq, slots, 8), BM_SERIAL_OK);
+
+  // Nothing published yet
+  EXPECT_EQ(bm_serial_txq_peek(&txq), nullptr);
+
+  bm_serial_txq_slot_t *claimed[8];
+  for (auto &slot : claimed) {
+    slot = bm_serial_txq_claim(&txq);
+    ASSERT_NE(slot, nullptr);
+  }
+  EXPECT_EQ(bm_serial_txq_claim(&txq), nullptr);
+  EXPECT_EQ(txq.full, 1u);
+
+  // Consumer waits for slots in claim order
+  bm_serial_txq_publish(&txq, claimed[1], 0, 1);
+  EXPECT_EQ(bm_serial_txq_peek(&txq), nullptr);
+  bm_serial_txq_publish(&txq, claimed[0], 3, 2);
+  EXPECT_EQ(bm_serial_txq_peek(&txq), claimed[0]);
+  EXPECT_EQ(claimed[0]->offset, 3);
+  EXPECT_EQ(claimed[0]->len, 2);
+  bm_serial_txq_release(&txq, claimed[0]);
+  EXPECT_EQ(bm_serial_txq_peek(&txq), claimed[1]);
+  bm_serial_txq_release(&txq, claimed[1]);
+
+  // Released slots can be claimed again (wrap around)
+  for (int lap = 0; lap < 2; lap++) {
+    bm_serial_txq_slot_t *slot = bm_serial_txq_claim(&txq);
+    ASSERT_NE(slot, nullptr);
+    bm_serial_txq_publish(&txq, slot, 0, 0);
+  }
+  for (size_t idx = 2; idx < 8; idx++) {
+    bm_serial_txq_publish(&txq, claimed[idx], 0, 0);
+  }
+  size_t count = 0;
+  bm_serial_txq_slot_t *slot;
+  while ((slot = bm_serial_txq_peek(&txq))) {
+    bm_serial_txq_release(&txq, slot);
+    count++;
+  }
+  EXPECT_EQ(count, 8u);
+}
+
+// Receiving end of the link, counts pubs per producer thread
+static constexpr int num_producers = 4;
+static constexpr uint32_t pubs_per_producer = 2000;
+static bm_serial_ctx_t rx_ctx;
+static uint32_t next_seq[num_producers];
+static uint32_t out_of_order;
+
+static bool txq_pub_fn(const char *topic, uint16_t topic_len, uint64_t node_id,
+                       const uint8_t *payload, size_t len, uint8_t type,
+                       uint8_t version) {
+  (void)topic;
+  (void)topic_len;
+  (void)type;
+  (void)version;
+
+  uint32_t seq;
+  EXPECT_EQ(len, sizeof(seq) + 100);
+  memcpy(&seq, payload, sizeof(seq));
+  if (seq != next_seq[node_id]) {
+    out_of_order++;
+  }
+  next_seq[node_id] = seq + 1;
+  return true;
+}
+
+static bool txq_tx_fn(const uint8_t *buff, size_t len) {
+  uint8_t packet[SERIAL_BUFF_LEN];
+  memcpy(packet, buff, len);
+  return bm_serial_ctx_process_packet(&rx_ctx, (bm_serial_packet_t *)packet, len) == BM_SERIAL_OK;
+}
+
+TEST(TxqTest, Threads) {
+  static bm_serial_txq_slot_t thread_slots[16];
+  static bm_serial_txq_t thread_txq;
+  ASSERT_EQ(bm_serial_txq_init(&thread_txq, thread_slots, 16), BM_SERIAL_OK);
+
+  bm_serial_callbacks_t rx_callbacks = {};
+  rx_callbacks.pub_fn = txq_pub_fn;
+  bm_serial_ctx_init(&rx_ctx, &rx_callbacks);
+  memset(next_seq, 0, sizeof(next_seq));
+  out_of_order = 0;
+
+  static bm_serial_ctx_t tx_ctx;
+  bm_serial_callbacks_t tx_callbacks = {};
+  tx_callbacks.tx_fn = txq_tx_fn;
+  bm_serial_ctx_init(&tx_ctx, &tx_callbacks);
+  bm_serial_ctx_set_txq(&tx_ctx, &thread_txq);
+
+  // Single writer thread owns tx_fn
+  std::atomic<bool> done(false);
+  std::thread writer([&]() {
+    while (!done.load()) {
+      EXPECT_EQ(bm_serial_ctx_txq_flush(&tx_ctx), BM_SERIAL_OK);
+      std::this_thread::yield();
+    }
+    EXPECT_EQ(bm_serial_ctx_txq_flush(&tx_ctx), BM_SERIAL_OK);
+  });
+
+  std::vector<std::thread> producers;
+  for (int producer = 0; producer < num_producers; producer++) {
+    producers.emplace_back([producer]() {
+      uint8_t data[sizeof(uint32_t) + 100] = {};
+      for (uint32_t seq = 0; seq < pubs_per_producer;) {
+        memcpy(data, &seq, sizeof(seq));
+        bm_serial_error_e rval = bm_serial_ctx_pub(&tx_ctx, producer, "txq", 3, data, sizeof(data), 0, 0);
+        if (rval == BM_SERIAL_OUT_OF_MEMORY) {
+          // Queue full, let the writer catch up
+          std::this_thread::yield();
+          continue;
+        }
+        ASSERT_EQ(rval, BM_SERIAL_OK);
+        seq++;
+      }
+    });
+  }
+
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  done = true;
+  writer.join();
+
+  for (int producer = 0; producer < num_producers; producer++) {
+    EXPECT_EQ(next_seq[producer], pubs_per_producer);
+  }
+  EXPECT_EQ(out_of_order, 0u);
+  EXPECT_EQ(tx_ctx.stats.tx_packets, num_producers * pubs_per_producer);
+  EXPECT_EQ(rx_ctx.stats.rx_packets, num_producers * pubs_per_producer);
+  EXPECT_EQ(rx_ctx.stats.rx_errors, 0u);
+}
+
+TEST(TxqTest, Abandoned) {
+  static bm_serial_txq_slot_t abandon_slots[4];
+  static bm_serial_txq_t abandon_txq;
+  ASSERT_EQ(bm_serial_txq_init(&abandon_txq, abandon_slots, 4), BM_SERIAL_OK);
+
+  bm_serial_callbacks_t rx_callbacks = {};
+  rx_callbacks.pub_fn = txq_pub_fn;
+  bm_serial_ctx_init(&rx_ctx, &rx_callbacks);
+  memset(next_seq, 0, sizeof(next_seq));
+
+  static bm_serial_ctx_t tx_ctx;
+  bm_serial_callbacks_t tx_callbacks = {};
+  tx_callbacks.tx_fn = txq_tx_fn;
+  bm_serial_ctx_init(&tx_ctx, &tx_callbacks);
+  bm_serial_ctx_set_txq(&tx_ctx, &abandon_txq);
+  bm_serial_ctx_set_cobs_tx(&tx_ctx, false);
+
+  // Failed reservations and dropped reservations don't block the queue
+  uint8_t *data;
+  EXPECT_EQ(bm_serial_ctx_dfu_chunk_reserve(&tx_ctx, 0, 16, &data), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_ctx_pub_reserve(&tx_ctx, 0, "txq", 3, SERIAL_BUFF_LEN - 16, 0, 0, &data), BM_SERIAL_OUT_OF_MEMORY);
+  EXPECT_EQ(bm_serial_ctx_commit(&tx_ctx), BM_SERIAL_MISC_ERR);
+  EXPECT_EQ(bm_serial_ctx_dfu_chunk_reserve(&tx_ctx, 0, 16, &data), BM_SERIAL_OK);
+  bm_serial_ctx_reserve_abort(&tx_ctx);
+  EXPECT_EQ(bm_serial_ctx_commit(&tx_ctx), BM_SERIAL_MISC_ERR);
+
+  uint32_t seq = 0;
+  uint8_t payload[sizeof(seq) + 100] = {};
+  EXPECT_EQ(bm_serial_ctx_pub(&tx_ctx, 0, "txq", 3, payload, sizeof(payload), 0, 0), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_ctx_txq_flush(&tx_ctx), BM_SERIAL_OK);
+  EXPECT_EQ(next_seq[0], 1u);
+  EXPECT_EQ(tx_ctx.stats.tx_packets, 1u);
+
+  // Queue isn't stuck after wrapping around
+  for (seq = 1; seq < 10; seq++) {
+    memcpy(payload, &seq, sizeof(seq));
+    EXPECT_EQ(bm_serial_ctx_pub(&tx_ctx, 0, "txq", 3, payload, sizeof(payload), 0, 0), BM_SERIAL_OK);
+    EXPECT_EQ(bm_serial_ctx_txq_flush(&tx_ctx), BM_SERIAL_OK);
+  }
+  EXPECT_EQ(next_seq[0], 10u);
+}
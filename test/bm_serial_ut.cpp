@@ -1,5 +1,6 @@
 #include "gtest/gtest.h"
 #include "bm_serial.h"
+#include "bm_serial_crc.h"
 
 #include <string.h>
 
@@ -104,6 +105,9 @@ TEST_F(NCPTest, SubUnsubTests) {
 
   fake_sub_called = false;
   EXPECT_EQ(bm_serial_sub("fake_sub_topic", sizeof("fake_sub_topic")), BM_SERIAL_OK);
+  // Nothing after the topic
+  EXPECT_EQ(serial_tx_buff_len, sizeof(bm_serial_packet_t) + sizeof(bm_serial_sub_unsub_header_t) +
+                                    sizeof("fake_sub_topic"));
   EXPECT_EQ(bm_serial_process_packet((bm_serial_packet_t *)serial_tx_buff, serial_tx_buff_len), BM_SERIAL_OK);
   EXPECT_TRUE(fake_sub_called);
 
@@ -196,6 +200,15 @@ TEST_F(NCPTest, DFUTest) {
   EXPECT_EQ(bm_serial_process_packet((bm_serial_packet_t *)serial_tx_buff, serial_tx_buff_len), BM_SERIAL_OK);
   EXPECT_TRUE(fake_dfu_chunk_called);
 
+  // Length past the end of the message
+  fake_dfu_chunk_called = false;
+  bm_serial_packet_t *packet = (bm_serial_packet_t *)serial_tx_buff;
+  ((bm_serial_dfu_chunk_t *)packet->payload)->length = sizeof(buf) + 1;
+  packet->crc16 = 0;
+  packet->crc16 = bm_serial_crc16_ccitt(0, serial_tx_buff, serial_tx_buff_len);
+  EXPECT_EQ(bm_serial_process_packet(packet, serial_tx_buff_len), BM_SERIAL_INVALID_MSG_LEN);
+  EXPECT_FALSE(fake_dfu_chunk_called);
+
   fake_dfu_chunk_called = false;
   EXPECT_EQ(bm_serial_dfu_send_chunk(0, 0, NULL), BM_SERIAL_OK);
   EXPECT_EQ(bm_serial_process_packet((bm_serial_packet_t *)serial_tx_buff, serial_tx_buff_len), BM_SERIAL_OK);
@@ -410,3 +423,269 @@ TEST_F(NCPTest, RebootInfoTest) {
   EXPECT_EQ(bm_serial_process_packet((bm_serial_packet_t *)serial_tx_buff, serial_tx_buff_len), BM_SERIAL_OK);
   EXPECT_TRUE(reboot_info_fn_called);
 }
+
+// Fake scatter-gather tx, gathers segments into serial_tx_buff
+static size_t tx_iov_cnt;
+static const uint8_t *tx_iov_last;
+static bool fake_tx_iov_fn(const bm_serial_iov_t *iov, size_t iov_cnt) {
+  serial_tx_buff_len = 0;
+  for (size_t idx = 0; idx < iov_cnt; idx++) {
+    if (serial_tx_buff_len + iov[idx].len > sizeof(serial_tx_buff)) {
+      return false;
+    }
+    memcpy(&serial_tx_buff[serial_tx_buff_len], iov[idx].buff, iov[idx].len);
+    serial_tx_buff_len += iov[idx].len;
+  }
+  tx_iov_cnt = iov_cnt;
+  tx_iov_last = iov[iov_cnt - 1].buff;
+  return true;
+}
+
+static bool fake_pub_called;
+static bool fake_pub_fn(const char *topic, uint16_t topic_len, uint64_t node_id,
+                        const uint8_t *payload, size_t len, uint8_t type,
+                        uint8_t version) {
+  EXPECT_EQ(topic_len, sizeof("iov_topic"));
+  EXPECT_STREQ(topic, "iov_topic");
+  EXPECT_EQ(node_id, 0x1234u);
+  EXPECT_EQ(type, 1);
+  EXPECT_EQ(version, 2);
+  EXPECT_EQ(len, 300u);
+  for (size_t idx = 0; idx < len; idx++) {
+    EXPECT_EQ(payload[idx], (uint8_t)idx);
+  }
+  fake_pub_called = true;
+  return true;
+}
+
+TEST_F(NCPTest, TxIovTest) {
+  _callbacks.tx_iov_fn = fake_tx_iov_fn;
+  _callbacks.pub_fn = fake_pub_fn;
+  _callbacks.sub_fn = fake_sub_fn;
+  bm_serial_set_callbacks(&_callbacks);
+
+  uint8_t payload[300];
+  for (size_t idx = 0; idx < sizeof(payload); idx++) {
+    payload[idx] = (uint8_t)idx;
+  }
+
+  // Payload is sent from the caller's buffer
+  fake_pub_called = false;
+  EXPECT_EQ(bm_serial_pub(0x1234, "iov_topic", sizeof("iov_topic"), payload, sizeof(payload), 1, 2), BM_SERIAL_OK);
+  EXPECT_EQ(tx_iov_cnt, 2u);
+  EXPECT_EQ(tx_iov_last, payload);
+  EXPECT_EQ(bm_serial_process_packet((bm_serial_packet_t *)serial_tx_buff, serial_tx_buff_len), BM_SERIAL_OK);
+  EXPECT_TRUE(fake_pub_called);
+
+  // Messages without a payload go out as a single segment
+  fake_sub_called = false;
+  EXPECT_EQ(bm_serial_sub("fake_sub_topic", sizeof("fake_sub_topic")), BM_SERIAL_OK);
+  EXPECT_EQ(tx_iov_cnt, 1u);
+  EXPECT_EQ(bm_serial_process_packet((bm_serial_packet_t *)serial_tx_buff, serial_tx_buff_len), BM_SERIAL_OK);
+  EXPECT_TRUE(fake_sub_called);
+
+  // Payload is copied when tx_iov_fn isn't available
+  _callbacks.tx_iov_fn = NULL;
+  _callbacks.tx_fn = fake_tx_fn;
+  bm_serial_set_callbacks(&_callbacks);
+  fake_pub_called = false;
+  EXPECT_EQ(bm_serial_pub(0x1234, "iov_topic", sizeof("iov_topic"), payload, sizeof(payload), 1, 2), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_process_packet((bm_serial_packet_t *)serial_tx_buff, serial_tx_buff_len), BM_SERIAL_OK);
+  EXPECT_TRUE(fake_pub_called);
+
+  // Added last so positional initializers and the layout don't change
+  EXPECT_EQ(offsetof(bm_serial_callbacks_t, pub_fn), sizeof(_callbacks.tx_fn));
+  EXPECT_EQ(offsetof(bm_serial_callbacks_t, tx_iov_fn) + sizeof(_callbacks.tx_iov_fn), sizeof(bm_serial_callbacks_t));
+}
+
+TEST_F(NCPTest, ReserveCommitTest) {
+  _callbacks.tx_fn = fake_tx_fn;
+  _callbacks.pub_fn = fake_pub_fn;
+  _callbacks.sub_fn = fake_sub_fn;
+  _callbacks.dfu_chunk_fn = dfu_chunk_fun;
+  _callbacks.cfg_value_fn = fake_cfg_value_fn;
+  bm_serial_set_callbacks(&_callbacks);
+
+  // Nothing reserved
+  EXPECT_EQ(bm_serial_commit(), BM_SERIAL_MISC_ERR);
+
+  uint8_t *data = NULL;
+  EXPECT_EQ(bm_serial_pub_reserve(0x1234, "iov_topic", sizeof("iov_topic"), 300, 1, 2, NULL), BM_SERIAL_NULL_BUFF);
+  EXPECT_EQ(bm_serial_pub_reserve(0x1234, "iov_topic", sizeof("iov_topic"), SERIAL_BUFF_LEN, 1, 2, &data), BM_SERIAL_OUT_OF_MEMORY);
+
+  // Fill data in place
+  fake_pub_called = false;
+  ASSERT_EQ(bm_serial_pub_reserve(0x1234, "iov_topic", sizeof("iov_topic"), 300, 1, 2, &data), BM_SERIAL_OK);
+  ASSERT_NE(data, nullptr);
+  for (size_t idx = 0; idx < 300; idx++) {
+    data[idx] = (uint8_t)idx;
+  }
+  EXPECT_EQ(bm_serial_commit(), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_process_packet((bm_serial_packet_t *)serial_tx_buff, serial_tx_buff_len), BM_SERIAL_OK);
+  EXPECT_TRUE(fake_pub_called);
+
+  // Only committed once
+  EXPECT_EQ(bm_serial_commit(), BM_SERIAL_MISC_ERR);
+
+  fake_dfu_chunk_called = false;
+  ASSERT_EQ(bm_serial_dfu_chunk_reserve(0x1000, 512, &data), BM_SERIAL_OK);
+  memset(data, 0xA5, 512);
+  EXPECT_EQ(bm_serial_commit(), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_process_packet((bm_serial_packet_t *)serial_tx_buff, serial_tx_buff_len), BM_SERIAL_OK);
+  EXPECT_TRUE(fake_dfu_chunk_called);
+
+  fake_cfg_value_fn_called = false;
+  ASSERT_EQ(bm_serial_cfg_value_reserve(0xdeadbadc0ffeedad, BM_COMMON_CFG_PARTITION_SYSTEM, 4, &data), BM_SERIAL_OK);
+  memcpy(data, "\x1a\x00\x01\x00", 4);
+  EXPECT_EQ(bm_serial_commit(), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_process_packet((bm_serial_packet_t *)serial_tx_buff, serial_tx_buff_len), BM_SERIAL_OK);
+  EXPECT_TRUE(fake_cfg_value_fn_called);
+
+  // Nothing else can be sent until the reservation is committed
+  fake_dfu_chunk_called = false;
+  ASSERT_EQ(bm_serial_dfu_chunk_reserve(0, 16, &data), BM_SERIAL_OK);
+  memset(data, 0xA5, 16);
+  EXPECT_EQ(bm_serial_sub("fake_sub_topic", sizeof("fake_sub_topic")), BM_SERIAL_BUSY);
+  EXPECT_EQ(bm_serial_commit(), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_process_packet((bm_serial_packet_t *)serial_tx_buff, serial_tx_buff_len), BM_SERIAL_OK);
+  EXPECT_TRUE(fake_dfu_chunk_called);
+
+  // Or aborted
+  ASSERT_EQ(bm_serial_dfu_chunk_reserve(0, 16, &data), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_sub("fake_sub_topic", sizeof("fake_sub_topic")), BM_SERIAL_BUSY);
+  bm_serial_reserve_abort();
+  EXPECT_EQ(bm_serial_commit(), BM_SERIAL_MISC_ERR);
+  fake_sub_called = false;
+  EXPECT_EQ(bm_serial_sub("fake_sub_topic", sizeof("fake_sub_topic")), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_process_packet((bm_serial_packet_t *)serial_tx_buff, serial_tx_buff_len), BM_SERIAL_OK);
+  EXPECT_TRUE(fake_sub_called);
+  bm_serial_reserve_abort();
+}
+
+// Two instances wired back to back, like two UARTs on one gateway
+static bm_serial_ctx_t ctx_a;
+static bm_serial_ctx_t ctx_b;
+
+static bool ctx_a_tx_fn(const uint8_t *buff, size_t len) {
+  uint8_t rx[SERIAL_BUFF_LEN];
+  memcpy(rx, buff, len);
+  return bm_serial_ctx_process_packet(&ctx_b, (bm_serial_packet_t *)rx, len) == BM_SERIAL_OK;
+}
+
+static uint32_t ctx_b_sub_count;
+static bool ctx_b_sub_fn(const char *topic, uint16_t topic_len) {
+  (void)topic;
+  (void)topic_len;
+  ctx_b_sub_count++;
+  return true;
+}
+
+TEST_F(NCPTest, ContextTest) {
+  bm_serial_callbacks_t callbacks_a = {};
+  callbacks_a.tx_fn = ctx_a_tx_fn;
+  bm_serial_ctx_init(&ctx_a, &callbacks_a);
+
+  bm_serial_callbacks_t callbacks_b = {};
+  callbacks_b.sub_fn = ctx_b_sub_fn;
+  bm_serial_ctx_init(&ctx_b, &callbacks_b);
+
+  // Default instance has no tx function, so nothing leaks into it
+  _callbacks.sub_fn = fake_sub_fn;
+  bm_serial_set_callbacks(&_callbacks);
+  fake_sub_called = false;
+
+  ctx_b_sub_count = 0;
+  EXPECT_EQ(bm_serial_ctx_sub(&ctx_a, "fake_sub_topic", sizeof("fake_sub_topic")), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_ctx_sub(&ctx_a, "fake_sub_topic", sizeof("fake_sub_topic")), BM_SERIAL_OK);
+  EXPECT_EQ(ctx_b_sub_count, 2u);
+  EXPECT_FALSE(fake_sub_called);
+  EXPECT_EQ(bm_serial_sub("fake_sub_topic", sizeof("fake_sub_topic")), BM_SERIAL_MISSING_CALLBACK);
+  EXPECT_EQ(bm_serial_ctx_sub(&ctx_b, "fake_sub_topic", sizeof("fake_sub_topic")), BM_SERIAL_MISSING_CALLBACK);
+
+  EXPECT_EQ(ctx_a.stats.tx_packets, 2u);
+  EXPECT_EQ(ctx_a.stats.tx_errors, 0u);
+  EXPECT_GT(ctx_a.stats.tx_bytes, 2 * sizeof("fake_sub_topic"));
+  EXPECT_EQ(ctx_b.stats.rx_packets, 2u);
+  EXPECT_EQ(ctx_b.stats.tx_packets, 0u);
+
+  // Bad crc counted on the receiving instance only
+  uint8_t packet[] = {BM_SERIAL_SUB, 0, 0x12, 0x34, 0, 0};
+  EXPECT_EQ(bm_serial_ctx_process_packet(&ctx_b, (bm_serial_packet_t *)packet, sizeof(packet)), BM_SERIAL_CRC_ERR);
+  EXPECT_EQ(ctx_b.stats.rx_errors, 1u);
+  EXPECT_EQ(ctx_a.stats.rx_errors, 0u);
+
+  // Reservations are per instance
+  uint8_t *data;
+  ASSERT_EQ(bm_serial_ctx_dfu_chunk_reserve(&ctx_a, 0, 16, &data), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_commit(), BM_SERIAL_MISC_ERR);
+  EXPECT_EQ(bm_serial_ctx_commit(&ctx_b), BM_SERIAL_MISC_ERR);
+}
+
+static uint32_t custom_msg_count;
+static size_t custom_msg_len;
+static bool custom_msg_fn(void *arg, uint8_t type, const uint8_t *payload, size_t len) {
+  EXPECT_EQ(arg, &custom_msg_count);
+  EXPECT_EQ(type, BM_SERIAL_APP_MSG_FIRST + 1);
+  EXPECT_EQ(payload[0], 'v');
+  custom_msg_count++;
+  custom_msg_len = len;
+  return true;
+}
+
+static bool custom_msg_validate_fn(const uint8_t *payload, size_t len) {
+  (void)len;
+  return payload[0] == 'v';
+}
+
+TEST_F(NCPTest, CustomMsgTest) {
+  static bm_serial_msg_table_t msgs;
+  bm_serial_callbacks_t callbacks_a = {};
+  callbacks_a.tx_fn = ctx_a_tx_fn;
+  bm_serial_ctx_init(&ctx_a, &callbacks_a);
+  bm_serial_callbacks_t callbacks_b = {};
+  callbacks_b.sub_fn = ctx_b_sub_fn;
+  bm_serial_ctx_init(&ctx_b, &callbacks_b);
+
+  const uint8_t type = BM_SERIAL_APP_MSG_FIRST + 1;
+  bm_serial_msg_handler_t handler = {custom_msg_fn, &custom_msg_count, custom_msg_validate_fn, 4};
+
+  // No table yet
+  EXPECT_EQ(bm_serial_ctx_register_msg(&ctx_b, type, &handler), BM_SERIAL_NULL_BUFF);
+  bm_serial_ctx_set_msg_table(&ctx_b, &msgs);
+
+  // Built-in types keep their callbacks
+  EXPECT_EQ(bm_serial_ctx_register_msg(&ctx_b, BM_SERIAL_SUB, &handler), BM_SERIAL_UNSUPPORTED_MSG);
+  EXPECT_EQ(bm_serial_ctx_register_msg(&ctx_b, BM_SERIAL_ACK, &handler), BM_SERIAL_UNSUPPORTED_MSG);
+  EXPECT_EQ(bm_serial_ctx_register_msg(&ctx_b, BM_SERIAL_BATCH, &handler), BM_SERIAL_UNSUPPORTED_MSG);
+  bm_serial_msg_handler_t no_fn = {};
+  EXPECT_EQ(bm_serial_ctx_register_msg(&ctx_b, type, &no_fn), BM_SERIAL_NULL_BUFF);
+  ASSERT_EQ(bm_serial_ctx_register_msg(&ctx_b, type, &handler), BM_SERIAL_OK);
+
+  custom_msg_count = 0;
+  const uint8_t payload[] = "valid message";
+  EXPECT_EQ(bm_serial_ctx_tx(&ctx_a, (bm_serial_message_t)type, payload, sizeof(payload)), BM_SERIAL_OK);
+  EXPECT_EQ(custom_msg_count, 1u);
+  EXPECT_EQ(custom_msg_len, sizeof(payload));
+
+  // Too short, rejected by the validator, not registered
+  EXPECT_EQ(bm_serial_ctx_tx(&ctx_a, (bm_serial_message_t)type, payload, 3), BM_SERIAL_TX_ERR);
+  const uint8_t invalid[] = "invalid";
+  EXPECT_EQ(bm_serial_ctx_tx(&ctx_a, (bm_serial_message_t)type, invalid, sizeof(invalid)), BM_SERIAL_TX_ERR);
+  EXPECT_EQ(bm_serial_ctx_tx(&ctx_a, (bm_serial_message_t)(type + 1), payload, sizeof(payload)), BM_SERIAL_TX_ERR);
+  EXPECT_EQ(custom_msg_count, 1u);
+  EXPECT_EQ(ctx_b.stats.rx_errors, 3u);
+
+  // Built-ins still work, and are length checked
+  ctx_b_sub_count = 0;
+  EXPECT_EQ(bm_serial_ctx_sub(&ctx_a, "topic", 5), BM_SERIAL_OK);
+  EXPECT_EQ(ctx_b_sub_count, 1u);
+  uint8_t rtc[sizeof(bm_serial_packet_t) + 2] = {BM_SERIAL_RTC_SET};
+  EXPECT_EQ(bm_serial_ctx_process_packet(&ctx_b, (bm_serial_packet_t *)rtc, sizeof(rtc)), BM_SERIAL_CRC_ERR);
+  ((bm_serial_packet_t *)rtc)->crc16 = bm_serial_crc16_ccitt(0, rtc, sizeof(rtc));
+  EXPECT_EQ(bm_serial_ctx_process_packet(&ctx_b, (bm_serial_packet_t *)rtc, sizeof(rtc)), BM_SERIAL_INVALID_MSG_LEN);
+
+  // Removed
+  ASSERT_EQ(bm_serial_ctx_register_msg(&ctx_b, type, NULL), BM_SERIAL_OK);
+  EXPECT_EQ(bm_serial_ctx_tx(&ctx_a, (bm_serial_message_t)type, payload, sizeof(payload)), BM_SERIAL_TX_ERR);
+  EXPECT_EQ(custom_msg_count, 1u);
+}